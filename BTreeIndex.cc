@@ -9,12 +9,54 @@
  
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
+#include "EntrySorter.h"
+#include "KeySearch.h"
+#include <algorithm>
+#include <climits>
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <thread>
 
 using namespace std;
 
+// the header page (page 0) of an index:
+//   [0..7]   magic "BRUINBT\0"
+//   [8..11]  the node format version (BTNODE_VERSION)
+//   [12..15] the PageId of the root node
+//   [16..19] the height of the tree
+//   [20..23] the first page of the free list (pages of removed nodes,
+//            each with the next one in [8..11]). 0 if there is none
+//   [24..27] the size of the cover of a RecordId. 0 if the index does
+//            not cover
+//   [28..31] 1 if the leaves are packed. 0 otherwise
+static const char INDEX_MAGIC[8] = { 'B', 'R', 'U', 'I', 'N', 'B', 'T', 0 };
+
+// an index written before the header page had the magic. its nodes have
+// no header: a leaf is (key, rid) pairs up to the first zero key with the
+// next sibling pointer in the last 4 bytes of the page, and a nonleaf node
+// is the leftmost child pointer, 4 unused bytes and (key, pid) pairs.
+// the root pid and the tree height are the first two ints of page 0.
+static const int LEGACY_VERSION = 0;
+
+// the RecordIds in front of and behind all others, for a cursor located at
+// the first or the last pair of a key
+static const RecordId FIRST_RID = { INT_MIN, INT_MIN };
+static const RecordId LAST_RID = { INT_MAX, INT_MAX };
+
+/*
+ * @param covers[IN] the covers of RecordIds, one after another
+ * @param i[IN] the position of a RecordId
+ * @param coverSize[IN] the size of a cover
+ * @return the cover of the i-th RecordId. NULL if the index does not cover
+ */
+static char* coverAt(vector<char>& covers, int i, int coverSize)
+{
+	return coverSize ? covers.data() + i*coverSize : NULL; 
+}
+
 /*
  * BTreeIndex constructor
  */
@@ -22,7 +64,25 @@ BTreeIndex::BTreeIndex()
 {
     rootPid = -1;
     treeHeight = 0; 
-    memset(buffer, 0, 1024); 
+    writable = false;
+    buffer = NULL;
+    shared = false;
+    freePid = 1;
+    freeList = 0;
+    coverSize = 0;
+    packed = false;
+    latches = new std::atomic<unsigned long long>[LATCH_STRIPES];
+    for (int i = 0; i < LATCH_STRIPES; ++i)
+        latches[i] = 0;
+}
+
+/*
+ * BTreeIndex destructor
+ */
+BTreeIndex::~BTreeIndex()
+{
+    delete [] buffer;
+    delete [] latches;
 }
 
 /*
@@ -30,48 +90,257 @@ BTreeIndex::BTreeIndex()
  * Under 'w' mode, the index file should be created if it does not exist.
  * @param indexname[IN] the name of the index file
  * @param mode[IN] 'r' for read, 'w' for write
- * @return error code. 0 if no error
+ * @param pageSize[IN] the node size of a new index. 0 for the default
+ * @param coverSize[IN] the cover size of a new index. 0 for no covers
+ * @param packed[IN] true for a new index with packed leaves
+ * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if the
+ *         index was built with another node format
  */
-RC BTreeIndex::open(const string& indexname, char mode)
+RC BTreeIndex::open(const string& indexname, char mode, int pageSize, int coverSize, bool packed)
 {
 	RC error; 
-	if (error = pf.open(indexname, mode))
+	if (coverSize < 0 || coverSize > MAX_COVER_SIZE)
+		return RC_INVALID_ATTRIBUTE; 
+	if (error = pf.open(indexname, mode, pageSize))
 		return error; 
+	writable = (mode == 'w' || mode == 'W');
+	nodeCache.clear(); 
+	freePid = pf.endPid() ? pf.endPid() : 1; 	// page 0 is the header
+	freeList = 0; 
+	this->coverSize = coverSize; 
+	this->packed = packed; 
+
+	delete [] buffer;
+	buffer = new char[pf.getPageSize()];
+	memset(buffer, 0, pf.getPageSize()); 
 
 	// If this is an empty pagefile, just initialize the first page with 0 
 	if (!pf.endPid()) {
 		//if (error = pf.write(0, buffer))
 		//	return error; 
+		// a leaf has to hold a few keys, and a list of more than one
+		// RecordId goes to posting pages
+		BTLeafNode emptyLeaf(pf.getPageSize(), coverSize, packed); 
+		if (emptyLeaf.getMaxKeyCount() < 3 || emptyLeaf.getMaxListLength() < 1) {
+			pf.close(); 
+			return RC_INVALID_ATTRIBUTE; 
+		}
 		return 0; 
 	}
 	
 	if (error = pf.read(0, buffer))
 		return error; 
 
+	// an index without the magic (or of another version) has nodes we
+	// cannot read. the caller has to rebuild it.
+	int version; 
+	memcpy(&version, buffer + 8, sizeof(int)); 
+	if (memcmp(buffer, INDEX_MAGIC, sizeof(INDEX_MAGIC)) || version != BTNODE_VERSION) {
+		pf.close(); 
+		return RC_INVALID_FILE_FORMAT; 
+	}
 	
 	// Check if the values we read are valid for rootPid and treeHeight
-	if ((int)(*buffer) > 0 && (int)(*(buffer+4)) > 0 ) {
-		memcpy(&rootPid, buffer, sizeof(int) );
-		memcpy(&treeHeight, buffer + 4, sizeof(int)); 
+	int theRootPid, theTreeHeight; 
+	memcpy(&theRootPid, buffer + 12, sizeof(int)); 
+	memcpy(&theTreeHeight, buffer + 16, sizeof(int)); 
+	if (theRootPid > 0 && theTreeHeight > 0) {
+		rootPid = theRootPid; 
+		treeHeight = theTreeHeight; 
+	}
+	memcpy(&freeList, buffer + 20, sizeof(PageId)); 
+	if (freeList < 0 || freeList >= pf.endPid())
+		freeList = 0; 
+	memcpy(&this->coverSize, buffer + 24, sizeof(int)); 
+	if (this->coverSize < 0 || this->coverSize > MAX_COVER_SIZE) {
+		pf.close(); 
+		return RC_INVALID_FILE_FORMAT; 
 	}
+	int thePacked; 
+	memcpy(&thePacked, buffer + 28, sizeof(int)); 
+	if (thePacked != 0 && thePacked != 1) {
+		pf.close(); 
+		return RC_INVALID_FILE_FORMAT; 
+	}
+	this->packed = thePacked; 
 	
     return 0;
 }
 
+/*
+ * Read the (key, rid) pairs of a leaf node written in an older format.
+ * @param page[IN] the leaf node
+ * @param pageSize[IN] the size of the node
+ * @param version[IN] the node format version of the index
+ * @param keys[OUT] the keys of the node are appended to it
+ * @param rids[OUT] the RecordIds of the node are appended to it
+ * @return the PageId of the next sibling node. 0 if none
+ */
+static PageId readOldLeaf(const char* page, int pageSize, int version,
+                          vector<int>& keys, vector<RecordId>& rids)
+{
+	int entrySize = sizeof(int) + sizeof(RecordId);
+	int theKey, keyCount; 
+	RecordId theRid; 
+	PageId nextPid; 
+	const char *entries; 
+
+	// where the key and the rid of the i-th entry are: key at keyOffset,
+	// rid at ridOffset, and the next entry entrySize bytes further
+	int keyOffset = 0, ridOffset = sizeof(int); 
+	int keyStride = entrySize, ridStride = entrySize; 
+
+	if (version == LEGACY_VERSION) {
+		// the keys end at the first zero key
+		entries = page; 
+		keyCount = (pageSize - sizeof(PageId)) / entrySize; 
+		memcpy(&nextPid, page + pageSize - sizeof(PageId), sizeof(PageId));
+	}
+	else { 	// version 1: the header and interleaved (key, rid) pairs
+		 	// version 2 and 3: the header, the key array and the rid array
+		entries = page + BTNODE_HEADER_SIZE; 
+		int maxKeyCount = (pageSize - BTNODE_HEADER_SIZE) / entrySize; 
+		memcpy(&keyCount, page + 4, sizeof(int));
+		if (keyCount < 0 || keyCount > maxKeyCount)
+			keyCount = 0; 
+		memcpy(&nextPid, page + 8, sizeof(PageId));
+		if (version >= 2) {
+			ridOffset = maxKeyCount*sizeof(int); 
+			keyStride = sizeof(int); 
+			ridStride = sizeof(RecordId); 
+		}
+	}
+
+	for (int i = 0; i < keyCount; ++i) {
+		memcpy(&theKey, entries + keyOffset + i*keyStride, sizeof(int));
+		if (version == LEGACY_VERSION && !theKey)
+			break; 
+		memcpy(&theRid, entries + ridOffset + i*ridStride, sizeof(RecordId));
+		keys.push_back(theKey); 
+		rids.push_back(theRid); 
+	}
+
+	return nextPid; 
+}
+
+/*
+ * Rewrite an index built with an older node format in the current format.
+ * @param indexname[IN] the name of the index file
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::convert(const string& indexname)
+{
+	PageFile old; 
+	RC error; 
+	if (error = old.open(indexname, 'r'))
+		return error; 
+
+	int pageSize = old.getPageSize(); 
+	char *page = new char[pageSize];
+	int version = LEGACY_VERSION; 
+	PageId oldRootPid = 0; 
+	int oldTreeHeight = 0; 
+
+	// find out the format of the index from its header page
+	if (old.endPid() > 0) {
+		if (error = old.read(0, page)) {
+			delete [] page; 
+			old.close(); 
+			return error; 
+		}
+		if (!memcmp(page, INDEX_MAGIC, sizeof(INDEX_MAGIC))) {
+			memcpy(&version, page + 8, sizeof(int));
+			memcpy(&oldRootPid, page + 12, sizeof(PageId));
+			memcpy(&oldTreeHeight, page + 16, sizeof(int));
+		}
+		else {
+			memcpy(&oldRootPid, page, sizeof(PageId));
+			memcpy(&oldTreeHeight, page + 4, sizeof(int));
+		}
+	}
+	if (version == BTNODE_VERSION || version > BTNODE_VERSION || version < LEGACY_VERSION) {
+		delete [] page; 
+		old.close(); 
+		return (version == BTNODE_VERSION) ? 0 : RC_INVALID_FILE_FORMAT; 
+	}
+
+	// build the new index next to the old one
+	string newname = indexname + ".new"; 
+	unlink(newname.c_str()); 
+	BTreeIndex tree; 
+	if (error = tree.open(newname, 'w', pageSize)) {
+		delete [] page; 
+		old.close(); 
+		return error; 
+	}
+
+	if (oldTreeHeight > 0 && oldRootPid > 0) {
+		// go down to the leftmost leaf
+		PageId pid = oldRootPid; 
+		for (int i = 1; i < oldTreeHeight && !error; ++i) {
+			if (!(error = old.read(pid, page)))
+				memcpy(&pid, page + (version == LEGACY_VERSION ? 0 : 8), sizeof(PageId));
+		}
+
+		// and insert the entries of the leaves from left to right.
+		// (a leaf chain longer than the file means the file is corrupt.)
+		vector<int> keys; 
+		vector<RecordId> rids; 
+		for (int leaves = 0; pid > 0 && !error; ++leaves) {
+			if (leaves >= old.endPid() || (error = old.read(pid, page))) {
+				if (!error) error = RC_INVALID_FILE_FORMAT; 
+				break; 
+			}
+			keys.clear(); 
+			rids.clear(); 
+			pid = readOldLeaf(page, pageSize, version, keys, rids);
+			for (unsigned i = 0; i < keys.size() && !error; ++i)
+				error = tree.insert(keys[i], rids[i]);
+		}
+	}
+	delete [] page; 
+	old.close(); 
+
+	RC closeError = tree.close(); 
+	if (!error) error = closeError; 
+	if (error) {
+		unlink(newname.c_str()); 
+		return error; 
+	}
+
+	// replace the old index
+	if (rename(newname.c_str(), indexname.c_str()) < 0) {
+		unlink(newname.c_str()); 
+		return RC_FILE_WRITE_FAILED; 
+	}
+	return 0; 
+}
+
 /*
  * Close the index file.
  * @return error code. 0 if no error
  */
 RC BTreeIndex::close()
 {
-	memcpy(buffer, &rootPid, sizeof(int) );
-	memcpy(buffer + 4, &treeHeight, sizeof(int) );
+	// the root pid and the tree height only change in 'w' mode
+	if (writable) {
+		int version = BTNODE_VERSION; 
+		memcpy(buffer, INDEX_MAGIC, sizeof(INDEX_MAGIC)); 
+		memcpy(buffer + 8, &version, sizeof(int)); 
+		memcpy(buffer + 12, &rootPid, sizeof(int) );
+		memcpy(buffer + 16, &treeHeight, sizeof(int) );
+		memcpy(buffer + 20, &freeList, sizeof(PageId) );
+		memcpy(buffer + 24, &coverSize, sizeof(int) );
+		int thePacked = packed; 
+		memcpy(buffer + 28, &thePacked, sizeof(int) );
 
-	RC error;
-	// write to disk 
-	if (error = pf.write(0, buffer))
-		return error;
+		RC error;
+		// write to disk 
+		if (error = pf.write(0, buffer))
+			return error;
+	}
 
+	nodeCache.clear(); 
     return pf.close();
 }
 
@@ -83,189 +352,2161 @@ RC BTreeIndex::close()
  */
 RC BTreeIndex::insert(int key, const RecordId& rid)
 {
-	// empty tree
-	if (!treeHeight) {
-		BTLeafNode myLeaf;
-		myLeaf.insert(key, rid);
+	// an empty cover sends a read for the value to the table
+	vector<char> cover(coverSize); 
+	return insertCover(key, rid, coverAt(cover, 0, coverSize)); 
+}
 
-		++treeHeight;
-		rootPid = pf.endPid()? pf.endPid() : 1;
+/*
+ * Insert (key, RecordId) pair to the index, with the value of the record.
+ * @param key[IN] the key for the value inserted into the index
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @param value[IN] the value of the record
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insert(int key, const RecordId& rid, const string& value)
+{
+	vector<char> cover(coverSize); 
+	if (coverSize)
+		makeCover(value, &cover[0]); 
+	return insertCover(key, rid, coverAt(cover, 0, coverSize)); 
+}
 
-		return myLeaf.write(rootPid, pf);
+/*
+ * Make the cover of a value.
+ * @param value[IN] the value
+ * @param cover[OUT] the cover. getCoverSize() bytes
+ */
+void BTreeIndex::makeCover(const string& value, char* cover) const
+{
+	// the length of a value that fits goes first, plus one, so that an
+	// empty cover (all zero) tells that the value is not in the index
+	int length = value.size(); 
+	memset(cover, 0, coverSize); 
+	if (length < coverSize) {
+		cover[0] = (char)(length + 1); 
+		memcpy(cover + 1, value.data(), length); 
 	}
+	else
+		memcpy(cover + 1, value.data(), coverSize - 1); 
+}
 
-	//else do the recursive function 
-	int keyToInsert = -1;
-	PageId pidToInsert = -1; 
-	return insert_helper(key, rid, rootPid, 1, keyToInsert, pidToInsert); 
+/*
+ * Read the value out of a cover.
+ * @param cover[IN] the cover. getCoverSize() bytes
+ * @param value[OUT] the value, or the prefix of it kept in the cover
+ * @return true if the value is complete
+ */
+bool BTreeIndex::readCover(const char* cover, string& value) const
+{
+	int length = (unsigned char)cover[0]; 
+	if (length > 0 && length <= coverSize) {
+		value.assign(cover + 1, length - 1); 
+		return true; 
+	}
+	value.assign(cover + 1, strnlen(cover + 1, coverSize - 1)); 
+	return false; 
 }
 
-// recursive function 
-RC BTreeIndex::insert_helper(int key, const RecordId& rid, PageId currentPid, int currentHeight, int& keyToInsert, PageId& pidToInsert)
+/*
+ * Insert (key, RecordId) pair to the index with the cover of the RecordId.
+ * @param cover[IN] the cover. NULL if the index does not cover
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insertCover(int key, const RecordId& rid, const char* cover)
 {
 	RC error; 
-	// this is somewhere in the middle of the tree
-	if (currentHeight != treeHeight) {
-		BTNonLeafNode myNonLeaf; 
-		if (error = myNonLeaf.read(currentPid, pf))
-			return error; 
+	int pageSize = pf.getPageSize(); 
 
-		PageId thePid; 
-		myNonLeaf.locateChildPtr(key, thePid);
+	// the path from the header page (which holds the root pointer) down to
+	// the leaf, the latch version each node was read at, and whether the
+	// node was full
+	PageId path[MAX_HEIGHT + 1]; 
+	unsigned long long versions[MAX_HEIGHT + 1]; 
+	bool full[MAX_HEIGHT + 1]; 
+	int height, top; 
+	PageId pid; 
 
-		int myKeyToInsert = -1;
-		PageId myPidToInsert = -1; 
+	restart: 
+	path[0] = 0; 
+	full[0] = false; 
+	versions[0] = readLatch(0); 
+	height = treeHeight; 
+	pid = rootPid; 
+	if (!checkLatch(0, versions[0]))
+		goto restart; 
 
-		insert_helper(key, rid, thePid, currentHeight+1, myKeyToInsert, myPidToInsert);
+	// empty tree
+	if (!height) {
+		if (!upgradeLatch(0, versions[0]))
+			goto restart; 
 
-		if ((myKeyToInsert != -1) && (myPidToInsert != -1)) { 
+		BTLeafNode myLeaf(pageSize, coverSize, packed);
+		myLeaf.insert(key, rid, cover);
+		PageId leafPid = allocatePage(); 
+		if (!(error = myLeaf.write(leafPid, pf))) {
+			rootPid = leafPid; 
+			treeHeight = 1; 
+		}
 
-			if (!myNonLeaf.insert(myKeyToInsert, myPidToInsert))  // if insert is successful, meaning no overflow 
-				return myNonLeaf.write(currentPid, pf);
-			// if not, then we have to do insertAndSplit
-			BTNonLeafNode mySecondNonLeaf; 
-			int myMidKey;
-			myNonLeaf.insertAndSplit(myKeyToInsert, myPidToInsert, mySecondNonLeaf, myMidKey);
-			// return key to insert (for parent to process)
-			keyToInsert = myMidKey;
-			// return pointer to new non-leaf node (for parent to process)
-			PageId lastPid = pf.endPid();
-			pidToInsert = lastPid; 
+		releaseLatch(0); 
+		return error; 
+	}
+	if (height > MAX_HEIGHT)
+		return RC_INVALID_FILE_FORMAT; 
 
-			if (error = mySecondNonLeaf.write(lastPid, pf))
-				return error;
-			if (error = myNonLeaf.write(currentPid, pf))
-				return error; 
+	// go down to the leaf like a lookup, without latching anything
+	for (int level = 1; level <= height; ++level) {
+		path[level] = pid; 
+		versions[level] = readLatch(pid); 
+		if (!checkLatch(path[level - 1], versions[level - 1]))
+			goto restart; 
 
-			if (treeHeight == 1) {
-				BTNonLeafNode myRoot; 
-				if (error = myRoot.initializeRoot(currentPid, myMidKey, lastPid))
-					return error; 
-				++treeHeight; 
-				rootPid = pf.endPid(); 
-				if (error = myRoot.write(rootPid, pf))
-					return error; 
+		if (level < height) {
+			BTNonLeafNode myNonLeaf(pageSize); 
+			if (!(error = myNonLeaf.read(pid, pf))) {
+				full[level] = (myNonLeaf.getKeyCount() >= myNonLeaf.getMaxKeyCount()); 
+				myNonLeaf.locateChildPtr(key, pid); 
 			}
-
+		}
+		else {
+			BTLeafNode myLeaf(pageSize, coverSize, packed); 
+			if (!(error = myLeaf.read(pid, pf)))
+				full[level] = !myLeaf.hasRoom(key, rid); 
 		}
 
-		return 0; 
+		// the node may have changed while it was read
+		if (!checkLatch(path[level], versions[level]))
+			goto restart; 
+		if (error)
+			return error; 
+	}
+
+	// latch the leaf and the full nodes above it, which are split, up to
+	// the node that takes the last split (the header page for a new root).
+	// if any of them has changed since it was read, start over.
+	for (top = height; full[top]; --top)
+		; 
+	if (!latchPath(path, versions, top, height + 1))
+		goto restart; 
 
+	// a split leaf changes the previous node pointer of the leaf behind it,
+	// which is written under that leaf's latch. it is not waited for while
+	// the path is latched; if it is held, start over.
+	PageId behindPid = 0; 
+	bool behindTaken = false; 
+	if (top < height) {
+		BTLeafNode myLeaf(pageSize, coverSize, packed); 
+		if (error = myLeaf.read(path[height], pf)) {
+			releasePath(path, top, height + 1); 
+			return error; 
+		}
+		behindPid = myLeaf.getNextNodePtr(); 
+		if (behindPid > 0 && !tryLatch(behindPid, path + top, height + 1 - top, behindTaken)) {
+			releasePath(path, top, height + 1); 
+			std::this_thread::yield(); 
+			goto restart; 
+		}
 	}
-	else {   // this is when we reached the leaf level 
-		BTLeafNode myLeaf; 
-		if (error = myLeaf.read(currentPid, pf))
+
+	error = insertLatched(key, rid, cover, path, top, height); 
+	if (behindTaken)
+		releaseLatch(behindPid); 
+	releasePath(path, top, height + 1); 
+
+	return error; 
+}
+
+/*
+ * Insert (key, RecordId) pair with the latches of path[top..height] held,
+ * and of the leaf behind path[height] if it is split.
+ * The nodes of path[top+1..height] are full and split bottom-up.
+ * path[top] takes the last split, and a new root is made if top is 0.
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insertLatched(int key, const RecordId& rid, const char* cover, 
+                             const PageId* path, int top, int height)
+{
+	RC error; 
+	int pageSize = pf.getPageSize(); 
+
+	// the latches are held, so the nodes are as they were read
+	BTLeafNode myLeaf(pageSize, coverSize, packed); 
+	if (error = myLeaf.read(path[height], pf))
+		return error; 
+
+	if (top == height) {	// the leaf has room
+		// a long list of RecordIds of the key goes to posting pages
+		int eid; 
+		if (!myLeaf.locate(key, eid) && (myLeaf.getListPtr(eid) || myLeaf.getRidCount(eid) >= myLeaf.getMaxListLength())) {
+			if (error = insertPosting(myLeaf, eid, rid, cover))
+				return error; 
+		}
+		else if (error = myLeaf.insert(key, rid, cover))
 			return error; 
+		return myLeaf.write(path[height], pf); 
+	}
 
-		if (!myLeaf.insert(key, rid))  // if insert is successful, meaning no overflow
-			return myLeaf.write(currentPid, pf); 
+	// split the leaf. the new leaf is written before it is linked, so a
+	// lookup that follows the link finds it complete.
+	BTLeafNode mySecondLeaf(pageSize, coverSize, packed); 
+	int keyToInsert; 
+	if (error = myLeaf.insertAndSplit(key, rid, mySecondLeaf, keyToInsert, cover))
+		return error; 
+	PageId pidToInsert = allocatePage(); 
+	mySecondLeaf.setPrevNodePtr(path[height]); 
+	if (error = mySecondLeaf.write(pidToInsert, pf))
+		return error; 
+	myLeaf.setNextNodePtr(pidToInsert); 
+	if (error = myLeaf.write(path[height], pf))
+		return error; 
 
-		// if not, then we have to do insertAndSplit 
-		BTLeafNode mySecondLeaf; 
-		int theKey; 
-		if (error = myLeaf.insertAndSplit(key, rid, mySecondLeaf, theKey))
+	// the leaf behind the new one points back to it. its latch is held, so
+	// no other writer rewrites it meanwhile. (a backward scan checks that
+	// the previous leaf still points forward to where it came from.)
+	PageId behindPid = mySecondLeaf.getNextNodePtr(); 
+	if (behindPid > 0) {
+		BTLeafNode myBehindLeaf(pageSize, coverSize, packed); 
+		if (error = myBehindLeaf.read(behindPid, pf))
+			return error; 
+		myBehindLeaf.setPrevNodePtr(pidToInsert); 
+		if (error = myBehindLeaf.write(behindPid, pf))
 			return error; 
-		// return the key to insert (for parent to process)
-		keyToInsert = theKey; 
-		// return pointer to new leaf node (for parent to process)
-		PageId lastPid = pf.endPid();
-		pidToInsert = lastPid; 
-		// set this leaf to point to the new leaf 
-		myLeaf.setNextNodePtr(lastPid); 
+	}
 
-		if (error = mySecondLeaf.write(lastPid, pf))
-			return error;
-		if (error = myLeaf.write(currentPid, pf))
-			return error;
+	// nonleaf nodes change, so their cached copies are stale
+	if (!shared)
+		nodeCache.clear(); 
 
-		// in case we just split the root 
-		if (treeHeight == 1) {
-			BTNonLeafNode myRoot; 
-			if (error = myRoot.initializeRoot(currentPid, theKey, lastPid))
-				return error; 
-			++treeHeight; 
-			rootPid = pf.endPid(); 
-			if (error = myRoot.write(rootPid, pf))
-				return error; 
+	// pass the new entry up, splitting the full nodes on the way
+	for (int level = height - 1; level > top; --level) {
+		BTNonLeafNode myNonLeaf(pageSize); 
+		if (error = myNonLeaf.read(path[level], pf))
+			return error; 
 
-		}
+		BTNonLeafNode mySecondNonLeaf(pageSize); 
+		int myMidKey; 
+		if (error = myNonLeaf.insertAndSplit(keyToInsert, pidToInsert, mySecondNonLeaf, myMidKey))
+			return error; 
+		PageId secondPid = allocatePage(); 
+		if (error = mySecondNonLeaf.write(secondPid, pf))
+			return error; 
+		if (error = myNonLeaf.write(path[level], pf))
+			return error; 
 
-		return 0; 
+		keyToInsert = myMidKey; 
+		pidToInsert = secondPid; 
+	}
+
+	if (top > 0) {	// the node at top has room
+		BTNonLeafNode myNonLeaf(pageSize); 
+		if (error = myNonLeaf.read(path[top], pf))
+			return error; 
+		if (error = myNonLeaf.insert(keyToInsert, pidToInsert))
+			return error; 
+		return myNonLeaf.write(path[top], pf); 
 	}
 
+	// the root was split. the header latch is held for the new root.
+	BTNonLeafNode myRoot(pageSize); 
+	if (error = myRoot.initializeRoot(path[1], keyToInsert, pidToInsert))
+		return error; 
+	PageId newRootPid = allocatePage(); 
+	if (error = myRoot.write(newRootPid, pf))
+		return error; 
+	rootPid = newRootPid; 
+	++treeHeight; 
+
+	return 0; 
 }
 
-/**
- * Run the standard B+Tree key search algorithm and identify the
- * leaf node where searchKey may exist. If an index entry with
- * searchKey exists in the leaf node, set IndexCursor to its location
- * (i.e., IndexCursor.pid = PageId of the leaf node, and
- * IndexCursor.eid = the searchKey index entry number.) and return 0.
- * If not, set IndexCursor.pid = PageId of the leaf node and
- * IndexCursor.eid = the index entry immediately after the largest
- * index key that is smaller than searchKey, and return the error
- * code RC_NO_SUCH_RECORD.
- * Using the returned "IndexCursor", you will have to call readForward()
- * to retrieve the actual (key, rid) pair from the index.
- * @param key[IN] the key to find
- * @param cursor[OUT] the cursor pointing to the index entry with
- *                    searchKey or immediately behind the largest key
- *                    smaller than searchKey.
- * @return 0 if searchKey is found. Othewise an error code
+/*
+ * Remove (key, RecordId) pair from the index.
+ * @param key[IN] the key of the pair
+ * @param rid[IN] the RecordId of the pair
+ * @return error code. 0 if no error
  */
-RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+RC BTreeIndex::remove(int key, const RecordId& rid)
 {
-	BTNonLeafNode myNonLeafNode; 
-	RC error;
-	int nextPid = rootPid; 
-	for (int i = 1; i < treeHeight; ++i) {
-		if (error = myNonLeafNode.read(nextPid, pf))
+	RC error; 
+	int pageSize = pf.getPageSize(); 
+
+	// the path from the header page down to the leaf with the pair, the
+	// latch version each node was read at, the child slot taken in each
+	// nonleaf node, and whether the node is left less than half full by
+	// the removal
+	PageId path[MAX_HEIGHT + 1]; 
+	unsigned long long versions[MAX_HEIGHT + 1]; 
+	int slots[MAX_HEIGHT + 1]; 
+	bool minimal[MAX_HEIGHT + 1]; 
+	PageId held[2*MAX_HEIGHT + 2]; 
+	vector<int> keys; 
+	vector<PageId> pids; 
+	int height, top, level, heldCount; 
+	PageId rightPid = 0; 
+
+	restart: 
+	path[0] = 0; 
+	minimal[0] = false; 
+	versions[0] = readLatch(0); 
+	height = treeHeight; 
+	path[1] = rootPid; 
+	if (!checkLatch(0, versions[0]))
+		goto restart; 
+	if (!height)
+		return RC_NO_SUCH_RECORD; 
+	if (height > MAX_HEIGHT)
+		return RC_INVALID_FILE_FORMAT; 
+
+	// go down like a lookup. a key is in a single entry of a single leaf.
+	versions[1] = readLatch(path[1]); 
+	if (!checkLatch(0, versions[0]))
+		goto restart; 
+	for (level = 1; level < height; ++level) {
+		BTNonLeafNode myNonLeaf(pageSize); 
+		int keyCount = 0; 
+		if (!(error = myNonLeaf.read(path[level], pf))) {
+			// nothing is latched, so the node may grow while it is read
+			keyCount = min(myNonLeaf.getKeyCount(), myNonLeaf.getMaxKeyCount()); 
+			keys.resize(myNonLeaf.getMaxKeyCount() + 1); 
+			pids.resize(myNonLeaf.getMaxKeyCount() + 1); 
+			myNonLeaf.readEntries(&keys[0], &pids[0]); 
+			slots[level] = KeySearch::upperBound((const char*)&keys[0], sizeof(int), keyCount, key); 
+			path[level + 1] = pids[slots[level]]; 
+		}
+		if (!checkLatch(path[level], versions[level]))
+			goto restart; 
+		if (error)
 			return error; 
 
-		if (error = myNonLeafNode.locateChildPtr(searchKey, nextPid))
+		// a root with a single key is removed when it loses it
+		if (level == 1)
+			minimal[level] = (keyCount <= 1); 
+		else
+			minimal[level] = (keyCount - 1 < myNonLeaf.getMaxKeyCount() / 2); 
+
+		versions[level + 1] = readLatch(path[level + 1]); 
+		if (!checkLatch(path[level], versions[level]))
+			goto restart; 
+	}
+
+	{
+		BTLeafNode myLeaf(pageSize, coverSize, packed); 
+		bool found = false; 
+		if (!(error = myLeaf.read(path[height], pf))) {
+			int eid, freed = 0; 
+			RecordId theRid; 
+			if (!myLeaf.locate(key, eid)) {
+				// the RecordIds in posting pages are looked at when the
+				// leaf is latched
+				if (myLeaf.getListPtr(eid))
+					found = true; 
+				else if (myLeaf.readRids(eid, myLeaf.ridLowerBound(eid, rid), &theRid, 1) == 1 && theRid == rid) {
+					found = true; 
+					freed = myLeaf.getRemovedBytes(eid); 
+				}
+			}
+			minimal[height] = (height > 1 && myLeaf.getUsedBytes() - freed < myLeaf.getCapacity() / 2); 
+		}
+		if (!checkLatch(path[height], versions[height]))
+			goto restart; 
+		if (error)
 			return error; 
+		if (!found)
+			return RC_NO_SUCH_RECORD; 
 	}
 
-	BTLeafNode myLeafNode; 
-	if (error = myLeafNode.read(nextPid, pf))
-		return error; 
-	int myEid; 
-	error = myLeafNode.locate(searchKey, myEid);
-	cursor.pid = nextPid;
-	cursor.eid = myEid; 
-		 
-    return error;
+	// latch the leaf and the nodes above it that lose a child, up to the
+	// one that is large enough (the header page if the root is removed).
+	// if any of them has changed since it was read, start over.
+	for (top = height; minimal[top]; --top)
+		; 
+	if (!latchPath(path, versions, top, height + 1))
+		goto restart; 
+
+	// latch the siblings that the nodes are merged with, and the leaf behind
+	// the merged leaves, whose previous node pointer changes. their latches
+	// are not waited for while the path is latched; if one is held, start
+	// over.
+	heldCount = height + 1 - top; 
+	memcpy(held, path + top, heldCount*sizeof(PageId)); 
+	for (level = (top < 1) ? 2 : top + 1; level <= height + (top < height); ++level) {
+		PageId sibling; 
+		if (level <= height) {
+			BTNonLeafNode myParent(pageSize); 
+			if (error = myParent.read(path[level - 1], pf))
+				break; 
+			keys.resize(myParent.getKeyCount() + 1); 
+			pids.resize(myParent.getKeyCount() + 1); 
+			myParent.readEntries(&keys[0], &pids[0]); 
+
+			// the left sibling, or the right one for the leftmost child
+			int slot = slots[level - 1]; 
+			sibling = pids[(slot > 0) ? slot - 1 : slot + 1]; 
+			if (level == height)
+				rightPid = (slot > 0) ? path[height] : sibling; 
+		}
+		else {
+			// the leaf behind the right one of the leaf and its sibling,
+			// whose previous node pointer changes if they are merged
+			BTLeafNode myRight(pageSize, coverSize, packed); 
+			if (error = myRight.read(rightPid, pf))
+				break; 
+			sibling = myRight.getNextNodePtr(); 
+			if (sibling <= 0)
+				break; 
+		}
+
+		bool taken; 
+		if (!tryLatch(sibling, held, heldCount, taken)) {
+			for (int i = height + 1 - top; i < heldCount; ++i)
+				releaseLatch(held[i]); 
+			releasePath(path, top, height + 1); 
+			std::this_thread::yield(); 
+			goto restart; 
+		}
+		if (taken)
+			held[heldCount++] = sibling; 
+	}
+
+	if (!error)
+		error = removeLatched(key, rid, path, slots, top, height); 
+	for (int i = height + 1 - top; i < heldCount; ++i)
+		releaseLatch(held[i]); 
+	releasePath(path, top, height + 1); 
+
+	return error; 
 }
 
 /*
- * Read the (key, rid) pair at the location specified by the index cursor,
- * and move foward the cursor to the next entry.
- * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
- * @param key[OUT] the key stored at the index cursor location.
- * @param rid[OUT] the RecordId stored at the index cursor location.
+ * Remove (key, RecordId) pair with the latches of path[top..height], of
+ * the siblings of path[top+1..height] and of the leaf behind the merged
+ * leaves held.
+ * The nodes of path[top+1..height] are merged bottom-up.
+ * path[top] loses the last merged child, and the root is removed if top is 0.
+ * @param slots[IN] the child slot of path[l + 1] in path[l]
  * @return error code. 0 if no error
  */
-RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
+RC BTreeIndex::removeLatched(int key, const RecordId& rid, const PageId* path, const int* slots, 
+                             int top, int height)
 {
-	BTLeafNode myLeaf;
 	RC error; 
+	int pageSize = pf.getPageSize(); 
 
-	if (cursor.pid <= 0)
-		return RC_INVALID_CURSOR; 
+	// the latches are held, so the nodes are as they were read
+	BTLeafNode myLeaf(pageSize, coverSize, packed); 
+	if (error = myLeaf.read(path[height], pf))
+		return error; 
+	int eid; 
+	if (myLeaf.locate(key, eid))
+		return RC_NO_SUCH_RECORD; 
+	if (myLeaf.getListPtr(eid)) {
+		if (error = removePosting(myLeaf, eid, rid))
+			return error; 
+	}
+	else if (error = myLeaf.removeRid(eid, rid))
+		return error; 
+	if (top == height)	// the leaf is still half full
+		return myLeaf.write(path[height], pf); 
 
-	if (error = myLeaf.read(cursor.pid, pf))
+	// the leaf is less than half full. it is merged with its left sibling
+	// (its right sibling if it is the leftmost child) when they fit in one
+	// leaf. otherwise it takes the last entries of its left sibling.
+	BTNonLeafNode myParent(pageSize); 
+	if (error = myParent.read(path[height - 1], pf))
 		return error; 
-	if (error = myLeaf.readEntry(cursor.eid, key, rid))
+	int parentCount = myParent.getKeyCount(); 
+	vector<int> parentKeys(parentCount + 1); 
+	vector<PageId> parentPids(parentCount + 1); 
+	myParent.readEntries(&parentKeys[0], &parentPids[0]); 
+
+	// the right one of the two leaves is at slot in the parent
+	int slot = slots[height - 1]; 
+	if (!slot)
+		++slot; 
+	PageId leftPid = parentPids[slot - 1], rightPid = parentPids[slot]; 
+	BTLeafNode mySibling(pageSize, coverSize, packed); 
+	if (error = mySibling.read((leftPid == path[height]) ? rightPid : leftPid, pf))
 		return error; 
+	BTLeafNode& myLeft = (leftPid == path[height]) ? myLeaf : mySibling; 
+	BTLeafNode& myRight = (leftPid == path[height]) ? mySibling : myLeaf; 
 
-	if (cursor.eid + 1 == myLeaf.getKeyCount()) {
-		cursor.eid = 0; 
-		cursor.pid = myLeaf.getNextNodePtr(); 
+	vector<BTLeafEntry> entries, rightEntries; 
+	myLeft.getEntries(entries); 
+	myRight.getEntries(rightEntries); 
+	int leftCount = entries.size(); 
+	entries.insert(entries.end(), rightEntries.begin(), rightEntries.end()); 
+	int total = entries.size(); 
+
+	// nonleaf nodes change, so their cached copies are stale
+	if (!shared)
+		nodeCache.clear(); 
+
+	if (!myLeaf.fits(entries.empty() ? NULL : &entries[0], total)) {
+		// a leftmost child does not take entries from the right, since a
+		// forward scan on the right leaf would miss them
+		if (leftPid == path[height])
+			return myLeaf.write(path[height], pf); 
+
+		// split the entries evenly by size, and the first key of the right
+		// leaf separates them in the parent. entries only go from left to
+		// right, for the same reason. (the sizes of packed entries depend on
+		// their neighbors, so an even split may take some from the right.)
+		int newLeftCount = myLeaf.splitEntries(&entries[0], total); 
+		if (newLeftCount < 0 || newLeftCount >= leftCount)
+			return myLeaf.write(path[height], pf); 
+		if (error = myRight.setEntries(&entries[newLeftCount], total - newLeftCount))
+			return error; 
+		if (error = myRight.write(rightPid, pf))
+			return error; 
+		if (error = myLeft.setEntries(&entries[0], newLeftCount))
+			return error; 
+		if (error = myLeft.write(leftPid, pf))
+			return error; 
+		parentKeys[slot - 1] = entries[newLeftCount].key; 
+		if (error = myParent.setEntries(&parentKeys[0], &parentPids[0], parentCount))
+			return error; 
+		return myParent.write(path[height - 1], pf); 
 	}
-	else {
-		int dummy = cursor.eid; 
-		cursor.eid = dummy + 1; 
+
+	// merge the right leaf into the left one, and unlink it. the leaf
+	// behind it, whose latch is held, points back to the left leaf.
+	PageId behindPid = myRight.getNextNodePtr(); 
+	if (error = myLeft.setEntries(entries.empty() ? NULL : &entries[0], total))
+		return error; 
+	myLeft.setNextNodePtr(behindPid); 
+	if (error = myLeft.write(leftPid, pf))
+		return error; 
+	if (behindPid > 0) {
+		BTLeafNode myBehindLeaf(pageSize, coverSize, packed); 
+		if (error = myBehindLeaf.read(behindPid, pf))
+			return error; 
+		myBehindLeaf.setPrevNodePtr(leftPid); 
+		if (error = myBehindLeaf.write(behindPid, pf))
+			return error; 
 	}
+	if (error = freePage(rightPid))
+		return error; 
 
-    return 0;
+	// take the right child and the key in front of it out of the parents,
+	// merging the nonleaf nodes left less than half full on the way
+	for (int level = height - 1; ; --level) {
+		BTNonLeafNode myNonLeaf(pageSize); 
+		if (error = myNonLeaf.read(path[level], pf))
+			return error; 
+		int keyCount = myNonLeaf.getKeyCount(); 
+		vector<int> nodeKeys(keyCount + 1); 
+		vector<PageId> nodePids(keyCount + 1); 
+		myNonLeaf.readEntries(&nodeKeys[0], &nodePids[0]); 
+		nodeKeys.erase(nodeKeys.begin() + slot - 1); 
+		nodePids.erase(nodePids.begin() + slot); 
+		--keyCount; 
+
+		if (level == top) {	// the node is still half full
+			if (error = myNonLeaf.setEntries(&nodeKeys[0], &nodePids[0], keyCount))
+				return error; 
+			return myNonLeaf.write(path[level], pf); 
+		}
+
+		// the root has a single child left, which becomes the root.
+		// the header latch is held for it.
+		if (level == 1) {
+			rootPid = nodePids[0]; 
+			--treeHeight; 
+			return freePage(path[1]); 
+		}
+
+		// the node is less than half full. like a leaf, it is merged with a
+		// sibling (the key between them in the parent comes down between
+		// their keys) or the keys of both are split evenly.
+		if (error = myParent.read(path[level - 1], pf))
+			return error; 
+		parentCount = myParent.getKeyCount(); 
+		parentKeys.resize(parentCount + 1); 
+		parentPids.resize(parentCount + 1); 
+		myParent.readEntries(&parentKeys[0], &parentPids[0]); 
+		slot = slots[level - 1]; 
+		if (!slot)
+			++slot; 
+		leftPid = parentPids[slot - 1]; 
+		rightPid = parentPids[slot]; 
+
+		BTNonLeafNode mySiblingNode(pageSize); 
+		if (error = mySiblingNode.read((leftPid == path[level]) ? rightPid : leftPid, pf))
+			return error; 
+		int siblingCount = mySiblingNode.getKeyCount(); 
+		vector<int> siblingKeys(siblingCount + 1); 
+		vector<PageId> siblingPids(siblingCount + 1); 
+		mySiblingNode.readEntries(&siblingKeys[0], &siblingPids[0]); 
+		BTNonLeafNode& myLeftNode = (leftPid == path[level]) ? myNonLeaf : mySiblingNode; 
+		BTNonLeafNode& myRightNode = (leftPid == path[level]) ? mySiblingNode : myNonLeaf; 
+
+		// the keys and the children of both, left first
+		vector<int> allKeys; 
+		vector<PageId> allPids; 
+		if (leftPid == path[level]) {
+			allKeys.assign(nodeKeys.begin(), nodeKeys.begin() + keyCount); 
+			allPids.assign(nodePids.begin(), nodePids.begin() + keyCount + 1); 
+			allKeys.push_back(parentKeys[slot - 1]); 
+			allKeys.insert(allKeys.end(), siblingKeys.begin(), siblingKeys.begin() + siblingCount); 
+			allPids.insert(allPids.end(), siblingPids.begin(), siblingPids.begin() + siblingCount + 1); 
+		}
+		else {
+			allKeys.assign(siblingKeys.begin(), siblingKeys.begin() + siblingCount); 
+			allPids.assign(siblingPids.begin(), siblingPids.begin() + siblingCount + 1); 
+			allKeys.push_back(parentKeys[slot - 1]); 
+			allKeys.insert(allKeys.end(), nodeKeys.begin(), nodeKeys.begin() + keyCount); 
+			allPids.insert(allPids.end(), nodePids.begin(), nodePids.begin() + keyCount + 1); 
+		}
+		total = allKeys.size(); 
+
+		if (total <= myNonLeaf.getMaxKeyCount()) {
+			if (error = myLeftNode.setEntries(&allKeys[0], &allPids[0], total))
+				return error; 
+			if (error = myLeftNode.write(leftPid, pf))
+				return error; 
+			if (error = freePage(rightPid))
+				return error; 
+			continue; 
+		}
+
+		// the middle key goes up to the parent
+		int newLeftCount = total / 2; 
+		if (error = myLeftNode.setEntries(&allKeys[0], &allPids[0], newLeftCount))
+			return error; 
+		if (error = myRightNode.setEntries(&allKeys[newLeftCount + 1], &allPids[newLeftCount + 1], total - newLeftCount - 1))
+			return error; 
+		if (error = myLeftNode.write(leftPid, pf))
+			return error; 
+		if (error = myRightNode.write(rightPid, pf))
+			return error; 
+		parentKeys[slot - 1] = allKeys[newLeftCount]; 
+		if (error = myParent.setEntries(&parentKeys[0], &parentPids[0], parentCount))
+			return error; 
+		return myParent.write(path[level - 1], pf); 
+	}
+}
+
+/*
+ * Return a page no node uses, for a new node.
+ * @return the page of a removed node if there is one and the index is not
+ *         shared. the page behind the last one otherwise
+ */
+PageId BTreeIndex::allocatePage()
+{
+	// a scan in another thread may still be on a removed node, so its
+	// page is not reused while the index is shared
+	if (!shared) {
+		std::lock_guard<std::mutex> guard(freeLatch); 
+		if (freeList > 0) {
+			vector<char> page(pf.getPageSize()); 
+			PageId pid = freeList; 
+			short flags = 0; 
+			if (!pf.read(pid, &page[0]))
+				memcpy(&flags, &page[0] + 2, sizeof(short)); 
+			if (flags & BTNODE_FREE) {
+				memcpy(&freeList, &page[0] + 8, sizeof(PageId)); 
+				return pid; 
+			}
+			// the list is broken. the rest of it is left unused
+			freeList = 0; 
+		}
+	}
+	return freePid++; 
+}
+
+/*
+ * Mark the page of a removed node as free, and add it to the free list.
+ * @param pid[IN] the page
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::freePage(PageId pid)
+{
+	// the page keeps the node format version, so that a lookup that still
+	// reaches it finds out that it is free
+	vector<char> page(pf.getPageSize()); 
+	short version = BTNODE_VERSION, flags = BTNODE_FREE; 
+	memcpy(&page[0], &version, sizeof(short)); 
+	memcpy(&page[0] + 2, &flags, sizeof(short)); 
+
+	std::lock_guard<std::mutex> guard(freeLatch); 
+	memcpy(&page[0] + 8, &freeList, sizeof(PageId)); 
+	RC error; 
+	if (error = pf.write(pid, &page[0]))
+		return error; 
+	freeList = pid; 
+	return 0; 
+}
+
+/*
+ * Add rid to the RecordIds of the eid entry of a latched leaf, which go
+ * to posting pages. The caller writes the leaf.
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::insertPosting(BTLeafNode& leaf, int eid, const RecordId& rid, const char* cover)
+{
+	RC error; 
+	int pageSize = pf.getPageSize(); 
+	int key, count = leaf.getRidCount(eid); 
+	PageId head = leaf.getListPtr(eid); 
+	leaf.readKey(eid, key); 
+
+	// the list in the leaf moves out with the new RecordId
+	if (!head) {
+		vector<RecordId> rids(count); 
+		vector<char> covers(count*coverSize); 
+		leaf.readRids(eid, 0, &rids[0], count, coverAt(covers, 0, coverSize)); 
+		int i = upper_bound(rids.begin(), rids.end(), rid) - rids.begin(); 
+		rids.insert(rids.begin() + i, rid); 
+		if (coverSize)
+			covers.insert(covers.begin() + i*coverSize, cover, cover + coverSize); 
+		if (error = writePostings(key, &rids[0], coverAt(covers, 0, coverSize), rids.size(), 100, head))
+			return error; 
+		return leaf.setListPtr(eid, head, rids.size()); 
+	}
+
+	// new records mostly come last, so the last page is tried first.
+	// otherwise the page is the first one whose last RecordId is >= rid.
+	BTPostingNode myHead(pageSize, coverSize), myNode(pageSize, coverSize); 
+	if (error = myHead.read(head, pf))
+		return error; 
+	PageId tail = myHead.getLastNodePtr(), pid = tail; 
+	RecordId theRid; 
+	if (tail != head && (error = myNode.read(tail, pf)))
+		return error; 
+	BTPostingNode* node = (tail == head) ? &myHead : &myNode; 
+	if (node->readRids(0, &theRid, 1) == 1 && rid < theRid) {
+		node = &myHead; 
+		for (pid = head; pid != tail; ) {
+			int n = node->getRidCount(); 
+			if (node->readRids(n - 1, &theRid, 1) == 1 && !(theRid < rid))
+				break; 
+			pid = node->getNextNodePtr(); 
+			if (error = myNode.read(pid, pf))
+				return error; 
+			node = &myNode; 
+		}
+	}
+
+	if (node->insert(rid, cover) == RC_NODE_FULL) {
+		// the page is full. rid goes to a new page behind it if it comes
+		// last, and the page is split in half otherwise.
+		vector<RecordId> rids(node->getRidCount()); 
+		vector<char> covers(rids.size()*coverSize); 
+		node->readRids(0, &rids[0], rids.size(), coverAt(covers, 0, coverSize)); 
+		int i = upper_bound(rids.begin(), rids.end(), rid) - rids.begin(); 
+		rids.insert(rids.begin() + i, rid); 
+		if (coverSize)
+			covers.insert(covers.begin() + i*coverSize, cover, cover + coverSize); 
+		int keep = (pid == tail && rids.back() == rid) ? rids.size() - 1 : rids.size() / 2; 
+
+		PageId newPid = allocatePage(); 
+		PageId behindPid = node->getNextNodePtr(); 
+		BTPostingNode myNew(pageSize, coverSize); 
+		myNew.setKey(key); 
+		myNew.setPrevNodePtr(pid); 
+		myNew.setNextNodePtr(behindPid); 
+		myNew.setRids(&rids[keep], rids.size() - keep, coverAt(covers, keep, coverSize)); 
+		if (error = myNew.write(newPid, pf))
+			return error; 
+		node->setRids(&rids[0], keep, coverAt(covers, 0, coverSize)); 
+		node->setNextNodePtr(newPid); 
+		if (error = node->write(pid, pf))
+			return error; 
+
+		if (behindPid > 0) {
+			BTPostingNode myBehind(pageSize, coverSize); 
+			if (error = myBehind.read(behindPid, pf))
+				return error; 
+			myBehind.setPrevNodePtr(newPid); 
+			if (error = myBehind.write(behindPid, pf))
+				return error; 
+		}
+		else {
+			myHead.setLastNodePtr(newPid); 
+			if (error = myHead.write(head, pf))
+				return error; 
+		}
+	}
+	else if (error = node->write(pid, pf))
+		return error; 
+
+	return leaf.setListPtr(eid, head, count + 1); 
+}
+
+/*
+ * Remove rid from the RecordIds of the eid entry of a latched leaf, which
+ * are in posting pages. The caller writes the leaf.
+ * @return error code. 0 if no error. RC_NO_SUCH_RECORD if there is no rid
+ */
+RC BTreeIndex::removePosting(BTLeafNode& leaf, int eid, const RecordId& rid)
+{
+	RC error; 
+	int pageSize = pf.getPageSize(); 
+	int count = leaf.getRidCount(eid); 
+	PageId head = leaf.getListPtr(eid); 
+
+	// the first page whose last RecordId is >= rid
+	BTPostingNode myHead(pageSize, coverSize), myNode(pageSize, coverSize); 
+	if (error = myHead.read(head, pf))
+		return error; 
+	BTPostingNode* node = &myHead; 
+	PageId pid = head; 
+	RecordId theRid; 
+	for (int i = 0; i < count; ++i) {
+		int n = node->getRidCount(); 
+		if (node->readRids(n - 1, &theRid, 1) == 1 && !(theRid < rid))
+			break; 
+		if (!(pid = node->getNextNodePtr()))
+			return RC_NO_SUCH_RECORD; 
+		if (error = myNode.read(pid, pf))
+			return error; 
+		node = &myNode; 
+	}
+	if (error = node->remove(rid))
+		return error; 
+	if (error = node->write(pid, pf))
+		return error; 
+	--count; 
+
+	// the last RecordId of the key goes with the key. (a leaf that holds
+	// a few RecordIds of a key keeps none in posting pages.)
+	if (count == 0) {
+		if (error = freePostings(head))
+			return error; 
+		return leaf.remove(eid); 
+	}
+
+	// a short list goes back into the leaf, if it has room
+	if (count <= leaf.getMaxListLength() / 2) {
+		vector<RecordId> rids; 
+		vector<char> covers; 
+		if (error = readPostings(head, count, rids, covers))
+			return error; 
+		if (!leaf.setRids(eid, &rids[0], rids.size(), coverAt(covers, 0, coverSize)))
+			return freePostings(head); 
+	}
+
+	// a page left less than a quarter full is merged with a neighbour when
+	// both fit in one page. the first page stays, since the leaf points to it.
+	int maxCount = node->getMaxRidCount(); 
+	if (node->getRidCount() < maxCount / 4) {
+		PageId leftPid = 0, rightPid = 0; 
+		BTPostingNode myOther(pageSize, coverSize); 
+		PageId nextPid = node->getNextNodePtr(), prevPid = node->getPrevNodePtr(); 
+		if (nextPid > 0) {
+			if (error = myOther.read(nextPid, pf))
+				return error; 
+			if (node->getRidCount() + myOther.getRidCount() <= maxCount) {
+				leftPid = pid; 
+				rightPid = nextPid; 
+			}
+		}
+		if (!rightPid && prevPid > 0) {
+			if (error = myOther.read(prevPid, pf))
+				return error; 
+			if (node->getRidCount() + myOther.getRidCount() <= maxCount) {
+				leftPid = prevPid; 
+				rightPid = pid; 
+			}
+		}
+
+		if (rightPid) {
+			BTPostingNode& myLeft = (leftPid == pid) ? *node : myOther; 
+			BTPostingNode& myRight = (leftPid == pid) ? myOther : *node; 
+			int leftCount = myLeft.getRidCount(), rightCount = myRight.getRidCount(); 
+			vector<RecordId> rids(leftCount + rightCount + 1); 
+			vector<char> covers((leftCount + rightCount + 1)*coverSize); 
+			myLeft.readRids(0, &rids[0], leftCount, coverAt(covers, 0, coverSize)); 
+			myRight.readRids(0, &rids[leftCount], rightCount, coverAt(covers, leftCount, coverSize)); 
+			PageId behindPid = myRight.getNextNodePtr(); 
+
+			myLeft.setRids(&rids[0], leftCount + rightCount, coverAt(covers, 0, coverSize)); 
+			myLeft.setNextNodePtr(behindPid); 
+			if (error = myLeft.write(leftPid, pf))
+				return error; 
+			if (behindPid > 0) {
+				BTPostingNode myBehind(pageSize, coverSize); 
+				if (error = myBehind.read(behindPid, pf))
+					return error; 
+				myBehind.setPrevNodePtr(leftPid); 
+				if (error = myBehind.write(behindPid, pf))
+					return error; 
+			}
+			else {
+				myHead.setLastNodePtr(leftPid); 
+				if (error = myHead.write(head, pf))
+					return error; 
+			}
+			if (error = freePage(rightPid))
+				return error; 
+		}
+	}
+
+	return leaf.setListPtr(eid, head, count); 
+}
+
+/*
+ * Write sorted RecordIds of a key to new posting pages.
+ * @param key[IN] the key of the RecordIds
+ * @param rids[IN] the RecordIds
+ * @param covers[IN] the covers of the RecordIds. NULL if the index does not cover
+ * @param count[IN] # of RecordIds
+ * @param fillFactor[IN] how full the pages are made, in percent (1-100)
+ * @param head[OUT] the first page
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::writePostings(int key, const RecordId* rids, const char* covers, int count, 
+                             int fillFactor, PageId& head)
+{
+	RC error; 
+	int pageSize = pf.getPageSize(); 
+	BTPostingNode emptyNode(pageSize, coverSize); 
+	int perPage = emptyNode.getMaxRidCount() * fillFactor / 100; 
+	if (perPage < 1)
+		perPage = 1; 
+
+	// the pages are linked both ways, so their pids are needed first
+	int pageCount = (count + perPage - 1) / perPage; 
+	vector<PageId> pids(pageCount); 
+	for (int i = 0; i < pageCount; ++i)
+		pids[i] = allocatePage(); 
+
+	for (int i = 0, c = 0; i < pageCount; ++i) {
+		BTPostingNode myNode(pageSize, coverSize); 
+		int n = count / pageCount + (i < count % pageCount); 
+		myNode.setKey(key); 
+		myNode.setRids(rids + c, n, covers ? covers + c*coverSize : NULL); 
+		myNode.setPrevNodePtr((i > 0) ? pids[i - 1] : 0); 
+		myNode.setNextNodePtr((i + 1 < pageCount) ? pids[i + 1] : 0); 
+		if (i == 0)
+			myNode.setLastNodePtr(pids[pageCount - 1]); 
+		if (error = myNode.write(pids[i], pf))
+			return error; 
+		c += n; 
+	}
+
+	head = pids[0]; 
+	return 0; 
+}
+
+/*
+ * Read all RecordIds of a list of posting pages.
+ * @param head[IN] the first page
+ * @param count[IN] # of RecordIds in the list
+ * @param rids[OUT] the RecordIds
+ * @param covers[OUT] the covers of the RecordIds
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readPostings(PageId head, int count, vector<RecordId>& rids, vector<char>& covers)
+{
+	RC error; 
+	BTPostingNode myNode(pf.getPageSize(), coverSize); 
+
+	rids.clear(); 
+	covers.clear(); 
+	for (PageId pid = head; pid > 0 && (int)rids.size() < count; pid = myNode.getNextNodePtr()) {
+		if (error = myNode.read(pid, pf))
+			return error; 
+		int n = myNode.getRidCount(), old = rids.size(); 
+		rids.resize(old + n); 
+		covers.resize((old + n)*coverSize); 
+		myNode.readRids(0, &rids[old], n, coverAt(covers, old, coverSize)); 
+	}
+	return 0; 
+}
+
+/*
+ * Free the pages of a list of posting pages.
+ * @param head[IN] the first page
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::freePostings(PageId head)
+{
+	RC error; 
+	BTPostingNode myNode(pf.getPageSize(), coverSize); 
+
+	// a freed page loses its next pointer
+	vector<PageId> pids; 
+	for (PageId pid = head; pid > 0; pid = myNode.getNextNodePtr()) {
+		if (error = myNode.read(pid, pf))
+			return error; 
+		pids.push_back(pid); 
+	}
+	for (unsigned i = 0; i < pids.size(); ++i)
+		if (error = freePage(pids[i]))
+			return error; 
+	return 0; 
+}
+
+/*
+ * Read the RecordIds of a key in posting pages from a page of the list,
+ * for a cursor. The pages belong to the latch of the leaf of the key,
+ * which the caller checks afterwards.
+ * @param key[IN] the key of the list
+ * @param head[IN] the first page of the list
+ * @param count[IN] # of RecordIds in the list
+ * @param from[IN] the RecordIds behind it (in front of it if backward) are read
+ * @param backward[IN] true to read the RecordIds in descending order
+ * @param rids[OUT] the RecordIds read
+ * @param covers[OUT] the covers of the RecordIds read. may be NULL
+ * @param maxCount[IN] the max # of RecordIds to read
+ * @param listPid[IN/OUT] the page read last, where the read starts if it
+ *                        still fits. set to the page read
+ * @param found[OUT] # of RecordIds read. 0 at the end of the list
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::scanPostings(int key, PageId head, int count, const RecordId& from, bool backward, 
+                            RecordId* rids, char* covers, int maxCount, PageId& listPid, int& found)
+{
+	RC error; 
+	BTPostingNode myNode(pf.getPageSize(), coverSize); 
+	RecordId theRid; 
+	PageId pid = 0; 
+
+	// the page read last can be used if no RecordId to read is in front
+	// of it (behind it if backward)
+	found = 0; 
+	if (listPid > 0 && !myNode.read(listPid, pf) && myNode.getKey() == key && myNode.getRidCount() > 0 
+	    && myNode.readRids(backward ? myNode.getRidCount() - 1 : 0, &theRid, 1) == 1 
+	    && (backward ? !(theRid < from) : !(from < theRid)))
+		pid = listPid; 
+
+	// otherwise start from the first (or last) page
+	if (!pid) {
+		if (error = myNode.read(head, pf))
+			return error; 
+		pid = head; 
+		if (backward && myNode.getLastNodePtr() != head) {
+			pid = myNode.getLastNodePtr(); 
+			if (error = myNode.read(pid, pf))
+				return error; 
+		}
+	}
+
+	// (the pages may change under the read, so the walk is bounded)
+	for (int i = 0; i <= count; ++i) {
+		if (backward) {
+			int pos = myNode.lowerBound(from); 
+			if (pos > 0) {
+				found = (pos < maxCount) ? pos : maxCount; 
+				for (int j = 0; j < found; ++j)
+					myNode.readRids(pos - 1 - j, &rids[j], 1, covers ? covers + j*coverSize : NULL); 
+				listPid = pid; 
+				return 0; 
+			}
+			pid = myNode.getPrevNodePtr(); 
+		}
+		else {
+			int pos = myNode.upperBound(from); 
+			if (pos < myNode.getRidCount()) {
+				found = myNode.readRids(pos, rids, maxCount, covers); 
+				listPid = pid; 
+				return 0; 
+			}
+			pid = myNode.getNextNodePtr(); 
+		}
+		if (pid <= 0)
+			return 0; 
+		if (error = myNode.read(pid, pf))
+			return error; 
+	}
+	return 0; 
+}
+
+/*
+ * Take the latch of pid for writing without waiting for it.
+ * @param held[IN] the pids whose latches are held already
+ * @param heldCount[IN] # of pids in held
+ * @param taken[OUT] true if the latch was taken by this call
+ * @return false if another thread holds the latch
+ */
+bool BTreeIndex::tryLatch(PageId pid, const PageId* held, int heldCount, bool& taken)
+{
+	// two nodes may share a latch
+	taken = false; 
+	for (int i = 0; i < heldCount; ++i)
+		if (!((held[i] ^ pid) & (LATCH_STRIPES - 1)))
+			return true; 
+
+	unsigned long long version = latches[pid & (LATCH_STRIPES - 1)].load(std::memory_order_acquire); 
+	if ((version & 1) || !upgradeLatch(pid, version))
+		return false; 
+	taken = true; 
+	return true; 
+}
+
+/*
+ * Set the cursor to the first entry with a key >= cursor.lastKey (the
+ * last one with a key <= cursor.lastKey if backward).
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::relocate(IndexCursor& cursor, bool backward)
+{
+	RC error; 
+	int lastKey = cursor.lastKey; 
+	RecordId lastRid = cursor.lastRid; 
+	if (backward)
+		error = locateBackward(lastKey, cursor); 
+	else
+		error = locate(lastKey, cursor); 
+
+	// the cursor is still behind (in front of) the last pair of lastKey
+	if (cursor.lastKey == lastKey)
+		cursor.lastRid = lastRid; 
+	return (error == RC_NO_SUCH_RECORD) ? 0 : error; 
+}
+
+/*
+ * relocate() the cursor of a backward read whose leaf is gone or whose
+ * previous leaf does not link to it. A writer that splits or merges the
+ * leaves fixes the links in a moment, so the read waits for it a number
+ * of times; a link that stays broken is an error.
+ * @param relocations[IN/OUT] # of times the read relocated its cursor
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::relocateAgain(IndexCursor& cursor, int& relocations)
+{
+	if (++relocations > MAX_RELOCATIONS)
+		return RC_INVALID_FILE_FORMAT; 
+	if (relocations > 1)
+		std::this_thread::yield(); 
+	return relocate(cursor, true); 
+}
+
+/*
+ * Read the leaf pid for a read with the cursor, at the given latch version.
+ * Unpacking a packed leaf takes much longer than reading it, so the
+ * unpacked leaf is kept in the cursor for the next reads. A writer moves
+ * the version of the latch on, so the kept leaf is as good as the page
+ * while the latch keeps the version it was read at.
+ * @param myLeaf[IN] the node an unpacked leaf is read into
+ * @param leaf[OUT] the node with the leaf
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readLeaf(IndexCursor& cursor, PageId pid, unsigned long long version, 
+                        BTLeafNode& myLeaf, BTLeafNode*& leaf)
+{
+	RC error; 
+	if (!packed) {
+		leaf = &myLeaf; 
+		return myLeaf.read(pid, pf); 
+	}
+
+	if (!cursor.leaf)
+		cursor.leaf = make_shared<BTLeafNode>(pf.getPageSize(), coverSize, packed); 
+	leaf = cursor.leaf.get(); 
+	if (cursor.leafPid == pid && cursor.leafVersion == version)
+		return 0; 
+	cursor.leafPid = 0; 
+	if (error = leaf->read(pid, pf))
+		return error; 
+	cursor.leafPid = pid; 
+	cursor.leafVersion = version; 
+	return 0; 
+}
+
+/*
+ * Write a leaf built by bulkLoad().
+ * @param pf[IN] the index file
+ * @param pid[IN] the page of the leaf
+ * @param entries[IN] the entries of the leaf
+ * @param prevPid[IN] the leaf in front of it. 0 if none
+ * @param nextPid[IN] the leaf behind it. 0 if none
+ * @param coverSize[IN] the cover size of the index
+ * @param packed[IN] true if the leaves of the index are packed
+ * @return error code. 0 if no error
+ */
+static RC writeLeaf(PageFile& pf, PageId pid, const vector<BTLeafEntry>& entries, 
+                    PageId prevPid, PageId nextPid, int coverSize, bool packed)
+{
+	RC error; 
+	BTLeafNode myLeaf(pf.getPageSize(), coverSize, packed); 
+	if (error = myLeaf.setEntries(&entries[0], entries.size()))
+		return error; 
+	myLeaf.setNextNodePtr(nextPid); 
+	myLeaf.setPrevNodePtr(prevPid); 
+	return myLeaf.write(pid, pf); 
+}
+
+/*
+ * Sort the RecordIds of an entry built by bulkLoad(), with their covers.
+ * @param entry[IN/OUT] the entry
+ * @param coverSize[IN] the cover size of the index
+ */
+static void sortRids(BTLeafEntry& entry, int coverSize)
+{
+	// the RecordIds of a load come in order, unless it was appended to
+	if (is_sorted(entry.rids.begin(), entry.rids.end()))
+		return; 
+	if (!coverSize) {
+		sort(entry.rids.begin(), entry.rids.end()); 
+		return; 
+	}
+
+	vector<pair<RecordId, int> > order(entry.rids.size()); 
+	for (unsigned i = 0; i < order.size(); ++i)
+		order[i] = make_pair(entry.rids[i], (int)i); 
+	sort(order.begin(), order.end()); 
+	vector<char> covers(entry.covers.size()); 
+	for (unsigned i = 0; i < order.size(); ++i) {
+		entry.rids[i] = order[i].first; 
+		memcpy(&covers[i*coverSize], &entry.covers[order[i].second*coverSize], coverSize); 
+	}
+	entry.covers.swap(covers); 
+}
+
+/*
+ * Build the index bottom-up from sorted (key, RecordId) pairs.
+ * @param entries[IN] the pairs to load. sort() must have been called
+ * @param fillFactor[IN] how full the nodes are made, in percent (1-100)
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::bulkLoad(EntrySorter& entries, int fillFactor)
+{
+	RC error; 
+	int key; 
+	RecordId rid; 
+
+	if (!writable || fillFactor < 1 || fillFactor > 100)
+		return RC_INVALID_ATTRIBUTE; 
+
+	// the payload of the pairs is the cover of the RecordId. the covers
+	// of pairs without one are left empty
+	vector<char> cover(coverSize); 
+	char* payload = (entries.getPayloadSize() == coverSize) ? coverAt(cover, 0, coverSize) : NULL; 
+
+	// an index that already has keys grows by the usual inserts
+	if (treeHeight) {
+		while (!(error = entries.next(key, rid, payload)))
+			if (error = insertCover(key, rid, coverAt(cover, 0, coverSize)))
+				return error; 
+		return (error == RC_NO_SUCH_RECORD) ? 0 : error; 
+	}
+
+	int total = entries.size(); 
+	if (!total)
+		return 0; 
+
+	int pageSize = pf.getPageSize(); 
+	BTLeafNode emptyLeaf(pageSize, coverSize, packed); 
+	BTNonLeafNode emptyNonLeaf(pageSize); 
+	// (the entries of a leaf take various sizes, so a leaf is filled by bytes)
+	int perLeaf = emptyLeaf.getCapacity() * fillFactor / 100; 
+	// (a nonleaf node needs at least 2 children, so that it has a key)
+	int perNode = (emptyNonLeaf.getMaxKeyCount() + 1) * fillFactor / 100; 
+	if (perNode < 3)
+		perNode = 3; 
+
+	// the first key and the pid of every node of the level built last
+	vector<int> keys; 
+	vector<PageId> pids; 
+
+	// write the leaves from left to right. a leaf is written when the one
+	// behind it is started, so that it can point to it, and the last two
+	// leaves share their entries evenly if the last one is too empty.
+	// the RecordIds of a key with too many of them go to posting pages.
+	vector<BTLeafEntry> prevEntries, curEntries; 
+	PageId frontPid = 0, prevPid = 0, curPid = 0; 
+	error = entries.next(key, rid, payload); 
+	while (!error) {
+		BTLeafEntry entry; 
+		entry.key = key; 
+		entry.listPid = 0; 
+		do {
+			entry.rids.push_back(rid); 
+			entry.covers.insert(entry.covers.end(), cover.begin(), cover.end()); 
+		} while (!(error = entries.next(key, rid, payload)) && key == entry.key); 
+		if (error && error != RC_NO_SUCH_RECORD)
+			return error; 
+		sortRids(entry, coverSize); 
+		entry.count = entry.rids.size(); 
+
+		if (entry.count > emptyLeaf.getMaxListLength()) {
+			RC postingError; 
+			if (postingError = writePostings(entry.key, &entry.rids[0], coverAt(entry.covers, 0, coverSize), 
+			                                 entry.count, fillFactor, entry.listPid))
+				return postingError; 
+			entry.rids.clear(); 
+			entry.covers.clear(); 
+		}
+
+		// the leaf is full. start the next one. (the entries of a packed
+		// leaf take fewer bytes when their keys and RecordIds are close,
+		// so the size of a leaf is that of all its entries.)
+		curEntries.push_back(entry); 
+		if (curEntries.size() > 1 && (emptyLeaf.getEntriesSize(&curEntries[0], curEntries.size()) > perLeaf
+		                              || !emptyLeaf.fits(&curEntries[0], curEntries.size()))) {
+			curEntries.pop_back(); 
+			RC leafError; 
+			if (prevPid && (leafError = writeLeaf(pf, prevPid, prevEntries, frontPid, curPid, coverSize, packed)))
+				return leafError; 
+			frontPid = prevPid; 
+			prevPid = curPid; 
+			prevEntries.swap(curEntries); 
+			curEntries.clear(); 
+			curEntries.push_back(entry); 
+		}
+		if (curEntries.size() == 1) {
+			curPid = allocatePage(); 
+			keys.push_back(entry.key); 
+			pids.push_back(curPid); 
+		}
+	}
+
+	if (prevPid && emptyLeaf.getEntriesSize(&curEntries[0], curEntries.size()) < perLeaf / 2) {
+		vector<BTLeafEntry> both(prevEntries); 
+		both.insert(both.end(), curEntries.begin(), curEntries.end()); 
+		int newPrevCount = emptyLeaf.splitEntries(&both[0], both.size()); 
+		if (newPrevCount > 0) {
+			prevEntries.assign(both.begin(), both.begin() + newPrevCount); 
+			curEntries.assign(both.begin() + newPrevCount, both.end()); 
+			keys.back() = curEntries[0].key; 
+		}
+	}
+	if (prevPid && (error = writeLeaf(pf, prevPid, prevEntries, frontPid, curPid, coverSize, packed)))
+		return error; 
+	if (error = writeLeaf(pf, curPid, curEntries, prevPid, 0, coverSize, packed))
+		return error; 
+	rootPid = curPid; 
+	treeHeight = 1; 
+
+	// then build the levels above, until a level has a single node
+	while (pids.size() > 1) {
+		vector<int> upperKeys; 
+		vector<PageId> upperPids; 
+		int count = pids.size(); 
+		int nodeCount = (count + perNode - 1) / perNode; 
+		for (int i = 0, c = 0; i < nodeCount; ++i) {
+			BTNonLeafNode myNonLeaf(pageSize); 
+			int n = count / nodeCount + (i < count % nodeCount); 
+			myNonLeaf.initializeRoot(pids[c], keys[c + 1], pids[c + 1]); 
+			for (int j = 2; j < n; ++j)
+				myNonLeaf.insert(keys[c + j], pids[c + j]); 
+
+			PageId pid = allocatePage(); 
+			upperKeys.push_back(keys[c]); 
+			upperPids.push_back(pid); 
+			if (error = myNonLeaf.write(pid, pf))
+				return error; 
+			c += n; 
+		}
+		keys.swap(upperKeys); 
+		pids.swap(upperPids); 
+		++treeHeight; 
+	}
+	rootPid = pids[0]; 
+	nodeCache.clear(); 
+
+	return 0; 
+}
+
+/**
+ * Run the standard B+Tree key search algorithm and identify the
+ * leaf node where searchKey may exist. If an index entry with
+ * searchKey exists in the leaf node, set IndexCursor to its location
+ * (i.e., IndexCursor.pid = PageId of the leaf node, and
+ * IndexCursor.eid = the searchKey index entry number.) and return 0.
+ * If not, set IndexCursor.pid = PageId of the leaf node and
+ * IndexCursor.eid = the index entry immediately after the largest
+ * index key that is smaller than searchKey, and return the error
+ * code RC_NO_SUCH_RECORD.
+ * Using the returned "IndexCursor", you will have to call readForward()
+ * to retrieve the actual (key, rid) pair from the index.
+ * @param key[IN] the key to find
+ * @param cursor[OUT] the cursor pointing to the index entry with
+ *                    searchKey or immediately behind the largest key
+ *                    smaller than searchKey.
+ * @return 0 if searchKey is found. Othewise an error code
+ */
+RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+{
+	RC error;
+	PageId nextPid; 
+	int node; 
+	unsigned long long version; 
+
+	cursor.pid = -1; 
+	restart: 
+	if (error = descend(searchKey, 0, nextPid, node, version))
+		return error; 
+
+	BTLeafNode myLeafNode(pf.getPageSize(), coverSize, packed); 
+	if (error = myLeafNode.read(nextPid, pf)) {
+		if (!checkLatch(nextPid, version))
+			goto restart; 
+		return error; 
+	}
+	int myEid; 
+	error = myLeafNode.locate(searchKey, myEid);
+	IndexCursor myCursor; 
+	myCursor.pid = nextPid;
+	myCursor.eid = myEid; 
+	myCursor.lastKey = searchKey; 
+	myCursor.lastRid = FIRST_RID; 
+	myCursor.listPid = 0; 
+
+	// all keys of the leaf are < searchKey, so the next key is the first
+	// one of the next leaf
+	if (myEid == myLeafNode.getKeyCount()) {
+		myCursor.pid = myLeafNode.getNextNodePtr(); 
+		myCursor.eid = 0; 
+	}
+
+	// a writer changed the leaf while it was read
+	if (!checkLatch(nextPid, version))
+		goto restart; 
+	cursor = myCursor; 
+		 
+    return error;
+}
+
+/*
+ * Find the last index entry with a key <= searchKey.
+ * @param searchKey[IN] the key to find
+ * @param cursor[OUT] the cursor pointing to the last index entry with
+ *                    a key <= searchKey
+ * @return 0 if the key of the entry is searchKey. Othewise an error code
+ */
+RC BTreeIndex::locateBackward(int searchKey, IndexCursor& cursor)
+{
+	RC error;
+	PageId nextPid; 
+	int node; 
+	unsigned long long version; 
+
+	// the search goes to the last leaf that may hold searchKey, since a
+	// nonleaf node sends a key equal to a separator to the right.
+	// if all keys of the leaf are larger, the cursor is at entry -1 and
+	// readBackward() goes on to the previous leaf.
+	cursor.pid = -1; 
+	restart: 
+	if (error = descend(searchKey, 0, nextPid, node, version))
+		return error; 
+
+	BTLeafNode myLeafNode(pf.getPageSize(), coverSize, packed); 
+	if (error = myLeafNode.read(nextPid, pf)) {
+		if (!checkLatch(nextPid, version))
+			goto restart; 
+		return error; 
+	}
+	IndexCursor myCursor; 
+	error = myLeafNode.locateBackward(searchKey, myCursor.eid);
+	myCursor.pid = nextPid;
+	myCursor.lastKey = searchKey; 
+	myCursor.lastRid = LAST_RID; 
+	myCursor.listPid = 0; 
+
+	// all keys of the leaf are < searchKey. the cursor is behind the last
+	// one, so that the leaf holds its lastKey (see readBatchBackward())
+	if (myCursor.eid >= 0 && myCursor.eid == myLeafNode.getKeyCount() - 1 && error)
+		myLeafNode.readKey(myCursor.eid, myCursor.lastKey); 
+
+	// a writer changed the leaf while it was read
+	if (!checkLatch(nextPid, version))
+		goto restart; 
+	cursor = myCursor; 
+		 
+    return error;
+}
+
+/*
+ * locate() many keys at once, walking the tree level by level.
+ * @param keys[IN] the keys to find. sorted keys share the most nodes
+ * @param count[IN] # of keys
+ * @param cursors[OUT] the cursor locate() would set for each key
+ * @param results[OUT] what locate() would return for each key
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::locateBatch(const int* keys, int count, IndexCursor* cursors, RC* results)
+{
+	// a node to visit, and the keys keys[first..last) that go through it
+	struct Probe {
+		PageId pid; 
+		int node; 		// the nodeCache index of the node. -1 if not cached
+		unsigned long long version; 	// the latch version of the node
+		int first, last; 
+		int parent, slot; 	// the cached parent and the child slot in it
+	}; 
+	vector<Probe> probes, nextProbes; 
+	vector<PageId> pids; 
+	vector<int> nodeKeys; 
+	vector<PageId> nodePids; 
+	vector<int> retries; 	// the keys whose nodes changed while they were read
+	int pageSize = pf.getPageSize(); 
+	unsigned long long version; 
+	int height; 
+	RC error; 
+
+	for (int k = 0; k < count; ++k) {
+		cursors[k].pid = -1; 
+		results[k] = RC_NO_SUCH_RECORD; 
+	}
+	if (count <= 0)
+		return 0; 
+
+	restart: 
+	probes.clear(); 
+	version = readLatch(0); 
+	height = treeHeight; 
+	Probe root; 
+	root.pid = rootPid; 
+	root.first = 0; 
+	root.last = count; 
+	root.parent = -1; 
+	root.slot = 0; 
+	if (!checkLatch(0, version))
+		goto restart; 
+	if (!height)
+		return 0; 
+
+	root.node = -1; 
+	if (!shared && height > 1 && CACHED_LEVELS > 0) {
+		if (nodeCache.empty() && (error = cacheNode(root.pid)))
+			return error; 
+		root.node = 0; 
+	}
+	root.version = readLatch(root.pid); 
+	if (!checkLatch(0, version))
+		goto restart; 
+	probes.push_back(root); 
+
+	for (int level = 1; level < height; ++level) {
+		// start reading the nodes of the level that are not in memory
+		pids.clear(); 
+		for (unsigned p = 0; p < probes.size(); ++p)
+			if (probes[p].node < 0)
+				pids.push_back(probes[p].pid); 
+		if (pids.size())
+			pf.prefetch(&pids[0], pids.size()); 
+
+		nextProbes.clear(); 
+		for (unsigned p = 0; p < probes.size(); ++p) {
+			const Probe& probe = probes[p]; 
+			const int* myKeys; 
+			const PageId* myPids; 
+			int keyCount; 
+			if (probe.node >= 0) {
+				const CachedNode& cached = nodeCache[probe.node]; 
+				myKeys = &cached.keys[0]; 
+				myPids = &cached.pids[0]; 
+				keyCount = cached.keys.size(); 
+			}
+			else {
+				BTNonLeafNode myNonLeaf(pageSize); 
+				if (!(error = myNonLeaf.read(probe.pid, pf))) {
+					keyCount = min(myNonLeaf.getKeyCount(), myNonLeaf.getMaxKeyCount()); 
+					nodeKeys.resize(myNonLeaf.getMaxKeyCount()); 
+					nodePids.resize(myNonLeaf.getMaxKeyCount() + 1); 
+					myNonLeaf.readEntries(&nodeKeys[0], &nodePids[0]); 
+				}
+				if (!checkLatch(probe.pid, probe.version)) {
+					for (int k = probe.first; k < probe.last; ++k)
+						retries.push_back(k); 
+					continue; 
+				}
+				if (error)
+					return error; 
+				myKeys = &nodeKeys[0]; 
+				myPids = &nodePids[0]; 
+			}
+
+			// the keys between two keys of the node go to the same child
+			unsigned before = nextProbes.size(); 
+			for (int k = probe.first; k < probe.last; ) {
+				int i = KeySearch::upperBound((const char*)myKeys, sizeof(int), keyCount, keys[k]); 
+				int end = k + 1; 
+				while (end < probe.last && (i == keyCount || keys[end] < myKeys[i])
+				       && (i == 0 || keys[end] >= myKeys[i - 1]))
+					++end; 
+
+				Probe child; 
+				child.pid = myPids[i]; 
+				child.node = (probe.node >= 0) ? nodeCache[probe.node].children[i] : -1; 
+				child.version = readLatch(child.pid); 
+				child.first = k; 
+				child.last = end; 
+				child.parent = probe.node; 
+				child.slot = i; 
+				nextProbes.push_back(child); 
+				k = end; 
+			}
+
+			// the child pointers are only good if the node did not change
+			if (probe.node < 0 && !checkLatch(probe.pid, probe.version)) {
+				nextProbes.resize(before); 
+				for (int k = probe.first; k < probe.last; ++k)
+					retries.push_back(k); 
+			}
+		}
+
+		// cache the children of cached nodes that are in the top levels.
+		// (this appends to nodeCache, so it is done after the loop above)
+		if (level + 1 < height && level + 1 <= CACHED_LEVELS) {
+			for (unsigned p = 0; p < nextProbes.size(); ++p) {
+				Probe& child = nextProbes[p]; 
+				if (child.parent < 0 || child.node >= 0)
+					continue; 
+				if (error = cacheNode(child.pid))
+					return error; 
+				child.node = nodeCache.size() - 1; 
+				nodeCache[child.parent].children[child.slot] = child.node; 
+			}
+		}
+		probes.swap(nextProbes); 
+	}
+
+	// read the leaves together, then search each of them
+	pids.clear(); 
+	for (unsigned p = 0; p < probes.size(); ++p)
+		pids.push_back(probes[p].pid); 
+	pf.prefetch(&pids[0], pids.size()); 
+
+	for (unsigned p = 0; p < probes.size(); ++p) {
+		const Probe& probe = probes[p]; 
+		BTLeafNode myLeaf(pageSize, coverSize, packed); 
+		if (!(error = myLeaf.read(probe.pid, pf))) {
+			int keyCount = myLeaf.getKeyCount(); 
+			PageId nextPid = myLeaf.getNextNodePtr(); 
+			for (int k = probe.first; k < probe.last; ++k) {
+				int myEid; 
+				results[k] = myLeaf.locate(keys[k], myEid); 
+				cursors[k].pid = probe.pid; 
+				cursors[k].eid = myEid; 
+				cursors[k].lastKey = keys[k]; 
+				cursors[k].lastRid = FIRST_RID; 
+				cursors[k].listPid = 0; 
+				if (myEid == keyCount) {
+					cursors[k].pid = nextPid; 
+					cursors[k].eid = 0; 
+				}
+			}
+		}
+		if (!checkLatch(probe.pid, probe.version)) {
+			for (int k = probe.first; k < probe.last; ++k)
+				retries.push_back(k); 
+			continue; 
+		}
+		if (error)
+			return error; 
+	}
+
+	// look up the keys that met a writer one by one
+	for (unsigned r = 0; r < retries.size(); ++r)
+		results[retries[r]] = locate(keys[retries[r]], cursors[retries[r]]); 
+
+	return 0; 
+}
+
+/*
+ * Read the nonleaf node pid and append its decoded copy to nodeCache.
+ * @param pid[IN] the node to cache
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::cacheNode(PageId pid)
+{
+	BTNonLeafNode myNonLeafNode(pf.getPageSize()); 
+	RC error; 
+	if (error = myNonLeafNode.read(pid, pf))
+		return error; 
+
+	int keyCount = myNonLeafNode.getKeyCount(); 
+	CachedNode cached; 
+	cached.keys.resize(keyCount); 
+	cached.pids.resize(keyCount + 1); 
+	cached.children.assign(keyCount + 1, -1); 
+	myNonLeafNode.readEntries(&cached.keys[0], &cached.pids[0]); 
+	nodeCache.push_back(cached); 
+
+	return 0; 
+}
+
+/*
+ * Follow searchKey from the root down to the node at the given level.
+ * The nonleaf nodes of the top CACHED_LEVELS levels are looked up in their
+ * decoded copies, and are cached the first time they are reached, unless
+ * the index is shared by several threads.
+ * @param searchKey[IN] the key to follow
+ * @param level[IN] the level to stop at. 0 for a leaf, 1 for its parent
+ * @param pid[OUT] the node reached
+ * @param node[OUT] its index in nodeCache. -1 if it is not cached
+ * @param version[OUT] the version of the latch of the node
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::descend(int searchKey, int level, PageId& pid, int& node, unsigned long long& version)
+{
+	RC error; 
+	int depth; 
+
+	restart: 
+	// the root and the height, as one consistent pair
+	version = readLatch(0); 
+	pid = rootPid; 
+	depth = treeHeight - level; 
+	if (!checkLatch(0, version))
+		goto restart; 
+	if (depth < 1)
+		return RC_NO_SUCH_RECORD; 
+
+	node = -1; 
+	if (!shared && treeHeight > 1 && CACHED_LEVELS > 0) {
+		if (nodeCache.empty() && (error = cacheNode(rootPid)))
+			return error; 
+		node = 0; 
+	}
+
+	unsigned long long parentVersion = version; 
+	version = readLatch(pid); 
+	if (!checkLatch(0, parentVersion))
+		goto restart; 
+
+	for (int d = 1; d < depth; ++d) {
+		if (node < 0) {
+			// below the cached levels. read the child pointer, check that
+			// the node did not change meanwhile, and only then go on to
+			// the child, checking the node again after the child latch
+			// is read (lock coupling).
+			BTNonLeafNode myNonLeafNode(pf.getPageSize()); 
+			PageId childPid; 
+			if (!(error = myNonLeafNode.read(pid, pf)))
+				error = myNonLeafNode.locateChildPtr(searchKey, childPid); 
+			if (!checkLatch(pid, version))
+				goto restart; 
+			if (error)
+				return error; 
+
+			unsigned long long childVersion = readLatch(childPid); 
+			if (!checkLatch(pid, version))
+				goto restart; 
+			pid = childPid; 
+			version = childVersion; 
+			continue; 
+		}
+
+		// follow the entry with the largest key <= searchKey,
+		// or the leftmost child if there is no such key
+		const CachedNode& cached = nodeCache[node]; 
+		int i = KeySearch::upperBound((const char*)&cached.keys[0], sizeof(int), cached.keys.size(), searchKey); 
+		int child = cached.children[i]; 
+		pid = cached.pids[i]; 
+
+		// cache the child if it is a nonleaf node of the top levels.
+		// (this appends to nodeCache, so cached cannot be used after it)
+		if (child < 0 && d + 1 < treeHeight && d + 1 <= CACHED_LEVELS) {
+			if (error = cacheNode(pid))
+				return error; 
+			child = nodeCache.size() - 1; 
+			nodeCache[node].children[i] = child; 
+		}
+		node = child; 
+		version = readLatch(pid); 
+	}
+
+	return 0; 
+}
+
+/*
+ * Read the (key, rid) pair at the location specified by the index cursor,
+ * and move foward the cursor to the next entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location.
+ * @param rid[OUT] the RecordId stored at the index cursor location.
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
+{
+	int count; 
+	return readBatch(cursor, INT_MAX, &key, &rid, 1, count); 
+}
+
+/*
+ * Read the (key, rid) pairs from the index cursor on, up to the pairs
+ * with keys <= toKey, and move the cursor behind them.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param toKey[IN] the largest key to read
+ * @param keys[OUT] the keys read
+ * @param rids[OUT] the RecordIds read
+ * @param maxCount[IN] the max # of pairs to read
+ * @param count[OUT] # of pairs read
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readBatch(IndexCursor& cursor, int toKey, int* keys, RecordId* rids, 
+                         int maxCount, int& count, char* covers)
+{
+	BTLeafNode myLeaf(pf.getPageSize(), coverSize, packed);
+	BTLeafNode* leaf; 
+	RC error; 
+	unsigned long long version; 
+
+	count = 0; 
+	if (maxCount <= 0)
+		return RC_INVALID_ATTRIBUTE; 
+
+	restart: 
+	if (cursor.pid == 0)
+		return RC_END_OF_TREE; 
+	if (cursor.pid < 0 || cursor.eid < 0)
+		return RC_INVALID_CURSOR; 
+
+	version = readLatch(cursor.pid); 
+	if (error = readLeaf(cursor, cursor.pid, version, myLeaf, leaf)) {
+		if (!checkLatch(cursor.pid, version))
+			goto restart; 
+		// the leaf was removed
+		if (error == RC_INVALID_PID && !(error = relocate(cursor, false)))
+			goto restart; 
+		return error; 
+	}
+
+	// go on behind the pair returned last. the entries in front of it may
+	// have moved since the cursor was set, but they were all read already,
+	// and the ones behind it are in this leaf or the next ones.
+	int keyCount = leaf->getKeyCount(); 
+	PageId nextPid = leaf->getNextNodePtr(); 
+	PageId listPid = cursor.listPid; 
+	int eid, pos = 0, found = 0, theKey; 
+	if (!leaf->locate(cursor.lastKey, eid))
+		pos = leaf->ridUpperBound(eid, cursor.lastRid); 
+	while (true) {
+		found = leaf->readEntries(eid, pos, toKey, keys, rids, maxCount, covers); 
+		if (found || leaf->readKey(eid, theKey) || theKey > toKey || !leaf->getListPtr(eid))
+			break; 
+
+		// the RecordIds of the key are in posting pages
+		const RecordId& from = (theKey == cursor.lastKey) ? cursor.lastRid : FIRST_RID; 
+		if (error = scanPostings(theKey, leaf->getListPtr(eid), leaf->getRidCount(eid), from, false, 
+		                         rids, covers, maxCount, listPid, found))
+			break; 
+		if (found) {
+			for (int i = 0; i < found; ++i)
+				keys[i] = theKey; 
+			break; 
+		}
+		++eid; 
+		pos = 0; 
+	}
+
+	// a writer changed the leaf (or its posting pages) while it was read
+	if (!checkLatch(cursor.pid, version))
+		goto restart; 
+	if (error)
+		return error; 
+
+	if (found == 0) {
+		// the next key is beyond toKey
+		if (eid < keyCount)
+			return RC_END_OF_TREE; 
+		// the rest of the leaf was read already
+		cursor.pid = nextPid; 
+		cursor.eid = 0; 
+		goto restart; 
+	}
+
+	cursor.lastKey = keys[found - 1]; 
+	cursor.lastRid = rids[found - 1]; 
+	cursor.listPid = listPid; 
+	cursor.eid = eid; 
+	if (eid >= keyCount) {
+		cursor.pid = nextPid; 
+		cursor.eid = 0; 
+		// entering a new leaf. read it while this one is consumed
+		if (nextPid > 0)
+			pf.prefetch(&nextPid, 1); 
+	}
+
+	count = found; 
+	return 0; 
+}
+
+/*
+ * Read the (key, rid) pair at the location specified by the index cursor,
+ * and move the cursor back to the previous entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location
+ * @param rid[OUT] the RecordId stored at the index cursor location
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readBackward(IndexCursor& cursor, int& key, RecordId& rid)
+{
+	int count; 
+	return readBatchBackward(cursor, INT_MIN, &key, &rid, 1, count); 
+}
+
+/*
+ * Read the (key, rid) pairs from the index cursor back, down to the pairs
+ * with keys >= fromKey, in descending key order.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param fromKey[IN] the smallest key to read
+ * @param keys[OUT] the keys read
+ * @param rids[OUT] the RecordIds read
+ * @param maxCount[IN] the max # of pairs to read
+ * @param count[OUT] # of pairs read
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::readBatchBackward(IndexCursor& cursor, int fromKey, int* keys, RecordId* rids, 
+                                 int maxCount, int& count, char* covers)
+{
+	BTLeafNode myLeaf(pf.getPageSize(), coverSize, packed);
+	BTLeafNode* leaf; 
+	RC error; 
+	unsigned long long version; 
+	bool relocated = false; 
+	int relocations = 0; 	// # of times the cursor was located again
+
+	count = 0; 
+	if (maxCount <= 0)
+		return RC_INVALID_ATTRIBUTE; 
+
+	restart: 
+	if (cursor.pid == 0)
+		return RC_END_OF_TREE; 
+	if (cursor.pid < 0)
+		return RC_INVALID_CURSOR; 
+
+	version = readLatch(cursor.pid); 
+	if (error = readLeaf(cursor, cursor.pid, version, myLeaf, leaf)) {
+		if (!checkLatch(cursor.pid, version))
+			goto restart; 
+		// the leaf was removed
+		if (error == RC_INVALID_PID && !(error = relocateAgain(cursor, relocations)))
+			goto restart; 
+		return error; 
+	}
+
+	int keyCount = leaf->getKeyCount(); 
+	PageId prevPid = leaf->getPrevNodePtr(); 
+	PageId listPid = cursor.listPid; 
+	int eid, pos, found = 0, theKey; 
+
+	// the leaf holds a key >= lastKey, unless it was split or lost entries
+	// since the cursor was set. the entries in front of the cursor may have
+	// moved to another leaf then, and the cursor is located again from the
+	// last key. (once: the key may have been removed.)
+	if (!relocated && (!keyCount || (!leaf->readKey(keyCount - 1, theKey) && theKey < cursor.lastKey))) {
+		if (!checkLatch(cursor.pid, version))
+			goto restart; 
+		if (error = relocate(cursor, true))
+			return error; 
+		relocated = true; 
+		goto restart; 
+	}
+
+	// go on in front of the pair returned last
+	if (leaf->locateBackward(cursor.lastKey, eid) || leaf->getListPtr(eid))
+		pos = leaf->getRidCount(eid); 
+	else
+		pos = leaf->ridLowerBound(eid, cursor.lastRid); 
+	while (true) {
+		found = leaf->readEntriesBackward(eid, pos, fromKey, keys, rids, maxCount, covers); 
+		if (found || leaf->readKey(eid, theKey) || theKey < fromKey || !leaf->getListPtr(eid))
+			break; 
+
+		// the RecordIds of the key are in posting pages
+		const RecordId& from = (theKey == cursor.lastKey) ? cursor.lastRid : LAST_RID; 
+		if (error = scanPostings(theKey, leaf->getListPtr(eid), leaf->getRidCount(eid), from, true, 
+		                         rids, covers, maxCount, listPid, found))
+			break; 
+		if (found) {
+			for (int i = 0; i < found; ++i)
+				keys[i] = theKey; 
+			break; 
+		}
+		if (--eid >= 0)
+			pos = leaf->getRidCount(eid); 
+	}
+
+	// a writer changed the leaf (or its posting pages) while it was read
+	if (!checkLatch(cursor.pid, version))
+		goto restart; 
+	if (error)
+		return error; 
+
+	// the next key is below fromKey
+	if (found == 0 && eid >= 0)
+		return RC_END_OF_TREE; 
+
+	// the leaf is used up. go on to the previous leaf if it still links
+	// to this one; if it does not, it was split, and the cursor is
+	// located again.
+	if (found == 0) {
+		if (prevPid == 0) {
+			cursor.pid = 0; 
+			return RC_END_OF_TREE; 
+		}
+
+		unsigned long long prevVersion = readLatch(prevPid); 
+		if (error = readLeaf(cursor, prevPid, prevVersion, myLeaf, leaf)) {
+			if (!checkLatch(prevPid, prevVersion))
+				goto restart; 
+			// the previous leaf was removed
+			if (error == RC_INVALID_PID && !(error = relocateAgain(cursor, relocations)))
+				goto restart; 
+			return error; 
+		}
+		bool linked = (leaf->getNextNodePtr() == cursor.pid); 
+		keyCount = leaf->getKeyCount(); 
+		bool hasKey = !leaf->readKey(keyCount - 1, theKey); 
+		if (!checkLatch(prevPid, prevVersion))
+			goto restart; 
+		// the leaf may have taken the last entries of the previous one
+		// since it was read
+		if (!checkLatch(cursor.pid, version))
+			goto restart; 
+
+		if (!linked) {
+			if (error = relocateAgain(cursor, relocations))
+				return error; 
+			goto restart; 
+		}
+
+		// every pair of the previous leaf is in front of the cursor
+		cursor.pid = prevPid; 
+		cursor.eid = keyCount - 1; 
+		if (hasKey) {
+			cursor.lastKey = theKey; 
+			cursor.lastRid = LAST_RID; 
+		}
+		cursor.listPid = 0; 
+		goto restart; 
+	}
+
+	cursor.eid = eid; 
+	cursor.lastKey = keys[found - 1]; 
+	cursor.lastRid = rids[found - 1]; 
+	cursor.listPid = listPid; 
+	count = found; 
+
+	// leaving the leaf. read the previous one while this one is consumed
+	if ((eid < 0 || (eid == 0 && pos <= 0)) && prevPid > 0)
+		pf.prefetch(&prevPid, 1); 
+
+	return 0; 
+}
+
+/*
+ * Start reading the leaf nodes that hold the keys in [fromKey, toKey].
+ * @param fromKey[IN] the smallest key of the range
+ * @param toKey[IN] the largest key of the range
+ * @param maxCount[IN] the max # of leaves to read
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::prefetchLeaves(int fromKey, int toKey, int maxCount)
+{
+	BTNonLeafNode myNonLeafNode(pf.getPageSize()); 
+	RC error;
+
+	// go down to the parent of the leaves.
+	// (a tree with a single leaf has nothing to read ahead)
+	PageId nextPid; 
+	int node; 
+	unsigned long long version; 
+	if (maxCount <= 0)
+		return 0; 
+	if (error = descend(fromKey, 1, nextPid, node, version))
+		return (error == RC_NO_SUCH_RECORD) ? 0 : error; 
+
+	// collect the children that overlap the range and read them together
+	PageId* pids = new PageId[maxCount];
+	int count = 0; 
+	if (node >= 0) {
+		// the child fromKey leads to, and the ones after it as long as
+		// their first key is within the range
+		const CachedNode& cached = nodeCache[node]; 
+		int keyCount = cached.keys.size(); 
+		int i = KeySearch::upperBound((const char*)&cached.keys[0], sizeof(int), keyCount, fromKey); 
+		pids[count++] = cached.pids[i]; 
+		for (; i < keyCount && count < maxCount && cached.keys[i] <= toKey; ++i)
+			pids[count++] = cached.pids[i + 1]; 
+	}
+	else {
+		if (error = myNonLeafNode.read(nextPid, pf)) {
+			delete [] pids; 
+			return error; 
+		}
+		count = myNonLeafNode.readChildPtrs(fromKey, toKey, pids, maxCount);
+
+		// the pointers may be garbage if a writer changed the node.
+		// the read ahead is only a hint, so it is simply skipped then.
+		if (!checkLatch(nextPid, version))
+			count = 0; 
+	}
+	error = pf.prefetch(pids, count);
+	delete [] pids;
+
+	return error;
+}
+
+/*
+ * Tell whether several threads use the index at the same time.
+ * @param shared[IN] true if several threads use the index
+ */
+void BTreeIndex::setShared(bool shared)
+{
+	this->shared = shared; 
+	nodeCache.clear(); 
+}
+
+unsigned long long BTreeIndex::readLatch(PageId pid) const
+{
+	std::atomic<unsigned long long>& latch = latches[pid & (LATCH_STRIPES - 1)]; 
+	unsigned long long version; 
+	while ((version = latch.load(std::memory_order_acquire)) & 1)
+		std::this_thread::yield(); 
+	return version; 
+}
+
+bool BTreeIndex::checkLatch(PageId pid, unsigned long long version) const
+{
+	// the node was read before the latch is read again
+	std::atomic_thread_fence(std::memory_order_acquire); 
+	return latches[pid & (LATCH_STRIPES - 1)].load(std::memory_order_relaxed) == version; 
+}
+
+bool BTreeIndex::upgradeLatch(PageId pid, unsigned long long version)
+{
+	return latches[pid & (LATCH_STRIPES - 1)].compare_exchange_strong(version, version + 1, std::memory_order_acquire); 
+}
+
+void BTreeIndex::releaseLatch(PageId pid)
+{
+	// the writer bit is cleared and the version goes up by 2
+	latches[pid & (LATCH_STRIPES - 1)].fetch_add(1, std::memory_order_release); 
+}
+
+bool BTreeIndex::latchPath(const PageId* path, const unsigned long long* versions, int from, int to)
+{
+	for (int i = from; i < to; ++i) {
+		// a latch already taken for an earlier node of the path was read
+		// at the same version, unless a writer came in between
+		int j = from; 
+		while (j < i && ((path[j] ^ path[i]) & (LATCH_STRIPES - 1)))
+			++j; 
+		if (j < i ? versions[j] == versions[i] : upgradeLatch(path[i], versions[i]))
+			continue; 
+
+		releasePath(path, from, i); 
+		return false; 
+	}
+	return true; 
+}
+
+void BTreeIndex::releasePath(const PageId* path, int from, int to)
+{
+	for (int i = from; i < to; ++i) {
+		int j = from; 
+		while (j < i && ((path[j] ^ path[i]) & (LATCH_STRIPES - 1)))
+			++j; 
+		if (j == i)
+			releaseLatch(path[i]); 
+	}
+}
+
+/*
+ * Tell how the index is going to be accessed.
+ * @param pattern[IN] the expected access pattern
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::advise(PageFile::AccessPattern pattern) const
+{
+	return pf.advise(pattern);
 }
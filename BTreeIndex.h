@@ -10,9 +10,16 @@
 #ifndef BTREEINDEX_H
 #define BTREEINDEX_H
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "Bruinbase.h"
 #include "PageFile.h"
 #include "RecordFile.h"
+
+class EntrySorter;
+class BTLeafNode;
              
 /**
  * The data structure to point to a particular entry at a b+tree leaf node.
@@ -20,35 +27,116 @@
  * eid (the location of the index entry inside the node).
  * IndexCursor is used for index lookup and traversal.
  */
-typedef struct {
+struct IndexCursor {
   // PageId of the index entry
   PageId  pid;  
   // The entry number inside the node
   int     eid;  
-} IndexCursor;
+  // The (key, rid) pair returned last, or the key the cursor was located
+  // at with a RecordId in front of (behind, if backward) all others. A read
+  // goes on right behind (in front of) the pair, so entries moved under the
+  // cursor by another thread are neither skipped nor returned twice.
+  int      lastKey; 
+  RecordId lastRid; 
+  // The posting page the RecordIds were read from last. 0 if none
+  PageId   listPid; 
+  // The packed leaf leafPid as the last read unpacked it, at the latch
+  // version leafVersion (see BTreeIndex::readLeaf()). The position of a
+  // cursor is copied, and the leaf is not.
+  std::shared_ptr<BTLeafNode> leaf; 
+  PageId   leafPid; 
+  unsigned long long leafVersion; 
+
+  IndexCursor() : leafPid(0), leafVersion(0) {}
+  IndexCursor(const IndexCursor& other) : leafPid(0), leafVersion(0) { *this = other; }
+  IndexCursor& operator=(const IndexCursor& other)
+  {
+    pid = other.pid; 
+    eid = other.eid; 
+    lastKey = other.lastKey; 
+    lastRid = other.lastRid; 
+    listPid = other.listPid; 
+    return *this; 
+  }
+};
 
 /**
  * Implements a B-Tree index for bruinbase.
- * 
+ *
+ * Lookups and inserts may run from several threads at the same time (see
+ * setShared()). Every node has a version latch, which a writer holds while
+ * it changes the node and which moves to a new version when the writer is
+ * done. A lookup does not latch anything: it reads a node, reads the
+ * child pointer it wants, and then checks that the latches of the node
+ * and of its parent still have the versions it saw before (optimistic lock
+ * coupling). If not, a writer got in the way and the lookup starts over
+ * from the root. An insert goes down the same way and then latches only
+ * the leaf and the full nodes above it that the insert splits. A removal
+ * latches the leaf, the nodes above it that it merges, and the siblings
+ * they are merged with or take entries from. A leaf that is split or
+ * merged also latches the leaf behind it, whose previous node pointer
+ * changes.
+ *
+ * A covering index keeps the value of every record next to its RecordId
+ * in the leaves (and posting pages), so that a scan needs no table read
+ * for the values. A RecordId has a cover of a fixed size (set when the
+ * index is created): the length of the value plus one in the first byte,
+ * and the value behind it. The cover of a value too long for it has 0 in
+ * the first byte and the first bytes of the value, and the value has to
+ * be read from the table. So does the value of an all-zero cover, which
+ * is what a RecordId inserted without a value gets.
+ *
+ * A packed index keeps its leaves packed (see BTNODE_PACKED_HEADER_SIZE):
+ * the keys of a leaf and the RecordIds that are its values are stored as
+ * offsets from the smallest one, in as few bits as the largest one needs.
+ * A leaf is unpacked when it is read, so the keys and RecordIds of a few
+ * pages of the table fit several times more entries into a leaf, and the
+ * tree is lower, at the cost of unpacking every leaf that is read.
  */
 class BTreeIndex {
  public:
+  static const int DEFAULT_FILL_FACTOR = 90;  /// % of a node filled by bulkLoad()
+  static const int CACHED_LEVELS = 3;         /// # of top levels kept decoded
+                                              /// in memory while open
+  static const int DEFAULT_COVER_SIZE = 32;   /// cover size of a covering index
+  static const int MAX_COVER_SIZE = RecordFile::MAX_VALUE_LENGTH + 1;
+                                              /// a cover that keeps any value
+
   BTreeIndex();
+  ~BTreeIndex();
 
   /**
    * Open the index file in read or write mode.
    * Under 'w' mode, the index file should be created if it does not exist.
+   * Under 'm' mode, the index file is read through a memory mapping.
    * @param indexname[IN] the name of the index file
-   * @param mode[IN] 'r' for read, 'w' for write
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for memory-mapped read
+   * @param pageSize[IN] the node size of a new index. 0 for the default
+   * @param coverSize[IN] the size of the cover of a RecordId in a new
+   *                      index. 0 for an index that does not cover.
+   *                      an existing index keeps its cover size
+   * @param packed[IN] true for a new index with packed leaves. an existing
+   *                   index keeps its leaf format
    * @return error code. 0 if no error
    */
-  RC open(const std::string& indexname, char mode);
+  RC open(const std::string& indexname, char mode, int pageSize = 0, int coverSize = 0,
+          bool packed = false);
 
   /**
    * Close the index file.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * Rewrite an index built with an older node format in the current
+   * format. The keys are read from the old leaves in order and inserted
+   * into a new index, which then replaces the old file.
+   * An index in the current format is left as it is.
+   * @param indexname[IN] the name of the index file
+   * @return error code. 0 if no error
+   */
+  static RC convert(const std::string& indexname);
     
   /**
    * Insert (key, RecordId) pair to the index.
@@ -58,7 +146,82 @@ class BTreeIndex {
    */
   RC insert(int key, const RecordId& rid);
 
-  RC insert_helper(int key, const RecordId& rid, PageId currentPid, int currentHeight, int& keyToInsert, PageId& pidToInsert);
+  /**
+   * Insert (key, RecordId) pair to the index, with the value of the record
+   * for the cover of the RecordId.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @param value[IN] the value of the record
+   * @return error code. 0 if no error
+   */
+  RC insert(int key, const RecordId& rid, const std::string& value);
+
+  /**
+   * @return the size of the cover of a RecordId. 0 if the index does not cover
+   */
+  int getCoverSize() const { return coverSize; }
+
+  /**
+   * @return true if the leaves of the index are packed
+   */
+  bool isPacked() const { return packed; }
+
+  /**
+   * Make the cover of a value.
+   * @param value[IN] the value
+   * @param cover[OUT] the cover. getCoverSize() bytes
+   */
+  void makeCover(const std::string& value, char* cover) const;
+
+  /**
+   * Read the value out of a cover read with readBatch().
+   * @param cover[IN] the cover. getCoverSize() bytes
+   * @param value[OUT] the value, or the part of it kept in the cover
+   * @return true if the value is complete. false if it has to be read
+   *         from the table
+   */
+  bool readCover(const char* cover, std::string& value) const;
+
+  /**
+   * Remove (key, RecordId) pair from the index.
+   * A node left less than half full is merged with its left sibling (or
+   * its right sibling, if it is the leftmost child of its parent) when
+   * both fit in one node, and takes entries from the left sibling
+   * otherwise. A leftmost leaf does not take entries from the right,
+   * since that would move entries under a forward scan, and may stay
+   * less than half full. The root is removed when it is left with a
+   * single child, and the tree becomes one level lower.
+   * The RecordIds of a key in posting pages go back into the leaf when
+   * they fit in half of a list there. A posting page left less than a
+   * quarter full is merged with a neighbour.
+   * The pages of the removed nodes are reused for new nodes. While the
+   * index is shared, they are only collected, since a scan in another
+   * thread may still be on them, and reused after setShared(false).
+   * A cursor on a removed leaf moves on from its lastKey; a cursor kept
+   * across a removal and a later insert without setShared(true) may be
+   * on a reused page.
+   * @param key[IN] the key of the pair
+   * @param rid[IN] the RecordId of the pair
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the index
+   *         does not have the pair
+   */
+  RC remove(int key, const RecordId& rid);
+
+  /**
+   * Build the index bottom-up from sorted (key, RecordId) pairs.
+   * The leaves are packed to fillFactor percent of their capacity (in
+   * bytes) and written from left to right, followed by the nonleaf levels
+   * one by one, so the index is written in a single sequential pass. The
+   * RecordIds of a key too many for a list in a leaf go to posting pages
+   * filled to fillFactor percent, written in front of the leaf.
+   * If the index is not empty, the pairs are inserted one by one instead.
+   * A covering index takes the payloads of the pairs as the covers, if
+   * they have the cover size. Otherwise the covers are left empty.
+   * @param entries[IN] the pairs to load. sort() must have been called
+   * @param fillFactor[IN] how full the nodes are made, in percent (1-100)
+   * @return error code. 0 if no error
+   */
+  RC bulkLoad(EntrySorter& entries, int fillFactor = DEFAULT_FILL_FACTOR);
 
   /**
    * Run the standard B+Tree key search algorithm and identify the
@@ -76,13 +239,43 @@ class BTreeIndex {
    * @param cursor[OUT] the cursor pointing to the index entry with 
    *                    searchKey or immediately behind the largest key 
    *                    smaller than searchKey.
+   *                    If every key of the leaf is smaller than searchKey,
+   *                    the cursor points to the first entry of the next leaf.
    * @return 0 if searchKey is found. Othewise, an error code
    */
   RC locate(int searchKey, IndexCursor& cursor);
 
+  /**
+   * locate() many keys at once. The tree is walked level by level for all
+   * keys together: a node is read once for all the keys that pass through
+   * it, and the nodes of a level are read ahead together before any of them
+   * is searched, so their reads overlap.
+   * @param keys[IN] the keys to find. sorted keys share the most nodes
+   * @param count[IN] # of keys
+   * @param cursors[OUT] the cursor locate() would set for each key
+   * @param results[OUT] what locate() would return for each key
+   * @return error code. 0 if no error
+   */
+  RC locateBatch(const int* keys, int count, IndexCursor* cursors, RC* results);
+
+  /**
+   * Find the last index entry with a key <= searchKey, for reading the
+   * index backward from there with readBackward().
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the last index entry with
+   *                    a key <= searchKey
+   * @return 0 if the key of the entry is searchKey. Othewise, an error code
+   */
+  RC locateBackward(int searchKey, IndexCursor& cursor);
+
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
    * and move foward the cursor to the next entry.
+   * When the cursor enters a leaf, the next leaf is read in the background.
+   * The pairs of a key come out in RecordId order. If another thread
+   * removed the leaf since the cursor was set, the cursor is located again
+   * from the last pair it returned. The pairs come out in order even with
+   * concurrent inserts and removals.
    * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
    * @param key[OUT] the key stored at the index cursor location
    * @param rid[OUT] the RecordId stored at the index cursor location
@@ -90,6 +283,88 @@ class BTreeIndex {
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
 
+  /**
+   * Read the (key, rid) pairs from the index cursor on, up to the pairs
+   * with keys <= toKey, and move the cursor behind them. The pairs are
+   * copied from the leaf of the cursor with a single read, and the cursor
+   * moves on to the next leaf only when the leaf is used up, so a range
+   * scan reads every leaf once (or once per maxCount pairs). The pairs
+   * of a call all come from one leaf, or from one posting page of a key
+   * with many RecordIds. Concurrent inserts and removals are handled as
+   * in readForward().
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param toKey[IN] the largest key to read
+   * @param keys[OUT] the keys read
+   * @param rids[OUT] the RecordIds read
+   * @param maxCount[IN] the max # of pairs to read. at least 1
+   * @param count[OUT] # of pairs read
+   * @param covers[OUT] the covers of the RecordIds read, getCoverSize()
+   *                    bytes each. may be NULL
+   * @return error code. 0 if no error. RC_END_OF_TREE if no pair with
+   *         a key <= toKey is left
+   */
+  RC readBatch(IndexCursor& cursor, int toKey, int* keys, RecordId* rids, 
+               int maxCount, int& count, char* covers = NULL);
+
+  /**
+   * Read the (key, rid) pair at the location specified by the index cursor,
+   * and move the cursor back to the previous entry. The cursor moves to
+   * the previous leaf through its previous sibling pointer.
+   * Concurrent inserts and removals are handled as in readForward(), with
+   * the pairs coming out in descending order. If the leaf of the cursor
+   * was split, the cursor is located again from the last pair.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param key[OUT] the key stored at the index cursor location
+   * @param rid[OUT] the RecordId stored at the index cursor location
+   * @return error code. 0 if no error. RC_END_OF_TREE before the first entry
+   */
+  RC readBackward(IndexCursor& cursor, int& key, RecordId& rid);
+
+  /**
+   * readBatch() backward: read the (key, rid) pairs from the index cursor
+   * back, down to the pairs with keys >= fromKey, in descending key order.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param fromKey[IN] the smallest key to read
+   * @param keys[OUT] the keys read
+   * @param rids[OUT] the RecordIds read
+   * @param maxCount[IN] the max # of pairs to read. at least 1
+   * @param count[OUT] # of pairs read
+   * @param covers[OUT] the covers of the RecordIds read, getCoverSize()
+   *                    bytes each. may be NULL
+   * @return error code. 0 if no error. RC_END_OF_TREE if no pair with
+   *         a key >= fromKey is left
+   */
+  RC readBatchBackward(IndexCursor& cursor, int fromKey, int* keys, RecordId* rids, 
+                       int maxCount, int& count, char* covers = NULL);
+
+  /**
+   * Start reading the leaf nodes that hold the keys in [fromKey, toKey]
+   * into the buffer pool in the background, up to maxCount leaves. The
+   * leaves are found through the parent of the leaf where fromKey may
+   * exist, so only the leaves under that parent are read.
+   * @param fromKey[IN] the smallest key of the range
+   * @param toKey[IN] the largest key of the range
+   * @param maxCount[IN] the max # of leaves to read
+   * @return error code. 0 if no error
+   */
+  RC prefetchLeaves(int fromKey, int toKey, int maxCount);
+
+  /**
+   * Tell how the index is going to be accessed. See PageFile::advise().
+   * @param pattern[IN] the expected access pattern
+   * @return error code. 0 if no error
+   */
+  RC advise(PageFile::AccessPattern pattern) const;
+
+  /**
+   * Tell whether several threads use the index at the same time. The
+   * threads then only coordinate through the node latches, and lookups do
+   * not use the decoded top levels, since those are not covered by the
+   * latches. Call it after open() and before the threads start.
+   * @param shared[IN] true if several threads use the index
+   */
+  void setShared(bool shared);
+
   void print(); 
   //PageId   rootPid;    /// the PageId of the root node
   //int      treeHeight; /// the height of the tree
@@ -99,12 +374,231 @@ class BTreeIndex {
 
   PageId   rootPid;    /// the PageId of the root node
   int      treeHeight; /// the height of the tree
+  bool     writable;   /// true if the index was opened in 'w' mode
   /// Note that the content of the above two variables will be gone when
   /// this class is destructed. Make sure to store the values of the two 
   /// variables in disk, so that they can be reconstructed when the index
   /// is opened again later.
 
-  char buffer[PageFile::PAGE_SIZE]; 
+  char* buffer;         /// the header page. as large as a page of pf
+
+  static const int LATCH_STRIPES = 1024;  /// # of node latches
+  static const int MAX_HEIGHT = 32;       /// the max height of a tree
+  static const int MAX_RELOCATIONS = 64;  /// max # of relocate() in a read
+
+  /// the version latches of the nodes. bit 0 of a latch is set while a
+  /// writer holds it, and the version goes up by 2 when it is released.
+  /// the nodes share the latches by pid, and the latch of pid 0 (the
+  /// header page) covers rootPid and treeHeight.
+  std::atomic<unsigned long long>* latches;
+
+  bool shared;                  /// true if several threads use the index
+  std::atomic<PageId> freePid;  /// the next page a new node is written to
+  PageId freeList;              /// the first page of the list of pages of
+                                /// removed nodes. 0 if there is none
+  std::mutex freeLatch;         /// guards freeList
+  int coverSize;                /// the size of the cover of a RecordId.
+                                /// 0 if the index does not cover
+  bool packed;                  /// true if the leaves are packed
+
+  /**
+   * Insert (key, RecordId) pair with the cover of the RecordId.
+   * @param cover[IN] the cover. NULL if the index does not cover
+   * @return error code. 0 if no error
+   */
+  RC insertCover(int key, const RecordId& rid, const char* cover);
+
+  /**
+   * Wait until no writer holds the latch of pid.
+   * @return the version of the latch
+   */
+  unsigned long long readLatch(PageId pid) const;
+
+  /**
+   * @return true if the latch of pid still has the given version, i.e.,
+   *         what was read from the node since then is consistent
+   */
+  bool checkLatch(PageId pid, unsigned long long version) const;
+
+  /**
+   * Take the latch of pid for writing, if it still has the given version.
+   * @return true if the latch was taken
+   */
+  bool upgradeLatch(PageId pid, unsigned long long version);
+
+  /**
+   * Release the latch of pid taken by upgradeLatch().
+   */
+  void releaseLatch(PageId pid);
+
+  /**
+   * Take the latches of path[from..to) for writing, each if it still has
+   * the version in versions. Two nodes of the path may share a latch.
+   * @return true if all latches were taken. if not, none is held
+   */
+  bool latchPath(const PageId* path, const unsigned long long* versions, int from, int to);
+
+  /**
+   * Release the latches of path[from..to) taken by latchPath().
+   */
+  void releasePath(const PageId* path, int from, int to);
+
+  /**
+   * Insert (key, RecordId) pair with the latches of path[top..height] held,
+   * and of the leaf behind path[height] if it is split.
+   * The nodes of path[top+1..height] are full and split bottom-up.
+   * path[top] takes the last split, and a new root is made if top is 0.
+   * @return error code. 0 if no error
+   */
+  RC insertLatched(int key, const RecordId& rid, const char* cover, 
+                   const PageId* path, int top, int height);
+
+  /**
+   * Remove (key, RecordId) pair from the leaf path[height] with the latches
+   * of path[top..height], of the siblings of path[top+1..height] and of
+   * the leaf behind the merged leaves held. The nodes of
+   * path[top+1..height] are left too small by the removal and are merged
+   * bottom-up. path[top] loses the last merged child, and
+   * the root is removed if top is 0.
+   * @param slots[IN] the child slot of path[l + 1] in path[l]
+   * @return error code. 0 if no error
+   */
+  RC removeLatched(int key, const RecordId& rid, const PageId* path, const int* slots, 
+                   int top, int height);
+
+  /**
+   * Add rid to the RecordIds of the eid entry of a latched leaf, which go
+   * to posting pages (moving there if they are still in the leaf). A full
+   * page is split, unless rid comes last and starts a new last page.
+   * The posting pages belong to the latch of the leaf. The caller writes
+   * the leaf.
+   * @return error code. 0 if no error
+   */
+  RC insertPosting(BTLeafNode& leaf, int eid, const RecordId& rid, const char* cover);
+
+  /**
+   * Remove rid from the RecordIds of the eid entry of a latched leaf,
+   * which are in posting pages. The caller writes the leaf.
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if there is no rid
+   */
+  RC removePosting(BTLeafNode& leaf, int eid, const RecordId& rid);
+
+  /**
+   * Write sorted RecordIds of a key, with their covers (NULL if the index
+   * does not cover), to new posting pages.
+   * @param fillFactor[IN] how full the pages are made, in percent (1-100)
+   * @param head[OUT] the first page
+   * @return error code. 0 if no error
+   */
+  RC writePostings(int key, const RecordId* rids, const char* covers, int count, 
+                   int fillFactor, PageId& head);
+
+  /**
+   * Read all count RecordIds of the posting pages from head on, with
+   * their covers.
+   * @return error code. 0 if no error
+   */
+  RC readPostings(PageId head, int count, std::vector<RecordId>& rids, std::vector<char>& covers);
+
+  /**
+   * Free the posting pages from head on.
+   * @return error code. 0 if no error
+   */
+  RC freePostings(PageId head);
+
+  /**
+   * Read up to maxCount RecordIds of a key behind from (in front of from,
+   * in descending order, if backward) from a single posting page, for a
+   * cursor. The read starts at listPid if it is still on the right side
+   * of from, and listPid is set to the page read. found is 0 at the end
+   * of the list. The covers are read as well if covers is not NULL.
+   * The caller checks the latch of the leaf afterwards.
+   * @return error code. 0 if no error
+   */
+  RC scanPostings(int key, PageId head, int count, const RecordId& from, bool backward, 
+                  RecordId* rids, char* covers, int maxCount, PageId& listPid, int& found);
+
+  /**
+   * Take the latch of pid for writing without waiting for it.
+   * @param held[IN] the pids whose latches are held already
+   * @param heldCount[IN] # of pids in held
+   * @param taken[OUT] true if the latch was taken by this call, false if
+   *                   it is one of the latches held already
+   * @return false if another thread holds the latch
+   */
+  bool tryLatch(PageId pid, const PageId* held, int heldCount, bool& taken);
+
+  /**
+   * Set the cursor to the first entry with a key >= cursor.lastKey (the
+   * last one with a key <= cursor.lastKey if backward), when the leaf of
+   * the cursor was removed or split. cursor.lastRid is kept.
+   * @return error code. 0 if no error
+   */
+  RC relocate(IndexCursor& cursor, bool backward);
+
+  /**
+   * Read the leaf pid for a read with the cursor, at the given latch
+   * version. A packed leaf is unpacked into the cursor, and is not read
+   * again while its latch keeps the version.
+   * @param myLeaf[IN] the node an unpacked leaf is read into
+   * @param leaf[OUT] the node with the leaf
+   * @return error code. 0 if no error
+   */
+  RC readLeaf(IndexCursor& cursor, PageId pid, unsigned long long version, 
+              BTLeafNode& myLeaf, BTLeafNode*& leaf);
+
+  /**
+   * relocate() the cursor of a backward read once more, up to
+   * MAX_RELOCATIONS times in one read.
+   * @param relocations[IN/OUT] # of times the read relocated its cursor
+   * @return error code. 0 if no error
+   */
+  RC relocateAgain(IndexCursor& cursor, int& relocations);
+
+  /**
+   * @return a page no node uses, for a new node. the page of a removed
+   *         node if there is one and the index is not shared
+   */
+  PageId allocatePage();
+
+  /**
+   * Mark the page of a removed node as free, and add it to the free list.
+   * @param pid[IN] the page
+   * @return error code. 0 if no error
+   */
+  RC freePage(PageId pid);
+
+  /// a nonleaf node of the top CACHED_LEVELS levels, decoded in memory.
+  /// the nodes are cached as lookups first reach them and dropped when
+  /// an insert changes a nonleaf node.
+  struct CachedNode {
+    std::vector<int>    keys;      /// the keys of the node
+    std::vector<PageId> pids;      /// the child-node pointers, leftmost first
+    std::vector<int>    children;  /// the nodeCache index of each child.
+                                   /// -1 if the child is not cached
+  };
+
+  /**
+   * Read the nonleaf node pid and append its decoded copy to nodeCache.
+   * @param pid[IN] the node to cache
+   * @return error code. 0 if no error
+   */
+  RC cacheNode(PageId pid);
+
+  /**
+   * Follow searchKey from the root down to the node at the given level.
+   * @param searchKey[IN] the key to follow
+   * @param level[IN] the level to stop at. 0 for a leaf, 1 for its parent
+   * @param pid[OUT] the node reached
+   * @param node[OUT] its index in nodeCache. -1 if it is not cached
+   * @param version[OUT] the version of the latch of the node. the caller
+   *                     checks it after reading the node
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the tree is
+   *         not high enough to have the level
+   */
+  RC descend(int searchKey, int level, PageId& pid, int& node, unsigned long long& version);
+
+  std::vector<CachedNode> nodeCache;  /// the cached nodes. the root is first
 };
 
 #endif /* BTREEINDEX_H */
@@ -1,15 +1,140 @@
 #include "BTreeNode.h"
+#include "KeySearch.h"
 #include <iostream>
 #include <cstring>
 #include <stdio.h>
 #include <cstdlib>
+#include <algorithm>
 
 using namespace std;
 
-BTLeafNode::BTLeafNode()
-{
+/*
+ * Initialize the header of an empty node.
+ * @param buffer[IN] the node
+ * @param flags[IN] the flags of the node
+ */
+static void initializeHeader(char* buffer, short flags)
+{ 
+	memcpy(buffer, &BTNODE_VERSION, sizeof(short));
+	memcpy(buffer + 2, &flags, sizeof(short));
+	memset(buffer + 4, 0, BTNODE_HEADER_SIZE - 4);
+}
+
+/*
+ * Check the header of a node read from the disk.
+ * @param buffer[IN] the node
+ * @param flags[IN] the flags the node should have
+ * @param maxKeyCount[IN] the max number of keys in the node
+ * @return 0 if the header is valid. RC_INVALID_PID if the page is free.
+ *         RC_INVALID_FILE_FORMAT otherwise.
+ */
+static RC checkHeader(const char* buffer, short flags, int maxKeyCount)
+{ 
+	short theVersion, theFlags;
+	int keyCount;
+	memcpy(&theVersion, buffer, sizeof(short));
+	memcpy(&theFlags, buffer + 2, sizeof(short));
+	memcpy(&keyCount, buffer + 4, sizeof(int));
+
+	if (theVersion != BTNODE_VERSION)
+		return RC_INVALID_FILE_FORMAT;
+	// the node was removed, and the page is free
+	if (theFlags & BTNODE_FREE)
+		return RC_INVALID_PID;
+	if ((theFlags & (BTNODE_LEAF | BTNODE_POSTING | BTNODE_COVER | BTNODE_STRING | BTNODE_PACKED)) != flags)
+		return RC_INVALID_FILE_FORMAT;
+	if (keyCount < 0 || keyCount > maxKeyCount)
+		return RC_INVALID_FILE_FORMAT;
+	return 0; 
+}
+
+/*
+ * Find where rid goes among sorted RecordIds.
+ * @param rids[IN] the RecordIds
+ * @param count[IN] # of RecordIds
+ * @param stride[IN] the distance between two RecordIds in bytes
+ * @param rid[IN] the RecordId to search for
+ * @param upper[IN] false for the first RecordId >= rid, true for the
+ *                  first RecordId > rid
+ * @return the position of the RecordId. count if there is none
+ */
+static int searchRids(const char* rids, int count, int stride, const RecordId& rid, bool upper)
+{ 
+	int low = 0, high = count;
+	RecordId theRid;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		memcpy(&theRid, rids + mid*stride, sizeof(RecordId));
+		if (theRid < rid || (upper && theRid == rid))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low; 
+}
+
+/*
+ * Copy RecordIds out of a node. Each RecordId of the node is followed by
+ * coverSize bytes of its cover.
+ * @param from[IN] the first RecordId in the node
+ * @param count[IN] # of RecordIds
+ * @param coverSize[IN] the size of a cover
+ * @param rids[OUT] the RecordIds
+ * @param covers[OUT] the covers. may be NULL
+ */
+static void copyOutRids(const char* from, int count, int coverSize, RecordId* rids, char* covers)
+{ 
+	if (!coverSize) {
+		memcpy(rids, from, count*sizeof(RecordId));
+		return;
+	}
+	for (int i = 0; i < count; ++i, from += sizeof(RecordId) + coverSize) {
+		memcpy(&rids[i], from, sizeof(RecordId));
+		if (covers)
+			memcpy(covers + i*coverSize, from + sizeof(RecordId), coverSize);
+	}
+}
+
+/*
+ * Copy RecordIds into a node. Each RecordId of the node is followed by
+ * coverSize bytes of its cover.
+ * @param to[IN] where the first RecordId goes in the node
+ * @param count[IN] # of RecordIds
+ * @param coverSize[IN] the size of a cover
+ * @param rids[IN] the RecordIds
+ * @param covers[IN] the covers. NULL to clear them
+ */
+static void copyInRids(char* to, int count, int coverSize, const RecordId* rids, const char* covers)
+{ 
+	if (!coverSize) {
+		memcpy(to, rids, count*sizeof(RecordId));
+		return;
+	}
+	for (int i = 0; i < count; ++i, to += sizeof(RecordId) + coverSize) {
+		memcpy(to, &rids[i], sizeof(RecordId));
+		if (covers)
+			memcpy(to + sizeof(RecordId), covers + i*coverSize, coverSize);
+		else
+			memset(to + sizeof(RecordId), 0, coverSize);
+	}
+}
+
+BTLeafNode::BTLeafNode(int pageSize, int coverSize, bool packed)
+{ 
+	// a packed node is unpacked to a node of a few pages, which holds the
+	// entries of its page
+	this->packedSize = packed ? pageSize : 0;
+	this->pageSize = packed ? UNPACKED_SCALE*pageSize : pageSize;
+	this->coverSize = coverSize;
+	page = new char[this->pageSize];
+	buffer = page;
+	memset(buffer, 0, this->pageSize); 
+	initializeHeader(buffer, getFlags());
+}
 
-	memset(buffer, 0, 1024);
+BTLeafNode::~BTLeafNode()
+{ 
+	delete [] page;
 }
 
 
@@ -21,9 +146,41 @@ BTLeafNode::BTLeafNode()
  */
 RC BTLeafNode::read(PageId pid, const PageFile& pf)
 { 
-	return pf.read(pid, buffer); 
+	RC error;
+
+	// the node is as large as the pages of pf
+	if (pf.getPageSize() != (packedSize ? packedSize : pageSize)) {
+		delete [] page;
+		if (packedSize)
+			packedSize = pf.getPageSize();
+		pageSize = packedSize ? UNPACKED_SCALE*packedSize : pf.getPageSize();
+		page = new char[pageSize];
+		memset(page, 0, pageSize);
+		initializeHeader(page, getFlags());
+	}
+
+	// pin the page and work on the cached frame directly
+	if (error = pf.pin(pid, guard)) {
+		buffer = page;
+		return error;
+	}
+	if (error = checkHeader(guard.data(), getFlags(), getMaxKeyCount())) {
+		guard.release();
+		buffer = page;
+		return error;
+	}
+
+	// a packed node is unpacked, and the page is not needed any more
+	if (packedSize) {
+		buffer = page;
+		error = unpack(guard.data());
+		guard.release();
+		return error;
+	}
+	buffer = guard.data();
+	return 0; 
 }
-    
+
 /*
  * Write the content of the node to the page pid in the PageFile pf.
  * @param pid[IN] the PageId to write to
@@ -32,472 +189,2489 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
  */
 RC BTLeafNode::write(PageId pid, PageFile& pf)
 { 
-	return pf.write(pid, buffer); 
+	// if the node was read from the page pid, buffer is the cached frame
+	// itself and pf.write() only has to write it through to the disk
+	if (!packedSize)
+		return pf.write(pid, buffer); 
+
+	RC error;
+	vector<char> packed(packedSize);
+	if (error = pack(&packed[0]))
+		return error; 
+	return pf.write(pid, &packed[0]); 
 }
 
+// For leaf: Structure is: header | key | key | ... | value | value | ... | free | lists
+// For non-leaf: Structure is: header (with the leftmost pid) | key | key | ... | pid | pid | ...
+// See BTreeNode.h for the header.
 /*
  * Return the number of keys stored in the node.
  * @return the number of keys in the node
  */
 int BTLeafNode::getKeyCount()
 { 
-	int entrySize = sizeof(int) + sizeof(RecordId); 
-	int count = 0; 
-	char *temp = buffer; 
+	int count;
+	memcpy(&count, buffer + 4, sizeof(int));
+	return count; 
+}
 
-	int theKey; 
-	for (int i = 0; i < (1024 - sizeof(PageId))/entrySize; ++i) {
-		// 4 is sizeof(int)
-		memcpy(&theKey, temp, 4); 
-		if (!theKey)
-			break; 
-		++count; 
-		temp += entrySize; 
+/*
+ * Return the max number of keys that fit in the node.
+ * @return the max number of keys in the node
+ */
+int BTLeafNode::getMaxKeyCount()
+{ 
+	// this is (1024 - 16)/12 = 84 with 1KB pages. a covering node keeps
+	// even a single RecordId in a list, so a key takes its room as well.
+	// (a packed node is UNPACKED_SCALE pages here.)
+	int size = sizeof(int) + sizeof(RecordId);
+	if (coverSize)
+		size += getRidSize();
+	return (pageSize - BTNODE_HEADER_SIZE) / size;
+}
+
+/*
+ * Set the number of keys in the node header.
+ * @param count[IN] the number of keys
+ */
+void BTLeafNode::setKeyCount(int count)
+{ 
+	memcpy(buffer + 4, &count, sizeof(int));
+}
+
+/*
+ * Return the max number of RecordIds of a key kept in the node.
+ * @return the max length of a list in the node
+ */
+int BTLeafNode::getMaxListLength()
+{ 
+	// a list takes at most a quarter of the room for the values and the
+	// lists. this is (1024 - 16 - 84*4)/4/8 = 21 with 1KB pages. a packed
+	// node keeps the lists of a node of the size of its page
+	int size = packedSize ? packedSize : pageSize;
+	int keySize = sizeof(int) + sizeof(RecordId) + (coverSize ? getRidSize() : 0);
+	int space = size - BTNODE_HEADER_SIZE - (size - BTNODE_HEADER_SIZE) / keySize * sizeof(int);
+	return space / 4 / getRidSize();
+}
+
+/*
+ * @return the size of the covers of the RecordIds
+ */
+int BTLeafNode::getCoverSize()
+{ 
+	return coverSize; 
+}
+
+/*
+ * @return the flags of the node header
+ */
+short BTLeafNode::getFlags()
+{ 
+	short flags = coverSize ? (BTNODE_LEAF | BTNODE_COVER) : BTNODE_LEAF;
+	return packedSize ? (flags | BTNODE_PACKED) : flags; 
+}
+
+/*
+ * @return # of bytes a RecordId of a list takes, with its cover
+ */
+int BTLeafNode::getRidSize()
+{ 
+	return sizeof(RecordId) + coverSize; 
+}
+
+/*
+ * Find the RecordIds of the eid entry kept in the node.
+ * @param eid[IN] the entry number
+ * @param offset[OUT] the byte offset of the first RecordId
+ * @param count[OUT] # of RecordIds. 0 if they are in posting pages
+ * @return true if the RecordIds are a list
+ */
+bool BTLeafNode::getList(int eid, int& offset, int& count)
+{ 
+	int valueStart = BTNODE_HEADER_SIZE + getMaxKeyCount()*sizeof(int);
+	RecordId value;
+	memcpy(&value, buffer + valueStart + eid*sizeof(RecordId), sizeof(RecordId));
+
+	offset = 0;
+	count = 0;
+	if (value.pid >= 0) {	// a single RecordId, which is the value itself
+		offset = valueStart + eid*sizeof(RecordId);
+		count = 1;
+		return false;
 	}
+	// a list. (a node read while a writer changes it may have a broken
+	// value, which must not lead out of the node.)
+	if (value.sid > 0 && value.pid <= -valueStart && value.pid > -pageSize
+	    && value.sid <= (pageSize + value.pid) / getRidSize()) {
+		offset = -value.pid;
+		count = value.sid;
+		return true;
+	}
+	return false;
+}
 
+/*
+ * Set the value of the eid entry.
+ */
+void BTLeafNode::setValue(int eid, PageId pid, int sid)
+{ 
+	RecordId value;
+	value.pid = pid;
+	value.sid = sid;
+	memcpy(buffer + BTNODE_HEADER_SIZE + getMaxKeyCount()*sizeof(int) + eid*sizeof(RecordId), &value, sizeof(RecordId));
+}
 
-	return count; 
+/*
+ * @return the byte offset of the first list of the node
+ */
+int BTLeafNode::getListStart()
+{ 
+	int start = pageSize;
+	int keyCount = getKeyCount();
+	int offset, count;
+	for (int i = 0; i < keyCount; ++i) {
+		if (getList(i, offset, count) && offset < start)
+			start = offset;
+	}
+	return start; 
+}
+
+/*
+ * @return the byte offset where the list of the eid entry goes
+ */
+int BTLeafNode::getListEnd(int eid)
+{ 
+	int keyCount = getKeyCount();
+	int offset, count;
+	for (int i = eid + 1; i < keyCount; ++i) {
+		if (getList(i, offset, count))
+			return offset;
+	}
+	return pageSize; 
+}
+
+/*
+ * @return # of free bytes between the values and the lists
+ */
+int BTLeafNode::getFreeBytes()
+{ 
+	int valueEnd = BTNODE_HEADER_SIZE + getMaxKeyCount()*sizeof(int) + getKeyCount()*sizeof(RecordId);
+	return getListStart() - valueEnd;
+}
+
+/*
+ * Make a gap of size bytes in front of the byte offset at.
+ */
+void BTLeafNode::openGap(int eid, int at, int size)
+{ 
+	int start = getListStart();
+	memmove(buffer + start - size, buffer + start, at - start);
+
+	// the lists of the entries in front of eid moved down
+	int offset, count;
+	for (int i = 0; i < eid; ++i) {
+		if (getList(i, offset, count))
+			setValue(i, -(offset - size), count);
+	}
+}
+
+/*
+ * Close the gap of size bytes at the byte offset at.
+ */
+void BTLeafNode::closeGap(int eid, int at, int size)
+{ 
+	int start = getListStart();
+	memmove(buffer + start + size, buffer + start, at - start);
+	memset(buffer + start, 0, size);
+
+	// the lists of the entries in front of eid moved up
+	int offset, count;
+	for (int i = 0; i < eid; ++i) {
+		if (getList(i, offset, count))
+			setValue(i, -(offset + size), count);
+	}
 }
 
 /*
  * Insert a (key, rid) pair to the node.
  * @param key[IN] the key to insert
  * @param rid[IN] the RecordId to insert
+ * @param cover[IN] the cover of rid. NULL for an empty one
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTLeafNode::insert(int key, const RecordId& rid)
+RC BTLeafNode::insert(int key, const RecordId& rid, const char* cover)
 { 
-	// this is 4 + (4 + 4) = 12 
-	int entrySize = sizeof(int) + sizeof(RecordId);
+	if (!packedSize)
+		return insertRid(key, rid, cover);
 
-	int maxNumberOfEntries = (1024 - sizeof(PageId)) / entrySize;   // this is (1024 - 4)/12 = 85 
-	int keyCount = getKeyCount();
-	if (keyCount == maxNumberOfEntries)
+	// the columns of a packed node may take more bits with the pair, and
+	// the node has to fit in its page with it
+	if (getPackedBytes(key, rid) > packedSize)
 		return RC_NODE_FULL; 
+	return insertRid(key, rid, cover);
+}
 
-	char *temp = buffer; 
-	int i = 0, theKey; 
-	for (; i < (1024 - sizeof(PageId))/entrySize; ++i) {
-		memcpy(&theKey, temp, sizeof(int)); 
-		if ((!theKey) || (theKey > key) )
-			break; 
-		temp += entrySize;
-	}
-	// i is the number of items "key" is > than 
-
-	char *newBuffer = (char *)malloc(1024); 
-	memset(newBuffer, 0, 1024); 
-
-	// copy i items 
-	memcpy(newBuffer, buffer, i*entrySize); 
-	// copy "key" and "rid" 
-	memcpy(newBuffer + (i*entrySize), &key, sizeof(int)); 
-	memcpy(newBuffer + (i*entrySize) + sizeof(int), &rid, sizeof(RecordId)); 
-
-	// copy the rest (items that "key" is < than)
-	memcpy(newBuffer + (i+1)*entrySize, buffer + (i*entrySize), (keyCount - i) * entrySize); 
-	// copy the pageID of next page 
-	PageId myPageID = getNextNodePtr();
-	memcpy(newBuffer + 1024 - sizeof(PageId), &myPageID, sizeof(PageId)); 
+/*
+ * Insert a (key, rid) pair to the node, as long as it has room for the
+ * unpacked entries.
+ */
+RC BTLeafNode::insertRid(int key, const RecordId& rid, const char* cover)
+{ 
+	int keyCount = getKeyCount();
+	int ridSize = getRidSize();
+	int eid, offset, count;
+
+	// a new key. shift the items that "key" is < than, and put "key" and
+	// "rid" in the gap
+	if (locate(key, eid)) {
+		int size = sizeof(RecordId) + (coverSize ? ridSize : 0);
+		if (keyCount == getMaxKeyCount() || getFreeBytes() < size)
+			return RC_NODE_FULL; 
+
+		char *keys = buffer + BTNODE_HEADER_SIZE;
+		char *values = keys + getMaxKeyCount()*sizeof(int);
+		memmove(keys + (eid+1)*sizeof(int), keys + eid*sizeof(int), (keyCount - eid) * sizeof(int));
+		memmove(values + (eid+1)*sizeof(RecordId), values + eid*sizeof(RecordId), (keyCount - eid) * sizeof(RecordId));
+		memcpy(keys + eid*sizeof(int), &key, sizeof(int));
+		memcpy(values + eid*sizeof(RecordId), &rid, sizeof(RecordId));
+		setKeyCount(keyCount + 1);
+		if (!coverSize)
+			return 0; 
 
-	// copy the newBuffer back into buffer 
-	memcpy(buffer, newBuffer, 1024);
+		// a covering node keeps rid with its cover in a list of one.
+		// (the entry has no list while the new one is placed)
+		setValue(eid, 0, 0);
+		int at = getListEnd(eid);
+		openGap(eid, at, ridSize);
+		copyInRids(buffer + at - ridSize, 1, coverSize, &rid, cover);
+		setValue(eid, -(at - ridSize), 1);
+		return 0; 
+	}
 
-	free(newBuffer);
+	bool isList = getList(eid, offset, count);
+	if (count == 0)
+		return RC_INVALID_ATTRIBUTE; 	// the RecordIds are in posting pages
+
+	// the single RecordId of the key becomes a list of two
+	if (!isList) {
+		if (getFreeBytes() < 2*(int)sizeof(RecordId))
+			return RC_NODE_FULL; 
+		RecordId rids[2];
+		memcpy(&rids[0], buffer + offset, sizeof(RecordId));
+		rids[1] = rid;
+		if (rid < rids[0]) {
+			rids[1] = rids[0];
+			rids[0] = rid;
+		}
+		int at = getListEnd(eid);
+		openGap(eid, at, sizeof(rids));
+		memcpy(buffer + at - sizeof(rids), rids, sizeof(rids));
+		setValue(eid, -(at - (int)sizeof(rids)), 2);
+		return 0; 
+	}
 
+	// put rid behind the RecordIds of the list that are <= rid
+	if (getFreeBytes() < ridSize)
+		return RC_NODE_FULL; 
+	int at = offset + searchRids(buffer + offset, count, ridSize, rid, true)*ridSize;
+	openGap(eid, at, ridSize);
+	copyInRids(buffer + at - ridSize, 1, coverSize, &rid, cover);
+	setValue(eid, -(offset - ridSize), count + 1);
 	return 0; 
 }
 
 /*
  * Insert the (key, rid) pair to the node
- * and split the node half and half with sibling.
+ * and split the node half and half (in bytes) with sibling.
  * The first key of the sibling node is returned in siblingKey.
  * @param key[IN] the key to insert.
  * @param rid[IN] the RecordId to insert.
  * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
  * @param siblingKey[OUT] the first key in the sibling node after split.
+ * @param cover[IN] the cover of rid. NULL for an empty one
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, 
-                              BTLeafNode& sibling, int& siblingKey)
+                              BTLeafNode& sibling, int& siblingKey, const char* cover)
 { 
-	int entrySize = sizeof(int) + sizeof(RecordId);
-	int maxNumberOfEntries = (1024 - sizeof(PageId)) / entrySize;   // this is (1024-4)/12 = 85 
-	int keyCount = getKeyCount();
-	if (keyCount < maxNumberOfEntries)
-		return RC_INVALID_FILE_FORMAT;
-
-	if (sibling.getKeyCount())
+	if (sibling.getKeyCount() || sibling.pageSize != pageSize || sibling.coverSize != coverSize
+	    || sibling.packedSize != packedSize)
 		return RC_INVALID_ATTRIBUTE; 
 
-	memset(sibling.buffer, 0, 1024);
+	// the entries of the node with the new (key, rid) pair
+	vector<BTLeafEntry> entries;
+	getEntries(entries);
+	vector<char> theCover(coverSize);
+	if (cover && coverSize)
+		memcpy(&theCover[0], cover, coverSize);
+	int eid; 
+	if (locate(key, eid)) {
+		BTLeafEntry entry;
+		entry.key = key;
+		entry.count = 1;
+		entry.listPid = 0;
+		entry.rids.push_back(rid);
+		entry.covers = theCover;
+		entries.insert(entries.begin() + eid, entry);
+	}
+	else {
+		BTLeafEntry& entry = entries[eid];
+		if (entry.listPid)
+			return RC_INVALID_ATTRIBUTE; 
+		int i = upper_bound(entry.rids.begin(), entry.rids.end(), rid) - entry.rids.begin();
+		entry.rids.insert(entry.rids.begin() + i, rid);
+		entry.covers.insert(entry.covers.begin() + i*coverSize, theCover.begin(), theCover.end());
+		++entry.count;
+	}
+
+	// This is the number of entries that remain in this node 
+	int firstHalf = splitEntries(&entries[0], entries.size());
+	if (firstHalf < 0)
+		return RC_NODE_FULL; 
 
-	// This is the number of keys that remain in this node 
-	int firstHalf = (keyCount + 1) / 2;
+	memset(sibling.buffer, 0, pageSize);
+	initializeHeader(sibling.buffer, getFlags());
 
-	// Copy the secondHalf to the sibling node 
-	memcpy(sibling.buffer, buffer + (firstHalf*entrySize), 1024 - sizeof(PageId) - (firstHalf*entrySize)); 
+	// Move the secondHalf to the sibling node 
+	sibling.setEntries(&entries[firstHalf], entries.size() - firstHalf);
 	// Set the pageid of the sibling node 
 	sibling.setNextNodePtr(getNextNodePtr()); 
-
-	// Erase the secondHalf from this node 
-	std::fill(buffer + (firstHalf*entrySize), buffer + 1024 - sizeof(PageId), 0); 
-
-	// Now we insert the new (key, rid) pair
-	int theKey;
-	memcpy(&theKey, sibling.buffer, sizeof(int));
-	if (key >= theKey)
-		sibling.insert(key, rid);
-	else
-		insert(key, rid);
+	setEntries(&entries[0], firstHalf);
 
 	// Now we return the first key of the sibling node 
-	memcpy(&siblingKey, sibling.buffer, sizeof(int)); 
+	siblingKey = entries[firstHalf].key;
 
-	// Should we set the "next node pointer" of this node to the sibling node ???
-	// ... 
+	// the caller sets the "next node pointer" of this node to the sibling node,
+	// and the "previous node pointer" of the sibling node to this node
 
 	return 0; 
 }
 
-/**
- * If searchKey exists in the node, set eid to the index entry
- * with searchKey and return 0. If not, set eid to the index entry
- * immediately after the largest index key that is smaller than searchKey,
- * and return the error code RC_NO_SUCH_RECORD.
- * Remember that keys inside a B+tree node are always kept sorted.
- * @param searchKey[IN] the key to search for.
- * @param eid[OUT] the index entry number with searchKey or immediately
-                   behind the largest key smaller than searchKey.
- * @return 0 if searchKey is found. Otherwise return an error code.
+/*
+ * Tell whether a RecordId with key can be inserted without a split.
+ * @param key[IN] the key to insert
+ * @return true if the RecordId fits in the node
  */
-RC BTLeafNode::locate(int searchKey, int& eid)
-{
-	int entrySize = sizeof(int) + sizeof(RecordId);
-
-	char *temp = buffer; 
-
-	int i = 0;	// i = index entry 
-	int theKey; 
-	for (; i < getKeyCount(); ++i) {
-		memcpy(&theKey, temp, sizeof(int));
-		if (theKey == searchKey) {
-			eid = i;
-			return 0; 
-		}
-		else if (theKey > searchKey) {
-			eid = i; 
-			return RC_NO_SUCH_RECORD;  
-		}
-		temp += entrySize;
+bool BTLeafNode::hasRoom(int key, const RecordId& rid)
+{ 
+	int eid, offset, count;
+	bool room;
+	if (locate(key, eid))
+		room = getKeyCount() < getMaxKeyCount() && getFreeBytes() >= (int)sizeof(RecordId) + (coverSize ? getRidSize() : 0);
+	else {
+		// a list that is too long goes to posting pages
+		bool isList = getList(eid, offset, count);
+		if (count == 0 || count >= getMaxListLength())
+			return true; 
+		room = getFreeBytes() >= (isList ? getRidSize() : 2*(int)sizeof(RecordId));
 	}
+	if (!room || !packedSize)
+		return room; 
 
-	// At this point, searchKey is > all keys in the node 
-	eid = i;
-	return RC_NO_SUCH_RECORD; 
+	// whether a packed node still fits in its page depends on rid
+	return getPackedBytes(key, rid) <= packedSize; 
 }
 
 /*
- * Read the (key, rid) pair from the eid entry.
- * @param eid[IN] the entry number to read the (key, rid) pair from
- * @param key[OUT] the key from the entry
- * @param rid[OUT] the RecordId from the entry
- * @return 0 if successful. Return an error code if there is an error.
+ * Remove the eid entry from the node.
+ * @param eid[IN] the entry number to remove
+ * @return 0 if successful. Return an error code if there is no such entry.
  */
-RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
+RC BTLeafNode::remove(int eid)
 { 
-	// first check if eid is valid
-	if (eid < 0 || eid >= getKeyCount())
+	int keyCount = getKeyCount();
+	if (eid < 0 || eid >= keyCount)
 		return RC_NO_SUCH_RECORD; 
 
-	int entrySize = sizeof(int) + sizeof(RecordId);
+	// the list of the entry goes first
+	int offset, count;
+	if (getList(eid, offset, count))
+		closeGap(eid, offset, count*getRidSize());
 
-	memcpy(&key, buffer + (eid*entrySize), sizeof(int));
-	memcpy(&rid, buffer + (eid*entrySize) + sizeof(int), sizeof(RecordId));
+	// close the gap, and clear the entry freed at the end
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+	char *values = keys + getMaxKeyCount()*sizeof(int);
+	memmove(keys + eid*sizeof(int), keys + (eid+1)*sizeof(int), (keyCount - eid - 1) * sizeof(int));
+	memmove(values + eid*sizeof(RecordId), values + (eid+1)*sizeof(RecordId), (keyCount - eid - 1) * sizeof(RecordId));
+	memset(keys + (keyCount-1)*sizeof(int), 0, sizeof(int));
+	memset(values + (keyCount-1)*sizeof(RecordId), 0, sizeof(RecordId));
 
+	setKeyCount(keyCount - 1);
 	return 0; 
 }
 
 /*
- * Return the pid of the next slibling node.
- * @return the PageId of the next sibling node 
+ * Remove rid from the RecordIds of the eid entry.
+ * @param eid[IN] the entry number
+ * @param rid[IN] the RecordId to remove
+ * @return 0 if successful. Return an error code if there is no such RecordId.
  */
-PageId BTLeafNode::getNextNodePtr()
+RC BTLeafNode::removeRid(int eid, const RecordId& rid)
 { 
-	PageId myPageID;
-	memcpy(&myPageID, buffer + 1024 - sizeof(PageId), sizeof(PageId));
-	return myPageID; 
+	if (eid < 0 || eid >= getKeyCount())
+		return RC_NO_SUCH_RECORD; 
+
+	int offset, count;
+	getList(eid, offset, count);
+	if (count == 0)
+		return RC_INVALID_ATTRIBUTE; 	// the RecordIds are in posting pages
+
+	int ridSize = getRidSize();
+	int i = searchRids(buffer + offset, count, ridSize, rid, false);
+	RecordId theRid;
+	if (i == count)
+		return RC_NO_SUCH_RECORD; 
+	memcpy(&theRid, buffer + offset + i*ridSize, sizeof(RecordId));
+	if (theRid != rid)
+		return RC_NO_SUCH_RECORD; 
+
+	// the last RecordId of the key goes with the key
+	if (count == 1)
+		return remove(eid);
+
+	// a list of two becomes a single RecordId, unless the node covers.
+	// (in a packed node, the pid of the RecordId might take more bits.)
+	if (count == 2 && !coverSize && !packedSize) {
+		memcpy(&theRid, buffer + offset + (1-i)*sizeof(RecordId), sizeof(RecordId));
+		closeGap(eid, offset, 2*sizeof(RecordId));
+		setValue(eid, theRid.pid, theRid.sid);
+		return 0; 
+	}
+
+	closeGap(eid, offset + i*ridSize, ridSize);
+	setValue(eid, -(offset + ridSize), count - 1);
+	return 0; 
 }
 
 /*
- * Set the pid of the next slibling node.
- * @param pid[IN] the PageId of the next sibling node 
- * @return 0 if successful. Return an error code if there is an error.
+ * @return # of bytes getUsedBytes() goes down by when a RecordId kept
+ *         in the node is removed from the eid entry
  */
-RC BTLeafNode::setNextNodePtr(PageId pid)
+int BTLeafNode::getRemovedBytes(int eid)
 { 
-	// first check if pid is valid 
-	if (pid < 0)
-		return RC_INVALID_PID; 
-
-	memcpy(buffer + 1024 - sizeof(PageId), &pid, sizeof(PageId)); 
-	return 0; 
-}
+	int offset, count;
+	bool isList = getList(eid, offset, count);
 
-void BTLeafNode::print() 
-{
-	int entrySize = sizeof(int) + sizeof(RecordId);
+	// the columns of a packed node may take fewer bits as well. (a list
+	// stays one, as in removeRid().)
+	if (packedSize) {
+		if (count == 0)
+			return 0; 
+		return getPackedBytes() - getPackedBytes(eid, false, 0, count - 1, NULL); 
+	}
 
-	char *temp = buffer; 
+	// the whole entry, the list of two, or one RecordId
+	if (count == 1)
+		return sizeof(int) + sizeof(RecordId) + (isList ? getRidSize() : 0); 
+	if (count == 2 && !coverSize)
+		return 2*sizeof(RecordId); 
+	return (count > 0) ? getRidSize() : 0; 
+}
 
-	int theKey;
-	for (int i = 0; i < getKeyCount(); ++i) {
-		memcpy(&theKey, temp, sizeof(int));
-		cout << theKey << " | ";
-		temp += entrySize; 
+/*
+ * Copy out all entries of the node.
+ * @param entries[OUT] the entries, sorted by key
+ */
+void BTLeafNode::getEntries(vector<BTLeafEntry>& entries)
+{ 
+	int keyCount = getKeyCount();
+	int offset, count;
+
+	entries.resize(keyCount);
+	for (int i = 0; i < keyCount; ++i) {
+		BTLeafEntry& entry = entries[i];
+		readKey(i, entry.key);
+		entry.count = getRidCount(i);
+		entry.listPid = getListPtr(i);
+		getList(i, offset, count);
+		entry.rids.resize(count);
+		entry.covers.resize(count*coverSize);
+		if (count)
+			copyOutRids(buffer + offset, count, coverSize, &entry.rids[0], coverSize ? &entry.covers[0] : NULL);
 	}
-	cout << "[pid]" << endl;
 }
 
+/*
+ * Replace the entries of the node. The sibling pointers are kept.
+ * @param entries[IN] the entries, sorted by key
+ * @param count[IN] # of entries
+ * @return 0 if successful. Return an error code if they do not fit.
+ */
+RC BTLeafNode::setEntries(const BTLeafEntry* entries, int count)
+{ 
+	if (count < 0 || !fits(entries, count))
+		return RC_NODE_FULL; 
 
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+	memset(keys, 0, pageSize - BTNODE_HEADER_SIZE);
+
+	// the lists are packed at the end, the one of the smallest key first
+	int at = pageSize;
+	for (int i = count - 1; i >= 0; --i) {
+		const BTLeafEntry& entry = entries[i];
+		memcpy(keys + i*sizeof(int), &entry.key, sizeof(int));
+		if (entry.listPid)
+			setValue(i, -entry.listPid, -entry.count);
+		else if (entry.count == 1 && !coverSize)
+			setValue(i, entry.rids[0].pid, entry.rids[0].sid);
+		else {
+			at -= entry.count*getRidSize();
+			copyInRids(buffer + at, entry.count, coverSize, &entry.rids[0], entry.covers.empty() ? NULL : &entry.covers[0]);
+			setValue(i, -at, entry.count);
+		}
+	}
 
-
-BTNonLeafNode::BTNonLeafNode()
-{
-	memset(buffer, 0, 1024);
+	setKeyCount(count);
+	return 0; 
 }
 
-
 /*
- * Read the content of the node from the page pid in the PageFile pf.
- * @param pid[IN] the PageId to read
- * @param pf[IN] PageFile to read from
- * @return 0 if successful. Return an error code if there is an error.
+ * @return # of bytes of the values and the lists the entry takes
  */
-RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
+int BTLeafNode::getValueSize(const BTLeafEntry& entry)
 { 
-	return pf.read(pid, buffer); 
+	if (entry.listPid || (entry.count == 1 && !coverSize))
+		return sizeof(RecordId); 
+	return sizeof(RecordId) + entry.count*getRidSize(); 
 }
-    
+
 /*
- * Write the content of the node to the page pid in the PageFile pf.
- * @param pid[IN] the PageId to write to
- * @param pf[IN] PageFile to write to
- * @return 0 if successful. Return an error code if there is an error.
+ * @return # of bytes the entry takes in a node
  */
-RC BTNonLeafNode::write(PageId pid, PageFile& pf)
+int BTLeafNode::getEntrySize(const BTLeafEntry& entry)
 { 
-	return pf.write(pid, buffer); 
+	return sizeof(int) + getValueSize(entry); 
 }
 
-// For leaf: Structure is: (key,rid) | (key, rid) | ... | pid 
-// For non-leaf: Structure is: pid (4 empty bytes) | (key, pid) | (key, pid) | ... | (key, pid) 
 /*
- * Return the number of keys stored in the node.
- * @return the number of keys in the node
+ * @return # of bytes the entries take in a node
  */
-int BTNonLeafNode::getKeyCount()
-{  
-	int count = 0; 
+int BTLeafNode::getEntriesSize(const BTLeafEntry* entries, int count)
+{ 
+	if (packedSize)
+		return getPackedBytes(entries, count) - BTNODE_PACKED_HEADER_SIZE; 
 
-	int entrySize = sizeof(PageId) + sizeof(int); 	// this is 4 + 4 = 8 
+	int size = 0;
+	for (int i = 0; i < count; ++i)
+		size += getEntrySize(entries[i]);
+	return size; 
+}
 
-	char *temp = buffer + 4 + sizeof(PageId); // according to the structure above 
+/*
+ * @return true if the entries fit in one node
+ */
+bool BTLeafNode::fits(const BTLeafEntry* entries, int count)
+{ 
+	int maxKeyCount = getMaxKeyCount();
+	if (count > maxKeyCount)
+		return false; 
+
+	// the keys have their array, and the values and the lists share the rest
+	int space = pageSize - BTNODE_HEADER_SIZE - maxKeyCount*sizeof(int);
+	for (int i = 0; i < count; ++i)
+		space -= getValueSize(entries[i]);
+	if (space < 0)
+		return false; 
+
+	// a packed node has to fit in its page as well
+	return !packedSize || getPackedBytes(entries, count) <= packedSize; 
+}
 
-	int theKey; 
-	for (int i = 0; i < (1024 - sizeof(PageId))/entrySize; ++i) {	// this is (1024 - 4)/8 = 127
-		// 4 is sizeof(int) and also sizeof(PageID)
-		memcpy(&theKey, temp, sizeof(int)); 
-		if (!theKey)
-			break; 
-		++count; 
-		temp += entrySize; 
+/*
+ * Find where to split entries between two nodes.
+ * @return # of entries of the first part. -1 if there is no such split
+ */
+int BTLeafNode::splitEntries(const BTLeafEntry* entries, int count)
+{ 
+	int maxKeyCount = getMaxKeyCount();
+	int space = pageSize - BTNODE_HEADER_SIZE - maxKeyCount*sizeof(int);
+	int total = 0, totalValues = 0;
+	for (int i = 0; i < count; ++i) {
+		total += getEntrySize(entries[i]);
+		totalValues += getValueSize(entries[i]);
 	}
 
-	return count; 
+	// try every split, and take the most even one of those that fit
+	int best = -1, bestDiff = 0, size = 0, values = 0;
+	for (int i = 1; i < count; ++i) {
+		size += getEntrySize(entries[i-1]);
+		values += getValueSize(entries[i-1]);
+		if (i > maxKeyCount || count - i > maxKeyCount || values > space || totalValues - values > space)
+			continue; 
+		int diff = abs(2*size - total);
+
+		// packed nodes are split by the size of their pages
+		if (packedSize) {
+			int left = getPackedBytes(entries, i);
+			int right = getPackedBytes(entries + i, count - i);
+			if (left > packedSize || right > packedSize)
+				continue; 
+			diff = abs(left - right);
+		}
+		if (best < 0 || diff < bestDiff) {
+			best = i;
+			bestDiff = diff;
+		}
+	}
+	return best; 
 }
 
-
 /*
- * Insert a (key, pid) pair to the node.
- * @param key[IN] the key to insert
- * @param pid[IN] the PageId to insert
- * @return 0 if successful. Return an error code if the node is full.
+ * @return # of bytes the entries of the node take
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+int BTLeafNode::getUsedBytes()
+{ 
+	if (packedSize)
+		return getPackedBytes() - BTNODE_PACKED_HEADER_SIZE; 
+	return getKeyCount()*(sizeof(int) + sizeof(RecordId)) + pageSize - getListStart(); 
+}
+
+/*
+ * @return # of bytes the entries of a full node take at most
+ */
+int BTLeafNode::getCapacity()
 { 
-	// this is 4 + 4 = 8 
-	int entrySize = sizeof(int) + sizeof(PageId);
+	if (packedSize)
+		return packedSize - BTNODE_PACKED_HEADER_SIZE; 
+	return pageSize - BTNODE_HEADER_SIZE; 
+}
 
-	int maxNumberOfEntries = (1024 - sizeof(PageId)) / entrySize;   // this is (1024 - 4)/8 = 127 
+/**
+ * If searchKey exists in the node, set eid to the index entry
+ * with searchKey and return 0. If not, set eid to the index entry
+ * immediately after the largest index key that is smaller than searchKey,
+ * and return the error code RC_NO_SUCH_RECORD.
+ * Remember that keys inside a B+tree node are always kept sorted.
+ * @param searchKey[IN] the key to search for.
+ * @param eid[OUT] the index entry number with searchKey or immediately
+                   behind the largest key smaller than searchKey.
+ * @return 0 if searchKey is found. Otherwise return an error code.
+ */
+RC BTLeafNode::locate(int searchKey, int& eid)
+{ 
 	int keyCount = getKeyCount();
-	if (keyCount == maxNumberOfEntries)
-		return RC_NODE_FULL; 
+	char *keys = buffer + BTNODE_HEADER_SIZE;
 
-	char *temp = buffer + 4 + sizeof(PageId); 
-	int i = 0, theKey; 
-	for (; i < (1024 - sizeof(PageId))/entrySize; ++i) {
-		memcpy(&theKey, temp, sizeof(int)); 
-		if ((!theKey) || (theKey > key) )
-			break; 
-		temp += entrySize;
-	}
-	// i is the number of items "key" is > than 
+	// the first entry with a key >= searchKey
+	eid = KeySearch::lowerBound(keys, sizeof(int), keyCount, searchKey);
+	if (eid == keyCount)
+		return RC_NO_SUCH_RECORD; 	// searchKey is > all keys in the node
 
-	char *newBuffer = (char *)malloc(1024); 
-	memset(newBuffer, 0, 1024); 
+	int theKey; 
+	memcpy(&theKey, keys + eid*sizeof(int), sizeof(int));
+	return (theKey == searchKey) ? 0 : RC_NO_SUCH_RECORD;
+}
 
-	// copy i items (and the initial 8 bytes)
-	memcpy(newBuffer, buffer, 8 + i*entrySize); 
-	// copy "key" and "pid"
-	memcpy(newBuffer + 8 + (i*entrySize), &key, sizeof(int));
-	memcpy(newBuffer + 8 + (i*entrySize) + sizeof(int), &pid, sizeof(PageId)); 
+/*
+ * Set eid to the last index entry with a key <= searchKey,
+ * or to -1 if every key of the node is larger.
+ * @param searchKey[IN] the key to search for
+ * @param eid[OUT] the last index entry with a key <= searchKey
+ * @return 0 if the key of the entry is searchKey. Otherwise return an error code.
+ */
+RC BTLeafNode::locateBackward(int searchKey, int& eid)
+{ 
+	int keyCount = getKeyCount();
+	char *keys = buffer + BTNODE_HEADER_SIZE;
 
-	// copy the rest (items that "key" is < than)
-	memcpy(newBuffer + 8 + (i+1)*entrySize, buffer + 8 + (i*entrySize), (keyCount - i) * entrySize); 
+	// the entry in front of the first key > searchKey
+	eid = KeySearch::upperBound(keys, sizeof(int), keyCount, searchKey) - 1;
+	if (eid < 0)
+		return RC_NO_SUCH_RECORD; 	// searchKey is < all keys in the node
 
-	// copy the newBuffer back into buffer 
-	memcpy(buffer, newBuffer, 1024);
+	int theKey; 
+	memcpy(&theKey, keys + eid*sizeof(int), sizeof(int));
+	return (theKey == searchKey) ? 0 : RC_NO_SUCH_RECORD;
+}
 
-	free(newBuffer);
+/*
+ * Read the key of the eid entry.
+ * @param eid[IN] the entry number to read the key from
+ * @param key[OUT] the key from the entry
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::readKey(int eid, int& key)
+{ 
+	// first check if eid is valid
+	if (eid < 0 || eid >= getKeyCount())
+		return RC_NO_SUCH_RECORD; 
 
+	memcpy(&key, buffer + BTNODE_HEADER_SIZE + eid*sizeof(int), sizeof(int));
 	return 0; 
 }
 
 /*
- * Insert the (key, pid) pair to the node
- * and split the node half and half with sibling.
- * The middle key after the split is returned in midKey.
- * @param key[IN] the key to insert
- * @param pid[IN] the PageId to insert
- * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
- * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @return # of RecordIds of the eid entry
+ */
+int BTLeafNode::getRidCount(int eid)
+{ 
+	RecordId value;
+	if (eid < 0 || eid >= getKeyCount())
+		return 0; 
+
+	memcpy(&value, buffer + BTNODE_HEADER_SIZE + getMaxKeyCount()*sizeof(int) + eid*sizeof(RecordId), sizeof(RecordId));
+	if (value.pid >= 0)
+		return 1; 
+	return (value.sid > 0) ? value.sid : -value.sid; 
+}
+
+/*
+ * @return the first posting page of the RecordIds of the eid entry.
+ *         0 if they are kept in the node
+ */
+PageId BTLeafNode::getListPtr(int eid)
+{ 
+	RecordId value;
+	if (eid < 0 || eid >= getKeyCount())
+		return 0; 
+
+	memcpy(&value, buffer + BTNODE_HEADER_SIZE + getMaxKeyCount()*sizeof(int) + eid*sizeof(RecordId), sizeof(RecordId));
+	return (value.pid < 0 && value.sid < 0) ? -value.pid : 0; 
+}
+
+/*
+ * Move the RecordIds of the eid entry to posting pages.
+ * @param eid[IN] the entry number
+ * @param pid[IN] the first posting page
+ * @param count[IN] # of RecordIds in the posting pages
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+RC BTLeafNode::setListPtr(int eid, PageId pid, int count)
 { 
-	int entrySize = sizeof(int) + sizeof(PageId);
-	int maxNumberOfEntries = (1024 - sizeof(PageId)) / entrySize;   // this is (1024-4)/8 = 127 
-	int keyCount = getKeyCount();
-	if (keyCount < maxNumberOfEntries)
-		return RC_INVALID_FILE_FORMAT;
+	if (eid < 0 || eid >= getKeyCount() || pid <= 0 || count <= 0)
+		return RC_INVALID_ATTRIBUTE; 
+
+	// the list in the node is not needed any more
+	int offset, n;
+	if (getList(eid, offset, n))
+		closeGap(eid, offset, n*getRidSize());
+
+	setValue(eid, -pid, -count);
+	return 0; 
+}
+
+/*
+ * Replace the RecordIds of the eid entry, and keep them in the node.
+ * @param eid[IN] the entry number
+ * @param rids[IN] the RecordIds, sorted
+ * @param count[IN] # of RecordIds
+ * @param covers[IN] the covers of the RecordIds. NULL for empty ones
+ * @return 0 if successful. Return an error code if they do not fit.
+ */
+RC BTLeafNode::setRids(int eid, const RecordId* rids, int count, const char* covers)
+{ 
+	if (!packedSize)
+		return replaceRids(eid, rids, count, covers);
+
+	// as in insert(), a packed node has to fit in its page
+	if (eid < 0 || eid >= getKeyCount() || count < 1)
+		return RC_INVALID_ATTRIBUTE; 
+	const RecordId* single = (count == 1 && !coverSize) ? rids : NULL;
+	if (getPackedBytes(eid, false, 0, count, single) > packedSize)
+		return RC_NODE_FULL; 
+	return replaceRids(eid, rids, count, covers);
+}
 
-	if (sibling.getKeyCount())
+/*
+ * Replace the RecordIds of the eid entry, as long as the node has room for
+ * the unpacked entries.
+ */
+RC BTLeafNode::replaceRids(int eid, const RecordId* rids, int count, const char* covers)
+{ 
+	if (eid < 0 || eid >= getKeyCount() || count < 1)
 		return RC_INVALID_ATTRIBUTE; 
 
-	memset(sibling.buffer, 0, 1024);
+	int offset, n;
+	bool isList = getList(eid, offset, n);
+	int oldSize = isList ? n*getRidSize() : 0;
+	int newSize = (count > 1 || coverSize) ? count*getRidSize() : 0;
+	if (newSize - oldSize > getFreeBytes())
+		return RC_NODE_FULL; 
 
-	// This is the number of keys that remain in this node 
-	int firstHalf = (keyCount + 1) / 2;
+	if (oldSize)
+		closeGap(eid, offset, oldSize);
+	if (!newSize) {
+		setValue(eid, rids[0].pid, rids[0].sid);
+		return 0; 
+	}
 
-	// Now we have to find the middle key 
-	// Since the keys are sorted, 3 candidates for middle key are:
-	// Last key of the first node, first key of the sibling node, and the one
-	// we are about to insert in this function 
-	int lastKeyOfFirst, firstKeyOfSibling; 
-	memcpy(&lastKeyOfFirst, buffer + 8 + (firstHalf*entrySize) - 8, sizeof(int));
-	memcpy(&firstKeyOfSibling, buffer + 8 + (firstHalf*entrySize), sizeof(int)); 
+	// (the entry has no list while the new one is placed)
+	setValue(eid, 0, 0);
+	int at = getListEnd(eid);
+	openGap(eid, at, newSize);
+	copyInRids(buffer + at - newSize, count, coverSize, rids, covers);
+	setValue(eid, -(at - newSize), count);
+	return 0; 
+}
 
-	if (key < lastKeyOfFirst) {		// lastKeyOfFirst = middle key 
-		// set the midKey
-		midKey = lastKeyOfFirst; 
+/*
+ * Copy out RecordIds of the eid entry kept in the node.
+ * @param eid[IN] the entry number
+ * @param from[IN] the first RecordId to copy
+ * @param rids[OUT] the RecordIds
+ * @param maxCount[IN] the max # of RecordIds to copy
+ * @param covers[OUT] the covers of the RecordIds. may be NULL
+ * @return the # of RecordIds copied
+ */
+int BTLeafNode::readRids(int eid, int from, RecordId* rids, int maxCount, char* covers)
+{ 
+	if (eid < 0 || eid >= getKeyCount())
+		return 0; 
+
+	int offset, count;
+	getList(eid, offset, count);
+	if (from < 0 || from >= count)
+		return 0; 
+	if (count - from < maxCount)
+		maxCount = count - from; 
+	copyOutRids(buffer + offset + from*getRidSize(), maxCount, coverSize, rids, covers);
+	return maxCount; 
+}
+
+/*
+ * @return # of the RecordIds of the eid entry that are smaller than rid
+ */
+int BTLeafNode::ridLowerBound(int eid, const RecordId& rid)
+{ 
+	if (eid < 0 || eid >= getKeyCount())
+		return 0; 
 
-		// copy the secondHalf to the sibling node
-		memcpy(sibling.buffer + 8, buffer + 8 + (firstHalf * entrySize), 1024 - 8 - (firstHalf * entrySize) );
-		// set the head pid of the sibling node to the pid of the (lastKeyOfFirst, pid) pair of the first node 
-		memcpy(sibling.buffer, buffer + (firstHalf*entrySize) + sizeof(int), sizeof(PageId)); 
+	int offset, count;
+	getList(eid, offset, count);
+	return searchRids(buffer + offset, count, getRidSize(), rid, false); 
+}
 
-		// erase the secondHalf from this node, including the lastKeyOfFirst 
-		std::fill(buffer + (firstHalf*entrySize), buffer + 1024, 0); 
+/*
+ * @return # of the RecordIds of the eid entry that are <= rid
+ */
+int BTLeafNode::ridUpperBound(int eid, const RecordId& rid)
+{ 
+	if (eid < 0 || eid >= getKeyCount())
+		return 0; 
 
-		insert(key, pid); 
+	int offset, count;
+	getList(eid, offset, count);
+	return searchRids(buffer + offset, count, getRidSize(), rid, true); 
+}
+
+/*
+ * Copy out the (key, rid) pairs from the pos-th RecordId of the eid entry
+ * on, as long as their keys are <= toKey.
+ * @param eid[IN/OUT] the first entry to copy
+ * @param pos[IN/OUT] the first RecordId of the entry to copy
+ * @param toKey[IN] the largest key to copy
+ * @param keys[OUT] the keys
+ * @param rids[OUT] the RecordIds
+ * @param maxCount[IN] the max # of pairs to copy
+ * @param covers[OUT] the covers of the RecordIds. may be NULL
+ * @return the # of pairs copied
+ */
+int BTLeafNode::readEntries(int& eid, int& pos, int toKey, int* keys, RecordId* rids, int maxCount, char* covers)
+{
+	int keyCount = getKeyCount();
+	char *keyArray = buffer + BTNODE_HEADER_SIZE;
+	int ridSize = getRidSize();
+	int count = 0, theKey, offset, n; 
+
+	if (eid < 0 || pos < 0) {
+		eid = (eid < 0) ? 0 : eid; 
+		pos = 0; 
 	}
-	else if (key > firstKeyOfSibling) {		// firstKeyOfSibling = middle key 
-		// set the midKey
-		midKey = firstKeyOfSibling; 
 
-		// copy the secondHalf to the sibling node, except the (firstKeyOfSibling, pid) pair 
-		memcpy(sibling.buffer + 8, buffer + 8 + (firstHalf*entrySize) + entrySize, 1024 - 8 - (firstHalf*entrySize) - entrySize); 
-		// set the head pid of the sibling node to the pid of the (firstKeyOfSibling, pid) pair 
-		memcpy(sibling.buffer, buffer + 8 + (firstHalf*entrySize) + sizeof(int), sizeof(PageId));
+	// the RecordIds of an entry are in a row, whether it is the value
+	// itself or a list
+	while (eid < keyCount && count < maxCount) {
+		memcpy(&theKey, keyArray + eid*sizeof(int), sizeof(int));
+		if (theKey > toKey || getListPtr(eid))
+			break; 
+
+		getList(eid, offset, n);
+		if (pos < n) {
+			int copied = (n - pos < maxCount - count) ? n - pos : maxCount - count; 
+			copyOutRids(buffer + offset + pos*ridSize, copied, coverSize, rids + count, covers ? covers + count*coverSize : NULL);
+			for (int i = 0; i < copied; ++i)
+				keys[count + i] = theKey; 
+			count += copied; 
+			pos += copied; 
+		}
+		if (pos < n)
+			break; 
+		++eid; 
+		pos = 0; 
+	}
+	return count; 
+}
 
-		// erase the secondHalf from this node 
-		std::fill(buffer + 8 + (firstHalf*entrySize), buffer + 1024, 0); 
+/*
+ * Copy out the (key, rid) pairs in front of the pos-th RecordId of the
+ * eid entry back to the first entry, as long as their keys are >= fromKey.
+ * @param eid[IN/OUT] the first entry to copy
+ * @param pos[IN/OUT] # of RecordIds of the entry to copy
+ * @param fromKey[IN] the smallest key to copy
+ * @param keys[OUT] the keys, in descending order
+ * @param rids[OUT] the RecordIds
+ * @param maxCount[IN] the max # of pairs to copy
+ * @param covers[OUT] the covers of the RecordIds. may be NULL
+ * @return the # of pairs copied
+ */
+int BTLeafNode::readEntriesBackward(int& eid, int& pos, int fromKey, int* keys, RecordId* rids, int maxCount, char* covers)
+{
+	int keyCount = getKeyCount();
+	char *keyArray = buffer + BTNODE_HEADER_SIZE;
+	int ridSize = getRidSize();
+	int count = 0, theKey, offset, n; 
 
-		sibling.insert(key, pid); 
+	if (eid >= keyCount) {
+		eid = keyCount - 1; 
+		pos = getRidCount(eid); 
 	}
-	else {	// key = middle key 
-		// set the midKey
-		midKey = key; 
 
-		// copy the secondHalf to the sibling node
-		memcpy(sibling.buffer + 8, buffer + 8 + (firstHalf*entrySize), 1024 - 8 - (firstHalf*entrySize)); 
-		// set the head pid of the sibling node to the pid of the (key, pid) pair we are to insert in this function 
-		memcpy(sibling.buffer, &pid, sizeof(PageId));
+	while (eid >= 0 && count < maxCount) {
+		// the entry is used up
+		if (pos <= 0) {
+			if (--eid >= 0)
+				pos = getRidCount(eid); 
+			continue; 
+		}
 
-		// erase the secondHalf from this node 
-		std::fill(buffer + 8 + (firstHalf*entrySize), buffer + 1024, 0); 
+		memcpy(&theKey, keyArray + eid*sizeof(int), sizeof(int));
+		if (theKey < fromKey || getListPtr(eid))
+			break; 
 
+		getList(eid, offset, n);
+		if (pos > n)
+			pos = n; 
+		for (; pos > 0 && count < maxCount; --pos, ++count) {
+			keys[count] = theKey; 
+			copyOutRids(buffer + offset + (pos-1)*ridSize, 1, coverSize, &rids[count], covers ? covers + count*coverSize : NULL);
+		}
 	}
+	return count; 
+}
+
+/*
+ * Return the pid of the next slibling node.
+ * @return the PageId of the next sibling node 
+ */
+PageId BTLeafNode::getNextNodePtr()
+{ 
+	PageId myPageID;
+	memcpy(&myPageID, buffer + 8, sizeof(PageId));
+	return myPageID; 
+}
+
+/*
+ * Set the pid of the next slibling node.
+ * @param pid[IN] the PageId of the next sibling node 
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::setNextNodePtr(PageId pid)
+{ 
+	// first check if pid is valid 
+	if (pid < 0)
+		return RC_INVALID_PID; 
 
+	memcpy(buffer + 8, &pid, sizeof(PageId));
 	return 0; 
 }
 
 /*
- * Given the searchKey, find the child-node pointer to follow and
- * output it in pid.
- * @param searchKey[IN] the searchKey that is being looked up.
- * @param pid[OUT] the pointer to the child node to follow.
+ * Return the pid of the previous sibling node.
+ * @return the PageId of the previous sibling node 
+ */
+PageId BTLeafNode::getPrevNodePtr()
+{ 
+	PageId myPageID;
+	memcpy(&myPageID, buffer + 12, sizeof(PageId));
+	return myPageID; 
+}
+
+/*
+ * Set the pid of the previous sibling node.
+ * @param pid[IN] the PageId of the previous sibling node 
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
+RC BTLeafNode::setPrevNodePtr(PageId pid)
 { 
-	int entrySize = sizeof(int) + sizeof(PageId);
+	if (pid < 0)
+		return RC_INVALID_PID; 
 
-	char *temp = buffer + 8; 
+	memcpy(buffer + 12, &pid, sizeof(PageId));
+	return 0; 
+}
 
-	int theKey; 
-	memcpy(&pid, buffer, sizeof(PageId));
-	for (int i = 0; i < getKeyCount(); ++i) {
-		memcpy(&theKey, temp, sizeof(int));
-		if (searchKey >= theKey)
-			memcpy(&pid, temp + sizeof(int), sizeof(PageId));
-		else 
-			break; 
+/*
+ * The columns of a packed node, as copied out of the node or the entries
+ * that go to it.
+ */
+struct BTLeafNode::Columns {
+	vector<int> keys;	// the key column
+	vector<int> pids;	// the pids of the values that are RecordIds. -1 for the others
+	vector<int> sids;	// the sid column
+	vector<int> postings;	// (first posting page, # of RecordIds) of the keys in posting pages
+	int listBytes;		// # of bytes of the lists
+
+	Columns() : listBytes(0) {}
+
+	void reserve(int count)
+	{ 
+		keys.reserve(count + 1);
+		pids.reserve(count + 1);
+		sids.reserve(count + 1);
+	}
 
-		temp += entrySize;
+	void addRid(int key, const RecordId& rid)
+	{ 
+		keys.push_back(key);
+		pids.push_back(rid.pid);
+		sids.push_back(rid.sid);
 	}
 
-	return 0; 
+	void addList(int key, int count, int bytes)
+	{ 
+		keys.push_back(key);
+		pids.push_back(-1);
+		sids.push_back(count);
+		listBytes += bytes;
+	}
+
+	void addPosting(int key, PageId pid, int count)
+	{ 
+		keys.push_back(key);
+		pids.push_back(-1);
+		sids.push_back(0);
+		postings.push_back(pid);
+		postings.push_back(count);
+	}
+
+	/*
+	 * Put count RecordIds kept in the node into the i-th entry: single if
+	 * it is not NULL, and a list of them otherwise. 0 takes the entry out.
+	 */
+	void setRids(unsigned i, int count, const RecordId* single, int ridSize)
+	{ 
+		if (pids[i] < 0 && sids[i] > 0)
+			listBytes -= sids[i]*ridSize;
+		else if (pids[i] < 0) {
+			// the RecordIds were in posting pages
+			int n = 0;
+			for (unsigned j = 0; j < i; ++j)
+				n += (pids[j] < 0 && sids[j] == 0);
+			postings.erase(postings.begin() + 2*n, postings.begin() + 2*n + 2);
+		}
+
+		if (count == 0) {
+			keys.erase(keys.begin() + i);
+			pids.erase(pids.begin() + i);
+			sids.erase(sids.begin() + i);
+		}
+		else if (single) {
+			pids[i] = single->pid;
+			sids[i] = single->sid;
+		}
+		else {
+			pids[i] = -1;
+			sids[i] = count;
+			listBytes += count*ridSize;
+		}
+	}
+
+	/*
+	 * Put a new key in front of the i-th entry, with a RecordId of page 0
+	 * until setRids() sets it.
+	 */
+	void insertKey(unsigned i, int key)
+	{ 
+		keys.insert(keys.begin() + i, key);
+		pids.insert(pids.begin() + i, 0);
+		sids.insert(sids.begin() + i, 0);
+	}
+
+	/*
+	 * Find the pid base and the # of bits of the key, pid and sid columns.
+	 */
+	void frame(int& pidBase, int* bits) const
+	{ 
+		int minPid = -1, maxPid = -1;
+		unsigned maxSid = 0;
+		for (unsigned i = 0; i < pids.size(); ++i) {
+			if (pids[i] >= 0 && (minPid < 0 || pids[i] < minPid))
+				minPid = pids[i];
+			if (pids[i] > maxPid)
+				maxPid = pids[i];
+			if ((unsigned)sids[i] > maxSid)
+				maxSid = sids[i];
+		}
+
+		// the pid base is below the smallest pid, so that the values that
+		// are not RecordIds can take 0
+		pidBase = (minPid >= 0) ? minPid - 1 : 0;
+		bits[0] = keys.empty() ? 0 : KeySearch::getBitWidth(keys.front(), keys.back());
+		bits[1] = (maxPid >= 0) ? KeySearch::getBitWidth(pidBase, maxPid) : 0;
+		bits[2] = KeySearch::getBitWidth(0, maxSid);
+	}
+
+	/*
+	 * @return # of bytes of the packed node
+	 */
+	int getSize() const
+	{ 
+		int pidBase, bits[3];
+		frame(pidBase, bits);
+		int size = BTNODE_PACKED_HEADER_SIZE + postings.size()*sizeof(int) + listBytes;
+		for (int i = 0; i < 3; ++i)
+			size += KeySearch::getPackedSize(keys.size(), bits[i]);
+		return size; 
+	}
+};
+
+/*
+ * Copy the keys and the values of the node into columns.
+ */
+void BTLeafNode::getColumns(Columns& columns)
+{ 
+	int keyCount = getKeyCount();
+	int key = 0, offset, count;
+	RecordId rid;
+
+	// (one more for getPackedBytes() with a new key)
+	columns.reserve(keyCount);
+	for (int i = 0; i < keyCount; ++i) {
+		readKey(i, key);
+		bool isList = getList(i, offset, count);
+		if (!count)
+			columns.addPosting(key, getListPtr(i), getRidCount(i));
+		else if (isList)
+			columns.addList(key, count, count*getRidSize());
+		else {
+			memcpy(&rid, buffer + offset, sizeof(RecordId));
+			columns.addRid(key, rid);
+		}
+	}
 }
 
 /*
- * Initialize the root node with (pid1, key, pid2).
- * @param pid1[IN] the first PageId to insert
- * @param key[IN] the key that should be inserted between the two PageIds
- * @param pid2[IN] the PageId to insert behind the key
- * @return 0 if successful. Return an error code if there is an error.
+ * Copy the keys and the values the entries take in a node into columns.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+void BTLeafNode::getColumns(const BTLeafEntry* entries, int count, Columns& columns)
 { 
-	memset(buffer, 0, 1024); 
+	columns.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		const BTLeafEntry& entry = entries[i];
+		if (entry.listPid)
+			columns.addPosting(entry.key, entry.listPid, entry.count);
+		else if (entry.count == 1 && !coverSize)
+			columns.addRid(entry.key, entry.rids[0]);
+		else
+			columns.addList(entry.key, entry.count, entry.count*getRidSize());
+	}
+}
 
-	memcpy(buffer, &pid1, sizeof(PageId));
+/*
+ * @return # of bytes the node takes when packed
+ */
+int BTLeafNode::getPackedBytes()
+{ 
+	Columns columns;
+	getColumns(columns);
+	return columns.getSize(); 
+}
 
-	return insert(key, pid2); 
+/*
+ * @return # of bytes the entries take in a packed node
+ */
+int BTLeafNode::getPackedBytes(const BTLeafEntry* entries, int count)
+{ 
+	Columns columns;
+	getColumns(entries, count, columns);
+	return columns.getSize(); 
 }
 
-void BTNonLeafNode::print() 
-{
-	int entrySize = sizeof(int) + sizeof(PageId);
+/*
+ * @return # of bytes the node takes when packed, with count RecordIds kept
+ *         in the eid entry (single if not NULL). if newKey, the entry is a
+ *         new one of key in front of the eid entry
+ */
+int BTLeafNode::getPackedBytes(int eid, bool newKey, int key, int count, const RecordId* single)
+{ 
+	Columns columns;
+	getColumns(columns);
+	if (newKey)
+		columns.insertKey(eid, key);
+	columns.setRids(eid, count, single, getRidSize());
+	return columns.getSize(); 
+}
 
-	char *temp = buffer + 8; 
+/*
+ * @return # of bytes the node takes when packed, with (key, rid) inserted
+ *         as insertRid() does
+ */
+int BTLeafNode::getPackedBytes(int key, const RecordId& rid)
+{ 
+	int eid, offset, count;
+	if (locate(key, eid))
+		return getPackedBytes(eid, true, key, 1, coverSize ? NULL : &rid); 
+	getList(eid, offset, count);
+	if (count == 0)
+		return getPackedBytes(); 	// the RecordId goes to posting pages
+	return getPackedBytes(eid, false, key, count + 1, NULL); 
+}
 
-	int theKey;
-	for (int i = 0; i < getKeyCount(); ++i) {
-		memcpy(&theKey, temp, sizeof(int));
-		cout << theKey << " | ";
-		temp += entrySize; 
+/*
+ * Pack the node into a page.
+ * @param to[OUT] the page
+ * @return 0 if successful. RC_NODE_FULL if the node does not fit.
+ */
+RC BTLeafNode::pack(char* to)
+{ 
+	Columns columns;
+	getColumns(columns);
+	if (columns.getSize() > packedSize)
+		return RC_NODE_FULL; 
+
+	int keyCount = columns.keys.size();
+	int keyBase = keyCount ? columns.keys[0] : 0;
+	int pidBase, bits[3];
+	columns.frame(pidBase, bits);
+	memset(to, 0, packedSize);
+	memcpy(to, buffer, BTNODE_HEADER_SIZE);
+	memcpy(to + 16, &keyBase, sizeof(int));
+	memcpy(to + 20, &pidBase, sizeof(int));
+	for (int i = 0; i < 3; ++i)
+		to[24 + i] = bits[i];
+
+	// the values that are not RecordIds take 0 in the pid column
+	for (int i = 0; i < keyCount; ++i) {
+		if (columns.pids[i] < 0)
+			columns.pids[i] = pidBase;
 	}
-	cout << endl;
-}
\ No newline at end of file
+
+	char *at = to + BTNODE_PACKED_HEADER_SIZE;
+	KeySearch::pack(columns.keys.data(), keyCount, keyBase, bits[0], at);
+	at += KeySearch::getPackedSize(keyCount, bits[0]);
+	KeySearch::pack(columns.pids.data(), keyCount, pidBase, bits[1], at);
+	at += KeySearch::getPackedSize(keyCount, bits[1]);
+	KeySearch::pack(columns.sids.data(), keyCount, 0, bits[2], at);
+	at += KeySearch::getPackedSize(keyCount, bits[2]);
+	memcpy(at, columns.postings.data(), columns.postings.size()*sizeof(int));
+
+	// the lists stay at the end of the page
+	memcpy(to + packedSize - columns.listBytes, buffer + pageSize - columns.listBytes, columns.listBytes);
+	return 0; 
+}
+
+/*
+ * Unpack a page into the node.
+ * @param from[IN] the page
+ * @return 0 if successful. RC_INVALID_FILE_FORMAT if the page is broken.
+ */
+RC BTLeafNode::unpack(const char* from)
+{ 
+	int keyCount, keyBase, pidBase, bits[3];
+	memcpy(&keyCount, from + 4, sizeof(int));
+	memcpy(&keyBase, from + 16, sizeof(int));
+	memcpy(&pidBase, from + 20, sizeof(int));
+	for (int i = 0; i < 3; ++i) {
+		bits[i] = (unsigned char)from[24 + i];
+		if (bits[i] > 32)
+			return RC_INVALID_FILE_FORMAT; 
+	}
+
+	// (a page read while a writer changes it may be broken, which must
+	// not lead out of the page or the node.)
+	int at = BTNODE_PACKED_HEADER_SIZE;
+	for (int i = 0; i < 3; ++i)
+		at += KeySearch::getPackedSize(keyCount, bits[i]);
+	if (keyCount < 0 || keyCount > getMaxKeyCount() || at > packedSize)
+		return RC_INVALID_FILE_FORMAT; 
+
+	vector<int> keys(keyCount), pids(keyCount), sids(keyCount);
+	const char *column = from + BTNODE_PACKED_HEADER_SIZE;
+	KeySearch::unpack(column, keyCount, keyBase, bits[0], keys.data());
+	column += KeySearch::getPackedSize(keyCount, bits[0]);
+	KeySearch::unpack(column, keyCount, pidBase, bits[1], pids.data());
+	column += KeySearch::getPackedSize(keyCount, bits[1]);
+	KeySearch::unpack(column, keyCount, 0, bits[2], sids.data());
+
+	// the lists and the posting pages
+	int ridSize = getRidSize();
+	long listBytes = 0, postings = 0;
+	for (int i = 0; i < keyCount; ++i) {
+		if (pids[i] != pidBase)
+			continue; 
+		if (sids[i] < 0)
+			return RC_INVALID_FILE_FORMAT; 
+		if (sids[i] > 0)
+			listBytes += (long)sids[i]*ridSize;
+		else
+			++postings;
+	}
+	long valueEnd = BTNODE_HEADER_SIZE + getMaxKeyCount()*sizeof(int) + keyCount*sizeof(RecordId);
+	if (at + postings*2*(long)sizeof(int) + listBytes > packedSize || valueEnd + listBytes > pageSize)
+		return RC_INVALID_FILE_FORMAT; 
+
+	memset(page, 0, pageSize);
+	memcpy(page, from, BTNODE_HEADER_SIZE);
+	memcpy(page + BTNODE_HEADER_SIZE, keys.data(), keyCount*sizeof(int));
+
+	// the lists are packed at the end of the node, the one of the smallest
+	// key first, as in the page
+	int listAt = pageSize - listBytes;
+	const char *posting = from + at;
+	for (int i = 0; i < keyCount; ++i) {
+		if (pids[i] != pidBase)
+			setValue(i, pids[i], sids[i]);
+		else if (sids[i] > 0) {
+			setValue(i, -listAt, sids[i]);
+			listAt += sids[i]*ridSize;
+		}
+		else {
+			int pid, count;
+			memcpy(&pid, posting, sizeof(int));
+			memcpy(&count, posting + sizeof(int), sizeof(int));
+			posting += 2*sizeof(int);
+			setValue(i, -pid, -count);
+		}
+	}
+	memcpy(page + pageSize - listBytes, from + packedSize - listBytes, listBytes);
+	return 0; 
+}
+
+void BTLeafNode::print() 
+{ 
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+
+	int theKey; 
+	int keyCount = getKeyCount();
+	for (int i = 0; i < keyCount; ++i) {
+		memcpy(&theKey, keys + i*sizeof(int), sizeof(int)); 
+		cout << theKey << " | ";
+	}
+	cout << "[pid]" << endl;
+}
+
+
+
+
+BTNonLeafNode::BTNonLeafNode(int pageSize)
+{ 
+	this->pageSize = pageSize;
+	page = new char[pageSize];
+	buffer = page;
+	memset(buffer, 0, pageSize); 
+	initializeHeader(buffer, 0);
+}
+
+BTNonLeafNode::~BTNonLeafNode()
+{ 
+	delete [] page;
+}
+
+
+/*
+ * Read the content of the node from the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
+{ 
+	RC error;
+
+	// the node is as large as the pages of pf
+	if (pf.getPageSize() != pageSize) {
+		delete [] page;
+		pageSize = pf.getPageSize();
+		page = new char[pageSize];
+		memset(page, 0, pageSize);
+		initializeHeader(page, 0);
+	}
+
+	// pin the page and work on the cached frame directly
+	if (error = pf.pin(pid, guard)) {
+		buffer = page;
+		return error;
+	}
+	if (error = checkHeader(guard.data(), 0, getMaxKeyCount())) {
+		guard.release();
+		buffer = page;
+		return error;
+	}
+	buffer = guard.data();
+	return 0; 
+}
+
+/*
+ * Write the content of the node to the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::write(PageId pid, PageFile& pf)
+{ 
+	// if the node was read from the page pid, buffer is the cached frame
+	// itself and pf.write() only has to write it through to the disk
+	return pf.write(pid, buffer); 
+}
+
+/*
+ * Return the number of keys stored in the node.
+ * @return the number of keys in the node
+ */
+int BTNonLeafNode::getKeyCount()
+{ 
+	int count;
+	memcpy(&count, buffer + 4, sizeof(int));
+	return count; 
+}
+
+/*
+ * Return the max number of keys that fit in the node.
+ * @return the max number of keys in the node
+ */
+int BTNonLeafNode::getMaxKeyCount()
+{ 
+	// this is (1024 - 16)/8 = 126 with 1KB pages
+	return (pageSize - BTNODE_HEADER_SIZE) / (sizeof(int) + sizeof(PageId));
+}
+
+/*
+ * Set the number of keys in the node header.
+ * @param count[IN] the number of keys
+ */
+void BTNonLeafNode::setKeyCount(int count)
+{ 
+	memcpy(buffer + 4, &count, sizeof(int));
+}
+
+
+/*
+ * Insert a (key, pid) pair to the node.
+ * @param key[IN] the key to insert
+ * @param pid[IN] the PageId to insert
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTNonLeafNode::insert(int key, PageId pid)
+{ 
+	int keyCount = getKeyCount();
+	if (keyCount == getMaxKeyCount())
+		return RC_NODE_FULL; 
+
+	// i is the number of items "key" is >= than
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+	char *pids = keys + getMaxKeyCount()*sizeof(int);
+	int i = KeySearch::upperBound(keys, sizeof(int), keyCount, key);
+
+	// shift the items that "key" is < than, and put "key" and "pid" in the gap
+	memmove(keys + (i+1)*sizeof(int), keys + i*sizeof(int), (keyCount - i) * sizeof(int));
+	memmove(pids + (i+1)*sizeof(PageId), pids + i*sizeof(PageId), (keyCount - i) * sizeof(PageId));
+	memcpy(keys + i*sizeof(int), &key, sizeof(int));
+	memcpy(pids + i*sizeof(PageId), &pid, sizeof(PageId));
+
+	setKeyCount(keyCount + 1);
+	return 0; 
+}
+
+/*
+ * Insert the (key, pid) pair to the node
+ * and split the node half and half with sibling.
+ * The middle key after the split is returned in midKey.
+ * @param key[IN] the key to insert
+ * @param pid[IN] the PageId to insert
+ * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
+ * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+{ 
+	int maxKeyCount = getMaxKeyCount();
+	int keyCount = getKeyCount();
+	if (keyCount < maxKeyCount)
+		return RC_INVALID_FILE_FORMAT;
+
+	if (sibling.getKeyCount() || sibling.pageSize != pageSize)
+		return RC_INVALID_ATTRIBUTE; 
+
+	memset(sibling.buffer, 0, pageSize);
+	initializeHeader(sibling.buffer, 0);
+
+	// This is the number of keys that remain in this node 
+	int firstHalf = (keyCount + 1) / 2;
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+	char *pids = keys + maxKeyCount*sizeof(int);
+	char *siblingKeys = sibling.buffer + BTNODE_HEADER_SIZE;
+	char *siblingPids = siblingKeys + maxKeyCount*sizeof(int);
+
+	// Now we have to find the middle key 
+	// Since the keys are sorted, 3 candidates for middle key are:
+	// Last key of the first node, first key of the sibling node, and the one
+	// we are about to insert in this function 
+	int lastKeyOfFirst, firstKeyOfSibling; 
+	memcpy(&lastKeyOfFirst, keys + (firstHalf-1)*sizeof(int), sizeof(int));
+	memcpy(&firstKeyOfSibling, keys + firstHalf*sizeof(int), sizeof(int));
+
+	// the entries [from, keyCount) move to the sibling, and the ones
+	// [keep, keyCount) are erased from this node
+	int from, keep;
+	if (key < lastKeyOfFirst) {		// lastKeyOfFirst = middle key 
+		// set the midKey
+		midKey = lastKeyOfFirst; 
+
+		// the head pid of the sibling node is the pid of the (lastKeyOfFirst, pid) pair of the first node 
+		memcpy(sibling.buffer + 8, pids + (firstHalf-1)*sizeof(PageId), sizeof(PageId));
+		from = firstHalf;
+		keep = firstHalf - 1;
+	}
+	else if (key > firstKeyOfSibling) {		// firstKeyOfSibling = middle key 
+		// set the midKey
+		midKey = firstKeyOfSibling; 
+
+		// the head pid of the sibling node is the pid of the (firstKeyOfSibling, pid) pair 
+		memcpy(sibling.buffer + 8, pids + firstHalf*sizeof(PageId), sizeof(PageId));
+		from = firstHalf + 1;
+		keep = firstHalf;
+	}
+	else {	// key = middle key 
+		// set the midKey
+		midKey = key; 
+
+		// the head pid of the sibling node is the pid we are to insert in this function 
+		memcpy(sibling.buffer + 8, &pid, sizeof(PageId));
+		from = firstHalf;
+		keep = firstHalf;
+	}
+
+	// copy the secondHalf to the sibling node
+	memcpy(siblingKeys, keys + from*sizeof(int), (keyCount - from)*sizeof(int));
+	memcpy(siblingPids, pids + from*sizeof(PageId), (keyCount - from)*sizeof(PageId));
+	sibling.setKeyCount(keyCount - from);
+
+	// erase the secondHalf from this node 
+	std::fill(keys + keep*sizeof(int), keys + keyCount*sizeof(int), 0);
+	std::fill(pids + keep*sizeof(PageId), pids + keyCount*sizeof(PageId), 0);
+	setKeyCount(keep);
+
+	// and insert the new (key, pid) pair on its side
+	if (key < lastKeyOfFirst)
+		insert(key, pid); 
+	else if (key > firstKeyOfSibling)
+		sibling.insert(key, pid); 
+
+	return 0; 
+}
+
+/*
+ * Given the searchKey, find the child-node pointer to follow and
+ * output it in pid.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param pid[OUT] the pointer to the child node to follow.
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
+{ 
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+	char *pids = keys + getMaxKeyCount()*sizeof(int);
+
+	// follow the entry with the largest key <= searchKey,
+	// or the leftmost child if there is no such key
+	int i = KeySearch::upperBound(keys, sizeof(int), getKeyCount(), searchKey);
+	if (i == 0)
+		memcpy(&pid, buffer + 8, sizeof(PageId));
+	else
+		memcpy(&pid, pids + (i-1)*sizeof(PageId), sizeof(PageId));
+
+	return 0; 
+}
+
+/*
+ * Output the child-node pointers that may lead to keys in [fromKey, toKey].
+ * @param fromKey[IN] the smallest key of the range
+ * @param toKey[IN] the largest key of the range
+ * @param pids[OUT] the child-node pointers
+ * @param maxCount[IN] the max # of pointers to output
+ * @return the # of pointers stored in pids
+ */
+int BTNonLeafNode::readChildPtrs(int fromKey, int toKey, PageId* pids, int maxCount)
+{
+	int keyCount = getKeyCount();
+	int count = 0; 
+
+	if (maxCount <= 0)
+		return 0; 
+
+	// the child that fromKey leads to
+	locateChildPtr(fromKey, pids[count++]);
+
+	// and the ones after it, as long as their first key is within the range
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+	char *children = keys + getMaxKeyCount()*sizeof(int);
+	int i = KeySearch::upperBound(keys, sizeof(int), keyCount, fromKey);
+	int theKey; 
+	for (; i < keyCount && count < maxCount; ++i) {
+		memcpy(&theKey, keys + i*sizeof(int), sizeof(int));
+		if (theKey > toKey)
+			break; 
+		memcpy(&pids[count++], children + i*sizeof(PageId), sizeof(PageId));
+	}
+
+	return count; 
+}
+
+/*
+ * Copy out all keys and child-node pointers of the node.
+ * @param keys[OUT] the keys. getKeyCount() of them
+ * @param pids[OUT] the child-node pointers, the leftmost child first
+ */
+void BTNonLeafNode::readEntries(int* keys, PageId* pids)
+{
+	// the page may change under a reader that does not hold its latch, so
+	// the key count is kept in the bounds checked by read()
+	int keyCount = getKeyCount();
+	if (keyCount > getMaxKeyCount())
+		keyCount = getMaxKeyCount();
+	char *keyArray = buffer + BTNODE_HEADER_SIZE;
+	char *pidArray = keyArray + getMaxKeyCount()*sizeof(int);
+
+	memcpy(keys, keyArray, keyCount*sizeof(int));
+	memcpy(pids, buffer + 8, sizeof(PageId));
+	memcpy(pids + 1, pidArray, keyCount*sizeof(PageId));
+}
+
+/*
+ * Replace the keys and child-node pointers of the node.
+ * @param keys[IN] the keys, sorted
+ * @param pids[IN] the child-node pointers, the leftmost child first
+ * @param count[IN] # of keys
+ * @return 0 if successful. Return an error code if they do not fit.
+ */
+RC BTNonLeafNode::setEntries(const int* keys, const PageId* pids, int count)
+{
+	int maxKeyCount = getMaxKeyCount();
+	if (count < 0 || count > maxKeyCount)
+		return RC_NODE_FULL; 
+
+	char *keyArray = buffer + BTNODE_HEADER_SIZE;
+	char *pidArray = keyArray + maxKeyCount*sizeof(int);
+	memcpy(buffer + 8, pids, sizeof(PageId));
+	memcpy(keyArray, keys, count*sizeof(int));
+	memcpy(pidArray, pids + 1, count*sizeof(PageId));
+	std::fill(keyArray + count*sizeof(int), keyArray + maxKeyCount*sizeof(int), 0);
+	std::fill(pidArray + count*sizeof(PageId), pidArray + maxKeyCount*sizeof(PageId), 0);
+
+	setKeyCount(count);
+	return 0; 
+}
+
+/*
+ * Initialize the root node with (pid1, key, pid2).
+ * @param pid1[IN] the first PageId to insert
+ * @param key[IN] the key that should be inserted between the two PageIds
+ * @param pid2[IN] the PageId to insert behind the key
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+{ 
+	memset(buffer, 0, pageSize); 
+	initializeHeader(buffer, 0);
+
+	memcpy(buffer + 8, &pid1, sizeof(PageId));
+
+	return insert(key, pid2); 
+}
+
+void BTNonLeafNode::print() 
+{ 
+	char *keys = buffer + BTNODE_HEADER_SIZE;
+
+	int theKey; 
+	int keyCount = getKeyCount();
+	for (int i = 0; i < keyCount; ++i) {
+		memcpy(&theKey, keys + i*sizeof(int), sizeof(int)); 
+		cout << theKey << " | ";
+	}
+	cout << endl;
+}
+
+
+
+
+BTPostingNode::BTPostingNode(int pageSize, int coverSize)
+{ 
+	this->pageSize = pageSize;
+	this->coverSize = coverSize;
+	page = new char[pageSize];
+	buffer = page;
+	memset(buffer, 0, pageSize); 
+	initializeHeader(buffer, getFlags());
+}
+
+BTPostingNode::~BTPostingNode()
+{ 
+	delete [] page;
+}
+
+
+/*
+ * Read the content of the node from the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::read(PageId pid, const PageFile& pf)
+{ 
+	RC error;
+
+	// the node is as large as the pages of pf
+	if (pf.getPageSize() != pageSize) {
+		delete [] page;
+		pageSize = pf.getPageSize();
+		page = new char[pageSize];
+		memset(page, 0, pageSize);
+		initializeHeader(page, getFlags());
+	}
+
+	// pin the page and work on the cached frame directly
+	if (error = pf.pin(pid, guard)) {
+		buffer = page;
+		return error;
+	}
+	if (error = checkHeader(guard.data(), getFlags(), getMaxRidCount())) {
+		guard.release();
+		buffer = page;
+		return error;
+	}
+	buffer = guard.data();
+	return 0; 
+}
+
+/*
+ * Write the content of the node to the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::write(PageId pid, PageFile& pf)
+{ 
+	return pf.write(pid, buffer); 
+}
+
+// For posting: Structure is: header | key | last pid | rid | rid | ...
+/*
+ * Return the number of RecordIds stored in the node.
+ * @return the number of RecordIds in the node
+ */
+int BTPostingNode::getRidCount()
+{ 
+	int count;
+	memcpy(&count, buffer + 4, sizeof(int));
+	return count; 
+}
+
+/*
+ * Return the max number of RecordIds that fit in the node.
+ * @return the max number of RecordIds in the node
+ */
+int BTPostingNode::getMaxRidCount()
+{ 
+	// this is (1024 - 24)/8 = 125 with 1KB pages
+	return (pageSize - BTPOSTING_HEADER_SIZE) / getRidSize();
+}
+
+/*
+ * @return the flags of the node header
+ */
+short BTPostingNode::getFlags()
+{ 
+	return coverSize ? (BTNODE_POSTING | BTNODE_COVER) : BTNODE_POSTING; 
+}
+
+/*
+ * @return # of bytes a RecordId takes, with its cover
+ */
+int BTPostingNode::getRidSize()
+{ 
+	return sizeof(RecordId) + coverSize; 
+}
+
+/*
+ * Set the number of RecordIds in the node header.
+ * @param count[IN] the number of RecordIds
+ */
+void BTPostingNode::setRidCount(int count)
+{ 
+	memcpy(buffer + 4, &count, sizeof(int));
+}
+
+/*
+ * Insert rid to the node, behind the RecordIds that are <= rid.
+ * @param rid[IN] the RecordId to insert
+ * @param cover[IN] the cover of rid. NULL for an empty one
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTPostingNode::insert(const RecordId& rid, const char* cover)
+{ 
+	int count = getRidCount();
+	int ridSize = getRidSize();
+	if (count >= getMaxRidCount())
+		return RC_NODE_FULL; 
+
+	char *rids = buffer + BTPOSTING_HEADER_SIZE;
+	int i = searchRids(rids, count, ridSize, rid, true);
+	memmove(rids + (i+1)*ridSize, rids + i*ridSize, (count - i) * ridSize);
+	copyInRids(rids + i*ridSize, 1, coverSize, &rid, cover);
+
+	setRidCount(count + 1);
+	return 0; 
+}
+
+/*
+ * Remove rid from the node.
+ * @param rid[IN] the RecordId to remove
+ * @return 0 if successful. Return an error code if there is no such RecordId.
+ */
+RC BTPostingNode::remove(const RecordId& rid)
+{ 
+	int count = getRidCount();
+	int ridSize = getRidSize();
+	char *rids = buffer + BTPOSTING_HEADER_SIZE;
+	int i = searchRids(rids, count, ridSize, rid, false);
+
+	RecordId theRid;
+	if (i == count)
+		return RC_NO_SUCH_RECORD; 
+	memcpy(&theRid, rids + i*ridSize, sizeof(RecordId));
+	if (theRid != rid)
+		return RC_NO_SUCH_RECORD; 
+
+	// close the gap, and clear the RecordId freed at the end
+	memmove(rids + i*ridSize, rids + (i+1)*ridSize, (count - i - 1) * ridSize);
+	memset(rids + (count-1)*ridSize, 0, ridSize);
+
+	setRidCount(count - 1);
+	return 0; 
+}
+
+/*
+ * Copy out RecordIds of the node.
+ * @param from[IN] the first RecordId to copy
+ * @param rids[OUT] the RecordIds
+ * @param maxCount[IN] the max # of RecordIds to copy
+ * @param covers[OUT] the covers of the RecordIds. may be NULL
+ * @return the # of RecordIds copied
+ */
+int BTPostingNode::readRids(int from, RecordId* rids, int maxCount, char* covers)
+{ 
+	int count = getRidCount();
+	if (from < 0 || from >= count || maxCount <= 0)
+		return 0; 
+	if (count - from < maxCount)
+		maxCount = count - from; 
+
+	copyOutRids(buffer + BTPOSTING_HEADER_SIZE + from*getRidSize(), maxCount, coverSize, rids, covers);
+	return maxCount; 
+}
+
+/*
+ * Replace the RecordIds of the node. The key and the page pointers are kept.
+ * @param rids[IN] the RecordIds, sorted
+ * @param count[IN] # of RecordIds
+ * @param covers[IN] the covers of the RecordIds. NULL for empty ones
+ * @return 0 if successful. Return an error code if they do not fit.
+ */
+RC BTPostingNode::setRids(const RecordId* rids, int count, const char* covers)
+{ 
+	if (count < 0 || count > getMaxRidCount())
+		return RC_NODE_FULL; 
+
+	char *theRids = buffer + BTPOSTING_HEADER_SIZE;
+	memset(theRids, 0, pageSize - BTPOSTING_HEADER_SIZE);
+	copyInRids(theRids, count, coverSize, rids, covers);
+
+	setRidCount(count);
+	return 0; 
+}
+
+/*
+ * @return # of the RecordIds of the node that are smaller than rid
+ */
+int BTPostingNode::lowerBound(const RecordId& rid)
+{ 
+	return searchRids(buffer + BTPOSTING_HEADER_SIZE, getRidCount(), getRidSize(), rid, false); 
+}
+
+/*
+ * @return # of the RecordIds of the node that are <= rid
+ */
+int BTPostingNode::upperBound(const RecordId& rid)
+{ 
+	return searchRids(buffer + BTPOSTING_HEADER_SIZE, getRidCount(), getRidSize(), rid, true); 
+}
+
+/*
+ * @return the key the RecordIds belong to
+ */
+int BTPostingNode::getKey()
+{ 
+	int key;
+	memcpy(&key, buffer + 16, sizeof(int));
+	return key; 
+}
+
+/*
+ * @param key[IN] the key the RecordIds belong to
+ */
+void BTPostingNode::setKey(int key)
+{ 
+	memcpy(buffer + 16, &key, sizeof(int));
+}
+
+/*
+ * Return the pid of the next page of the list.
+ * @return the PageId of the next page. 0 if none
+ */
+PageId BTPostingNode::getNextNodePtr()
+{ 
+	PageId pid;
+	memcpy(&pid, buffer + 8, sizeof(PageId));
+	return pid; 
+}
+
+/*
+ * Set the pid of the next page of the list.
+ * @param pid[IN] the PageId of the next page
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::setNextNodePtr(PageId pid)
+{ 
+	if (pid < 0)
+		return RC_INVALID_PID; 
+
+	memcpy(buffer + 8, &pid, sizeof(PageId));
+	return 0; 
+}
+
+/*
+ * Return the pid of the previous page of the list.
+ * @return the PageId of the previous page. 0 if none
+ */
+PageId BTPostingNode::getPrevNodePtr()
+{ 
+	PageId pid;
+	memcpy(&pid, buffer + 12, sizeof(PageId));
+	return pid; 
+}
+
+/*
+ * Set the pid of the previous page of the list.
+ * @param pid[IN] the PageId of the previous page
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::setPrevNodePtr(PageId pid)
+{ 
+	if (pid < 0)
+		return RC_INVALID_PID; 
+
+	memcpy(buffer + 12, &pid, sizeof(PageId));
+	return 0; 
+}
+
+/*
+ * Return the pid of the last page of the list. Only the first page keeps it.
+ * @return the PageId of the last page
+ */
+PageId BTPostingNode::getLastNodePtr()
+{ 
+	PageId pid;
+	memcpy(&pid, buffer + 20, sizeof(PageId));
+	return pid; 
+}
+
+/*
+ * Set the pid of the last page of the list.
+ * @param pid[IN] the PageId of the last page
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTPostingNode::setLastNodePtr(PageId pid)
+{ 
+	if (pid < 0)
+		return RC_INVALID_PID; 
+
+	memcpy(buffer + 20, &pid, sizeof(PageId));
+	return 0; 
+}
+
+
+
+
+BTStringNode::BTStringNode(int pageSize, bool leaf)
+{ 
+	this->pageSize = pageSize;
+	page = new char[pageSize];
+	buffer = page;
+	initialize(leaf);
+}
+
+BTStringNode::~BTStringNode()
+{ 
+	delete [] page;
+}
+
+/*
+ * Read the content of the node from the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNode::read(PageId pid, const PageFile& pf)
+{ 
+	RC error;
+
+	// the node is as large as the pages of pf
+	if (pf.getPageSize() != pageSize) {
+		delete [] page;
+		pageSize = pf.getPageSize();
+		page = new char[pageSize];
+		buffer = page;
+		initialize(true);
+	}
+
+	// pin the page and work on the cached frame directly. the page may
+	// hold a leaf or a nonleaf node
+	if (error = pf.pin(pid, guard)) {
+		buffer = page;
+		return error;
+	}
+	short flags;
+	int start, keyCount;
+	memcpy(&flags, guard.data() + 2, sizeof(short));
+	flags = BTNODE_STRING | (flags & BTNODE_LEAF);
+	if (error = checkHeader(guard.data(), flags, (pageSize - BTSTRING_HEADER_SIZE) / getEntrySize(0))) {
+		guard.release();
+		buffer = page;
+		return error;
+	}
+	// the entries start behind the offsets
+	memcpy(&keyCount, guard.data() + 4, sizeof(int));
+	memcpy(&start, guard.data() + 16, sizeof(int));
+	if (start < BTSTRING_HEADER_SIZE + keyCount*(int)sizeof(short) || start > pageSize) {
+		guard.release();
+		buffer = page;
+		return RC_INVALID_FILE_FORMAT;
+	}
+	buffer = guard.data();
+	return 0; 
+}
+
+/*
+ * Write the content of the node to the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNode::write(PageId pid, PageFile& pf)
+{ 
+	return pf.write(pid, buffer); 
+}
+
+/*
+ * Compare two keys byte by byte, a shorter key before a longer one
+ * it is a prefix of.
+ * @return < 0, 0 or > 0 if the first key is smaller, equal or larger
+ */
+int BTStringNode::compare(const char* key1, int length1, const char* key2, int length2)
+{ 
+	// memcmp() compares unsigned bytes, as strcmp() does
+	int diff = memcmp(key1, key2, min(length1, length2));
+	if (diff)
+		return diff; 
+	return length1 - length2; 
+}
+
+/*
+ * Make the shortest key that is larger than last and not larger than first.
+ * @param last[IN] the last key of a node
+ * @param first[IN] the first key of the next node. >= last
+ * @param separator[OUT] a prefix of first, or first itself if it is last
+ */
+void BTStringNode::makeSeparator(const string& last, const string& first, string& separator)
+{ 
+	// the common prefix, and the first byte of first behind it
+	unsigned i = 0;
+	while (i < last.size() && i < first.size() && last[i] == first[i])
+		++i;
+	separator.assign(first, 0, min((size_t)i + 1, first.size()));
+}
+
+/*
+ * Make the node an empty leaf or nonleaf node.
+ * @param leaf[IN] true for a leaf node
+ */
+void BTStringNode::initialize(bool leaf)
+{ 
+	// the node is not read from a page any more
+	guard.release();
+	buffer = page;
+	memset(buffer, 0, pageSize); 
+	initializeHeader(buffer, BTNODE_STRING | (leaf ? BTNODE_LEAF : 0));
+	// no entries yet: they start at the end of the node
+	memcpy(buffer + 16, &pageSize, sizeof(int));
+}
+
+bool BTStringNode::isLeaf()
+{ 
+	short flags;
+	memcpy(&flags, buffer + 2, sizeof(short));
+	return flags & BTNODE_LEAF;
+}
+
+/*
+ * Return the number of keys stored in the node.
+ * @return the number of keys in the node
+ */
+int BTStringNode::getKeyCount()
+{ 
+	int count;
+	memcpy(&count, buffer + 4, sizeof(int));
+	return count; 
+}
+
+/*
+ * Set the number of keys in the node header.
+ * @param count[IN] the number of keys
+ */
+void BTStringNode::setKeyCount(int count)
+{ 
+	memcpy(buffer + 4, &count, sizeof(int));
+}
+
+int BTStringNode::getValueSize()
+{ 
+	return isLeaf() ? sizeof(RecordId) : sizeof(PageId);
+}
+
+int BTStringNode::getEntrySize(int keyLength)
+{ 
+	// the offset, the key length, the key and the value
+	return 2*sizeof(short) + keyLength + getValueSize();
+}
+
+int BTStringNode::getUsedBytes()
+{ 
+	int start;
+	memcpy(&start, buffer + 16, sizeof(int));
+	return getKeyCount()*sizeof(short) + (pageSize - start);
+}
+
+int BTStringNode::getCapacity()
+{ 
+	return pageSize - BTSTRING_HEADER_SIZE;
+}
+
+/*
+ * @param eid[IN] the entry number
+ * @param length[OUT] the length of the key of the entry
+ * @return the key of the entry, in the node
+ */
+const char* BTStringNode::getKey(int eid, int& length)
+{ 
+	unsigned short offset;
+	short theLength;
+	memcpy(&offset, buffer + BTSTRING_HEADER_SIZE + eid*sizeof(short), sizeof(short));
+	memcpy(&theLength, buffer + offset, sizeof(short));
+	length = theLength;
+	return buffer + offset + sizeof(short);
+}
+
+/*
+ * Find the first entry with a key >= key (> key if upper).
+ * @param key[IN] the key to search for
+ * @param upper[IN] true to skip the entries with the key
+ * @return the entry number. getKeyCount() if there is none
+ */
+int BTStringNode::locate(const string& key, bool upper)
+{ 
+	int low = 0, high = getKeyCount();
+	while (low < high) {
+		int mid = (low + high) / 2, length;
+		const char* theKey = getKey(mid, length);
+		int diff = compare(theKey, length, key.data(), key.size());
+		if (diff < 0 || (upper && diff == 0))
+			low = mid + 1;
+		else 
+			high = mid;
+	}
+	return low; 
+}
+
+/*
+ * Insert an entry at eid.
+ * @param value[IN] the RecordId or the child-node pointer of the entry
+ * @param valueSize[IN] the size of value
+ * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+ */
+RC BTStringNode::insertEntry(int eid, const string& key, const void* value, int valueSize)
+{ 
+	int keyCount = getKeyCount();
+	if (key.size() > MAX_KEY_LENGTH)
+		return RC_INVALID_ATTRIBUTE; 
+	if (eid < 0 || eid > keyCount)
+		return RC_INVALID_CURSOR; 
+
+	// the entry goes in front of the others, and its offset between the
+	// offsets of eid - 1 and eid
+	int start;
+	memcpy(&start, buffer + 16, sizeof(int));
+	int size = sizeof(short) + key.size() + valueSize;
+	if (start - size < BTSTRING_HEADER_SIZE + (keyCount + 1)*(int)sizeof(short))
+		return RC_NODE_FULL; 
+
+	start -= size;
+	short length = key.size();
+	memcpy(buffer + start, &length, sizeof(short));
+	memcpy(buffer + start + sizeof(short), key.data(), key.size());
+	memcpy(buffer + start + sizeof(short) + key.size(), value, valueSize);
+	memcpy(buffer + 16, &start, sizeof(int));
+
+	char *offsets = buffer + BTSTRING_HEADER_SIZE;
+	unsigned short offset = start;
+	memmove(offsets + (eid+1)*sizeof(short), offsets + eid*sizeof(short), (keyCount - eid)*sizeof(short));
+	memcpy(offsets + eid*sizeof(short), &offset, sizeof(short));
+
+	setKeyCount(keyCount + 1);
+	return 0; 
+}
+
+/*
+ * Insert a (key, rid) entry to a leaf at eid.
+ * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+ */
+RC BTStringNode::insert(int eid, const string& key, const RecordId& rid)
+{ 
+	if (!isLeaf())
+		return RC_INVALID_ATTRIBUTE; 
+	return insertEntry(eid, key, &rid, sizeof(RecordId));
+}
+
+/*
+ * Insert a (key, pid) entry to a nonleaf node at eid.
+ * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+ */
+RC BTStringNode::insert(int eid, const string& key, PageId pid)
+{ 
+	if (isLeaf())
+		return RC_INVALID_ATTRIBUTE; 
+	return insertEntry(eid, key, &pid, sizeof(PageId));
+}
+
+/*
+ * Remove the eid-th entry of a leaf, moving the entries in front of it
+ * (in bytes) up over its bytes.
+ * @return 0 if successful. RC_INVALID_CURSOR if there is no such entry
+ */
+RC BTStringNode::remove(int eid)
+{ 
+	int keyCount = getKeyCount();
+	if (!isLeaf())
+		return RC_INVALID_ATTRIBUTE; 
+	if (eid < 0 || eid >= keyCount)
+		return RC_INVALID_CURSOR; 
+
+	int start, length;
+	memcpy(&start, buffer + 16, sizeof(int));
+	char *offsets = buffer + BTSTRING_HEADER_SIZE;
+	unsigned short offset;
+	memcpy(&offset, offsets + eid*sizeof(short), sizeof(short));
+	getKey(eid, length);
+	int size = sizeof(short) + length + sizeof(RecordId);
+
+	memmove(buffer + start + size, buffer + start, offset - start);
+	start += size;
+	memcpy(buffer + 16, &start, sizeof(int));
+	memmove(offsets + eid*sizeof(short), offsets + (eid+1)*sizeof(short), (keyCount - eid - 1)*sizeof(short));
+	setKeyCount(--keyCount);
+
+	// the entries that moved
+	for (int i = 0; i < keyCount; ++i) {
+		unsigned short other;
+		memcpy(&other, offsets + i*sizeof(short), sizeof(short));
+		if (other < offset) {
+			other += size;
+			memcpy(offsets + i*sizeof(short), &other, sizeof(short));
+		}
+	}
+	return 0; 
+}
+
+/*
+ * Move the entries of the second half (in bytes) of the node to an empty
+ * sibling node.
+ * @param sibling[IN] the sibling node. MUST be empty
+ * @param siblingKey[OUT] the key to insert to the parent node
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNode::split(BTStringNode& sibling, string& siblingKey)
+{ 
+	RC error;
+	int keyCount = getKeyCount();
+	bool leaf = isLeaf();
+	if (keyCount < (leaf ? 2 : 3) || sibling.getKeyCount())
+		return RC_INVALID_ATTRIBUTE; 
+	
+	// the entries the node keeps: about half of the bytes, and at least
+	// one entry on each side (and the middle one of a nonleaf node)
+	int keep = 0, used = 0, length;
+	while (keep < keyCount - (leaf ? 1 : 2) && (keep == 0 || 2*used < getUsedBytes())) {
+		getKey(keep, length);
+		used += getEntrySize(length);
+		++keep;
+	}
+
+	// copy out the node, and rebuild it from the copy
+	vector<char> copy(buffer, buffer + pageSize);
+	char* old = buffer;
+	buffer = copy.data();
+	vector<string> keys(keyCount);
+	vector<const char*> values(keyCount);
+	for (int i = 0; i < keyCount; ++i) {
+		const char* theKey = getKey(i, length);
+		keys[i].assign(theKey, length);
+		values[i] = theKey + length;
+	}
+	buffer = old;
+	setKeyCount(0);
+	memcpy(buffer + 16, &pageSize, sizeof(int));
+
+	int valueSize = getValueSize();
+	for (int i = 0; i < keep; ++i) {
+		if (error = insertEntry(i, keys[i], values[i], valueSize))
+			return error; 
+	}
+
+	// a leaf is separated from the sibling by the shortest key that does it.
+	// the middle key of a nonleaf node moves up, and the sibling takes its
+	// child as the leftmost one.
+	int from = keep;
+	if (leaf) {
+		makeSeparator(keys[keep - 1], keys[keep], siblingKey);
+	}
+	else {
+		siblingKey = keys[keep];
+		PageId pid;
+		memcpy(&pid, values[keep], sizeof(PageId));
+		sibling.setLeftmostPtr(pid);
+		++from;
+	}
+	for (int i = from; i < keyCount; ++i) {
+		if (error = sibling.insertEntry(i - from, keys[i], values[i], valueSize))
+			return error; 
+	}
+	return 0; 
+}
+
+void BTStringNode::readKey(int eid, string& key)
+{ 
+	int length;
+	const char* theKey = getKey(eid, length);
+	key.assign(theKey, length);
+}
+
+RecordId BTStringNode::readRid(int eid)
+{ 
+	int length;
+	RecordId rid;
+	const char* theKey = getKey(eid, length);
+	memcpy(&rid, theKey + length, sizeof(RecordId));
+	return rid; 
+}
+
+/*
+ * Copy out the entries of a leaf from eid on.
+ * @param eid[IN/OUT] the first entry to copy. moves behind the last one
+ * @param keys[OUT] the keys
+ * @param rids[OUT] the RecordIds
+ * @param maxCount[IN] the max # of entries to copy
+ * @return the # of entries copied
+ */
+int BTStringNode::readEntries(int& eid, string* keys, RecordId* rids, int maxCount)
+{ 
+	int count = 0, length;
+	int keyCount = getKeyCount();
+	for (; eid < keyCount && count < maxCount; ++eid, ++count) {
+		const char* theKey = getKey(eid, length);
+		keys[count].assign(theKey, length);
+		memcpy(&rids[count], theKey + length, sizeof(RecordId));
+	}
+	return count; 
+}
+
+/*
+ * @param slot[IN] the pointer number. 0 for the leftmost child
+ * @return the slot-th child-node pointer of a nonleaf node
+ */
+PageId BTStringNode::getChildPtr(int slot)
+{ 
+	PageId pid;
+	if (slot == 0) {
+		memcpy(&pid, buffer + 8, sizeof(PageId));
+	}
+	else {
+		int length;
+		const char* theKey = getKey(slot - 1, length);
+		memcpy(&pid, theKey + length, sizeof(PageId));
+	}
+	return pid; 
+}
+
+/*
+ * Find the child-node pointer to follow for searchKey.
+ * @param searchKey[IN] the searchKey that is being looked up.
+ * @param slot[OUT] the pointer number of the child
+ * @param upper[IN] true to follow the rightmost child with searchKey
+ * @return the pointer to the child node to follow
+ */
+PageId BTStringNode::locateChildPtr(const string& searchKey, int& slot, bool upper)
+{ 
+	// the i-th pointer is in front of the i-th key
+	slot = locate(searchKey, upper);
+	return getChildPtr(slot);
+}
+
+/*
+ * Initialize the root node with (pid1, key, pid2).
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNode::initializeRoot(PageId pid1, const string& key, PageId pid2)
+{ 
+	initialize(false);
+	setLeftmostPtr(pid1);
+	return insert(0, key, pid2);
+}
+
+void BTStringNode::setLeftmostPtr(PageId pid)
+{ 
+	memcpy(buffer + 8, &pid, sizeof(PageId));
+}
+
+PageId BTStringNode::getNextNodePtr()
+{ 
+	PageId pid;
+	memcpy(&pid, buffer + 8, sizeof(PageId));
+	return pid; 
+}
+
+void BTStringNode::setNextNodePtr(PageId pid)
+{ 
+	memcpy(buffer + 8, &pid, sizeof(PageId));
+}
+
+PageId BTStringNode::getPrevNodePtr()
+{ 
+	PageId pid;
+	memcpy(&pid, buffer + 12, sizeof(PageId));
+	return pid; 
+}
+
+void BTStringNode::setPrevNodePtr(PageId pid)
+{ 
+	memcpy(buffer + 12, &pid, sizeof(PageId));
+}
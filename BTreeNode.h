@@ -10,36 +10,263 @@
 #ifndef BTREENODE_H
 #define BTREENODE_H
 
+#include <string>
+#include <vector>
 #include "RecordFile.h"
 #include "PageFile.h"
 
+/**
+ * Every B+tree node starts with a header:
+ *   [0..1]   node format version (BTNODE_VERSION)
+ *   [2..3]   flags (BTNODE_LEAF for a leaf node, BTNODE_POSTING for a
+ *            posting page, BTNODE_FREE for a page of a removed node,
+ *            whose [8..11] is the next free page, BTNODE_COVER for
+ *            a leaf or a posting page of a covering index,
+ *            BTNODE_STRING for a node of a string index, and
+ *            BTNODE_PACKED for a packed leaf)
+ *   [4..7]   # of keys stored in the node
+ *   [8..11]  leaf: the PageId of the next sibling (0 if none)
+ *            nonleaf: the PageId of the leftmost child
+ *   [12..15] leaf: the PageId of the previous sibling (0 if none)
+ *            nonleaf: reserved (0)
+ * The entries follow the header, sorted by key. The keys are stored in
+ * an array of their own, so that a key search only reads the keys:
+ *   leaf:    key | key | ... (max # of keys) | value | value | ... | free | lists
+ *   nonleaf: key | key | ... (max # of keys) | pid | pid | ...
+ * where the i-th pid of a nonleaf node points to the child holding the
+ * keys >= the i-th key.
+ *
+ * A leaf has every key once, with all the RecordIds of the key. The value
+ * of a key with a single RecordId is that RecordId. The RecordIds of a key
+ * with more are a sorted list, and the value is (-offset, count): the list
+ * is at the byte offset of the node. The lists are packed at the end of
+ * the node, the one of the smallest key first. A list longer than
+ * BTLeafNode::getMaxListLength() moves to posting pages (BTPostingNode),
+ * and the value is (-first posting page, -count).
+ *
+ * The nodes of a covering index keep a cover (see BTreeIndex) of a fixed
+ * size behind every RecordId of a list or a posting page. A leaf of a
+ * covering index keeps a single RecordId in a list of one as well, i.e.,
+ * its value is (-offset, 1).
+ *
+ * The leaves of a packed index are packed (see BTNODE_PACKED_HEADER_SIZE).
+ *
+ * Version 1 nodes stored the entries interleaved, i.e., (key, rid) pairs.
+ * Version 2 leaves had no previous sibling pointer.
+ * Version 3 leaves had a (key, rid) entry for every RecordId.
+ * BTreeIndex::convert() rewrites an index in an older format.
+ */
+const int   BTNODE_HEADER_SIZE = 16;
+const short BTNODE_VERSION     = 4;
+const short BTNODE_LEAF        = 0x0001;
+const short BTNODE_FREE        = 0x0002;
+const short BTNODE_POSTING     = 0x0004;
+const short BTNODE_COVER       = 0x0008;
+const short BTNODE_STRING      = 0x0010;
+const short BTNODE_PACKED      = 0x0020;
+
+/**
+ * A packed leaf keeps its keys and values in bit-packed columns, where
+ * every value of a column takes the same # of bits:
+ *   [0..15]  the node header, as in a leaf
+ *   [16..19] the key base: the first key
+ *   [20..23] the pid base: one less than the smallest pid of a RecordId
+ *            that is a value
+ *   [24..26] the # of bits of a value of the key, pid and sid columns
+ *   [27]     reserved (0)
+ *   [28..]   the key column: key - key base for every key
+ *            the pid column: pid - pid base if the value is a RecordId,
+ *            and 0 otherwise
+ *            the sid column: sid if the value is a RecordId, the # of
+ *            RecordIds of a list, and 0 for posting pages
+ *            (first posting page, # of RecordIds) of every key whose
+ *            RecordIds are in posting pages, as two ints
+ *            free
+ *            the lists, as in a leaf
+ * Each column starts at a byte. The # of bits of a column are the ones
+ * its largest value takes, so the keys of a leaf that are close together
+ * take a few bits each, and so do the RecordIds from a few pages of the
+ * table. A packed leaf is read into a node as large as BTLeafNode::
+ * UNPACKED_SCALE pages, and packed again when it is written.
+ */
+const int   BTNODE_PACKED_HEADER_SIZE = 28;
+
+/**
+ * A posting page holds a part of the RecordId list of a key:
+ *   [0..15]  the node header. [4..7] is the # of RecordIds, and [8..11]
+ *            and [12..15] are the next and the previous page of the list
+ *   [16..19] the key
+ *   [20..23] the last page of the list (kept in the first page only)
+ *   [24..]   the RecordIds, sorted, each followed by its cover in a
+ *            covering index
+ * The RecordIds of a page are smaller than the ones of the next page.
+ * The pages of a list belong to the leaf with the key, and are changed
+ * only while the leaf is latched.
+ */
+const int   BTPOSTING_HEADER_SIZE = 24;
+
+/**
+ * A node of a string index (see StringIndex) has keys of any length up
+ * to BTStringNode::MAX_KEY_LENGTH, kept in a slotted page:
+ *   [0..15]  the node header. [8..11] and [12..15] are as in the leaf or
+ *            the nonleaf node of an integer index
+ *   [16..19] the offset of the first byte of the entries
+ *   [20..]   the offsets of the entries (2 bytes each), in key order
+ * The entries are packed at the end of the node, in the order they were
+ * added. An entry is the length of its key (2 bytes), the key, and the
+ * RecordId of a leaf entry or the child-node pointer of a nonleaf entry.
+ * The i-th pointer of a nonleaf node points to the child holding the
+ * keys >= the i-th key, as in an integer index. The keys are compared
+ * byte by byte like strcmp(), and a leaf may have a key more than once.
+ */
+const int   BTSTRING_HEADER_SIZE = 20;
+
+/**
+ * A key of a leaf node with its RecordIds, as copied out of the node to
+ * move it to another node.
+ */
+struct BTLeafEntry {
+  int key;                     // the key
+  int count;                   // # of RecordIds of the key
+  PageId listPid;              // the first posting page of the RecordIds.
+                               // 0 if they are kept in the node
+  std::vector<RecordId> rids;  // the RecordIds kept in the node, sorted
+  std::vector<char> covers;    // the covers of rids, one after another.
+                               // empty if the index does not cover
+};
+
 /**
  * BTLeafNode: The class representing a B+tree leaf node.
  */
 class BTLeafNode {
   public:
-    BTLeafNode(); 
+    static const int UNPACKED_SCALE = 4;  /// # of pages an unpacked packed leaf takes
+
+   /**
+    * @param pageSize[IN] the size of the page the node is stored in
+    * @param coverSize[IN] the size of the cover of a RecordId. 0 if the
+    *                      index does not cover
+    * @param packed[IN] true for a packed leaf
+    */
+    BTLeafNode(int pageSize = PageFile::DEFAULT_PAGE_SIZE, int coverSize = 0, bool packed = false); 
+    ~BTLeafNode();
+
    /**
-    * Insert the (key, rid) pair to the node.
+    * Insert the (key, rid) pair to the node: add rid to the RecordIds of
+    * key, or add key with rid if the node does not have it.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param rid[IN] the RecordId to insert
-    * @return 0 if successful. Return an error code if the node is full.
+    * @param cover[IN] the cover of rid. NULL for an empty one
+    * @return 0 if successful. RC_NODE_FULL if the node is full.
+    *         RC_INVALID_ATTRIBUTE if the RecordIds of key are in posting pages.
     */
-    RC insert(int key, const RecordId& rid);
+    RC insert(int key, const RecordId& rid, const char* cover = NULL);
 
    /**
     * Insert the (key, rid) pair to the node
-    * and split the node half and half with sibling.
+    * and split the node half and half (in bytes) with sibling.
     * The first key of the sibling node is returned in siblingKey.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert.
     * @param rid[IN] the RecordId to insert.
     * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
     * @param siblingKey[OUT] the first key in the sibling node after split.
+    * @param cover[IN] the cover of rid. NULL for an empty one
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
+    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey,
+                      const char* cover = NULL);
+
+   /**
+    * Tell whether a RecordId with key can be inserted without a split.
+    * A RecordId added to a list of getMaxListLength() RecordIds or more
+    * goes to posting pages, and takes no room in the node.
+    * @param key[IN] the key to insert
+    * @param rid[IN] the RecordId to insert
+    * @return true if the RecordId fits in the node
+    */
+    bool hasRoom(int key, const RecordId& rid);
+
+   /**
+    * Remove the eid entry, with all its RecordIds, from the node.
+    * @param eid[IN] the entry number to remove
+    * @return 0 if successful. Return an error code if there is no such entry.
+    */
+    RC remove(int eid);
+
+   /**
+    * Remove rid from the RecordIds of the eid entry, and the entry if rid
+    * is its only RecordId.
+    * @param eid[IN] the entry number
+    * @param rid[IN] the RecordId to remove
+    * @return 0 if successful. RC_NO_SUCH_RECORD if the entry does not have
+    *         rid. RC_INVALID_ATTRIBUTE if its RecordIds are in posting pages.
+    */
+    RC removeRid(int eid, const RecordId& rid);
+
+   /**
+    * @param eid[IN] the entry number
+    * @return # of bytes getUsedBytes() goes down by when a RecordId kept
+    *         in the node is removed from the eid entry
+    */
+    int getRemovedBytes(int eid);
+
+   /**
+    * Copy out all entries of the node.
+    * @param entries[OUT] the entries, sorted by key
+    */
+    void getEntries(std::vector<BTLeafEntry>& entries);
+
+   /**
+    * Replace the entries of the node. The sibling pointers are kept.
+    * @param entries[IN] the entries, sorted by key
+    * @param count[IN] # of entries
+    * @return 0 if successful. RC_NODE_FULL if they do not fit.
+    */
+    RC setEntries(const BTLeafEntry* entries, int count);
+
+   /**
+    * @param entries[IN] the entries, sorted by key
+    * @param count[IN] # of entries
+    * @return true if the entries fit in one node
+    */
+    bool fits(const BTLeafEntry* entries, int count);
+
+   /**
+    * Find where to split entries between two nodes, so that both parts
+    * fit and take about the same # of bytes.
+    * @param entries[IN] the entries, sorted by key
+    * @param count[IN] # of entries
+    * @return # of entries of the first part. -1 if there is no such split
+    */
+    int splitEntries(const BTLeafEntry* entries, int count);
+
+   /**
+    * @param entry[IN] an entry
+    * @return # of bytes the entry takes in a node
+    */
+    int getEntrySize(const BTLeafEntry& entry);
+
+   /**
+    * @param entries[IN] the entries, sorted by key
+    * @param count[IN] # of entries
+    * @return # of bytes the entries take in a node. in a packed node,
+    *         this depends on all of them
+    */
+    int getEntriesSize(const BTLeafEntry* entries, int count);
+
+   /**
+    * @return # of bytes the entries of the node take: 12 for each key
+    *         (its key and value), and the lists of RecordIds in the node.
+    *         a packed node takes the size of its columns instead
+    */
+    int getUsedBytes();
+
+   /**
+    * @return # of bytes the entries of a full node take at most
+    */
+    int getCapacity();
 
    /**
     * If searchKey exists in the node, set eid to the index entry
@@ -55,13 +282,112 @@ class BTLeafNode {
     RC locate(int searchKey, int& eid);
 
    /**
-    * Read the (key, rid) pair from the eid entry.
-    * @param eid[IN] the entry number to read the (key, rid) pair from
+    * Set eid to the last index entry with a key <= searchKey,
+    * or to -1 if every key of the node is larger.
+    * @param searchKey[IN] the key to search for
+    * @param eid[OUT] the last index entry with a key <= searchKey
+    * @return 0 if the key of the entry is searchKey. If not, RC_NO_SUCH_RECORD.
+    */
+    RC locateBackward(int searchKey, int& eid);
+
+   /**
+    * Read the key of the eid entry.
+    * @param eid[IN] the entry number to read the key from
     * @param key[OUT] the key from the slot
-    * @param rid[OUT] the RecordId from the slot
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC readEntry(int eid, int& key, RecordId& rid);
+    RC readKey(int eid, int& key);
+
+   /**
+    * @param eid[IN] the entry number
+    * @return # of RecordIds of the eid entry
+    */
+    int getRidCount(int eid);
+
+   /**
+    * @param eid[IN] the entry number
+    * @return the first posting page of the RecordIds of the eid entry.
+    *         0 if they are kept in the node
+    */
+    PageId getListPtr(int eid);
+
+   /**
+    * Move the RecordIds of the eid entry to posting pages, or change the
+    * # of RecordIds in the posting pages.
+    * @param eid[IN] the entry number
+    * @param pid[IN] the first posting page
+    * @param count[IN] # of RecordIds in the posting pages
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setListPtr(int eid, PageId pid, int count);
+
+   /**
+    * Replace the RecordIds of the eid entry, and keep them in the node.
+    * @param eid[IN] the entry number
+    * @param rids[IN] the RecordIds, sorted
+    * @param count[IN] # of RecordIds. at least 1
+    * @param covers[IN] the covers of the RecordIds. NULL for empty ones
+    * @return 0 if successful. RC_NODE_FULL if they do not fit.
+    */
+    RC setRids(int eid, const RecordId* rids, int count, const char* covers = NULL);
+
+   /**
+    * Copy out RecordIds of the eid entry kept in the node.
+    * @param eid[IN] the entry number
+    * @param from[IN] the first RecordId to copy
+    * @param rids[OUT] the RecordIds
+    * @param maxCount[IN] the max # of RecordIds to copy
+    * @param covers[OUT] the covers of the RecordIds. may be NULL
+    * @return the # of RecordIds copied. 0 if they are in posting pages
+    */
+    int readRids(int eid, int from, RecordId* rids, int maxCount, char* covers = NULL);
+
+   /**
+    * @return # of the RecordIds of the eid entry kept in the node that
+    *         are smaller than rid
+    */
+    int ridLowerBound(int eid, const RecordId& rid);
+
+   /**
+    * @return # of the RecordIds of the eid entry kept in the node that
+    *         are smaller than or equal to rid
+    */
+    int ridUpperBound(int eid, const RecordId& rid);
+
+   /**
+    * Copy out the (key, rid) pairs from the pos-th RecordId of the eid
+    * entry on, as long as their keys are <= toKey. The copy stops in front
+    * of an entry whose RecordIds are in posting pages.
+    * @param eid[IN/OUT] the first entry to copy. set to where the copy stopped
+    * @param pos[IN/OUT] the first RecordId of the entry to copy. set to
+    *                    where the copy stopped
+    * @param toKey[IN] the largest key to copy
+    * @param keys[OUT] the keys
+    * @param rids[OUT] the RecordIds
+    * @param maxCount[IN] the max # of pairs to copy
+    * @param covers[OUT] the covers of the RecordIds. may be NULL
+    * @return the # of pairs copied
+    */
+    int readEntries(int& eid, int& pos, int toKey, int* keys, RecordId* rids, int maxCount,
+                    char* covers = NULL);
+
+   /**
+    * Copy out the (key, rid) pairs in front of the pos-th RecordId of the
+    * eid entry back to the first entry, as long as their keys are >=
+    * fromKey. The pairs come out in descending order. The copy stops in
+    * front of an entry whose RecordIds are in posting pages.
+    * @param eid[IN/OUT] the first entry to copy. set to where the copy stopped
+    * @param pos[IN/OUT] # of RecordIds of the entry to copy (the ones in
+    *                    front of the pos-th). set to where the copy stopped
+    * @param fromKey[IN] the smallest key to copy
+    * @param keys[OUT] the keys
+    * @param rids[OUT] the RecordIds
+    * @param maxCount[IN] the max # of pairs to copy
+    * @param covers[OUT] the covers of the RecordIds. may be NULL
+    * @return the # of pairs copied
+    */
+    int readEntriesBackward(int& eid, int& pos, int fromKey, int* keys, RecordId* rids, int maxCount,
+                            char* covers = NULL);
 
    /**
     * Return the pid of the next slibling node.
@@ -77,17 +403,50 @@ class BTLeafNode {
     */
     RC setNextNodePtr(PageId pid);
 
+   /**
+    * Return the pid of the previous sibling node.
+    * @return the PageId of the previous sibling node. 0 if none
+    */
+    PageId getPrevNodePtr();
+
+   /**
+    * Set the previous sibling node PageId.
+    * @param pid[IN] the PageId of the previous sibling node
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setPrevNodePtr(PageId pid);
+
    /**
     * Return the number of keys stored in the node.
     * @return the number of keys in the node
     */
     int getKeyCount();
+
+   /**
+    * Return the max number of keys that fit in the node.
+    * @return the max number of keys in the node
+    */
+    int getMaxKeyCount();
+
+   /**
+    * Return the max number of RecordIds of a key kept in the node.
+    * Longer lists go to posting pages.
+    * @return the max length of a list in the node
+    */
+    int getMaxListLength();
+
+   /**
+    * @return the size of the cover of a RecordId. 0 if the index does not cover
+    */
+    int getCoverSize();
  
    /**
     * Read the content of the node from the page pid in the PageFile pf.
+    * The node takes the page size of pf.
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
-    * @return 0 if successful. Return an error code if there is an error.
+    * @return 0 if successful. RC_INVALID_FILE_FORMAT if the page does not
+    *         hold a node of this kind in the current format.
     */
     RC read(PageId pid, const PageFile& pf);
     
@@ -104,10 +463,163 @@ class BTLeafNode {
 
   private:
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * Set the number of keys in the node header.
+    * @param count[IN] the number of keys
     */
-    char buffer[PageFile::PAGE_SIZE];
+    void setKeyCount(int count);
+
+   /**
+    * @return the flags of the node header
+    */
+    short getFlags();
+
+   /**
+    * @return # of bytes a RecordId of a list takes, with its cover
+    */
+    int getRidSize();
+
+   /**
+    * Find the RecordIds of the eid entry kept in the node. A single
+    * RecordId is the value of the entry itself.
+    * @param eid[IN] the entry number
+    * @param offset[OUT] the byte offset of the first RecordId
+    * @param count[OUT] # of RecordIds. 0 if they are in posting pages
+    * @return true if the RecordIds are a list
+    */
+    bool getList(int eid, int& offset, int& count);
+
+   /**
+    * Set the value of the eid entry.
+    */
+    void setValue(int eid, PageId pid, int sid);
+
+   /**
+    * @return the byte offset of the first list of the node. the page size
+    *         if there is none
+    */
+    int getListStart();
+
+   /**
+    * @return the byte offset where the list of the eid entry goes: in
+    *         front of the list of the next entry that has one
+    */
+    int getListEnd(int eid);
+
+   /**
+    * @return # of free bytes between the values and the lists
+    */
+    int getFreeBytes();
+
+   /**
+    * Make a gap of size bytes in front of the byte offset at, by moving
+    * the lists in front of it down. The lists of the entries in front of
+    * the eid entry move; the caller updates the eid entry.
+    */
+    void openGap(int eid, int at, int size);
+
+   /**
+    * Close the gap of size bytes at the byte offset at, by moving the
+    * lists in front of it up. The lists of the entries in front of the eid
+    * entry move; the caller updates the eid entry.
+    */
+    void closeGap(int eid, int at, int size);
+
+   /**
+    * @return # of bytes of the values and the lists the entry takes
+    */
+    int getValueSize(const BTLeafEntry& entry);
+
+   /**
+    * The part of insert() and setRids() that does not check that a packed
+    * node fits in its page.
+    */
+    RC insertRid(int key, const RecordId& rid, const char* cover);
+    RC replaceRids(int eid, const RecordId* rids, int count, const char* covers);
+
+   /**
+    * The columns of a packed node (see BTNODE_PACKED_HEADER_SIZE).
+    */
+    struct Columns;
+
+   /**
+    * Copy the keys and the values of the node into columns.
+    */
+    void getColumns(Columns& columns);
+
+   /**
+    * Copy the keys and the values the entries take in a node into columns.
+    */
+    void getColumns(const BTLeafEntry* entries, int count, Columns& columns);
+
+   /**
+    * @return # of bytes the node takes when packed
+    */
+    int getPackedBytes();
+
+   /**
+    * @return # of bytes the entries take in a packed node
+    */
+    int getPackedBytes(const BTLeafEntry* entries, int count);
+
+   /**
+    * @return # of bytes the node takes when packed, with count RecordIds
+    *         kept in the eid entry (single if not NULL). if newKey, the
+    *         entry is a new one of key in front of the eid entry
+    */
+    int getPackedBytes(int eid, bool newKey, int key, int count, const RecordId* single);
+
+   /**
+    * @return # of bytes the node takes when packed, with (key, rid)
+    *         inserted as insertRid() does
+    */
+    int getPackedBytes(int key, const RecordId& rid);
+
+   /**
+    * Pack the node into a page.
+    * @param to[OUT] the page
+    * @return 0 if successful. RC_NODE_FULL if the node does not fit.
+    */
+    RC pack(char* to);
+
+   /**
+    * Unpack a page into the node.
+    * @param from[IN] the page
+    * @return 0 if successful. RC_INVALID_FILE_FORMAT if the page is broken.
+    */
+    RC unpack(const char* from);
+
+   /**
+    * The content of the node. After read(), it points directly into the
+    * buffer-pool frame of the page, which stays pinned by guard until the
+    * node is read again or destroyed. Otherwise it points to page, which
+    * is where a packed node is always unpacked to.
+    */
+    char* buffer;
+
+   /**
+    * The pin on the disk page the node was read from.
+    */
+    PageGuard guard;
+
+   /**
+    * The private memory buffer of a node that was not read from the disk.
+    */
+    char* page;
+
+   /**
+    * The size of the node in bytes. UNPACKED_SCALE pages for a packed node.
+    */
+    int pageSize;
+
+   /**
+    * The size of the page of a packed node. 0 if the node is not packed.
+    */
+    int packedSize;
+
+   /**
+    * The size of the cover behind a RecordId. 0 if the index does not cover.
+    */
+    int coverSize;
 }; 
 
 
@@ -117,7 +629,11 @@ class BTLeafNode {
 class BTNonLeafNode {
   public:
 
-    BTNonLeafNode(); 
+   /**
+    * @param pageSize[IN] the size of the page the node is stored in
+    */
+    BTNonLeafNode(int pageSize = PageFile::DEFAULT_PAGE_SIZE); 
+    ~BTNonLeafNode();
     
    /**
     * Insert a (key, pid) pair to the node.
@@ -152,6 +668,35 @@ class BTNonLeafNode {
     */
     RC locateChildPtr(int searchKey, PageId& pid);
 
+   /**
+    * Output the child-node pointers that may lead to keys in
+    * [fromKey, toKey], in key order, up to maxCount pointers.
+    * @param fromKey[IN] the smallest key of the range
+    * @param toKey[IN] the largest key of the range
+    * @param pids[OUT] the child-node pointers
+    * @param maxCount[IN] the max # of pointers to output
+    * @return the # of pointers stored in pids
+    */
+    int readChildPtrs(int fromKey, int toKey, PageId* pids, int maxCount);
+
+   /**
+    * Copy out all keys and child-node pointers of the node.
+    * @param keys[OUT] the keys. getKeyCount() of them
+    * @param pids[OUT] the child-node pointers, the leftmost child first.
+    *                  getKeyCount() + 1 of them
+    */
+    void readEntries(int* keys, PageId* pids);
+
+   /**
+    * Replace the keys and child-node pointers of the node.
+    * @param keys[IN] the keys, sorted
+    * @param pids[IN] the child-node pointers, the leftmost child first.
+    *                 count + 1 of them
+    * @param count[IN] # of keys. at most getMaxKeyCount()
+    * @return 0 if successful. Return an error code if they do not fit.
+    */
+    RC setEntries(const int* keys, const PageId* pids, int count);
+
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
@@ -167,11 +712,19 @@ class BTNonLeafNode {
     */
     int getKeyCount();
 
+   /**
+    * Return the max number of keys that fit in the node.
+    * @return the max number of keys in the node
+    */
+    int getMaxKeyCount();
+
    /**
     * Read the content of the node from the page pid in the PageFile pf.
+    * The node takes the page size of pf.
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
-    * @return 0 if successful. Return an error code if there is an error.
+    * @return 0 if successful. RC_INVALID_FILE_FORMAT if the page does not
+    *         hold a node of this kind in the current format.
     */
     RC read(PageId pid, const PageFile& pf);
     
@@ -188,10 +741,468 @@ class BTNonLeafNode {
 
   private:
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * Set the number of keys in the node header.
+    * @param count[IN] the number of keys
+    */
+    void setKeyCount(int count);
+
+   /**
+    * The content of the node. After read(), it points directly into the
+    * buffer-pool frame of the page, which stays pinned by guard until the
+    * node is read again or destroyed. Otherwise it points to page.
+    */
+    char* buffer;
+
+   /**
+    * The pin on the disk page the node was read from.
+    */
+    PageGuard guard;
+
+   /**
+    * The private memory buffer of a node that was not read from the disk.
+    */
+    char* page;
+
+   /**
+    * The size of the node in bytes.
+    */
+    int pageSize;
+}; 
+
+/**
+ * BTPostingNode: The class representing a posting page, which holds a part
+ * of the RecordIds of a key with too many of them for a leaf node.
+ */
+class BTPostingNode {
+  public:
+
+   /**
+    * @param pageSize[IN] the size of the page the node is stored in
+    * @param coverSize[IN] the size of the cover of a RecordId. 0 if the
+    *                      index does not cover
+    */
+    BTPostingNode(int pageSize = PageFile::DEFAULT_PAGE_SIZE, int coverSize = 0); 
+    ~BTPostingNode();
+
+   /**
+    * Insert rid to the node, behind the RecordIds that are <= rid.
+    * @param rid[IN] the RecordId to insert
+    * @param cover[IN] the cover of rid. NULL for an empty one
+    * @return 0 if successful. Return an error code if the node is full.
+    */
+    RC insert(const RecordId& rid, const char* cover = NULL);
+
+   /**
+    * Remove rid from the node.
+    * @param rid[IN] the RecordId to remove
+    * @return 0 if successful. RC_NO_SUCH_RECORD if the node does not have rid.
+    */
+    RC remove(const RecordId& rid);
+
+   /**
+    * Copy out RecordIds of the node.
+    * @param from[IN] the first RecordId to copy
+    * @param rids[OUT] the RecordIds
+    * @param maxCount[IN] the max # of RecordIds to copy
+    * @param covers[OUT] the covers of the RecordIds. may be NULL
+    * @return the # of RecordIds copied
+    */
+    int readRids(int from, RecordId* rids, int maxCount, char* covers = NULL);
+
+   /**
+    * Replace the RecordIds of the node. The key and the page pointers are kept.
+    * @param rids[IN] the RecordIds, sorted
+    * @param count[IN] # of RecordIds
+    * @param covers[IN] the covers of the RecordIds. NULL for empty ones
+    * @return 0 if successful. Return an error code if they do not fit.
+    */
+    RC setRids(const RecordId* rids, int count, const char* covers = NULL);
+
+   /**
+    * @return # of the RecordIds of the node that are smaller than rid
+    */
+    int lowerBound(const RecordId& rid);
+
+   /**
+    * @return # of the RecordIds of the node that are smaller than or equal to rid
+    */
+    int upperBound(const RecordId& rid);
+
+   /**
+    * @return the key the RecordIds belong to
+    */
+    int getKey();
+
+   /**
+    * @param key[IN] the key the RecordIds belong to
+    */
+    void setKey(int key);
+
+   /**
+    * @return the PageId of the next page of the list. 0 if none
+    */
+    PageId getNextNodePtr();
+
+   /**
+    * @param pid[IN] the PageId of the next page of the list
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setNextNodePtr(PageId pid);
+
+   /**
+    * @return the PageId of the previous page of the list. 0 if none
+    */
+    PageId getPrevNodePtr();
+
+   /**
+    * @param pid[IN] the PageId of the previous page of the list
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setPrevNodePtr(PageId pid);
+
+   /**
+    * @return the PageId of the last page of the list. only kept in the
+    *         first page
+    */
+    PageId getLastNodePtr();
+
+   /**
+    * @param pid[IN] the PageId of the last page of the list
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setLastNodePtr(PageId pid);
+
+   /**
+    * Return the number of RecordIds stored in the node.
+    * @return the number of RecordIds in the node
+    */
+    int getRidCount();
+
+   /**
+    * Return the max number of RecordIds that fit in the node.
+    * @return the max number of RecordIds in the node
+    */
+    int getMaxRidCount();
+
+   /**
+    * Read the content of the node from the page pid in the PageFile pf.
+    * The node takes the page size of pf.
+    * @param pid[IN] the PageId to read
+    * @param pf[IN] PageFile to read from
+    * @return 0 if successful. RC_INVALID_FILE_FORMAT if the page does not
+    *         hold a posting page in the current format.
+    */
+    RC read(PageId pid, const PageFile& pf);
+    
+   /**
+    * Write the content of the node to the page pid in the PageFile pf.
+    * @param pid[IN] the PageId to write to
+    * @param pf[IN] PageFile to write to
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC write(PageId pid, PageFile& pf);
+
+  private:
+   /**
+    * Set the number of RecordIds in the node header.
+    * @param count[IN] the number of RecordIds
+    */
+    void setRidCount(int count);
+
+   /**
+    * @return the flags of the node header
+    */
+    short getFlags();
+
+   /**
+    * @return # of bytes a RecordId takes, with its cover
+    */
+    int getRidSize();
+
+   /**
+    * The content of the node. After read(), it points directly into the
+    * buffer-pool frame of the page, which stays pinned by guard until the
+    * node is read again or destroyed. Otherwise it points to page.
+    */
+    char* buffer;
+
+   /**
+    * The pin on the disk page the node was read from.
+    */
+    PageGuard guard;
+
+   /**
+    * The private memory buffer of a node that was not read from the disk.
+    */
+    char* page;
+
+   /**
+    * The size of the node in bytes.
+    */
+    int pageSize;
+
+   /**
+    * The size of the cover behind a RecordId. 0 if the index does not cover.
+    */
+    int coverSize;
+}; 
+
+/**
+ * BTStringNode: The class representing a leaf or a nonleaf node of a
+ * string index.
+ */
+class BTStringNode {
+  public:
+    static const int MAX_KEY_LENGTH = RecordFile::MAX_VALUE_LENGTH - 1;
+                                               /// the longest value a table keeps
+
+   /**
+    * @param pageSize[IN] the size of the page the node is stored in
+    * @param leaf[IN] true for a leaf node
+    */
+    BTStringNode(int pageSize = PageFile::DEFAULT_PAGE_SIZE, bool leaf = true); 
+    ~BTStringNode();
+
+   /**
+    * Compare two keys byte by byte, a shorter key before a longer one
+    * it is a prefix of.
+    * @return < 0, 0 or > 0 if the first key is smaller, equal or larger
+    */
+    static int compare(const char* key1, int length1, const char* key2, int length2);
+
+   /**
+    * Make the shortest key that is larger than one key and not larger
+    * than the next one, to separate two nodes in their parent.
+    * @param last[IN] the last key of a node
+    * @param first[IN] the first key of the next node. >= last
+    * @param separator[OUT] a prefix of first, or first itself if it is last
+    */
+    static void makeSeparator(const std::string& last, const std::string& first, 
+                              std::string& separator);
+
+   /**
+    * Make the node an empty leaf or nonleaf node.
+    * @param leaf[IN] true for a leaf node
+    */
+    void initialize(bool leaf);
+
+   /**
+    * @return true if the node is a leaf
+    */
+    bool isLeaf();
+
+   /**
+    * Find the first entry with a key >= key (> key if upper).
+    * @param key[IN] the key to search for
+    * @param upper[IN] true to skip the entries with the key
+    * @return the entry number. getKeyCount() if there is none
+    */
+    int locate(const std::string& key, bool upper = false);
+
+   /**
+    * Insert a (key, rid) entry to a leaf at eid, moving the entries from
+    * eid on back. The keys have to stay sorted.
+    * @param eid[IN] the entry number of the new entry
+    * @param key[IN] the key. at most MAX_KEY_LENGTH bytes
+    * @param rid[IN] the RecordId
+    * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+    */
+    RC insert(int eid, const std::string& key, const RecordId& rid);
+
+   /**
+    * Insert a (key, pid) entry to a nonleaf node at eid, i.e., with pid
+    * behind the eid-th child-node pointer.
+    * @param eid[IN] the entry number of the new entry
+    * @param key[IN] the key. at most MAX_KEY_LENGTH bytes
+    * @param pid[IN] the child-node pointer
+    * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+    */
+    RC insert(int eid, const std::string& key, PageId pid);
+
+   /**
+    * Remove the eid-th entry of a leaf. The bytes it took are given back
+    * to the free space in the middle of the node.
+    * @param eid[IN] the entry number
+    * @return 0 if successful. RC_INVALID_CURSOR if there is no such entry
+    */
+    RC remove(int eid);
+
+   /**
+    * Move the entries of the second half (in bytes) of the node to an
+    * empty sibling node. For a leaf, siblingKey is the shortest key that
+    * is larger than the last key of the node and not larger than the
+    * first key of the sibling. For a nonleaf node, the middle key moves
+    * up in siblingKey, and its child pointer becomes the leftmost child
+    * of the sibling. The sibling pointers are left to the caller.
+    * @param sibling[IN] the sibling node. MUST be empty
+    * @param siblingKey[OUT] the key to insert to the parent node
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC split(BTStringNode& sibling, std::string& siblingKey);
+
+   /**
+    * @param eid[IN] the entry number
+    * @param key[OUT] the key of the entry
+    */
+    void readKey(int eid, std::string& key);
+
+   /**
+    * @param eid[IN] the entry number of a leaf entry
+    * @return the RecordId of the entry
+    */
+    RecordId readRid(int eid);
+
+   /**
+    * Copy out the entries of a leaf from eid on.
+    * @param eid[IN/OUT] the first entry to copy. moves behind the last one
+    * @param keys[OUT] the keys
+    * @param rids[OUT] the RecordIds
+    * @param maxCount[IN] the max # of entries to copy
+    * @return the # of entries copied
+    */
+    int readEntries(int& eid, std::string* keys, RecordId* rids, int maxCount);
+
+   /**
+    * @param slot[IN] the pointer number. 0 for the leftmost child
+    * @return the slot-th child-node pointer of a nonleaf node
+    */
+    PageId getChildPtr(int slot);
+
+   /**
+    * Given the searchKey, find the child-node pointer to follow: the
+    * child in front of the first key >= searchKey, which leads to the
+    * leftmost leaf with searchKey, or in front of the first key >
+    * searchKey if upper, which leads to the rightmost one.
+    * @param searchKey[IN] the searchKey that is being looked up.
+    * @param slot[OUT] the pointer number of the child
+    * @param upper[IN] true to follow the rightmost child with searchKey
+    * @return the pointer to the child node to follow
+    */
+    PageId locateChildPtr(const std::string& searchKey, int& slot, bool upper = false);
+
+   /**
+    * Initialize the root node with (pid1, key, pid2).
+    * @param pid1[IN] the first PageId to insert
+    * @param key[IN] the key that should be inserted between the two PageIds
+    * @param pid2[IN] the PageId to insert behind the key
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC initializeRoot(PageId pid1, const std::string& key, PageId pid2);
+
+   /**
+    * @param pid[IN] the leftmost child-node pointer of a nonleaf node
+    */
+    void setLeftmostPtr(PageId pid);
+
+   /**
+    * @return the PageId of the next sibling of a leaf. 0 if none
+    */
+    PageId getNextNodePtr();
+
+   /**
+    * @param pid[IN] the PageId of the next sibling of a leaf
+    */
+    void setNextNodePtr(PageId pid);
+
+   /**
+    * @return the PageId of the previous sibling of a leaf. 0 if none
+    */
+    PageId getPrevNodePtr();
+
+   /**
+    * @param pid[IN] the PageId of the previous sibling of a leaf
+    */
+    void setPrevNodePtr(PageId pid);
+
+   /**
+    * @param keyLength[IN] the length of a key
+    * @return # of bytes an entry with the key takes, with its offset
+    */
+    int getEntrySize(int keyLength);
+
+   /**
+    * @return # of bytes the entries of the node take, with their offsets
+    */
+    int getUsedBytes();
+
+   /**
+    * @return # of bytes the entries of a node can take
+    */
+    int getCapacity();
+
+   /**
+    * Return the number of keys stored in the node.
+    * @return the number of keys in the node
+    */
+    int getKeyCount();
+
+   /**
+    * Read the content of the node from the page pid in the PageFile pf.
+    * The node takes the page size of pf, and becomes a leaf or a nonleaf
+    * node as the page says.
+    * @param pid[IN] the PageId to read
+    * @param pf[IN] PageFile to read from
+    * @return 0 if successful. RC_INVALID_FILE_FORMAT if the page does not
+    *         hold a node of a string index in the current format.
+    */
+    RC read(PageId pid, const PageFile& pf);
+    
+   /**
+    * Write the content of the node to the page pid in the PageFile pf.
+    * @param pid[IN] the PageId to write to
+    * @param pf[IN] PageFile to write to
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC write(PageId pid, PageFile& pf);
+
+  private:
+   /**
+    * Set the number of keys in the node header.
+    * @param count[IN] the number of keys
+    */
+    void setKeyCount(int count);
+
+   /**
+    * @param eid[IN] the entry number
+    * @param length[OUT] the length of the key of the entry
+    * @return the key of the entry, in the node
+    */
+    const char* getKey(int eid, int& length);
+
+   /**
+    * Insert an entry at eid.
+    * @param value[IN] the RecordId or the child-node pointer of the entry
+    * @param valueSize[IN] the size of value
+    * @return 0 if successful. RC_NODE_FULL if the entry does not fit.
+    */
+    RC insertEntry(int eid, const std::string& key, const void* value, int valueSize);
+
+   /**
+    * @return the size of the RecordId or the child-node pointer of an entry
+    */
+    int getValueSize();
+
+   /**
+    * The content of the node. After read(), it points directly into the
+    * buffer-pool frame of the page, which stays pinned by guard until the
+    * node is read again or destroyed. Otherwise it points to page.
+    */
+    char* buffer;
+
+   /**
+    * The pin on the disk page the node was read from.
+    */
+    PageGuard guard;
+
+   /**
+    * The private memory buffer of a node that was not read from the disk.
+    */
+    char* page;
+
+   /**
+    * The size of the node in bytes.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    int pageSize;
 }; 
 
 #endif /* BTREENODE_H */
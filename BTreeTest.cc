@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * A test of a B+tree index shared by several threads (see
+ * BTreeIndex::setShared()). Writer threads insert and remove keys while
+ * reader threads scan the index forward and backward, and the index is
+ * checked when they are done. The output does not depend on how the
+ * threads interleave, so that test.sh can add it to result.txt.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "BTreeNode.h"
+#include "PageFile.h"
+
+using std::vector;
+
+static const char* INDEX_NAME = "btreetest.idx";
+static const int PAGE_SIZE = 1024;  // small nodes, for many splits and merges
+static const int KEYS = 4000;       // # of keys that are there all the time
+static const int WRITERS = 4;
+static const int READERS = 4;
+static const int SCAN_BATCH = 5;    // # of pairs a scan reads at once
+static const int SCAN_LENGTH = 300; // max # of batches of a scan
+
+static std::atomic<int> errors(0);
+
+static void fail(const char* what, int key)
+{
+  if (errors++ < 10) printf("  error: %s (key %d)\n", what, key);
+}
+
+static RecordId ridOf(int key)
+{
+  RecordId rid;
+  rid.pid = key;
+  rid.sid = 0;
+  return rid;
+}
+
+// the keys 4k are inserted before the threads start and stay. writer w
+// inserts the keys 4k + 1 and 4k + 3 with k % WRITERS == w, and then
+// removes the keys 4k + 3 again.
+static void writeKeys(BTreeIndex& index, int w)
+{
+  for (int k = w; k < KEYS; k += WRITERS) {
+    if (index.insert(4*k + 1, ridOf(4*k + 1)) < 0) fail("insert", 4*k + 1);
+    if (index.insert(4*k + 3, ridOf(4*k + 3)) < 0) fail("insert", 4*k + 3);
+  }
+  for (int k = w; k < KEYS; k += WRITERS) {
+    if (index.remove(4*k + 3, ridOf(4*k + 3)) < 0) fail("remove", 4*k + 3);
+  }
+}
+
+// scan a part of the index forward or backward from a random key. the
+// keys have to come out in order, and none of the keys 4k the scan went
+// over may be missing.
+static void scan(BTreeIndex& index, bool backward, unsigned& seed)
+{
+  IndexCursor cursor;
+  int keys[SCAN_BATCH], count;
+  RecordId rids[SCAN_BATCH];
+  vector<int> seen;
+
+  int start = rand_r(&seed) % (4*KEYS);
+  if (backward) index.locateBackward(start, cursor);
+  else index.locate(start, cursor);
+  for (int i = 0; i < SCAN_LENGTH; i++) {
+    RC rc = backward ? index.readBatchBackward(cursor, INT_MIN, keys, rids, SCAN_BATCH, count)
+                     : index.readBatch(cursor, INT_MAX, keys, rids, SCAN_BATCH, count);
+    if (rc < 0) break;
+    seen.insert(seen.end(), keys, keys + count);
+  }
+  if (seen.empty()) return;
+
+  if (backward) std::reverse(seen.begin(), seen.end());
+  for (unsigned i = 1; i < seen.size(); i++) {
+    if (seen[i] <= seen[i - 1]) {
+      fail(backward ? "backward scan out of order" : "forward scan out of order", seen[i]);
+      return;
+    }
+  }
+  for (int key = (seen.front() + 3) / 4 * 4; key <= seen.back(); key += 4) {
+    if (!std::binary_search(seen.begin(), seen.end(), key)) {
+      fail(backward ? "backward scan skipped a key" : "forward scan skipped a key", key);
+      return;
+    }
+  }
+}
+
+static void readKeys(BTreeIndex& index, int r, const std::atomic<int>& writing)
+{
+  unsigned seed = r + 1;
+  do {
+    scan(index, r % 2, seed);
+  } while (writing > 0);
+}
+
+// the keys the index has to have when the threads are done
+static bool expected(int key)
+{
+  return key >= 0 && key < 4*KEYS && key % 4 < 2;
+}
+
+// walk the leaves from the first one through their next node pointers.
+// every leaf has to point back to the one in front of it, and the keys
+// have to go up from leaf to leaf.
+static void checkLeafChain(PageId first, bool packed)
+{
+  PageFile pf;
+  if (pf.open(INDEX_NAME, 'r') < 0) {
+    fail("cannot open the index file", 0);
+    return;
+  }
+
+  // (the leaf keeps its page pinned until it goes)
+  {
+    BTLeafNode leaf(pf.getPageSize(), 0, packed);
+    PageId pid = first, prevPid = 0;
+    int lastKey = INT_MIN, total = 0;
+    while (pid > 0) {
+      if (leaf.read(pid, pf) < 0) {
+        fail("cannot read a leaf", pid);
+        break;
+      }
+      if (leaf.getPrevNodePtr() != prevPid) {
+        fail("leaf does not point back to the leaf in front of it", pid);
+        break;
+      }
+      for (int eid = 0; eid < leaf.getKeyCount(); eid++) {
+        int key;
+        leaf.readKey(eid, key);
+        if (key <= lastKey) fail("leaf keys out of order", key);
+        lastKey = key;
+        total++;
+      }
+      prevPid = pid;
+      pid = leaf.getNextNodePtr();
+    }
+    if (total != 2*KEYS) fail("leaf chain has a wrong number of keys", total);
+  }
+  pf.close();
+}
+
+static void run(bool packed)
+{
+  BTreeIndex index;
+  IndexCursor cursor;
+  int key;
+  RecordId rid;
+
+  remove(INDEX_NAME);
+  if (index.open(INDEX_NAME, 'w', PAGE_SIZE, 0, packed) < 0) {
+    fail("cannot create the index", 0);
+    return;
+  }
+  for (int k = 0; k < KEYS; k++) {
+    if (index.insert(4*k, ridOf(4*k)) < 0) fail("insert", 4*k);
+  }
+
+  index.setShared(true);
+  std::atomic<int> writing(WRITERS);
+  vector<std::thread> threads;
+  for (int w = 0; w < WRITERS; w++) {
+    threads.push_back(std::thread([&, w] { writeKeys(index, w); writing--; }));
+  }
+  for (int r = 0; r < READERS; r++) {
+    threads.push_back(std::thread([&, r] { readKeys(index, r, writing); }));
+  }
+  for (unsigned i = 0; i < threads.size(); i++) threads[i].join();
+  index.setShared(false);
+
+  // the whole index, both ways
+  vector<int> forward, backward;
+  index.locate(INT_MIN, cursor);
+  PageId first = cursor.pid;
+  while (index.readForward(cursor, key, rid) == 0) forward.push_back(key);
+  index.locateBackward(INT_MAX, cursor);
+  while (index.readBackward(cursor, key, rid) == 0) backward.push_back(key);
+  std::reverse(backward.begin(), backward.end());
+
+  int count = 0;
+  for (unsigned i = 0; i < forward.size(); i++) {
+    if (!expected(forward[i]) || (i > 0 && forward[i] <= forward[i - 1])) {
+      fail("wrong key in a forward scan of the index", forward[i]);
+      break;
+    }
+    count++;
+  }
+  if (count != 2*KEYS) fail("forward scan has a wrong number of keys", count);
+  if (backward != forward) fail("backward scan differs from forward scan", (int)backward.size());
+  index.close();
+
+  checkLeafChain(first, packed);
+  remove(INDEX_NAME);
+}
+
+int main()
+{
+  run(false);
+  printf("shared index, %d writers and %d readers: %s\n", WRITERS, READERS,
+         errors ? "FAILED" : "ok");
+  int failed = errors;
+  errors = 0;
+
+  run(true);
+  printf("shared packed index, %d writers and %d readers: %s\n", WRITERS, READERS,
+         errors ? "FAILED" : "ok");
+  return (failed || errors) ? 1 : 0;
+}
@@ -0,0 +1,498 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Bruinbase.h"
+#include "BufferPool.h"
+#include "PageFile.h"
+
+using std::vector;
+
+int BufferPool::configuredFrameCount = BufferPool::DEFAULT_FRAME_COUNT;
+int BufferPool::configuredShardCount = BufferPool::DEFAULT_SHARD_COUNT;
+BufferPool::Policy BufferPool::configuredPolicy = BufferPool::DEFAULT_POLICY;
+std::mutex BufferPool::instancesLatch;
+std::unordered_map<int, BufferPool*> BufferPool::instances;
+std::mutex BufferPool::filesLatch;
+vector<std::pair<dev_t, ino_t> > BufferPool::files;
+vector<PageFile*> BufferPool::writers;
+
+RC BufferPool::configure(int frameCount, int shardCount, Policy policy)
+{
+  std::lock_guard<std::mutex> lock(instancesLatch);
+
+  // the pools cannot be resized once pages have been cached
+  if (!instances.empty()) return RC_INVALID_ATTRIBUTE;
+  if (frameCount <= 0 || shardCount <= 0) return RC_INVALID_ATTRIBUTE;
+
+  configuredFrameCount = frameCount;
+  configuredShardCount = shardCount;
+  configuredPolicy = policy;
+  return 0;
+}
+
+const char* BufferPool::getPolicyName(Policy policy)
+{
+  switch (policy) {
+  case CLOCK:
+    return "clock";
+  case LRU:
+    return "lru";
+  default:
+    return "2q";
+  }
+}
+
+vector<BufferPool*> BufferPool::getInstances()
+{
+  vector<BufferPool*> pools;
+  std::lock_guard<std::mutex> lock(instancesLatch);
+
+  // the page sizes are powers of two, so this finds them in order
+  for (int size = 1; size > 0; size <<= 1) {
+    std::unordered_map<int, BufferPool*>::iterator it = instances.find(size);
+    if (it != instances.end()) pools.push_back(it->second);
+  }
+  return pools;
+}
+
+BufferPool& BufferPool::getInstance(int pageSize)
+{
+  std::lock_guard<std::mutex> lock(instancesLatch);
+
+  std::unordered_map<int, BufferPool*>::iterator it = instances.find(pageSize);
+  if (it != instances.end()) return *it->second;
+
+  // give every pool the same amount of memory
+  int frameCount = (int)((long long)configuredFrameCount * FRAME_UNIT / pageSize);
+  if (frameCount < MIN_SHARD_FRAMES) frameCount = MIN_SHARD_FRAMES;
+
+  // a page is evicted from its own shard only, so every shard needs
+  // enough frames for the pages a query keeps pinned at the same time
+  int shardCount = frameCount / MIN_SHARD_FRAMES;
+  if (shardCount > configuredShardCount) shardCount = configuredShardCount;
+
+  BufferPool* pool = new BufferPool(pageSize, frameCount, shardCount, configuredPolicy);
+  instances[pageSize] = pool;
+  return *pool;
+}
+
+BufferPool::BufferPool(int pageSize, int frameCount, int shardCount, Policy policy)
+  : pageSize(pageSize), frameCount(frameCount), policy(policy),
+    shards(shardCount), hits(0), misses(0), accesses(0)
+{
+  // distribute the frames evenly over the shards.
+  // the frame buffers are allocated lazily when a shard fills up,
+  // so a large pool costs nothing until it is actually used.
+  for (int i = 0; i < shardCount; i++) {
+    Shard& s = shards[i];
+    s.capacity = frameCount / shardCount + (i < frameCount % shardCount ? 1 : 0);
+    s.frames.reserve(s.capacity);
+    s.clockHand = 0;
+    for (int q = 0; q < QUEUE_COUNT; q++) {
+      s.queues[q].head = s.queues[q].tail = -1;
+      s.queues[q].size = 0;
+    }
+
+    // the sizes of A1in and A1out recommended by the 2Q paper
+    s.inCapacity = s.capacity / 4;
+    if (s.inCapacity < 1) s.inCapacity = 1;
+    s.ghostCapacity = s.capacity / 2;
+  }
+}
+
+BufferPool::~BufferPool()
+{
+  for (unsigned i = 0; i < shards.size(); i++) {
+    for (unsigned j = 0; j < shards[i].frames.size(); j++) {
+      delete [] shards[i].frames[j].buffer;
+    }
+  }
+}
+
+int BufferPool::getFileId(dev_t dev, ino_t ino)
+{
+  std::lock_guard<std::mutex> lock(filesLatch);
+
+  for (unsigned i = 0; i < files.size(); i++) {
+    if (files[i].first == dev && files[i].second == ino) return i;
+  }
+  files.push_back(std::make_pair(dev, ino));
+  writers.push_back(NULL);
+  return files.size() - 1;
+}
+
+void BufferPool::setWriter(int fileId, PageFile* writer)
+{
+  std::lock_guard<std::mutex> lock(filesLatch);
+  writers[fileId] = writer;
+}
+
+PageFile* BufferPool::getWriter(int fileId)
+{
+  std::lock_guard<std::mutex> lock(filesLatch);
+  return writers[fileId];
+}
+
+void BufferPool::invalidateFileInAllPools(int fileId)
+{
+  vector<BufferPool*> pools = getInstances();
+  for (unsigned i = 0; i < pools.size(); i++) pools[i]->invalidateFile(fileId);
+}
+
+uint64_t BufferPool::makeKey(int fileId, PageId pid)
+{
+  return ((uint64_t)(uint32_t)fileId << 32) | (uint32_t)pid;
+}
+
+BufferPool::Shard& BufferPool::getShard(uint64_t key)
+{
+  // multiplicative hashing spreads consecutive pids over the shards
+  uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+  return shards[(h >> 32) % shards.size()];
+}
+
+void BufferPool::drop(Shard& s, Frame& frame)
+{
+  s.table.erase(makeKey(frame.fileId, frame.pid));
+  if (frame.queue >= 0) dequeue(s, &frame - &s.frames[0]);
+  frame.valid = false;
+  frame.dirty = false;
+
+  // a pinned frame is freed when its last pin is given up
+  if (frame.pinCount == 0) s.freeSlots.push_back(&frame - &s.frames[0]);
+}
+
+void BufferPool::enqueue(Shard& s, int queue, int slot)
+{
+  Queue& q = s.queues[queue];
+  Frame& f = s.frames[slot];
+
+  f.queue = queue;
+  f.prev = q.tail;
+  f.next = -1;
+  if (q.tail >= 0) s.frames[q.tail].next = slot;
+  else q.head = slot;
+  q.tail = slot;
+  q.size++;
+}
+
+void BufferPool::dequeue(Shard& s, int slot)
+{
+  Frame& f = s.frames[slot];
+  Queue& q = s.queues[f.queue];
+
+  if (f.prev >= 0) s.frames[f.prev].next = f.next;
+  else q.head = f.next;
+  if (f.next >= 0) s.frames[f.next].prev = f.prev;
+  else q.tail = f.prev;
+  q.size--;
+
+  f.queue = f.prev = f.next = -1;
+}
+
+bool BufferPool::touch(Shard& s, int slot, bool speculative)
+{
+  Frame& f = s.frames[slot];
+  long long now = accesses++;
+
+  if (speculative) return false;
+
+  bool prefetchHit = f.prefetched;
+  f.prefetched = false;
+
+  switch (policy) {
+  case CLOCK:
+    f.referenced = true;
+    break;
+  case LRU:
+    dequeue(s, slot);
+    enqueue(s, MAIN_QUEUE, slot);
+    break;
+  case TWO_QUEUE:
+    if (f.queue == MAIN_QUEUE) {
+      dequeue(s, slot);
+      enqueue(s, MAIN_QUEUE, slot);
+    } else if (!f.referenced) {
+      // the first request of a prefetched page
+      f.referenced = true;
+    } else if (now - f.lastAccess > CORRELATED_ACCESSES) {
+      // a page requested again on its own account is a hot page
+      dequeue(s, slot);
+      enqueue(s, MAIN_QUEUE, slot);
+    }
+    break;
+  }
+  f.lastAccess = now;
+  return prefetchHit;
+}
+
+void BufferPool::admit(Shard& s, int slot, uint64_t key, bool speculative)
+{
+  std::unordered_map<uint64_t, std::list<uint64_t>::iterator>::iterator it;
+  Frame& f = s.frames[slot];
+
+  // (CLOCK gives a prefetched page its second chance too, so that it is
+  // not evicted before the reader gets to it)
+  f.referenced = (policy == CLOCK) || !speculative;
+  f.prefetched = speculative;
+  f.lastAccess = accesses++;
+
+  switch (policy) {
+  case CLOCK:
+    break;
+  case LRU:
+    enqueue(s, MAIN_QUEUE, slot);
+    break;
+  case TWO_QUEUE:
+    // a page requested again after it left A1in is a hot page
+    it = s.ghostTable.find(key);
+    if (it != s.ghostTable.end()) {
+      s.ghosts.erase(it->second);
+      s.ghostTable.erase(it);
+      enqueue(s, MAIN_QUEUE, slot);
+    } else {
+      enqueue(s, IN_QUEUE, slot);
+    }
+    break;
+  }
+}
+
+bool BufferPool::tryEvict(Shard& s, int slot)
+{
+  Frame& f = s.frames[slot];
+
+  // a dirty victim is written back first. (if that fails, it is skipped.)
+  if (f.pinCount > 0) return false;
+  if (f.dirty && writeBack(f) < 0) return false;
+
+  drop(s, f);
+  return true;
+}
+
+bool BufferPool::evictFrom(Shard& s, int queue, bool remember)
+{
+  for (int slot = s.queues[queue].head; slot >= 0; slot = s.frames[slot].next) {
+    uint64_t key = makeKey(s.frames[slot].fileId, s.frames[slot].pid);
+    if (!tryEvict(s, slot)) continue;
+
+    // remember the pages evicted from A1in in A1out
+    if (remember && s.ghostCapacity > 0) {
+      s.ghosts.push_back(key);
+      s.ghostTable[key] = --s.ghosts.end();
+      if ((int)s.ghosts.size() > s.ghostCapacity) {
+        s.ghostTable.erase(s.ghosts.front());
+        s.ghosts.pop_front();
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+bool BufferPool::evict(Shard& s)
+{
+  switch (policy) {
+  case CLOCK:
+    // run the CLOCK hand until we find an unpinned frame that was not
+    // referenced since the hand passed it the last time.
+    // two full rounds without a victim means that every frame is pinned.
+    for (int i = 0; i < 2 * s.capacity; i++) {
+      int slot = s.clockHand;
+      Frame& f = s.frames[slot];
+      s.clockHand = (s.clockHand + 1) % s.capacity;
+
+      if (f.valid && !f.referenced && tryEvict(s, slot)) return true;
+      f.referenced = false;
+    }
+    return false;
+
+  case LRU:
+    return evictFrom(s, MAIN_QUEUE, false);
+
+  default:
+    // evict from A1in while it is over its share, from Am otherwise.
+    // if every frame of the chosen queue is pinned, try the other one.
+    if (s.queues[IN_QUEUE].size > s.inCapacity || s.queues[MAIN_QUEUE].size == 0) {
+      return evictFrom(s, IN_QUEUE, true) || evictFrom(s, MAIN_QUEUE, false);
+    }
+    return evictFrom(s, MAIN_QUEUE, false) || evictFrom(s, IN_QUEUE, true);
+  }
+}
+
+RC BufferPool::writeBack(Frame& frame)
+{
+  // without a writer, the page has nowhere to go and cannot be evicted
+  PageFile* writer = getWriter(frame.fileId);
+  if (writer == NULL) return RC_FILE_WRITE_FAILED;
+
+  RC rc = writer->writeFrame(frame.pid, frame.buffer);
+  if (rc == 0) frame.dirty = false;
+  return rc;
+}
+
+BufferPool::Frame* BufferPool::lookup(int fileId, PageId pid)
+{
+  uint64_t key = makeKey(fileId, pid);
+  Shard& s = getShard(key);
+  std::unique_lock<std::mutex> lock(s.latch);
+
+  for (;;) {
+    std::unordered_map<uint64_t, int>::iterator it = s.table.find(key);
+    if (it == s.table.end()) return NULL;
+
+    Frame* frame = &s.frames[it->second];
+    if (frame->loading) {
+      // another thread is reading the page. wait for it and look again,
+      // since the read may have failed.
+      s.loaded.wait(lock);
+      continue;
+    }
+
+    touch(s, it->second, false);
+    frame->pinCount++;
+    return frame;
+  }
+}
+
+BufferPool::Frame* BufferPool::fix(int fileId, PageId pid, bool& loaded,
+                                   bool speculative, bool* prefetchHit)
+{
+  uint64_t key = makeKey(fileId, pid);
+  Shard& s = getShard(key);
+  std::unique_lock<std::mutex> lock(s.latch);
+  int slot;
+
+  // if the page is already cached, simply pin it
+  for (;;) {
+    std::unordered_map<uint64_t, int>::iterator it = s.table.find(key);
+    if (it == s.table.end()) break;
+
+    Frame* frame = &s.frames[it->second];
+    if (frame->loading) {
+      s.loaded.wait(lock);
+      continue;
+    }
+
+    bool first = touch(s, it->second, speculative);
+    if (prefetchHit != NULL) *prefetchHit = first;
+    frame->pinCount++;
+    loaded = true;
+    hits++;
+    return frame;
+  }
+
+  if (s.freeSlots.empty()) {
+    if ((int)s.frames.size() < s.capacity) {
+      // the shard is not full yet. grow it by one frame.
+      Frame f;
+      f.valid = false;
+      f.loading = false;
+      f.dirty = false;
+      f.prefetched = false;
+      f.referenced = false;
+      f.queue = f.prev = f.next = -1;
+      f.pinCount = 0;
+      f.buffer = new char[pageSize];
+      s.frames.push_back(f);
+      s.freeSlots.push_back(s.frames.size() - 1);
+    } else if (!evict(s)) {
+      // every frame is pinned
+      return NULL;
+    }
+  }
+  slot = s.freeSlots.back();
+  s.freeSlots.pop_back();
+
+  Frame* frame = &s.frames[slot];
+  frame->fileId = fileId;
+  frame->pid = pid;
+  frame->valid = true;
+  frame->loading = true;
+  frame->pinCount = 1;
+  s.table[key] = slot;
+  admit(s, slot, key, speculative);
+  misses++;
+  if (prefetchHit != NULL) *prefetchHit = false;
+
+  loaded = false;
+  return frame;
+}
+
+void BufferPool::finishLoad(Frame* frame, bool success)
+{
+  uint64_t key = makeKey(frame->fileId, frame->pid);
+  Shard& s = getShard(key);
+  std::lock_guard<std::mutex> lock(s.latch);
+
+  // a frame invalidated while it was loading is dropped already, and the
+  // page may have a newer frame by now, which stays
+  frame->loading = false;
+  std::unordered_map<uint64_t, int>::iterator it = s.table.find(key);
+  if (!success && frame->valid && it != s.table.end() && it->second == frame - &s.frames[0]) {
+    drop(s, *frame);
+  }
+  s.loaded.notify_all();
+}
+
+bool BufferPool::unpin(Frame* frame, bool dirty)
+{
+  Shard& s = getShard(makeKey(frame->fileId, frame->pid));
+  std::lock_guard<std::mutex> lock(s.latch);
+
+  bool dirtied = dirty && frame->valid && !frame->dirty;
+  if (dirtied) frame->dirty = true;
+
+  // a frame dropped while it was pinned is free now
+  if (--frame->pinCount == 0 && !frame->valid) {
+    s.freeSlots.push_back(frame - &s.frames[0]);
+  }
+
+  return dirtied;
+}
+
+void BufferPool::collectDirty(int fileId, vector<Frame*>& frames)
+{
+  for (unsigned i = 0; i < shards.size(); i++) {
+    Shard& s = shards[i];
+    std::lock_guard<std::mutex> lock(s.latch);
+
+    for (unsigned j = 0; j < s.frames.size(); j++) {
+      Frame& f = s.frames[j];
+      if (f.valid && f.dirty && f.fileId == fileId) {
+        // the page is marked clean before it is written. if it is modified
+        // again in the meantime, it simply becomes dirty again.
+        f.dirty = false;
+        f.pinCount++;
+        frames.push_back(&f);
+      }
+    }
+  }
+}
+
+void BufferPool::invalidate(int fileId, PageId pid)
+{
+  uint64_t key = makeKey(fileId, pid);
+  Shard& s = getShard(key);
+  std::lock_guard<std::mutex> lock(s.latch);
+
+  std::unordered_map<uint64_t, int>::iterator it = s.table.find(key);
+  if (it == s.table.end()) return;
+
+  drop(s, s.frames[it->second]);
+}
+
+void BufferPool::invalidateFile(int fileId)
+{
+  for (unsigned i = 0; i < shards.size(); i++) {
+    Shard& s = shards[i];
+    std::lock_guard<std::mutex> lock(s.latch);
+
+    for (unsigned j = 0; j < s.frames.size(); j++) {
+      Frame& f = s.frames[j];
+      if (f.valid && f.fileId == fileId) drop(s, f);
+    }
+  }
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <vector>
+#include <list>
+#include <atomic>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <sys/types.h>
+#include "Bruinbase.h"
+
+typedef int PageId;
+class PageFile;
+
+/**
+ * The page cache shared by every PageFile in the process with the same
+ * page size. (there is one pool per page size in use.)
+ * A page is identified by (file id, pid). The frames are split into
+ * shards by the hash of the page identifier, and every shard keeps its
+ * own hash table, CLOCK hand and latch, so that a lookup never touches
+ * more than one shard and threads working on different shards never wait
+ * for each other.
+ *
+ * Every frame handed out by lookup() or fix() is pinned and must be given
+ * back with unpin(). A pinned frame is never evicted.
+ *
+ * The victim of an eviction is chosen by the replacement policy of the
+ * pool, within the shard of the new page:
+ *  - CLOCK: the second-chance approximation of LRU.
+ *  - LRU: least recently used first.
+ *  - TWO_QUEUE: the 2Q policy. A page enters a small FIFO queue (A1in)
+ *    and is promoted to the main LRU queue (Am) only if it is requested
+ *    again after it has left A1in (which is remembered in the ghost queue
+ *    A1out), or if it is requested again while in A1in more than
+ *    CORRELATED_ACCESSES pool accesses after its last request. (the
+ *    back-to-back requests of a scan reading the records of a page one by
+ *    one are correlated and do not count.) A page read once by a scan
+ *    never reaches Am, so a scan cannot push the frequently used pages
+ *    (e.g., the upper levels of a B+tree) out of the pool.
+ *
+ * The pool is a write-back cache. A modified page is only marked dirty and
+ * is written to the disk when its frame is evicted, or when its file is
+ * flushed. A dirty page is written through the PageFile registered as the
+ * writer of its file with setWriter().
+ */
+class BufferPool {
+ public:
+  static const int DEFAULT_FRAME_COUNT = 4096;  // 4MB of 1KB frames
+  static const int FRAME_UNIT = 1024;           // frame counts are in 1KB units
+  static const int DEFAULT_SHARD_COUNT = 16;
+  static const int MIN_SHARD_FRAMES = 16;       // min # of frames per shard
+
+  /**
+   * the replacement policies. see the class comment.
+   */
+  enum Policy { CLOCK, LRU, TWO_QUEUE };
+  static const Policy DEFAULT_POLICY = TWO_QUEUE;
+  static const int CORRELATED_ACCESSES = 4;
+
+  /**
+   * a cache slot holding one page.
+   * all fields except buffer are protected by the latch of the shard.
+   */
+  struct Frame {
+    int    fileId;      // file id of the cached page
+    PageId pid;         // page id of the cached page
+    bool   valid;       // false if the frame does not hold any page
+    bool   loading;     // true while the page is being read into buffer
+    bool   referenced;  // second-chance bit of the CLOCK policy. for 2Q,
+                        //   false until a prefetched page is requested
+    long long lastAccess;  // the pool access count at the last request
+    int    queue;       // the LRU/2Q queue holding the frame. -1 if none
+    int    prev;        // the previous frame (slot) in the queue. -1 if none
+    int    next;        // the next frame (slot) in the queue. -1 if none
+    bool   dirty;       // true if buffer is newer than the disk page
+    bool   prefetched;  // true if the page was read ahead of its use and
+                        //   has not been requested since
+    int    pinCount;    // # of users holding the page.
+                        //   a pinned frame is never evicted
+    char*  buffer;      // the page content
+  };
+
+  /**
+   * set the size of the buffer pools.
+   * must be called before the first PageFile is opened.
+   * every pool gets the memory of frameCount 1KB frames, i.e., a pool of
+   * 4KB pages has frameCount/4 frames.
+   * @param frameCount[IN] # of 1KB frames in each pool
+   * @param shardCount[IN] # of shards the frames are split into
+   * @param policy[IN] the replacement policy
+   * @return error code. 0 if no error
+   */
+  static RC configure(int frameCount, int shardCount, Policy policy = DEFAULT_POLICY);
+
+  /**
+   * @param policy[IN] a replacement policy
+   * @return the name of the policy ("clock", "lru" or "2q")
+   */
+  static const char* getPolicyName(Policy policy);
+
+  /**
+   * @return the pools created so far, in the order of their page sizes
+   */
+  static std::vector<BufferPool*> getInstances();
+
+  /**
+   * @param pageSize[IN] the page size
+   * @return the buffer pool of the process for pages of the given size
+   */
+  static BufferPool& getInstance(int pageSize);
+
+  /**
+   * map a unix file to the id used to identify its pages in the pools.
+   * the same file always gets the same id, however many times it is opened.
+   * @param dev[IN] device of the file
+   * @param ino[IN] inode number of the file
+   * @return the file id
+   */
+  static int getFileId(dev_t dev, ino_t ino);
+
+  /**
+   * drop all cached pages of a file from every pool.
+   * (a file may have been recreated with a different page size.)
+   * @param fileId[IN] the file id
+   */
+  static void invalidateFileInAllPools(int fileId);
+
+  /**
+   * register the PageFile that writes back the dirty pages of a file.
+   * @param fileId[IN] the file id
+   * @param writer[IN] the PageFile with the file open for writing.
+   *                   NULL when the file is closed
+   */
+  static void setWriter(int fileId, PageFile* writer);
+
+  /**
+   * @param fileId[IN] the file id
+   * @return the PageFile registered as the writer of the file, or NULL
+   */
+  static PageFile* getWriter(int fileId);
+
+  /**
+   * find the frame caching a page, pin it and mark it as recently used.
+   * if the page is being read by another thread, wait until it is loaded.
+   * @param fileId[IN] the file id of the page
+   * @param pid[IN] the page to look for
+   * @return the pinned frame holding the page. NULL if the page is not cached
+   */
+  Frame* lookup(int fileId, PageId pid);
+
+  /**
+   * pin the frame of a page, assigning a frame to the page if it is not
+   * cached (evicting another page if necessary). in the latter case,
+   * loaded is set to false and the caller has to fill the frame and call
+   * finishLoad(). until then, other threads looking for the page wait.
+   * @param fileId[IN] the file id of the page
+   * @param pid[IN] the page to pin
+   * @param loaded[OUT] false if the frame content has to be loaded
+   * @param speculative[IN] true if the page is read ahead of its use.
+   *                        it is then not counted as requested yet
+   * @param prefetchHit[OUT] if not NULL, set to true if this is the first
+   *                         request of a page that was read ahead
+   * @return the pinned frame. NULL if every frame is pinned
+   */
+  Frame* fix(int fileId, PageId pid, bool& loaded, bool speculative = false,
+             bool* prefetchHit = NULL);
+
+  /**
+   * finish loading a frame returned by fix() with loaded == false.
+   * @param frame[IN] the frame
+   * @param success[IN] false if the page could not be loaded.
+   *                    the frame is dropped in that case
+   */
+  void finishLoad(Frame* frame, bool success);
+
+  /**
+   * give up a pin on a frame.
+   * @param frame[IN] the frame returned by lookup() or fix()
+   * @param dirty[IN] true if the page was modified while it was pinned
+   * @return true if the frame was clean and has become dirty
+   */
+  bool unpin(Frame* frame, bool dirty = false);
+
+  /**
+   * pin every dirty frame of a file and mark it clean, so that the caller
+   * can write the pages to the disk. a frame that could not be written has
+   * to be given back with unpin(frame, true).
+   * @param fileId[IN] the file id
+   * @param frames[OUT] the pinned frames
+   */
+  void collectDirty(int fileId, std::vector<Frame*>& frames);
+
+  /**
+   * drop a page from the pool, if it is cached.
+   * @param fileId[IN] the file id of the page
+   * @param pid[IN] the page to drop
+   */
+  void invalidate(int fileId, PageId pid);
+
+  /**
+   * drop all cached pages of a file.
+   * @param fileId[IN] the file id
+   */
+  void invalidateFile(int fileId);
+
+  /**
+   * @return the total # of frames in the pool
+   */
+  int getFrameCount() const { return frameCount; }
+
+  /**
+   * @return the size of the pages cached in the pool
+   */
+  int getPageSize() const { return pageSize; }
+
+  /**
+   * @return the replacement policy of the pool
+   */
+  Policy getPolicy() const { return policy; }
+
+  /**
+   * @return # of fix() calls that found the page in the pool
+   */
+  long long getHitCount() const { return hits; }
+
+  /**
+   * @return # of fix() calls that had to assign a frame to the page
+   */
+  long long getMissCount() const { return misses; }
+
+ private:
+  BufferPool(int pageSize, int frameCount, int shardCount, Policy policy);
+  ~BufferPool();
+
+  // the queues of the LRU and 2Q policies. LRU only uses MAIN_QUEUE.
+  enum { IN_QUEUE, MAIN_QUEUE, QUEUE_COUNT };
+
+  // a doubly-linked list of frames, from the least recently used (head)
+  // to the most recently used (tail)
+  struct Queue {
+    int head;
+    int tail;
+    int size;
+  };
+
+  struct Shard {
+    std::mutex latch;                         // protects the whole shard
+    std::condition_variable loaded;           // signaled when a load is done
+    std::unordered_map<uint64_t, int> table;  // (file id, pid) -> frame
+    std::vector<Frame> frames;                // frames of the shard
+    std::vector<int> freeSlots;               // unpinned frames without a page
+    int capacity;                             // max # of frames
+    int clockHand;                            // next eviction candidate
+
+    Queue queues[QUEUE_COUNT];                // the LRU/2Q queues
+    int inCapacity;                           // 2Q: max size of A1in
+    int ghostCapacity;                        // 2Q: max size of A1out
+    std::list<uint64_t> ghosts;               // 2Q: A1out, oldest first
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> ghostTable;
+  };
+
+  Shard& getShard(uint64_t key);
+  static uint64_t makeKey(int fileId, PageId pid);
+
+  // drop a frame from the table and the queues of its shard.
+  // the latch must be held.
+  static void drop(Shard& s, Frame& frame);
+
+  // the replacement policy. the latch of the shard must be held.
+  // touch() returns true on the first request of a prefetched page.
+  bool touch(Shard& s, int slot, bool speculative);  // the page was requested
+  void admit(Shard& s, int slot, uint64_t key, bool speculative);  // a page entered
+  bool evict(Shard& s);                        // free a frame. false if none
+
+  // try to evict the unpinned frame at slot. false if it cannot be evicted
+  static bool tryEvict(Shard& s, int slot);
+
+  // evict the least recently used unpinned frame of a queue
+  static bool evictFrom(Shard& s, int queue, bool remember);
+
+  // queue manipulation
+  static void enqueue(Shard& s, int queue, int slot);
+  static void dequeue(Shard& s, int slot);
+
+  // write a dirty frame to the disk before it is evicted.
+  // the latch of the shard must be held.
+  static RC writeBack(Frame& frame);
+
+  int pageSize;
+  int frameCount;
+  Policy policy;
+  std::vector<Shard> shards;
+
+  std::atomic<long long> hits;    // # of fix() calls that found the page
+  std::atomic<long long> misses;  // # of fix() calls that did not
+  std::atomic<long long> accesses;  // # of lookup() and fix() calls
+
+  static std::mutex filesLatch;                        // protects files, writers
+  static std::vector<std::pair<dev_t, ino_t> > files;  // file id -> unix file
+  static std::vector<PageFile*> writers;               // file id -> writer
+
+  static int configuredFrameCount;
+  static int configuredShardCount;
+  static Policy configuredPolicy;
+  static std::mutex instancesLatch;                    // protects instances
+  static std::unordered_map<int, BufferPool*> instances;  // page size -> pool
+};
+
+#endif // BUFFERPOOL_H
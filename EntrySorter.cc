@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "Bruinbase.h"
+#include "EntrySorter.h"
+
+using std::string;
+using std::vector;
+
+EntrySorter::EntrySorter(const string& tempPrefix, int memoryEntries, int payloadSize)
+  : prefix(tempPrefix)
+{
+  maxEntries = (memoryEntries > 0) ? memoryEntries : 1;
+  this->payloadSize = (payloadSize > 0) ? payloadSize : 0;
+  count = 0;
+  sorted = false;
+  bufferPos = 0;
+}
+
+EntrySorter::~EntrySorter()
+{
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (runs[i].file != NULL) fclose(runs[i].file);
+    remove(runs[i].name.c_str());
+  }
+}
+
+RC EntrySorter::add(int key, const RecordId& rid, const char* payload)
+{
+  RC rc;
+
+  if (sorted) return RC_INVALID_FILE_MODE;
+
+  if ((int)buffer.size() >= maxEntries && (rc = spill()) < 0) return rc;
+
+  Entry entry;
+  entry.key = key;
+  entry.rid = rid;
+  entry.payload = payloads.size();
+  buffer.push_back(entry);
+  if (payload) payloads.insert(payloads.end(), payload, payload + payloadSize);
+  else payloads.resize(payloads.size() + payloadSize);
+  count++;
+
+  return 0;
+}
+
+RC EntrySorter::spill()
+{
+  char suffix[16];
+  Run run;
+
+  std::stable_sort(buffer.begin(), buffer.end(), lessByKey);
+
+  snprintf(suffix, sizeof(suffix), ".run%d", (int)runs.size());
+  run.name = prefix + suffix;
+  run.valid = false;
+  if ((run.file = fopen(run.name.c_str(), "w+b")) == NULL) return RC_FILE_OPEN_FAILED;
+  runs.push_back(run);
+
+  // the entries are written in one piece
+  int recordSize = sizeof(int) + sizeof(RecordId) + payloadSize;
+  vector<char> records(buffer.size() * recordSize);
+  char* p = records.empty() ? NULL : &records[0];
+  for (unsigned i = 0; i < buffer.size(); i++, p += recordSize) {
+    memcpy(p, &buffer[i].key, sizeof(int));
+    memcpy(p + sizeof(int), &buffer[i].rid, sizeof(RecordId));
+    if (payloadSize) memcpy(p + sizeof(int) + sizeof(RecordId), &payloads[buffer[i].payload], payloadSize);
+  }
+  if (fwrite(records.data(), recordSize, buffer.size(), run.file) != buffer.size()) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  buffer.clear();
+  payloads.clear();
+
+  return 0;
+}
+
+RC EntrySorter::sort()
+{
+  RC rc;
+
+  if (sorted) return 0;
+  sorted = true;
+
+  // the last entries stay in memory
+  std::stable_sort(buffer.begin(), buffer.end(), lessByKey);
+  bufferPos = 0;
+
+  // read the first entry of every run
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (fflush(runs[i].file) != 0) return RC_FILE_WRITE_FAILED;
+    rewind(runs[i].file);
+    if ((rc = advance(runs[i])) < 0) return rc;
+  }
+
+  return 0;
+}
+
+RC EntrySorter::advance(Run& run)
+{
+  char record[sizeof(int) + sizeof(RecordId)];
+  size_t n = fread(record, sizeof(record), 1, run.file);
+  run.headPayload.resize(payloadSize);
+  if (n == 1 && payloadSize) n = fread(&run.headPayload[0], payloadSize, 1, run.file);
+  run.valid = (n == 1);
+  if (n != 1 && ferror(run.file)) return RC_FILE_READ_FAILED;
+  memcpy(&run.head.key, record, sizeof(int));
+  memcpy(&run.head.rid, record + sizeof(int), sizeof(RecordId));
+  return 0;
+}
+
+RC EntrySorter::next(int& key, RecordId& rid, char* payload)
+{
+  RC rc;
+
+  if (!sorted) return RC_INVALID_FILE_MODE;
+
+  // pick the smallest head of the runs and the buffer. on a tie, the run
+  // written first wins, and the buffer (holding the last entries) loses.
+  // there are few runs, so they are simply compared one by one.
+  int best = -1;
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (runs[i].valid && (best < 0 || runs[i].head.key < runs[best].head.key)) best = i;
+  }
+
+  if (bufferPos < buffer.size()
+      && (best < 0 || buffer[bufferPos].key < runs[best].head.key)) {
+    key = buffer[bufferPos].key;
+    rid = buffer[bufferPos].rid;
+    if (payload && payloadSize) memcpy(payload, &payloads[buffer[bufferPos].payload], payloadSize);
+    bufferPos++;
+    return 0;
+  }
+  if (best < 0) return RC_NO_SUCH_RECORD;
+
+  key = runs[best].head.key;
+  rid = runs[best].head.rid;
+  if (payload && payloadSize) memcpy(payload, &runs[best].headPayload[0], payloadSize);
+  if ((rc = advance(runs[best])) < 0) return rc;
+
+  return 0;
+}
+
+StringSorter::StringSorter(const string& tempPrefix, int maxKeyLength, int memoryBytes)
+  : prefix(tempPrefix)
+{
+  this->maxKeyLength = (maxKeyLength > 0) ? maxKeyLength : 0;
+  maxBytes = (memoryBytes > 0) ? memoryBytes : 1;
+  count = 0;
+  sorted = false;
+  bufferPos = 0;
+}
+
+StringSorter::~StringSorter()
+{
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (runs[i].file != NULL) fclose(runs[i].file);
+    remove(runs[i].name.c_str());
+  }
+}
+
+bool StringSorter::KeyLess::operator()(const Entry& a, const Entry& b) const
+{
+  // as std::string compares them: byte by byte, and a prefix goes first
+  int diff = memcmp(bytes + a.offset, bytes + b.offset, std::min(a.length, b.length));
+  return diff ? (diff < 0) : (a.length < b.length);
+}
+
+RC StringSorter::add(const string& key, const RecordId& rid)
+{
+  RC rc;
+
+  if (sorted) return RC_INVALID_FILE_MODE;
+
+  int length = key.size();
+  if (maxKeyLength && length > maxKeyLength) length = maxKeyLength;
+  if (!buffer.empty() && (buffer.size() + 1) * sizeof(Entry) + keyBytes.size() + length > (size_t)maxBytes
+      && (rc = spill()) < 0) return rc;
+
+  Entry entry;
+  entry.offset = keyBytes.size();
+  entry.length = length;
+  entry.rid = rid;
+  buffer.push_back(entry);
+  keyBytes.insert(keyBytes.end(), key.data(), key.data() + length);
+  count++;
+
+  return 0;
+}
+
+void StringSorter::sortBuffer()
+{
+  KeyLess less;
+  less.bytes = keyBytes.empty() ? NULL : &keyBytes[0];
+  std::stable_sort(buffer.begin(), buffer.end(), less);
+}
+
+RC StringSorter::spill()
+{
+  char suffix[16];
+  Run run;
+
+  sortBuffer();
+
+  snprintf(suffix, sizeof(suffix), ".run%d", (int)runs.size());
+  run.name = prefix + suffix;
+  run.valid = false;
+  if ((run.file = fopen(run.name.c_str(), "w+b")) == NULL) return RC_FILE_OPEN_FAILED;
+  runs.push_back(run);
+
+  // the entries are written in one piece
+  vector<char> records;
+  records.reserve(buffer.size() * (sizeof(int) + sizeof(RecordId)) + keyBytes.size());
+  for (unsigned i = 0; i < buffer.size(); i++) {
+    const char* length = (const char*)&buffer[i].length;
+    const char* rid = (const char*)&buffer[i].rid;
+    records.insert(records.end(), length, length + sizeof(int));
+    records.insert(records.end(), rid, rid + sizeof(RecordId));
+    records.insert(records.end(), keyBytes.begin() + buffer[i].offset,
+                   keyBytes.begin() + buffer[i].offset + buffer[i].length);
+  }
+  if (fwrite(records.data(), 1, records.size(), run.file) != records.size()) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  buffer.clear();
+  keyBytes.clear();
+
+  return 0;
+}
+
+RC StringSorter::sort()
+{
+  RC rc;
+
+  if (sorted) return 0;
+  sorted = true;
+
+  // the last entries stay in memory
+  sortBuffer();
+  bufferPos = 0;
+
+  // read the first entry of every run
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (fflush(runs[i].file) != 0) return RC_FILE_WRITE_FAILED;
+    rewind(runs[i].file);
+    if ((rc = advance(runs[i])) < 0) return rc;
+  }
+
+  return 0;
+}
+
+RC StringSorter::advance(Run& run)
+{
+  char record[sizeof(int) + sizeof(RecordId)];
+  int length = 0;
+  size_t n = fread(record, sizeof(record), 1, run.file);
+  if (n == 1) {
+    memcpy(&length, record, sizeof(int));
+    memcpy(&run.headRid, record + sizeof(int), sizeof(RecordId));
+    run.headKey.resize(length);
+    if (length > 0) n = fread(&run.headKey[0], length, 1, run.file);
+  }
+  run.valid = (n == 1);
+  if (n != 1 && ferror(run.file)) return RC_FILE_READ_FAILED;
+  return 0;
+}
+
+RC StringSorter::next(string& key, RecordId& rid)
+{
+  RC rc;
+
+  if (!sorted) return RC_INVALID_FILE_MODE;
+
+  // pick the smallest head of the runs and the buffer, as EntrySorter does
+  int best = -1;
+  for (unsigned i = 0; i < runs.size(); i++) {
+    if (runs[i].valid && (best < 0 || runs[i].headKey < runs[best].headKey)) best = i;
+  }
+
+  if (bufferPos < buffer.size()) {
+    const Entry& entry = buffer[bufferPos];
+    const char* bytes = keyBytes.empty() ? "" : &keyBytes[0] + entry.offset;
+    if (best < 0 || runs[best].headKey.compare(0, string::npos, bytes, entry.length) > 0) {
+      key.assign(bytes, entry.length);
+      rid = entry.rid;
+      bufferPos++;
+      return 0;
+    }
+  }
+  if (best < 0) return RC_NO_SUCH_RECORD;
+
+  key.swap(runs[best].headKey);
+  rid = runs[best].headRid;
+  if ((rc = advance(runs[best])) < 0) return rc;
+
+  return 0;
+}
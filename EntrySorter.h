@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef ENTRYSORTER_H
+#define ENTRYSORTER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "RecordFile.h"
+
+/**
+ * Sorts (key, RecordId) index entries by key, spilling to the disk when
+ * they do not fit in memory.
+ *
+ * The entries are collected in a memory buffer of memoryEntries entries.
+ * Whenever the buffer is full, it is sorted and written to a run file
+ * (named tempPrefix followed by the run number). sort() sorts the last
+ * buffer, and next() then merges the runs and the buffer. The sort is
+ * stable: entries with the same key come out in the order they were
+ * added. The run files are removed when the sorter is destroyed.
+ *
+ * An entry may carry a payload of payloadSize bytes (e.g., the cover of
+ * the RecordId in a covering index), which is sorted along with it.
+ */
+class EntrySorter {
+ public:
+  static const int DEFAULT_MEMORY_ENTRIES = 1 << 20;  // 16MB of entries, and
+                                                      // their payloads
+
+  /**
+   * @param tempPrefix[IN] the name prefix of the run files
+   * @param memoryEntries[IN] max # of entries kept in memory
+   * @param payloadSize[IN] # of bytes of the payload of an entry
+   */
+  EntrySorter(const std::string& tempPrefix, int memoryEntries = DEFAULT_MEMORY_ENTRIES,
+              int payloadSize = 0);
+  ~EntrySorter();
+
+  /**
+   * add an entry. may only be called before sort().
+   * @param key[IN] the key of the entry
+   * @param rid[IN] the RecordId of the entry
+   * @param payload[IN] the payload of the entry. NULL for an all-zero one
+   * @return error code. 0 if no error
+   */
+  RC add(int key, const RecordId& rid, const char* payload = NULL);
+
+  /**
+   * finish adding entries and get ready to return them in key order.
+   * @return error code. 0 if no error
+   */
+  RC sort();
+
+  /**
+   * return the next entry in key order. may only be called after sort().
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @param payload[OUT] the payload of the entry. may be NULL
+   * @return error code. RC_NO_SUCH_RECORD after the last entry
+   */
+  RC next(int& key, RecordId& rid, char* payload = NULL);
+
+  /**
+   * @return the total # of entries added
+   */
+  int size() const { return count; }
+
+  /**
+   * @return # of runs written to the disk
+   */
+  int getRunCount() const { return runs.size(); }
+
+  /**
+   * @return # of bytes of the payload of an entry
+   */
+  int getPayloadSize() const { return payloadSize; }
+
+ private:
+  struct Entry {
+    int      key;
+    RecordId rid;
+    int      payload;  // the offset of the payload in payloads
+  };
+
+  // a sorted run in a file, and the entry of the run to be returned next.
+  // an entry of a run is its key, its RecordId and its payload.
+  struct Run {
+    std::string name;
+    FILE*       file;
+    Entry       head;
+    std::vector<char> headPayload;
+    bool        valid;   // false after the last entry of the run
+  };
+
+  static bool lessByKey(const Entry& a, const Entry& b) { return a.key < b.key; }
+
+  RC spill();                      // sort the buffer and write it as a run
+  RC advance(Run& run);            // read the next entry of a run
+
+  std::string prefix;
+  int maxEntries;
+  int payloadSize;
+  int count;
+  bool sorted;
+
+  std::vector<Entry> buffer;  // the entries not written to a run
+  std::vector<char> payloads; // the payloads of the entries of buffer
+  unsigned bufferPos;         // the next entry of buffer to return
+  std::vector<Run> runs;      // the runs written so far, in input order
+};
+
+/**
+ * Sorts (key, RecordId) index entries with string keys by key, spilling to
+ * the disk when they do not fit in memory, like EntrySorter.
+ *
+ * The keys take various sizes, so the memory buffer is bounded by the
+ * bytes of its entries (memoryBytes) rather than by their number. A run
+ * file keeps an entry as the length of its key, its RecordId and the bytes
+ * of its key. The sort is stable, and the run files are removed when the
+ * sorter is destroyed.
+ */
+class StringSorter {
+ public:
+  static const int DEFAULT_MEMORY_BYTES = 1 << 24;  // 16MB of entries
+
+  /**
+   * @param tempPrefix[IN] the name prefix of the run files
+   * @param maxKeyLength[IN] keys longer than it are cut to it when they are
+   *                         added. 0 for keys of any length
+   * @param memoryBytes[IN] max # of bytes of the entries kept in memory
+   */
+  StringSorter(const std::string& tempPrefix, int maxKeyLength = 0,
+               int memoryBytes = DEFAULT_MEMORY_BYTES);
+  ~StringSorter();
+
+  /**
+   * add an entry. may only be called before sort().
+   * @param key[IN] the key of the entry
+   * @param rid[IN] the RecordId of the entry
+   * @return error code. 0 if no error
+   */
+  RC add(const std::string& key, const RecordId& rid);
+
+  /**
+   * finish adding entries and get ready to return them in key order.
+   * @return error code. 0 if no error
+   */
+  RC sort();
+
+  /**
+   * return the next entry in key order. may only be called after sort().
+   * @param key[OUT] the key of the entry
+   * @param rid[OUT] the RecordId of the entry
+   * @return error code. RC_NO_SUCH_RECORD after the last entry
+   */
+  RC next(std::string& key, RecordId& rid);
+
+  /**
+   * @return the total # of entries added
+   */
+  int size() const { return count; }
+
+  /**
+   * @return # of runs written to the disk
+   */
+  int getRunCount() const { return runs.size(); }
+
+ private:
+  // an entry of the buffer. its key is in keyBytes
+  struct Entry {
+    int      offset;
+    int      length;
+    RecordId rid;
+  };
+
+  // orders the entries of the buffer as their keys are ordered as strings
+  struct KeyLess {
+    const char* bytes;
+    bool operator()(const Entry& a, const Entry& b) const;
+  };
+
+  // a sorted run in a file, and the entry of the run to be returned next
+  struct Run {
+    std::string name;
+    FILE*       file;
+    std::string headKey;
+    RecordId    headRid;
+    bool        valid;   // false after the last entry of the run
+  };
+
+  RC spill();                      // sort the buffer and write it as a run
+  RC advance(Run& run);            // read the next entry of a run
+  void sortBuffer();
+
+  std::string prefix;
+  int maxKeyLength;
+  int maxBytes;
+  int count;
+  bool sorted;
+
+  std::vector<Entry> buffer;  // the entries not written to a run
+  std::vector<char> keyBytes; // the keys of the entries of buffer
+  unsigned bufferPos;         // the next entry of buffer to return
+  std::vector<Run> runs;      // the runs written so far, in input order
+};
+
+#endif // ENTRYSORTER_H
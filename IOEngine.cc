@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Bruinbase.h"
+#include "IOEngine.h"
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+using std::vector;
+
+IOEngine::Kind IOEngine::configuredKind = IOEngine::AUTO;
+IOEngine* IOEngine::instance = NULL;
+std::once_flag IOEngine::instanceFlag;
+
+//
+// The fallback engine: a pool of worker threads doing pread()
+//
+class ThreadPoolEngine : public IOEngine {
+ public:
+  ThreadPoolEngine(int workerCount);
+
+  const char* getName() const { return "threads"; }
+  RC submit(IORequest** requests, int count);
+
+ private:
+  void work();
+
+  std::mutex latch;                 // protects queue
+  std::condition_variable queued;   // signaled when a request is queued
+  std::deque<IORequest*> queue;     // requests waiting for a worker
+};
+
+ThreadPoolEngine::ThreadPoolEngine(int workerCount)
+{
+  // the workers live as long as the process
+  for (int i = 0; i < workerCount; i++) {
+    std::thread(&ThreadPoolEngine::work, this).detach();
+  }
+}
+
+RC ThreadPoolEngine::submit(IORequest** requests, int count)
+{
+  std::lock_guard<std::mutex> lock(latch);
+
+  for (int i = 0; i < count; i++) {
+    requests[i]->done = false;
+    queue.push_back(requests[i]);
+  }
+  queued.notify_all();
+
+  return 0;
+}
+
+void ThreadPoolEngine::work()
+{
+  for (;;) {
+    IORequest* req;
+    {
+      std::unique_lock<std::mutex> lock(latch);
+      while (queue.empty()) queued.wait(lock);
+      req = queue.front();
+      queue.pop_front();
+    }
+
+    ssize_t n = ::pread(req->fd, req->buffer, req->length, req->offset);
+    complete(req, (n < 0) ? -errno : n);
+  }
+}
+
+//
+// The io_uring engine. the ring is driven with raw system calls, so that
+// no library beyond the kernel headers is needed. reads are submitted by
+// the calling threads and reaped by a dedicated completion thread.
+//
+class UringEngine : public IOEngine {
+ public:
+  // set up a ring. returns NULL if the kernel does not support io_uring.
+  static UringEngine* create(unsigned entries);
+
+  const char* getName() const { return "io_uring"; }
+  RC submit(IORequest** requests, int count);
+
+ private:
+  UringEngine() {}
+  RC enter(unsigned toSubmit);
+  RC reap();
+
+  int ringFd;
+  unsigned entries;
+
+  // the submission queue
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  struct io_uring_sqe* sqes;
+
+  // the completion queue
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_cqe* cqes;
+
+  std::mutex latch;                   // protects the submission queue
+  std::condition_variable spaceFree;  // signaled when requests complete
+  unsigned inflight;                  // # of requests not reaped yet
+  bool broken;                        // true once the ring cannot be reaped
+};
+
+UringEngine* UringEngine::create(unsigned entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  int fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0) return NULL;
+
+  // map the two rings and the submission entries
+  size_t sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqLen > sqLen) sqLen = cqLen;
+    cqLen = sqLen;
+  }
+
+  char* sq = (char*)mmap(NULL, sqLen, PROT_READ|PROT_WRITE,
+                         MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) { ::close(fd); return NULL; }
+
+  char* cq = sq;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    cq = (char*)mmap(NULL, cqLen, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) { munmap(sq, sqLen); ::close(fd); return NULL; }
+  }
+
+  void* sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                    fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    munmap(sq, sqLen);
+    if (cq != sq) munmap(cq, cqLen);
+    ::close(fd);
+    return NULL;
+  }
+
+  UringEngine* e = new UringEngine();
+  e->ringFd = fd;
+  e->entries = p.sq_entries;
+  e->sqHead = (unsigned*)(sq + p.sq_off.head);
+  e->sqTail = (unsigned*)(sq + p.sq_off.tail);
+  e->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+  e->sqArray = (unsigned*)(sq + p.sq_off.array);
+  e->sqes = (struct io_uring_sqe*)sqes;
+  e->cqHead = (unsigned*)(cq + p.cq_off.head);
+  e->cqTail = (unsigned*)(cq + p.cq_off.tail);
+  e->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+  e->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  e->inflight = 0;
+  e->broken = false;
+
+  // the completion thread lives as long as the process
+  std::thread(&UringEngine::reap, e).detach();
+
+  return e;
+}
+
+RC UringEngine::enter(unsigned toSubmit)
+{
+  while (toSubmit > 0) {
+    int n = syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, NULL, 0);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+      return RC_FILE_READ_FAILED;
+    }
+    toSubmit -= n;
+  }
+  return 0;
+}
+
+RC UringEngine::submit(IORequest** requests, int count)
+{
+  std::unique_lock<std::mutex> lock(latch);
+  vector<IORequest*> queued;  // the requests put in the ring by this call
+  unsigned pending = 0;
+  RC rc = 0;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    IORequest* req = requests[i];
+
+    // never have more requests in flight than the completion queue holds
+    while (inflight == entries && !broken) {
+      if ((rc = enter(pending)) < 0) break;
+      pending = 0;
+      spaceFree.wait(lock);
+    }
+    if (broken) rc = RC_FILE_READ_FAILED;
+    if (rc < 0) break;
+
+    req->done = false;
+    req->iov.iov_base = req->buffer;
+    req->iov.iov_len = req->length;
+
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = req->fd;
+    sqe->off = req->offset;
+    sqe->addr = (unsigned long)&req->iov;
+    sqe->len = 1;
+    sqe->user_data = (unsigned long)req;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    queued.push_back(req);
+    pending++;
+    inflight++;
+  }
+  if (rc == 0) rc = enter(pending);
+  if (rc == 0) return 0;
+
+  // the kernel consumes the entries of the ring in order, and the ring is
+  // empty whenever the latch is free. the entries it has not consumed are
+  // the last ones of this call. they are taken back out of the ring and
+  // fail, as do the requests that never got into the ring. the consumed
+  // ones complete through reap() as usual.
+  unsigned tail = *sqTail;
+  unsigned unconsumed = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+  __atomic_store_n(sqTail, tail - unconsumed, __ATOMIC_RELEASE);
+  inflight -= unconsumed;
+  spaceFree.notify_all();
+
+  vector<IORequest*> failed(queued.end() - unconsumed, queued.end());
+  failed.insert(failed.end(), requests + i, requests + count);
+  lock.unlock();
+
+  for (unsigned j = 0; j < failed.size(); j++) complete(failed[j], -EIO);
+  return rc;
+}
+
+RC UringEngine::reap()
+{
+  vector<std::pair<IORequest*, ssize_t> > completed;
+
+  for (;;) {
+    // sleep until at least one request completes. the completion queue is
+    // drained on a transient error as well (EBUSY waits for that). any
+    // other error means the ring is unusable, and new requests fail.
+    int n = syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      std::lock_guard<std::mutex> lock(latch);
+      broken = true;
+      spaceFree.notify_all();
+      return RC_FILE_READ_FAILED;
+    }
+
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    completed.clear();
+    while (head != tail) {
+      struct io_uring_cqe* cqe = &cqes[head & *cqMask];
+      completed.push_back(std::make_pair((IORequest*)cqe->user_data, (ssize_t)cqe->res));
+      head++;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+    if (completed.empty()) continue;
+    {
+      std::lock_guard<std::mutex> lock(latch);
+      inflight -= completed.size();
+      spaceFree.notify_all();
+    }
+
+    for (unsigned i = 0; i < completed.size(); i++) {
+      complete(completed[i].first, completed[i].second);
+    }
+  }
+}
+
+//
+// IOEngine
+//
+RC IOEngine::configure(Kind kind)
+{
+  if (instance != NULL) return RC_INVALID_ATTRIBUTE;
+  configuredKind = kind;
+  return 0;
+}
+
+IOEngine& IOEngine::getInstance()
+{
+  std::call_once(instanceFlag, []() {
+    if (configuredKind != THREADS) instance = UringEngine::create(QUEUE_DEPTH);
+    if (instance == NULL) instance = new ThreadPoolEngine(WORKER_COUNT);
+  });
+  return *instance;
+}
+
+void IOEngine::complete(IORequest* request, ssize_t result)
+{
+  request->result = result;
+
+  // the callback owns the request from now on
+  if (request->callback != NULL) {
+    request->callback(request);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(doneLatch);
+  request->done = true;
+  doneSignal.notify_all();
+}
+
+void IOEngine::wait(IORequest* request)
+{
+  std::unique_lock<std::mutex> lock(doneLatch);
+  while (!request->done) doneSignal.wait(lock);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <mutex>
+#include <condition_variable>
+#include "Bruinbase.h"
+
+/**
+ * An asynchronous read request. The request is owned by the caller and
+ * must stay alive until it completes. A request with a callback is handed
+ * over to the callback on completion (which may free it) and cannot be
+ * waited for.
+ */
+struct IORequest {
+  int     fd;       // file to read from
+  off_t   offset;   // file offset to read at
+  char*   buffer;   // memory buffer to read into
+  size_t  length;   // # of bytes to read
+  ssize_t result;   // # of bytes read, or -errno. valid once completed
+
+  // called on completion instead of marking the request done.
+  // may run on any thread. may be NULL.
+  void  (*callback)(IORequest* request);
+  void*   context;  // free for the use of the callback
+
+  // the following members are used by IOEngine internally
+  struct iovec iov;
+  bool    done;
+};
+
+/**
+ * The engine that reads pages asynchronously.
+ * Many reads can be submitted at once. They are in flight together and
+ * complete in any order. The engine uses io_uring when the kernel
+ * supports it, and a pool of worker threads doing pread() otherwise.
+ */
+class IOEngine {
+ public:
+  enum Kind { AUTO, URING, THREADS };
+
+  static const int QUEUE_DEPTH = 128;   // max # of io_uring reads in flight
+  static const int WORKER_COUNT = 8;    // # of threads of the fallback pool
+
+  /**
+   * choose the engine implementation.
+   * must be called before the engine is used for the first time.
+   * @param kind[IN] URING, THREADS, or AUTO to use io_uring if available
+   * @return error code. 0 if no error
+   */
+  static RC configure(Kind kind);
+
+  /**
+   * @return the I/O engine of the process
+   */
+  static IOEngine& getInstance();
+
+  virtual ~IOEngine() {}
+
+  /**
+   * @return the name of the implementation ("io_uring" or "threads")
+   */
+  virtual const char* getName() const = 0;
+
+  /**
+   * start reading a batch of requests. returns without waiting for them.
+   * every request completes exactly once, even if submit() fails: the
+   * requests that could not be started complete with a result of -EIO,
+   * and the others complete when their reads do.
+   * @param requests[IN] the requests to submit
+   * @param count[IN] # of requests
+   * @return error code. 0 if no error
+   */
+  virtual RC submit(IORequest** requests, int count) = 0;
+
+  /**
+   * wait until a submitted request without a callback completes.
+   * @param request[IN] the request to wait for
+   */
+  void wait(IORequest* request);
+
+ protected:
+  /**
+   * record the result of a request, and run its callback or wake up the
+   * threads waiting for it. called by the implementations.
+   * @param request[IN] the completed request
+   * @param result[IN] # of bytes read, or -errno
+   */
+  void complete(IORequest* request, ssize_t result);
+
+ private:
+  std::mutex doneLatch;
+  std::condition_variable doneSignal;
+
+  static Kind configuredKind;
+  static IOEngine* instance;
+  static std::once_flag instanceFlag;
+};
+
+#endif // IOENGINE_H
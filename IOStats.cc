@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Bruinbase.h"
+#include "IOStats.h"
+#include <chrono>
+
+using std::string;
+using std::vector;
+
+std::mutex IOStats::latch;
+vector<FileCounters*> IOStats::counters;
+bool IOStats::reportEnabled = false;
+
+//
+// FileStats
+//
+FileStats::FileStats()
+{
+  requests = misses = 0;
+  reads = readBytes = 0;
+  writes = writeBytes = 0;
+  prefetches = prefetchHits = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) readLatency[i] = writeLatency[i] = 0;
+}
+
+bool FileStats::isActive() const
+{
+  return requests || reads || writes || prefetches;
+}
+
+FileStats& FileStats::operator-=(const FileStats& before)
+{
+  requests -= before.requests;
+  misses -= before.misses;
+  reads -= before.reads;
+  readBytes -= before.readBytes;
+  writes -= before.writes;
+  writeBytes -= before.writeBytes;
+  prefetches -= before.prefetches;
+  prefetchHits -= before.prefetchHits;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    readLatency[i] -= before.readLatency[i];
+    writeLatency[i] -= before.writeLatency[i];
+  }
+  return *this;
+}
+
+long long FileStats::percentile(const long long* histogram, int percent)
+{
+  long long total = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) total += histogram[i];
+  if (total == 0) return 0;
+
+  // find the bucket where the running count passes the percentile
+  long long rank = (total * percent + 99) / 100;
+  long long count = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    count += histogram[i];
+    if (count >= rank) return 1LL << i;
+  }
+  return 1LL << (LATENCY_BUCKETS - 1);
+}
+
+//
+// FileCounters
+//
+FileCounters::FileCounters()
+  : requests(0), misses(0), reads(0), readBytes(0), writes(0), writeBytes(0),
+    prefetches(0), prefetchHits(0)
+{
+  for (int i = 0; i < FileStats::LATENCY_BUCKETS; i++) {
+    readLatency[i] = 0;
+    writeLatency[i] = 0;
+  }
+}
+
+int FileCounters::bucket(long long micros)
+{
+  if (micros <= 0) return 0;
+
+  // the # of bits of micros, i.e., 2^(b-1) <= micros < 2^b
+  int b = 64 - __builtin_clzll((unsigned long long)micros);
+  return (b < FileStats::LATENCY_BUCKETS) ? b : FileStats::LATENCY_BUCKETS - 1;
+}
+
+void FileCounters::request(bool miss)
+{
+  requests.fetch_add(1, std::memory_order_relaxed);
+  if (miss) misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileCounters::read(int pages, long long bytes, long long micros)
+{
+  reads.fetch_add(pages, std::memory_order_relaxed);
+  readBytes.fetch_add(bytes, std::memory_order_relaxed);
+  readLatency[bucket(micros)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileCounters::write(int pages, long long bytes, long long micros)
+{
+  writes.fetch_add(pages, std::memory_order_relaxed);
+  writeBytes.fetch_add(bytes, std::memory_order_relaxed);
+  writeLatency[bucket(micros)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileCounters::prefetch(int pages)
+{
+  prefetches.fetch_add(pages, std::memory_order_relaxed);
+}
+
+void FileCounters::prefetchHit()
+{
+  prefetchHits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FileCounters::setName(const string& name)
+{
+  std::lock_guard<std::mutex> lock(nameLatch);
+  this->name = name;
+}
+
+void FileCounters::get(FileStats& stats) const
+{
+  {
+    std::lock_guard<std::mutex> lock(nameLatch);
+    stats.name = name;
+  }
+  stats.requests = requests;
+  stats.misses = misses;
+  stats.reads = reads;
+  stats.readBytes = readBytes;
+  stats.writes = writes;
+  stats.writeBytes = writeBytes;
+  stats.prefetches = prefetches;
+  stats.prefetchHits = prefetchHits;
+  for (int i = 0; i < FileStats::LATENCY_BUCKETS; i++) {
+    stats.readLatency[i] = readLatency[i];
+    stats.writeLatency[i] = writeLatency[i];
+  }
+}
+
+//
+// IOStats
+//
+FileCounters* IOStats::getCounters(int fileId, const string& name)
+{
+  std::lock_guard<std::mutex> lock(latch);
+
+  while ((int)counters.size() <= fileId) counters.push_back(new FileCounters());
+  counters[fileId]->setName(name);
+  return counters[fileId];
+}
+
+void IOStats::getSnapshot(vector<FileStats>& stats)
+{
+  std::lock_guard<std::mutex> lock(latch);
+
+  stats.resize(counters.size());
+  for (unsigned i = 0; i < counters.size(); i++) counters[i]->get(stats[i]);
+}
+
+void IOStats::report(FILE* out, const vector<FileStats>& before)
+{
+  vector<FileStats> stats;
+  getSnapshot(stats);
+
+  for (unsigned i = 0; i < stats.size(); i++) {
+    FileStats& s = stats[i];
+    if (i < before.size()) s -= before[i];
+    if (!s.isActive()) continue;
+
+    fprintf(out, "  -- %s: %lld requests, %lld hits, %lld misses; "
+            "read %lld pages (%lld bytes), p50 %lldus, p99 %lldus; "
+            "wrote %lld pages (%lld bytes), p50 %lldus, p99 %lldus; "
+            "prefetched %lld pages, %lld used\n",
+            s.name.c_str(), s.requests, s.hits(), s.misses,
+            s.reads, s.readBytes,
+            FileStats::percentile(s.readLatency, 50),
+            FileStats::percentile(s.readLatency, 99),
+            s.writes, s.writeBytes,
+            FileStats::percentile(s.writeLatency, 50),
+            FileStats::percentile(s.writeLatency, 99),
+            s.prefetches, s.prefetchHits);
+  }
+}
+
+long long IOStats::now()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
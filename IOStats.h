@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "Bruinbase.h"
+
+/**
+ * The I/O statistics of a file, as of some point in time.
+ * The latency histograms count the disk reads and writes by their duration:
+ * bucket 0 holds the ones shorter than 1us, and bucket i > 0 the ones
+ * taking [2^(i-1), 2^i) us. The last bucket holds everything longer.
+ */
+struct FileStats {
+  static const int LATENCY_BUCKETS = 24;
+
+  std::string name;       // the name the file was opened with
+  long long requests;     // # of pages requested through pin() or read()
+  long long misses;       // # of requests that waited for a disk read
+  long long reads;        // # of pages read from the disk
+  long long readBytes;    // # of bytes read from the disk
+  long long writes;       // # of pages written to the disk
+  long long writeBytes;   // # of bytes written to the disk
+  long long prefetches;   // # of pages read ahead of their use
+  long long prefetchHits; // # of pages read ahead that were requested later
+  long long readLatency[LATENCY_BUCKETS];   // disk reads by duration
+  long long writeLatency[LATENCY_BUCKETS];  // disk writes by duration
+
+  FileStats();
+
+  /**
+   * @return # of requests served from the buffer pool or the mapping
+   */
+  long long hits() const { return requests - misses; }
+
+  /**
+   * @return true if any counter is nonzero
+   */
+  bool isActive() const;
+
+  /**
+   * subtract an earlier snapshot of the same file, leaving what happened
+   * in between.
+   * @param before[IN] the earlier snapshot
+   */
+  FileStats& operator-=(const FileStats& before);
+
+  /**
+   * estimate a percentile of a latency histogram.
+   * @param histogram[IN] readLatency or writeLatency
+   * @param percent[IN] the percentile, e.g. 99
+   * @return the upper bound of the bucket holding the percentile, in us.
+   *         0 if the histogram is empty
+   */
+  static long long percentile(const long long* histogram, int percent);
+};
+
+/**
+ * The live counters of a file. They are updated without a latch, so they
+ * can be bumped from any thread on every page access.
+ */
+class FileCounters {
+ public:
+  FileCounters();
+
+  /**
+   * count a page requested through pin() or read().
+   * @param miss[IN] true if the request had to wait for a disk read
+   */
+  void request(bool miss);
+
+  /**
+   * count a disk read.
+   * @param pages[IN] # of pages read
+   * @param bytes[IN] # of bytes read
+   * @param micros[IN] how long the read took, in microseconds
+   */
+  void read(int pages, long long bytes, long long micros);
+
+  /**
+   * count a disk write.
+   * @param pages[IN] # of pages written
+   * @param bytes[IN] # of bytes written
+   * @param micros[IN] how long the write took, in microseconds
+   */
+  void write(int pages, long long bytes, long long micros);
+
+  /**
+   * count pages read ahead of their use.
+   * @param pages[IN] # of pages
+   */
+  void prefetch(int pages);
+
+  /**
+   * count a request of a page that was read ahead.
+   */
+  void prefetchHit();
+
+  /**
+   * @param name[IN] the name of the file
+   */
+  void setName(const std::string& name);
+
+  /**
+   * @param stats[OUT] the current values of the counters
+   */
+  void get(FileStats& stats) const;
+
+ private:
+  static int bucket(long long micros);
+
+  mutable std::mutex nameLatch;  // protects name
+  std::string name;
+  std::atomic<long long> requests;
+  std::atomic<long long> misses;
+  std::atomic<long long> reads;
+  std::atomic<long long> readBytes;
+  std::atomic<long long> writes;
+  std::atomic<long long> writeBytes;
+  std::atomic<long long> prefetches;
+  std::atomic<long long> prefetchHits;
+  std::atomic<long long> readLatency[FileStats::LATENCY_BUCKETS];
+  std::atomic<long long> writeLatency[FileStats::LATENCY_BUCKETS];
+};
+
+/**
+ * The registry of the I/O statistics of every file used by the process.
+ * The files are identified by their buffer pool file ids (see
+ * BufferPool::getFileId()), so the statistics of a file accumulate over
+ * all the times it is opened.
+ *
+ * To find out what a statement did, take a snapshot before and after it
+ * and subtract them, or let report() do it.
+ */
+class IOStats {
+ public:
+  /**
+   * @param fileId[IN] the buffer pool file id of a file
+   * @param name[IN] the name the file is opened with
+   * @return the counters of the file. they live as long as the process
+   */
+  static FileCounters* getCounters(int fileId, const std::string& name);
+
+  /**
+   * @param stats[OUT] the statistics of all files, indexed by file id
+   */
+  static void getSnapshot(std::vector<FileStats>& stats);
+
+  /**
+   * print what every file did since an earlier snapshot, one line per
+   * file that was accessed.
+   * @param out[IN] the stream to print to
+   * @param before[IN] the earlier snapshot
+   */
+  static void report(FILE* out, const std::vector<FileStats>& before);
+
+  /**
+   * turn the per-statement report of the SQL engine on or off.
+   * @param enabled[IN] true to print the statistics after every statement
+   */
+  static void setReportEnabled(bool enabled) { reportEnabled = enabled; }
+
+  /**
+   * @return true if the statistics are printed after every statement
+   */
+  static bool isReportEnabled() { return reportEnabled; }
+
+  /**
+   * @return the time in microseconds from an arbitrary starting point,
+   *         for timing the disk accesses
+   */
+  static long long now();
+
+ private:
+  static std::mutex latch;                    // protects counters
+  static std::vector<FileCounters*> counters; // file id -> counters
+  static bool reportEnabled;
+};
+
+#endif // IOSTATS_H
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <climits>
+#include <cstring>
+#include "KeySearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KEYSEARCH_X86
+#include <immintrin.h>
+#endif
+
+const KeySearch::CountFunction KeySearch::countLess = KeySearch::pick();
+const KeySearch::UnpackFunction KeySearch::unpackValues = KeySearch::pickUnpack();
+
+// the key at position i
+static inline int keyAt(const char* keys, int stride, int i)
+{
+  int key;
+  memcpy(&key, keys + (long)i * stride, sizeof(int));
+  return key;
+}
+
+int KeySearch::lowerBound(const char* keys, int stride, int count, int key)
+{
+  const char* base = keys;
+  int n = count;
+
+  // the first key >= key is within [base, base + n]. halve the range with
+  // a conditional move instead of a branch the CPU cannot predict.
+  while (n > WINDOW) {
+    int half = n / 2;
+    base = (keyAt(base, stride, half - 1) < key) ? base + (long)half * stride : base;
+    n -= half;
+  }
+
+  return (base - keys) / stride + countLess(base, stride, n, key);
+}
+
+int KeySearch::upperBound(const char* keys, int stride, int count, int key)
+{
+  // the first key > key is the first key >= key + 1
+  if (key == INT_MAX) return count;
+  return lowerBound(keys, stride, count, key + 1);
+}
+
+// the mask of the low bits of a word
+static inline unsigned lowBits(int bits)
+{
+  return (bits < 32) ? (1u << bits) - 1 : ~0u;
+}
+
+// unpack the values from-th to count-th. a value is read byte by byte,
+// so that no byte behind the packed values is read.
+static void unpackRange(const char* packed, int from, int count, int base, int bits, int* values)
+{
+  const unsigned char* bytes = (const unsigned char*)packed;
+  unsigned mask = lowBits(bits);
+  for (int i = from; i < count; i++) {
+    long pos = (long)i * bits;
+    int shift = pos & 7;
+    unsigned long long word = 0;
+    for (int k = 0; k < (shift + bits + 7) / 8; k++)
+      word |= (unsigned long long)bytes[(pos >> 3) + k] << (8 * k);
+    values[i] = (int)((unsigned)base + ((unsigned)(word >> shift) & mask));
+  }
+}
+
+void KeySearch::pack(const int* values, int count, int base, int bits, char* packed)
+{
+  unsigned char* bytes = (unsigned char*)packed;
+  unsigned mask = lowBits(bits);
+  memset(bytes, 0, getPackedSize(count, bits));
+  for (int i = 0; bits && i < count; i++) {
+    long pos = (long)i * bits;
+    int shift = pos & 7;
+    unsigned long long word = (unsigned long long)(((unsigned)values[i] - (unsigned)base) & mask) << shift;
+    for (int k = 0; k < (shift + bits + 7) / 8; k++)
+      bytes[(pos >> 3) + k] |= (unsigned char)(word >> (8 * k));
+  }
+}
+
+void KeySearch::unpack(const char* packed, int count, int base, int bits, int* values)
+{
+  unpackValues(packed, count, base, bits, values);
+}
+
+int KeySearch::getBitWidth(int low, int high)
+{
+  unsigned range = (unsigned)high - (unsigned)low;
+  return range ? 32 - __builtin_clz(range) : 0;
+}
+
+KeySearch::Implementation KeySearch::getImplementation()
+{
+#ifdef KEYSEARCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return AVX2;
+  if (__builtin_cpu_supports("sse4.1")) return SSE41;
+#endif
+  return PORTABLE;
+}
+
+const char* KeySearch::getImplementationName(Implementation impl)
+{
+  switch (impl) {
+  case AVX2:
+    return "avx2";
+  case SSE41:
+    return "sse4.1";
+  default:
+    return "portable";
+  }
+}
+
+KeySearch::CountFunction KeySearch::pick()
+{
+  switch (getImplementation()) {
+  case AVX2:
+    return countAVX2;
+  case SSE41:
+    return countSSE41;
+  default:
+    return countPortable;
+  }
+}
+
+KeySearch::UnpackFunction KeySearch::pickUnpack()
+{
+  // SSE4.1 has neither gathers nor shifts by lane
+  return (getImplementation() == AVX2) ? unpackAVX2 : unpackPortable;
+}
+
+void KeySearch::unpackPortable(const char* packed, int count, int base, int bits, int* values)
+{
+  unpackRange(packed, 0, count, base, bits, values);
+}
+
+int KeySearch::countPortable(const char* keys, int stride, int count, int key)
+{
+  int less = 0;
+  for (int i = 0; i < count; i++) less += (keyAt(keys, stride, i) < key);
+  return less;
+}
+
+#ifdef KEYSEARCH_X86
+
+__attribute__((target("sse4.1")))
+int KeySearch::countSSE41(const char* keys, int stride, int count, int key)
+{
+  __m128i target = _mm_set1_epi32(key);
+  __m128i less = _mm_setzero_si128();
+  int i = 0;
+
+  // a lane of the compare result is -1 where the key is smaller
+  for (; i + 4 <= count; i += 4) {
+    __m128i v;
+    if (stride == sizeof(int)) {
+      v = _mm_loadu_si128((const __m128i*)(keys + (long)i * stride));
+    } else {
+      v = _mm_set_epi32(keyAt(keys, stride, i + 3), keyAt(keys, stride, i + 2),
+                        keyAt(keys, stride, i + 1), keyAt(keys, stride, i));
+    }
+    less = _mm_sub_epi32(less, _mm_cmpgt_epi32(target, v));
+  }
+
+  // add up the lanes
+  less = _mm_add_epi32(less, _mm_shuffle_epi32(less, _MM_SHUFFLE(1, 0, 3, 2)));
+  less = _mm_add_epi32(less, _mm_shuffle_epi32(less, _MM_SHUFFLE(2, 3, 0, 1)));
+  int result = _mm_cvtsi128_si32(less);
+
+  return result + countPortable(keys + (long)i * stride, stride, count - i, key);
+}
+
+__attribute__((target("avx2")))
+int KeySearch::countAVX2(const char* keys, int stride, int count, int key)
+{
+  __m256i target = _mm256_set1_epi32(key);
+  __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                     _mm256_set1_epi32(stride / sizeof(int)));
+  int result = 0;
+  int i = 0;
+
+  // a lane of the compare result is -1 where the key is smaller.
+  // the keys of the entries are gathered 8 at a time.
+  for (; i + 8 <= count; i += 8) {
+    const char* p = keys + (long)i * stride;
+    __m256i v;
+    if (stride == sizeof(int)) v = _mm256_loadu_si256((const __m256i*)p);
+    else v = _mm256_i32gather_epi32((const int*)p, index, sizeof(int));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(target, v)));
+    result += __builtin_popcount(mask);
+  }
+
+  return result + countPortable(keys + (long)i * stride, stride, count - i, key);
+}
+
+__attribute__((target("avx2")))
+void KeySearch::unpackAVX2(const char* packed, int count, int base, int bits, int* values)
+{
+  int size = getPackedSize(count, bits);
+  int i = 0;
+
+  // the value of a lane is in the 4 bytes from the byte of its first bit,
+  // as long as it has at most 25 bits. they are gathered 8 lanes at a time
+  // while the 4 bytes of the last lane are within the packed values.
+  if (bits <= 25) {
+    __m256i lane = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(bits));
+    __m256i mask = _mm256_set1_epi32(lowBits(bits));
+    __m256i seven = _mm256_set1_epi32(7);
+    __m256i offset = _mm256_set1_epi32(base);
+    for (; i + 8 <= count && ((long)(i + 7) * bits >> 3) + 4 <= size; i += 8) {
+      __m256i pos = _mm256_add_epi32(_mm256_set1_epi32(i * bits), lane);
+      __m256i word = _mm256_i32gather_epi32((const int*)packed, _mm256_srli_epi32(pos, 3), 1);
+      __m256i v = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(pos, seven)), mask);
+      _mm256_storeu_si256((__m256i*)(values + i), _mm256_add_epi32(v, offset));
+    }
+  }
+
+  unpackRange(packed, i, count, base, bits, values);
+}
+
+#else
+
+int KeySearch::countSSE41(const char* keys, int stride, int count, int key)
+{
+  return countPortable(keys, stride, count, key);
+}
+
+int KeySearch::countAVX2(const char* keys, int stride, int count, int key)
+{
+  return countPortable(keys, stride, count, key);
+}
+
+void KeySearch::unpackAVX2(const char* packed, int count, int base, int bits, int* values)
+{
+  unpackPortable(packed, count, base, bits, values);
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+/**
+ * Search of a sorted array of int keys inside a B+tree node.
+ * The keys are stride bytes apart (the key is the first int of an entry),
+ * so the same code works on the (key, payload) entries of a node and on
+ * a plain key array.
+ *
+ * The search narrows the range with a branch-free binary search until at
+ * most WINDOW keys are left, and counts the keys of the last window that
+ * are smaller than the search key with vector compares. The compare is
+ * done with AVX2 or SSE4.1 instructions if the CPU has them (found out at
+ * run time), and by portable code otherwise.
+ *
+ * It also packs and unpacks the bit-packed columns of a packed leaf (see
+ * BTLeafNode): count values of a column take bits bits each, as offsets
+ * from a base value (frame of reference). A column is unpacked 8 values
+ * at a time with AVX2 gathers and shifts if the CPU has them.
+ */
+class KeySearch {
+ public:
+  static const int WINDOW = 32;  // # of keys compared without branching
+
+  /**
+   * the implementations of the window compare
+   */
+  enum Implementation { PORTABLE, SSE41, AVX2 };
+
+  /**
+   * find the first key >= key.
+   * @param keys[IN] the first key
+   * @param stride[IN] the distance between two keys in bytes. a multiple of 4
+   * @param count[IN] # of keys
+   * @param key[IN] the key to search for
+   * @return the position of the first key >= key. count if there is none
+   */
+  static int lowerBound(const char* keys, int stride, int count, int key);
+
+  /**
+   * find the first key > key.
+   * @param keys[IN] the first key
+   * @param stride[IN] the distance between two keys in bytes. a multiple of 4
+   * @param count[IN] # of keys
+   * @param key[IN] the key to search for
+   * @return the position of the first key > key. count if there is none
+   */
+  static int upperBound(const char* keys, int stride, int count, int key);
+
+  /**
+   * pack values as offsets from base, bits bits each. the first value goes
+   * to the lowest bits of the first byte.
+   * @param values[IN] the values. each is base + an offset of bits bits
+   * @param count[IN] # of values
+   * @param base[IN] the base of the offsets
+   * @param bits[IN] # of bits of an offset (0-32)
+   * @param packed[OUT] the packed values. getPackedSize(count, bits) bytes
+   */
+  static void pack(const int* values, int count, int base, int bits, char* packed);
+
+  /**
+   * unpack values packed by pack().
+   * @param packed[IN] the packed values. getPackedSize(count, bits) bytes
+   * @param count[IN] # of values
+   * @param base[IN] the base of the offsets
+   * @param bits[IN] # of bits of an offset (0-32)
+   * @param values[OUT] the values
+   */
+  static void unpack(const char* packed, int count, int base, int bits, int* values);
+
+  /**
+   * @return # of bytes of count values packed with bits bits each
+   */
+  static int getPackedSize(int count, int bits) { return ((long)count * bits + 7) / 8; }
+
+  /**
+   * @return # of bits of the offsets from low of the values in [low, high]
+   */
+  static int getBitWidth(int low, int high);
+
+  /**
+   * @return the window compare picked for this CPU
+   */
+  static Implementation getImplementation();
+
+  /**
+   * @param impl[IN] an implementation
+   * @return the name of the implementation ("portable", "sse4.1" or "avx2")
+   */
+  static const char* getImplementationName(Implementation impl);
+
+ private:
+  // count the keys < key among count keys
+  typedef int (*CountFunction)(const char* keys, int stride, int count, int key);
+
+  // unpack count values
+  typedef void (*UnpackFunction)(const char* packed, int count, int base, int bits, int* values);
+
+  static CountFunction pick();
+  static UnpackFunction pickUnpack();
+  static int countPortable(const char* keys, int stride, int count, int key);
+  static int countSSE41(const char* keys, int stride, int count, int key);
+  static int countAVX2(const char* keys, int stride, int count, int key);
+
+  static void unpackPortable(const char* packed, int count, int base, int bits, int* values);
+  static void unpackAVX2(const char* packed, int count, int base, int bits, int* values);
+
+  static const CountFunction countLess;  // the compare picked for the CPU
+  static const UnpackFunction unpackValues;  // the unpack picked for the CPU
+};
+
+#endif // KEYSEARCH_H
@@ -9,39 +9,140 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "IOEngine.h"
+#include "IOStats.h"
+#include <algorithm>
 #include <cstring>
+#include <unordered_set>
+#include <vector>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 using std::string;
+using std::vector;
 
-int PageFile::readCount = 0;
-int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
-struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+std::atomic<int> PageFile::readCount(0);
+std::atomic<int> PageFile::writeCount(0);
+int PageFile::defaultPageSize = PageFile::DEFAULT_PAGE_SIZE;
+
+//
+// the header page in front of the pages of a file:
+//   [0..7]   magic "BRUINPF\0"
+//   [8..11]  header format version
+//   [12..15] page size
+// the rest of the header page is unused.
+//
+static const char HEADER_MAGIC[8] = { 'B', 'R', 'U', 'I', 'N', 'P', 'F', 0 };
+static const int  HEADER_VERSION = 1;
+static const int  HEADER_LENGTH = 16;
+
+// max # of pages flush() writes with a single system call
+static const int MAX_RUN_PAGES = 256;
+
+// a read started by prefetch(). it lives until the read completes.
+struct PrefetchRequest {
+  IORequest          io;
+  const PageFile*    file;
+  BufferPool*        pool;
+  BufferPool::Frame* frame;
+  long long          start;  // when the read was submitted, in us
+};
+
+PageGuard::PageGuard()
+{
+  file = NULL;
+  frame = NULL;
+  buffer = NULL;
+  pid = -1;
+  dirty = false;
+}
+
+PageGuard::~PageGuard()
+{
+  release();
+}
+
+RC PageGuard::release()
+{
+  if (file == NULL) return 0;
+  return file->unpin(*this);
+}
 
 PageFile::PageFile() 
 { 
   fd = -1; 
+  fid = -1;
   epid = 0; 
+  pageSize = DEFAULT_PAGE_SIZE;
+  headerPages = 0;
+  map = NULL;
+  mapSize = 0;
+  writable = false;
+  pool = NULL;
+  dirtyPages = 0;
+  stats = NULL;
+  pattern = NORMAL;
+  lastPid = -1;
+  seqCount = 0;
+  aheadEnd = 0;
+  prefetchCount = 0;
 }
 
-PageFile::PageFile(const string& filename, char mode)
+PageFile::PageFile(const string& filename, char mode, int pageSize)
 {
   fd = -1;
+  fid = -1;
   epid = 0;
-  open(filename.c_str(), mode);
+  this->pageSize = DEFAULT_PAGE_SIZE;
+  headerPages = 0;
+  map = NULL;
+  mapSize = 0;
+  writable = false;
+  pool = NULL;
+  dirtyPages = 0;
+  stats = NULL;
+  pattern = NORMAL;
+  lastPid = -1;
+  seqCount = 0;
+  aheadEnd = 0;
+  prefetchCount = 0;
+  open(filename.c_str(), mode, pageSize);
+}
+
+PageFile::~PageFile()
+{
+  // do not lose the dirty pages of a file that was not closed
+  if (fd > 0) close();
+}
+
+bool PageFile::isValidPageSize(int pageSize)
+{
+  return pageSize >= MIN_PAGE_SIZE && pageSize <= MAX_PAGE_SIZE
+    && (pageSize & (pageSize - 1)) == 0;
 }
 
-RC PageFile::open(const string& filename, char mode)
+RC PageFile::setDefaultPageSize(int pageSize)
+{
+  if (!isValidPageSize(pageSize)) return RC_INVALID_ATTRIBUTE;
+  defaultPageSize = pageSize;
+  return 0;
+}
+
+RC PageFile::open(const string& filename, char mode, int pageSize)
 {
   RC   rc;
   int  oflag;
   struct stat statbuf;
+  char header[HEADER_LENGTH];
 
   if (fd > 0) return RC_FILE_OPEN_FAILED;
 
+  if (pageSize == 0) pageSize = defaultPageSize;
+  if (!isValidPageSize(pageSize)) return RC_INVALID_ATTRIBUTE;
+
   // set the unix file flag depending on the file mode
   switch (mode) {
   case 'r':
@@ -52,6 +153,10 @@ RC PageFile::open(const string& filename, char mode)
   case 'W':
     oflag = (O_RDWR|O_CREAT);
     break;
+  case 'm':
+  case 'M':
+    oflag = O_RDONLY;
+    break;
   default:
     return RC_INVALID_FILE_MODE;
   }
@@ -60,33 +165,136 @@ RC PageFile::open(const string& filename, char mode)
   fd = ::open(filename.c_str(), oflag, 0644);
   if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
 
-  // get the size of the file to set the end pid
+  // get the size of the file
   rc = ::fstat(fd, &statbuf);
   if (rc < 0) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
-  epid = statbuf.st_size / PAGE_SIZE;
+
+  if (statbuf.st_size == 0) {
+    // a new file. write the header page when we may write to the file.
+    headerPages = 1;
+    if (oflag & O_RDWR) {
+      char* page = new char[pageSize];
+      memset(page, 0, pageSize);
+      memcpy(page, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+      memcpy(page + 8, &HEADER_VERSION, sizeof(int));
+      memcpy(page + 12, &pageSize, sizeof(int));
+      ssize_t n = ::pwrite(fd, page, pageSize, 0);
+      delete [] page;
+      if (n != pageSize) { ::close(fd); fd = -1; return RC_FILE_WRITE_FAILED; }
+    }
+  } else if (::pread(fd, header, HEADER_LENGTH, 0) == HEADER_LENGTH
+             && memcmp(header, HEADER_MAGIC, sizeof(HEADER_MAGIC)) == 0) {
+    // the page size of an existing file is the one in its header
+    int version;
+    memcpy(&version, header + 8, sizeof(int));
+    memcpy(&pageSize, header + 12, sizeof(int));
+    if (version != HEADER_VERSION || !isValidPageSize(pageSize)) {
+      ::close(fd);
+      fd = -1;
+      return RC_INVALID_FILE_FORMAT;
+    }
+    headerPages = 1;
+  } else {
+    // a file without a header page has 1KB pages starting at offset 0
+    pageSize = 1024;
+    headerPages = 0;
+  }
+  this->pageSize = pageSize;
+
+  // set the end pid
+  epid = statbuf.st_size / pageSize - headerPages;
+  if (epid < 0) epid = 0;
+
+  // in 'm' mode, map the whole file. (an empty file cannot be mapped,
+  // but there is nothing to read from it either.)
+  if ((mode == 'm' || mode == 'M') && epid > 0) {
+    mapSize = ((size_t)epid + headerPages) * pageSize;
+    void* addr = ::mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      fd = -1;
+      epid = 0;
+      mapSize = 0;
+      return RC_FILE_OPEN_FAILED;
+    }
+    map = (char*)addr;
+  }
+
+  // the pages of the file are cached under the same id every time
+  // the file is opened, so they survive close() and re-open().
+  // if the file is empty, whatever is cached for it is stale.
+  pool = &BufferPool::getInstance(pageSize);
+  fid = BufferPool::getFileId(statbuf.st_dev, statbuf.st_ino);
+  if (epid == 0) BufferPool::invalidateFileInAllPools(fid);
+  stats = IOStats::getCounters(fid, filename);
+
+  // the dirty pages of the file are written back through this PageFile
+  writable = (oflag & O_RDWR) != 0;
+  if (writable) BufferPool::setWriter(fid, this);
+  dirtyPages = 0;
+
+  pattern = NORMAL;
+  lastPid = -1;
+  seqCount = 0;
+  aheadEnd = 0;
 
   return 0;
 }
 
 RC PageFile::close()
 {
+  RC rc;
+
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
-  // close the file
-  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
+  // wait for the reads started by prefetch()
+  {
+    std::unique_lock<std::mutex> lock(prefetchLatch);
+    while (prefetchCount > 0) prefetchSignal.wait(lock);
+  }
 
-  // evict all cached pages for this file
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
+  // write the dirty pages while the file is still open. if that fails,
+  // the pages cannot be written any more and are dropped.
+  if (BufferPool::getWriter(fid) == this) {
+    rc = flush();
+    BufferPool::setWriter(fid, NULL);
+    if (rc < 0) {
+      pool->invalidateFile(fid);
+      ::close(fd);
+      fd = -1;
+      fid = -1;
+      writable = false;
+      epid = 0;
+      pool = NULL;
+      return rc;
     }
   }
 
-  // set the fd and epid to the initial state
+  // unmap the file in 'm' mode
+  if (map != NULL) {
+    ::munmap(map, mapSize);
+    map = NULL;
+    mapSize = 0;
+  }
+
+  // close the file
+  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
+
+  // set the fd and epid to the initial state.
+  // note that the cached pages of the file are kept in the buffer pool,
+  // so that they can be reused when the file is opened again.
   fd = -1; 
+  fid = -1;
+  writable = false;
   epid = 0;
+  pool = NULL;
+  return 0;
+}
+
+RC PageFile::getStats(FileStats& stats) const
+{
+  if (this->stats == NULL) return RC_FILE_CLOSE_FAILED;
+  this->stats->get(stats);
   return 0;
 }
 
@@ -95,38 +303,158 @@ PageId PageFile::endPid() const
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
+RC PageFile::advise(AccessPattern pattern) const
 {
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  int advice;
+
+  this->pattern = pattern;
+  seqCount = 0;
+  aheadEnd = 0;
+  if (map == NULL) return 0;
+
+  switch (pattern) {
+  case SEQUENTIAL:
+    advice = MADV_SEQUENTIAL;
+    break;
+  case RANDOM:
+    advice = MADV_RANDOM;
+    break;
+  default:
+    advice = MADV_NORMAL;
+    break;
+  }
+
+  return (::madvise(map, mapSize, advice) < 0) ? RC_INVALID_ATTRIBUTE : 0;
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
-  if (pid < 0) return RC_INVALID_PID; 
+  RC   rc;
+  bool loaded;
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
+  if (pid < 0) return RC_INVALID_PID; 
 
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  // a file opened in 'r' or 'm' mode is read only. (a dirty page that
+  // no PageFile can write back would stay in the pool for good.)
+  if (!writable) return RC_INVALID_FILE_MODE;
 
-  // if the page is in read cache, invalidate it
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid &&
-        readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-       break;
-    }
+  // copy the buffer into the frame of the page and leave it dirty there.
+  // the old content does not matter, so a missing page is not read first.
+  // (the buffer may be the cached frame itself if the page is pinned.)
+  BufferPool::Frame* frame = pool->fix(fid, pid, loaded);
+  if (frame == NULL) {
+    // every frame is pinned. write the page directly to the disk.
+    if ((rc = writeFrame(pid, (const char*)buffer)) < 0) return rc;
+    noteWritten(pid);
+    return 0;
   }
 
-  // if the written pid >= end pid, update the end pid
-  if (pid >= epid) epid = pid + 1;
+  if (frame->buffer != buffer) memcpy(frame->buffer, buffer, pageSize);
+  if (!loaded) pool->finishLoad(frame, true);
+  noteWritten(pid);
+
+  if (pool->unpin(frame, true)) return noteDirty();
+  return 0;
+}
+
+RC PageFile::writeFrame(PageId pid, const char* buffer)
+{
+  long long start = IOStats::now();
+  if (::pwrite(fd, buffer, pageSize, pageOffset(pid)) != pageSize) {
+    return RC_FILE_WRITE_FAILED;
+  }
 
   // increase page write count
   writeCount++;
+  stats->write(1, pageSize, IOStats::now() - start);
+
+  return 0;
+}
+
+void PageFile::noteWritten(PageId pid)
+{
+  // if the written pid >= end pid, update the end pid
+  PageId end = epid;
+  while (pid >= end && !epid.compare_exchange_weak(end, pid + 1));
+}
+
+RC PageFile::noteDirty()
+{
+  // do not let the dirty pages pile up. writing them in a batch now keeps
+  // the runs long and saves the evictions from writing them one by one.
+  if (++dirtyPages >= WRITE_BEHIND_PAGES) return flush();
+  return 0;
+}
+
+RC PageFile::flush()
+{
+  RC rc = 0;
+  vector<BufferPool::Frame*> frames;
+  vector<struct iovec> iov;
+
+  if (fd <= 0 || map != NULL) return 0;
+
+  dirtyPages = 0;
+  pool->collectDirty(fid, frames);
+  std::sort(frames.begin(), frames.end(),
+            [](const BufferPool::Frame* a, const BufferPool::Frame* b) {
+              return a->pid < b->pid;
+            });
+
+  for (unsigned i = 0; i < frames.size(); ) {
+    // find the run of consecutive pages starting at frames[i]
+    unsigned j = i + 1;
+    while (j < frames.size() && j - i < (unsigned)MAX_RUN_PAGES
+           && frames[j]->pid == frames[j - 1]->pid + 1) j++;
+
+    // and write it with a single system call
+    iov.resize(j - i);
+    for (unsigned k = i; k < j; k++) {
+      iov[k - i].iov_base = frames[k]->buffer;
+      iov[k - i].iov_len = pageSize;
+    }
+    long long start = IOStats::now();
+    ssize_t n = ::pwritev(fd, &iov[0], j - i, pageOffset(frames[i]->pid));
+    bool success = (n == (ssize_t)(j - i) * pageSize);
+
+    // a page that could not be written stays dirty
+    for (unsigned k = i; k < j; k++) pool->unpin(frames[k], !success);
+    if (success) {
+      writeCount += j - i;
+      stats->write(j - i, n, IOStats::now() - start);
+    } else if (rc == 0) rc = RC_FILE_WRITE_FAILED;
+
+    i = j;
+  }
+
+  return rc;
+}
+
+RC PageFile::fetch(PageId pid, BufferPool::Frame*& frame) const
+{
+  bool loaded;
+  bool prefetchHit;
+
+  // pin the frame of the page. if the page is cached, we are done.
+  frame = pool->fix(fid, pid, loaded, false, &prefetchHit);
+  if (frame == NULL) return RC_BUFFER_FULL;
+  stats->request(!loaded);
+  if (prefetchHit) stats->prefetchHit();
+  if (loaded) return 0;
+
+  // read the page into the frame. a short read is a failed one too,
+  // as in prefetchDone(): the page would be left partly filled.
+  long long start = IOStats::now();
+  if (::pread(fd, frame->buffer, pageSize, pageOffset(pid)) != pageSize) {
+    pool->finishLoad(frame, false);
+    pool->unpin(frame);
+    return RC_FILE_READ_FAILED;
+  }
+  pool->finishLoad(frame, true);
+
+  // increase the page read count
+  readCount++;
+  stats->read(1, pageSize, IOStats::now() - start);
 
   return 0;
 }
@@ -134,47 +462,221 @@ RC PageFile::write(PageId pid, const void* buffer)
 RC PageFile::read(PageId pid, void* buffer) const
 {
   RC rc;
+  BufferPool::Frame* frame;
 
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
-  //
-  // if the page is in cache, read it from there
-  //
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid && 
-        readCache[i].lastAccessed != 0) {
-       memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
-       return 0;
-    }
+  // in 'm' mode, copy the page from the mapping
+  if (map != NULL) {
+    memcpy(buffer, map + pageOffset(pid), pageSize);
+    readCount++;
+    stats->request(false);
+    return 0;
   }
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
+  rc = fetch(pid, frame);
+  if (rc == 0) {
+    memcpy(buffer, frame->buffer, pageSize);
+    pool->unpin(frame);
+    readAhead(pid);
+    return 0;
+  }
+  if (rc != RC_BUFFER_FULL) return rc;
+
+  // every frame is pinned. read the page directly into the buffer.
+  long long start = IOStats::now();
+  if (::pread(fd, buffer, pageSize, pageOffset(pid)) != pageSize) {
+    return RC_FILE_READ_FAILED;
+  }
+  readCount++;
+  stats->request(true);
+  stats->read(1, pageSize, IOStats::now() - start);
+
+  return 0;
+}
+
+RC PageFile::prefetch(const PageId* pids, int count) const
+{
+  bool loaded;
+  vector<IORequest*> batch;
+
+  // in 'm' mode, ask the kernel to bring in the pages
+  if (map != NULL) {
+    for (int i = 0; i < count; i++) {
+      if (pids[i] < 0 || pids[i] >= epid) return RC_INVALID_PID;
+      ::madvise(map + pageOffset(pids[i]), pageSize, MADV_WILLNEED);
     }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
+    return 0;
+  }
+
+  // assign a frame to every page that is not cached yet.
+  // the frame stays pinned until its read completes.
+  std::unordered_set<PageId> seen;
+  for (int i = 0; i < count; i++) {
+    if (pids[i] < 0 || pids[i] >= epid) continue;
+    if (!seen.insert(pids[i]).second) continue;
+
+    BufferPool::Frame* frame = pool->fix(fid, pids[i], loaded, true);
+    if (frame == NULL) break;
+    if (loaded) {
+      pool->unpin(frame);
+      continue;
     }
+
+    PrefetchRequest* req = new PrefetchRequest;
+    req->io.fd = fd;
+    req->io.offset = pageOffset(pids[i]);
+    req->io.buffer = frame->buffer;
+    req->io.length = pageSize;
+    req->io.callback = prefetchDone;
+    req->io.context = req;
+    req->file = this;
+    req->pool = pool;
+    req->frame = frame;
+    req->start = IOStats::now();
+    batch.push_back(&req->io);
   }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
+  if (batch.empty()) return 0;
+  stats->prefetch(batch.size());
+
+  {
+    std::lock_guard<std::mutex> lock(prefetchLatch);
+    prefetchCount += batch.size();
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
 
-  // increase the page read count
-  readCount++;
+  // the reads that could not be started complete as failed ones, so
+  // prefetchDone() gives up their frames either way
+  return IOEngine::getInstance().submit(&batch[0], batch.size());
+}
+
+void PageFile::prefetchDone(IORequest* request)
+{
+  PrefetchRequest* req = (PrefetchRequest*)request->context;
+  const PageFile* file = req->file;
+
+  bool success = (request->result == (ssize_t)request->length);
+  req->pool->finishLoad(req->frame, success);
+  req->pool->unpin(req->frame);
+  if (success) {
+    readCount++;
+    file->stats->read(1, request->length, IOStats::now() - req->start);
+  }
+  delete req;
+
+  // this must be the last access to the file. close() may go ahead
+  // and the PageFile may be gone as soon as the latch is released.
+  std::lock_guard<std::mutex> lock(file->prefetchLatch);
+  if (--file->prefetchCount == 0) file->prefetchSignal.notify_all();
+}
+
+void PageFile::readAhead(PageId pid) const
+{
+  if (pattern == RANDOM) return;
+
+  // find out whether the pages are accessed in order
+  PageId last = lastPid.exchange(pid);
+  if (pid == last) return;
+  if (pid == last + 1) {
+    seqCount++;
+  } else {
+    seqCount = 0;
+    aheadEnd = 0;
+  }
+  if (pattern != SEQUENTIAL && seqCount < SEQUENTIAL_THRESHOLD) return;
+
+  // keep READ_AHEAD_PAGES pages ahead of the reader. the next window is
+  // started when the reader is half way through the current one, so that
+  // it never has to wait for a read.
+  PageId end = aheadEnd;
+  if (end > pid + READ_AHEAD_PAGES / 2) return;
+
+  PageId from = (end > pid) ? end : pid + 1;
+  PageId to = pid + 1 + READ_AHEAD_PAGES;
+  if (to > epid) to = epid;
+  if (from >= to) return;
+  if (!aheadEnd.compare_exchange_strong(end, to)) return;
+
+  vector<PageId> pids;
+  for (PageId p = from; p < to; p++) pids.push_back(p);
+  prefetch(&pids[0], pids.size());
+}
+
+RC PageFile::pin(PageId pid, PageGuard& guard) const
+{
+  RC rc;
+  BufferPool::Frame* frame;
+
+  if ((rc = guard.release()) < 0) return rc;
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+
+  if (map != NULL) {
+    // in 'm' mode, the page is accessed right in the mapping.
+    // nothing has to be pinned, since the mapping stays until close().
+    frame = NULL;
+    readCount++;
+    stats->request(false);
+  } else {
+    if ((rc = fetch(pid, frame)) < 0) return rc;
+    readAhead(pid);
+  }
+
+  guard.file = const_cast<PageFile*>(this);
+  guard.frame = frame;
+  guard.buffer = (frame != NULL) ? frame->buffer : map + pageOffset(pid);
+  guard.pid = pid;
+  guard.dirty = false;
+
+  return 0;
+}
+
+RC PageFile::pinNew(PageId pid, PageGuard& guard)
+{
+  RC rc;
+  bool loaded;
+  BufferPool::Frame* frame;
+
+  if ((rc = guard.release()) < 0) return rc;
+  if (pid < 0) return RC_INVALID_PID; 
+  if (!writable) return RC_INVALID_FILE_MODE;
+
+  // the old content of the page does not matter, so a cached copy is
+  // reused as is and a missing page is never read from the disk
+  if ((frame = pool->fix(fid, pid, loaded)) == NULL) return RC_BUFFER_FULL;
+  memset(frame->buffer, 0, pageSize);
+  if (!loaded) pool->finishLoad(frame, true);
+
+  guard.file = this;
+  guard.frame = frame;
+  guard.buffer = frame->buffer;
+  guard.pid = pid;
+  guard.dirty = true;
 
   return 0;
 }
+
+RC PageFile::unpin(PageGuard& guard)
+{
+  RC rc = 0;
+
+  // a modified page is left dirty in the buffer pool.
+  // (a page of a read-only file cannot be modified. what was written into
+  // its frame is dropped, so that no reader sees it.)
+  if (guard.dirty) {
+    if (!writable) {
+      rc = RC_INVALID_FILE_MODE;
+      if (guard.frame != NULL) pool->invalidate(fid, guard.pid);
+      guard.dirty = false;
+    } else noteWritten(guard.pid);
+  }
+  if (guard.frame != NULL && pool->unpin(guard.frame, guard.dirty)) {
+    rc = noteDirty();
+  }
+
+  guard.file = NULL;
+  guard.frame = NULL;
+  guard.buffer = NULL;
+  guard.pid = -1;
+  guard.dirty = false;
+
+  return rc;
+}
@@ -11,35 +11,135 @@
 #define PAGEFILE_H
 
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "Bruinbase.h"
+#include "BufferPool.h"
 
-typedef int PageId;
+struct IORequest;
+struct FileStats;
+class FileCounters;
+
+class PageFile;
+
+/**
+ * A page of a PageFile pinned in the buffer pool.
+ * While the guard holds the page, the page is never evicted and data()
+ * points directly into the cached frame, so the page can be accessed
+ * without copying it. The page is unpinned when the guard is released
+ * or destroyed. If the page was modified through data(), call markDirty()
+ * so that the page is marked dirty in the buffer pool when it is unpinned.
+ */
+class PageGuard {
+ public:
+  PageGuard();
+  ~PageGuard();
+
+  /**
+   * @return pointer to the page content. NULL if no page is pinned
+   */
+  char* data() const { return buffer; }
+
+  /**
+   * @return the id of the pinned page
+   */
+  PageId getPid() const { return pid; }
+
+  /**
+   * @return true if the guard holds a page
+   */
+  bool isPinned() const { return buffer != NULL; }
+
+  /**
+   * mark the pinned page as modified.
+   */
+  void markDirty() { dirty = true; }
+
+  /**
+   * unpin the page. if the page is dirty, it is marked dirty in the pool.
+   * @return error code. 0 if no error
+   */
+  RC release();
+
+ private:
+  // a guard cannot be copied, since it owns the pin
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+
+  friend class PageFile;
+
+  PageFile*          file;   // the file the page belongs to
+  BufferPool::Frame* frame;  // the frame holding the page
+  char*              buffer; // the page content
+  PageId             pid;    // the pinned page
+  bool               dirty;  // true if the page needs to be written back
+};
 
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * pages are accessed with positional I/O (pread/pwrite) and cached in the
+ * latched BufferPool, so read(), write(), pin() and pinNew() can be called
+ * from multiple threads at the same time. open() and close() must not run
+ * concurrently with any other call on the same PageFile.
+ * written pages stay dirty in the buffer pool and reach the disk when they
+ * are evicted, when flush() is called, or when the file is closed. only
+ * one PageFile may have a file open in 'w' mode at a time.
  */
 class PageFile {
  public:
 
-  static const int PAGE_SIZE = 1024;    // the size of a page is 1KB
+  // # of pages that may be dirtied before they are written in the background
+  static const int WRITE_BEHIND_PAGES = 256;
+
+  // # of pages read ahead of a sequential reader, and # of consecutive
+  // pages a reader has to touch before it is considered sequential
+  static const int READ_AHEAD_PAGES = 32;
+  static const int SEQUENTIAL_THRESHOLD = 4;
+
+  // the size of a page is chosen when a file is created and recorded in
+  // the header page of the file. it is a power of two between 1KB and 64KB.
+  static const int DEFAULT_PAGE_SIZE = 1024;
+  static const int MIN_PAGE_SIZE = 1024;
+  static const int MAX_PAGE_SIZE = 65536;
+
+  /**
+   * the expected access pattern of a file. see advise().
+   */
+  enum AccessPattern { NORMAL, SEQUENTIAL, RANDOM };
 
   PageFile();
-  PageFile(const std::string& filename, char mode);
+  PageFile(const std::string& filename, char mode, int pageSize = 0);
+  ~PageFile();
 
   /**
    * open a file in read or write mode.
-   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'w' mode, if the file does not exist, it is created
+   * with the given page size. the page size of an existing file is read
+   * from its header page. (a file without the header page was created
+   * before the page size became configurable and has 1KB pages.)
+   * when opened in 'm' mode, the file is read-only and memory-mapped.
+   * its pages are served directly from the mapping (i.e., by the kernel
+   * page cache) instead of going through the buffer pool.
    * @param filename[IN] the name of the file to open
-   * @param mode[IN] 'r' for read, 'w' for write
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for memory-mapped read
+   * @param pageSize[IN] the page size of a new file. 0 for the default
    * @return error code. 0 if no error
    */
-  RC open(const std::string& filename, char mode);
+  RC open(const std::string& filename, char mode, int pageSize = 0);
 
   /**
-   * close the file.
+   * close the file. the dirty pages of the file are written first.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * write all dirty pages of the file to the disk. pages with consecutive
+   * pids are written together with a single system call.
+   * @return error code. 0 if no error
+   */
+  RC flush();
   
   /**
    * read a disk page into memory buffer.
@@ -51,13 +151,48 @@ class PageFile {
   
   /**
    * write the memory buffer to the disk page.
+   * the page is copied into the buffer pool and written back later.
    * if (pid >= endPid()), the file is expanded such that
    * endPid() becomes (pid + 1).
    * @param pid[IN] page to write to
    * @param buffer[IN] the content to write
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error. RC_INVALID_FILE_MODE if the file
+   *         was not opened in 'w' mode
    */
   RC write(PageId pid, const void *buffer);
+
+  /**
+   * start reading a set of pages into the buffer pool and return without
+   * waiting for them. a later pin() or read() of a page that is still
+   * being read waits for that read instead of issuing another one.
+   * pages that are cached already, or that do not fit in the pool because
+   * every frame is pinned, are skipped. a page may be listed more than once.
+   * @param pids[IN] the pages to read
+   * @param count[IN] # of pages in pids
+   * @return error code. 0 if no error
+   */
+  RC prefetch(const PageId* pids, int count) const;
+
+  /**
+   * pin a disk page in the buffer pool, reading it from the disk if
+   * it is not cached. the page content can then be accessed through
+   * guard.data() without any copy. if the guard already holds a page,
+   * that page is released first.
+   * @param pid[IN] the page to pin
+   * @param guard[OUT] the guard holding the page
+   * @return error code. 0 if no error
+   */
+  RC pin(PageId pid, PageGuard& guard) const;
+
+  /**
+   * pin a page that is about to be overwritten entirely, without reading
+   * it from the disk. the page content is initialized with zeros and the
+   * page is marked dirty. pid may be endPid() to append a new page.
+   * @param pid[IN] the page to pin
+   * @param guard[OUT] the guard holding the page
+   * @return error code. 0 if no error
+   */
+  RC pinNew(PageId pid, PageGuard& guard);
     
   /**
    * note the +1 part. The last page id in the file is actually endPid()-1.
@@ -66,6 +201,42 @@ class PageFile {
    */
   PageId endPid() const;
 
+  /**
+   * @return the size of a page of the file in bytes
+   */
+  int getPageSize() const { return pageSize; }
+
+  /**
+   * set the page size of the files created from now on.
+   * @param pageSize[IN] the page size
+   * @return error code. 0 if no error
+   */
+  static RC setDefaultPageSize(int pageSize);
+
+  /**
+   * @return true if pageSize is a valid page size
+   */
+  static bool isValidPageSize(int pageSize);
+
+  /**
+   * tell how the file is going to be accessed, so that the pages can be
+   * brought in accordingly. in 'm' mode, it is passed to the kernel as an
+   * madvise() hint. otherwise, SEQUENTIAL reads pages ahead from the first
+   * pin() or read() on, RANDOM never reads ahead, and NORMAL reads ahead
+   * once SEQUENTIAL_THRESHOLD consecutive pages have been accessed.
+   * @param pattern[IN] the expected access pattern
+   * @return error code. 0 if no error
+   */
+  RC advise(AccessPattern pattern) const;
+
+  /**
+   * get the I/O statistics of the file, accumulated over all the times the
+   * file has been opened by the process. see IOStats.h.
+   * @param stats[OUT] the statistics
+   * @return error code. 0 if no error
+   */
+  RC getStats(FileStats& stats) const;
+
   /**
    * @return the total # of disk reads
    */
@@ -78,35 +249,88 @@ class PageFile {
 
  protected:
   /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
+   * find and pin the frame caching a page, reading the page into the
+   * buffer pool if it is not cached.
+   * @param pid[IN] the page to fetch
+   * @param frame[OUT] the pinned frame holding the page
+   * @return error code. 0 if no error
+   */
+  RC fetch(PageId pid, BufferPool::Frame*& frame) const;
+
+  /**
+   * give up the pin held by the guard. called from PageGuard::release().
+   * @param guard[IN] the guard to release
+   * @return error code. 0 if no error
+   */
+  RC unpin(PageGuard& guard);
+
+  /**
+   * write a page to the disk right away. called by the buffer pool to
+   * write back a dirty frame it evicts.
+   * @param pid[IN] the page to write
+   * @param buffer[IN] the page content
    * @return error code. 0 if no error
    */
-  RC seek(PageId pid) const;
+  RC writeFrame(PageId pid, const char* buffer);
 
  private:
+  friend class PageGuard;
+  friend class BufferPool;
+
+  // note that a page of the file turned dirty. may write the dirty pages
+  RC noteDirty();
+
+  // update the end pid after pid has been written
+  void noteWritten(PageId pid);
+
+  // note that pid has been accessed, and read the following pages ahead
+  // if the file is read sequentially
+  void readAhead(PageId pid) const;
+
+  // completion callback of the reads started by prefetch()
+  static void prefetchDone(IORequest* request);
+
+  // the byte offset of a page in the unix file
+  off_t pageOffset(PageId pid) const
+    { return ((off_t)pid + headerPages) * pageSize; }
+
   int     fd;     // file descriptor of the associated unix file
-  PageId  epid;   // (last page id + 1) of the file
+  int     fid;    // id of the file in the buffer pool
+  std::atomic<PageId> epid;   // (last page id + 1) of the file
+  int     pageSize;     // the size of a page of the file
+  int     headerPages;  // # of header pages in front of page 0 (0 or 1)
+  char*   map;    // the mapping of the file in 'm' mode. NULL otherwise
+  size_t  mapSize;  // the size of the mapping
+  bool    writable; // true if the file was opened in 'w' mode
+
+  //
+  // the pages are cached in the process-wide BufferPool for the page size
+  // of the file. see BufferPool.h for the details.
+  //
+  BufferPool* pool;
+  std::atomic<int> dirtyPages;  // # of pages dirtied since the last flush
+
+  FileCounters* stats;  // the I/O statistics of the file. NULL until open()
 
   //
-  // the following set of members implement LRU caching 
+  // the read-ahead state. it is only a hint, so the members are updated
+  // without a latch and a race at worst reads a page ahead twice.
   //
-  static const int CACHE_COUNT = 10;
+  mutable std::atomic<int>    pattern;    // the advised AccessPattern
+  mutable std::atomic<PageId> lastPid;    // the page accessed last
+  mutable std::atomic<int>    seqCount;   // # of consecutive pages accessed
+  mutable std::atomic<PageId> aheadEnd;   // the end of the read-ahead window
 
-  static int cacheClock; // clock tick counter for LRU policy
+  // the reads started by prefetch() that have not completed yet.
+  // close() waits for them, so that none completes after the fd is gone.
+  mutable std::mutex prefetchLatch;
+  mutable std::condition_variable prefetchSignal;
+  mutable int prefetchCount;
 
-  // the actual cache data structure
-  static struct cacheStruct {
-    int    fd;              // file id of the cached page
-    PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
-                            //   (lastAccessed == 0) means that the buffer is empty
-    char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+  static int defaultPageSize;  // the page size of new files
 
-  static int readCount;  // total # of page reads 
-  static int writeCount; // total # of page writes 
+  static std::atomic<int> readCount;  // total # of page reads 
+  static std::atomic<int> writeCount; // total # of page writes 
 };
   
 #endif // PAGEFILE_H
@@ -10,6 +10,7 @@
 #include "Bruinbase.h"
 #include "RecordFile.h"
 #include <cstring>
+#include <vector>
 
 using std::string;
 
@@ -26,6 +27,12 @@ static void readSlot(const char* page, int n, int& key, std::string& value);
 // write the record to the n'th slot in the page
 static void writeSlot(char* page, int n, int key, const std::string& value);
 
+// true if the record in the n'th slot in the page was removed
+static bool isRemoved(const char* page, int n);
+
+// mark the record in the n'th slot in the page as removed
+static void removeSlot(char* page, int n);
+
 // get # records stored in the page
 static int getRecordCount(const char* page);
 
@@ -37,32 +44,6 @@ static void setRecordCount(char* page, int count);
 // helper functions for RecordId manipulation
 //
 
-// postfix record id iterator
-RecordId operator++ (RecordId& rid, int)
-{
-  RecordId prid(rid);
-
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  }
-
-  return prid;
-}
-
-// prefix record id iterator
-RecordId& operator++ (RecordId& rid)
-{
-  // if the end of a page is reached, move to the next page
-  if (++rid.sid >= RecordFile::RECORDS_PER_PAGE) {
-    rid.pid++;
-    rid.sid = 0;
-  } 
-
-  return rid;
-}
-
 // RecordId comparators
 bool operator < (const RecordId& r1, const RecordId& r2)
 {
@@ -107,20 +88,22 @@ RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  recordsPerPage = 0;
 }
 
-RecordFile::RecordFile(const string& filename, char mode)
+RecordFile::RecordFile(const string& filename, char mode, int pageSize)
 {
-  open(filename, mode);
+  open(filename, mode, pageSize);
 }
 
-RC RecordFile::open(const string& filename, char mode)
+RC RecordFile::open(const string& filename, char mode, int pageSize)
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC        rc;
+  PageGuard page;
 
   // open the page file
-  if ((rc = pf.open(filename, mode)) < 0) return rc;
+  if ((rc = pf.open(filename, mode, pageSize)) < 0) return rc;
+  recordsPerPage = (pf.getPageSize() - sizeof(int)) / (sizeof(int) + MAX_VALUE_LENGTH);
   
   //
   // in the rest of this function, we set the end record id
@@ -139,7 +122,7 @@ RC RecordFile::open(const string& filename, char mode)
   // obtain # records in the last page to set sid of the end record id.
   // read the last page of the file and get # records in the page.
   // remeber that the id of the last page is endPid()-1 not endPid().
-  if ((rc = pf.read(--erid.pid, page)) < 0) {
+  if ((rc = pf.pin(--erid.pid, page)) < 0) {
     // an error occurred during page read
     erid.pid = erid.sid = 0;
     pf.close();
@@ -147,8 +130,8 @@ RC RecordFile::open(const string& filename, char mode)
   }
 
   // get # records in the last page
-  erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
+  erid.sid = getRecordCount(page.data());
+  if (erid.sid >= recordsPerPage) {
     // the last page is full. advance the end record id to the next page.
     erid.pid++;
     erid.sid = 0;
@@ -167,62 +150,97 @@ RC RecordFile::close()
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC        rc;
+  PageGuard page;
   
   // check whether the rid is in the valid range
   if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
-  if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  // pin the page containing the record
+  if ((rc = pf.pin(rid.pid, page)) < 0) return rc;
 
   // read the record from the slot in the page
-  readSlot(page, rid.sid, key, value);
+  if (isRemoved(page.data(), rid.sid)) return RC_NO_SUCH_RECORD;
+  readSlot(page.data(), rid.sid, key, value);
 
   return 0;
 }
 
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC        rc;
+  PageGuard page;
 
   // unless we are writing to the the first slot of an empty page,
-  // we have to read the page first
+  // we have to pin the page first
   if (erid.sid > 0) {
-    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
+    if ((rc = pf.pin(erid.pid, page)) < 0) return rc;
   } else {
     // if this is the first slot of an empty page
-    // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+    // we can simply start from a page filled with zeros
+    if ((rc = pf.pinNew(erid.pid, page)) < 0) return rc;
   }
     
   // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
+  writeSlot(page.data(), erid.sid, key, value);
 
   // the first four bytes in the page stores # records in the page.
   // update this number.
-  setRecordCount(page, erid.sid + 1);
+  setRecordCount(page.data(), erid.sid + 1);
 
   // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
+  page.markDirty();
+  if ((rc = page.release()) < 0) return rc;
     
   // we need to output the rid of the record slot
   rid = erid;
 
   // advance the end record id by one to the next empty slot
-  ++erid;
+  advance(erid);
 
   return 0;
 }
 
+RC RecordFile::remove(const RecordId& rid)
+{
+  RC        rc;
+  PageGuard page;
+
+  // check whether the rid is in the valid range
+  if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
+  if (rid >= erid) return RC_INVALID_RID;
+
+  if ((rc = pf.pin(rid.pid, page)) < 0) return rc;
+  if (isRemoved(page.data(), rid.sid)) return RC_NO_SUCH_RECORD;
+  removeSlot(page.data(), rid.sid);
+
+  // write the page to the disk
+  page.markDirty();
+  return page.release();
+}
+
 const RecordId& RecordFile::endRid() const
 {
   return erid;
 }
 
+void RecordFile::advance(RecordId& rid) const
+{
+  // if the end of a page is reached, move to the next page
+  if (++rid.sid >= recordsPerPage) {
+    rid.pid++;
+    rid.sid = 0;
+  }
+}
+
+RC RecordFile::advise(PageFile::AccessPattern pattern) const
+{
+  return pf.advise(pattern);
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
@@ -276,3 +294,18 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
     strcpy(ptr + sizeof(int), value.c_str());
   }
 }
+
+static bool isRemoved(const char* page, int n)
+{
+  // the last byte of the value of a record is always 0, since a value
+  // is cut to MAX_VALUE_LENGTH - 1 characters. a removed record has 1 there.
+  char *ptr = slotPtr(const_cast<char*>(page), n);
+  return *(ptr + sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1) != 0;
+}
+
+static void removeSlot(char* page, int n)
+{
+  char *ptr = slotPtr(page, n);
+  memset(ptr + sizeof(int), 0, RecordFile::MAX_VALUE_LENGTH - 1);
+  *(ptr + sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1) = 1;
+}
@@ -26,10 +26,6 @@ typedef struct {
 // helper functions for RecordId
 // 
 
-// RecordId iterators
-RecordId& operator++ (RecordId& rid);
-RecordId  operator++ (RecordId& rid, int);
-
 // RecordId comparators
 bool operator> (const RecordId& r1, const RecordId& r2);
 bool operator< (const RecordId& r1, const RecordId& r2);
@@ -47,22 +43,20 @@ class RecordFile {
   // maximum length of the value field
   static const int MAX_VALUE_LENGTH = 100;  
 
-  // number of record slots per page
-  static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
-    // Note that we subtract sizeof(int) from PAGE_SIZE because the first
-    // four bytes in the page is used to store # records in the page.
-
   RecordFile();
-  RecordFile(const std::string& filename, char mode);
+  RecordFile(const std::string& filename, char mode, int pageSize = 0);
   
   /**
    * open a file in read or write mode.
-   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'w' mode, if the file does not exist, it is created
+   * with the given page size (see PageFile::open()).
+   * 'm' opens the file read-only through a memory mapping.
    * @param filename[IN] the name of the file to open
-   * @param mode[IN] 'r' for read, 'w' for write
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for memory-mapped read
+   * @param pageSize[IN] the page size of a new file. 0 for the default
    * @return error code. 0 if no error
    */
-  RC open(const std::string& filename, char mode);
+  RC open(const std::string& filename, char mode, int pageSize = 0);
 
   /**
    * close the file.
@@ -75,7 +69,8 @@ class RecordFile {
    * @param rid[IN] the id of the record to read
    * @param key[OUT] the record key
    * @param value[OUT] the record valu
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         was removed
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
@@ -90,15 +85,48 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * remove a record from the file.
+   * the slot of the record is only marked as removed and is not reused,
+   * so the record ids of the other records stay the same.
+   * @param rid[IN] the id of the record to remove
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         was removed already
+   */
+  RC remove(const RecordId& rid);
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
    */
   const RecordId& endRid() const;
 
+  /**
+   * move a record id to the next record slot of the file.
+   * @param rid[IN/OUT] the record id to advance
+   */
+  void advance(RecordId& rid) const;
+
+  /**
+   * @return # of record slots per page of the file
+   */
+  int getRecordsPerPage() const { return recordsPerPage; }
+
+  /**
+   * tell how the records are going to be read. see PageFile::advise().
+   * @param pattern[IN] the expected access pattern
+   * @return error code. 0 if no error
+   */
+  RC advise(PageFile::AccessPattern pattern) const;
+
  private:
   PageFile pf;     // the PageFile used to store the records
   RecordId erid;   // the last record id of the file + 1
+
+  // number of record slots per page.
+  // Note that we subtract sizeof(int) from the page size because the first
+  // four bytes in the page is used to store # records in the page.
+  int recordsPerPage;
 };
 
 #endif // RECORDFILE_H
@@ -7,15 +7,21 @@
  * @date 3/24/2008
  */
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <climits>
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <unistd.h>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include "BTreeIndex.h"
+#include "BTreeNode.h"
+#include "EntrySorter.h"
+#include "StringIndex.h"
 
 using namespace std;
 
@@ -23,6 +29,138 @@ using namespace std;
 extern FILE* sqlin;
 int sqlparse(void);
 
+char SqlEngine::readMode = 'r';
+int SqlEngine::fillFactor = BTreeIndex::DEFAULT_FILL_FACTOR;
+
+// a bound on the key, which a query may or may not have.
+// any int is a valid key, so no key value can stand for "no bound".
+struct KeyBound {
+  bool set;
+  int  value;
+
+  KeyBound() : set(false), value(0) { }
+};
+
+// -1, 0 or 1 as key is smaller than, equal to or larger than value.
+// (key - value can overflow)
+static inline int compareKey(int key, int value)
+{
+  return (key > value) - (key < value);
+}
+
+// the order of the tuples a SELECT ... ORDER BY key prints
+static bool ascendingKey(const pair<int, string>& a, const pair<int, string>& b)
+{
+  return a.first < b.first;
+}
+
+static bool descendingKey(const pair<int, string>& a, const pair<int, string>& b)
+{
+  return a.first > b.first;
+}
+
+// the file of the index on the value column of a table
+static string valueIndexName(const string& table)
+{
+  return table + ".vidx";
+}
+
+// the keys of a key IN (...) condition, sorted and without duplicates
+static void parseKeyList(const char* list, vector<int>& keys)
+{
+  keys.clear();
+  for (const char* s = list; *s; s++) {
+    keys.push_back(atoi(s));
+    if (!(s = strchr(s, ','))) break;
+  }
+  sort(keys.begin(), keys.end());
+  keys.erase(unique(keys.begin(), keys.end()), keys.end());
+}
+
+// true if key is one of the keys of a key IN (...) condition
+static bool inKeyList(int key, const char* list)
+{
+  for (const char* s = list; *s; s++) {
+    if (atoi(s) == key) return true;
+    if (!(s = strchr(s, ','))) break;
+  }
+  return false;
+}
+
+// true if the tuple meets all the conditions
+static bool matchConditions(const vector<SelCond>& cond, int key, const string& value)
+{
+  for (unsigned i = 0; i < cond.size(); i++) {
+    // the difference between the tuple value and the condition value.
+    // (IN has a list of keys instead)
+    int diff = 0;
+    if (cond[i].comp != SelCond::IN) {
+      diff = (cond[i].attr == 1) ? compareKey(key, atoi(cond[i].value))
+                                 : strcmp(value.c_str(), cond[i].value);
+    }
+    switch (cond[i].comp) {
+      case SelCond::EQ: if (diff != 0) return false; break;
+      case SelCond::NE: if (diff == 0) return false; break;
+      case SelCond::GT: if (diff <= 0) return false; break;
+      case SelCond::LT: if (diff >= 0) return false; break;
+      case SelCond::GE: if (diff < 0) return false; break;
+      case SelCond::LE: if (diff > 0) return false; break;
+      case SelCond::IN: if (!inKeyList(key, cond[i].value)) return false; break;
+    }
+  }
+  return true;
+}
+
+// add the (value, rid) pairs of a sorter to the value index of a table,
+// which is made if the table has none. an index that is not built to the
+// end is removed, so that no query reads it.
+static RC loadValueIndex(const string& table, StringSorter& values, int fillFactor)
+{
+  StringIndex index;
+  RC rc;
+
+  if ((rc = index.open(valueIndexName(table), 'w')) < 0) return rc;
+  if ((rc = values.sort()) < 0 || (rc = index.bulkLoad(values, fillFactor)) < 0) {
+    index.close();
+    unlink(valueIndexName(table).c_str());
+    return rc;
+  }
+  if ((rc = index.close()) < 0) unlink(valueIndexName(table).c_str());
+  return rc;
+}
+
+// print a tuple of the result of SELECT attr
+static void printTuple(int attr, int key, const string& value)
+{
+  switch (attr) {
+    case 1:  // SELECT key
+    case 5:  // SELECT MAX(key)
+    case 6:  // SELECT MIN(key)
+      fprintf(stdout, "%d\n", key);
+      break;
+    case 2:  // SELECT value
+      fprintf(stdout, "%s\n", value.c_str());
+      break;
+    case 3:  // SELECT *
+      fprintf(stdout, "%d '%s'\n", key, value.c_str());
+      break;
+  }
+}
+
+RC SqlEngine::setReadMode(char mode)
+{
+  if (mode != 'r' && mode != 'm') return RC_INVALID_FILE_MODE;
+  readMode = mode;
+  return 0;
+}
+
+RC SqlEngine::setFillFactor(int percent)
+{
+  if (percent < 1 || percent > 100) return RC_INVALID_ATTRIBUTE;
+  fillFactor = percent;
+  return 0;
+}
+
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -36,26 +174,40 @@ RC SqlEngine::run(FILE* commandline)
   return 0;
 }
 
-RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
+RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond,
+                     int order, int limit)
 {
   RecordFile rf;   // RecordFile containing the table
   RecordId   rid;  // record cursor for table scanning
 
   RC     rc = 0;
+  RC     indexRc;
   int    key;     
   string value;
   int    count = 0;
-  int    diff;
   BTreeIndex myTree;
+  StringIndex valueIndex;
+  bool valueIndexOpened = false;
   int dummy = 0; 
+  vector<pair<int, string> > rows;  // the tuples to print in key order
+
+  // COUNT(*) is a single tuple, whatever the LIMIT.
+  // MAX(key) and MIN(key) are the first key in descending or ascending order.
+  if (attr == 4) limit = -1;
+  if (limit == 0) return 0;
+  if (attr == 5 || attr == 6) {
+    order = (attr == 5) ? -1 : 1;
+    limit = 1;
+  }
 
- 
-
-  bool conditionForIndex = false, valueCondition = false; 
-  int myMin = -1, myMax = -1, targetValue = -1; 
+  bool conditionForIndex = false, valueCondition = false, indexOpened; 
+  KeyBound myMin, myMax, targetValue; 
   vector<int> myV;    // store the key <> .....
+  vector<int> inKeys, myKeys;  // the keys of key IN (...)
+  bool inSet = false;
   vector<string> myV2;  // store the value <> .....
   string targetValue2 = "", myValMin = "", myValMax = ""; 
+  bool valMinSet = false, valMaxSet = false;  // the range of values
 
   // analyze the conditions 
   for (int i = 0; i < cond.size(); ++i) {
@@ -64,30 +216,53 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
           if (cond[i].comp == SelCond::NE) {
               myV.push_back(compareValue); 
           }
+          else if (cond[i].comp == SelCond::IN) {
+              // the keys in all the lists
+              conditionForIndex = true; 
+              parseKeyList(cond[i].value, myKeys);
+              if (inSet) {
+                  vector<int> both;
+                  set_intersection(inKeys.begin(), inKeys.end(), myKeys.begin(), myKeys.end(),
+                                   back_inserter(both));
+                  inKeys.swap(both);
+              }
+              else inKeys.swap(myKeys);
+              inSet = true;
+          }
           else {
               conditionForIndex = true; 
               switch (cond[i].comp) {
                   case SelCond::EQ:
-                      if (targetValue == -1)
-                          targetValue = compareValue;
-                      else if (targetValue != compareValue)
+                      if (!targetValue.set) {
+                          targetValue.set = true; 
+                          targetValue.value = compareValue;
+                      }
+                      else if (targetValue.value != compareValue)
                           goto exit_select_2; 
                       break;
-                  case SelCond::GE:
-                      if (myMin == -1 || compareValue > myMin)
-                        myMin = compareValue;
-                      break;
                   case SelCond::GT:
-                      if (myMin == -1 || compareValue >= myMin)
-                        myMin = compareValue + 1;
+                      // no key is > INT_MAX
+                      if (compareValue == INT_MAX) goto exit_select_2;
+                      ++compareValue;
+                      // fall through: key > v is key >= v + 1
+                  case SelCond::GE:
+                      if (!myMin.set || compareValue > myMin.value) {
+                        myMin.set = true;
+                        myMin.value = compareValue;
+                      }
                       break;
+                  case SelCond::LT:
+                      // no key is < INT_MIN
+                      if (compareValue == INT_MIN) goto exit_select_2;
+                      --compareValue;
+                      // fall through: key < v is key <= v - 1
                   case SelCond::LE:
-                      if (myMax == -1 || compareValue < myMax)
-                        myMax = compareValue;
+                      if (!myMax.set || compareValue < myMax.value) {
+                        myMax.set = true;
+                        myMax.value = compareValue;
+                      }
                       break;
-                  case SelCond::LT:
-                      if (myMax == -1 || compareValue <= myMax)
-                        myMax = compareValue - 1;
+                  default:  // NE and IN are taken above
                       break;
               }
 
@@ -109,6 +284,22 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
               default:
                   break;
           }
+
+          // the range of values to read from the value index.
+          // = is both the smallest and the largest value
+          if (cond[i].comp != SelCond::NE) {
+              string bound = cond[i].value;
+              if (cond[i].comp != SelCond::LT && cond[i].comp != SelCond::LE
+                  && (!valMinSet || bound > myValMin)) {
+                  valMinSet = true;
+                  myValMin = bound;
+              }
+              if (cond[i].comp != SelCond::GT && cond[i].comp != SelCond::GE
+                  && (!valMaxSet || bound < myValMax)) {
+                  valMaxSet = true;
+                  myValMax = bound;
+              }
+          }
       }
   }
 
@@ -116,101 +307,149 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
   // early failure for case like: key = 9 AND key <> 9 
   // early failure for case like: key = 9 AND key > 20
   // early failure for case like: key = 9 AND key < 4 
-  if (targetValue != -1) {
+  if (targetValue.set) {
     if (myV.size())
       for (int i = 0; i < myV.size(); ++i)
-        if (myV[i] == targetValue)
+        if (myV[i] == targetValue.value)
           goto exit_select_2;
 
-    if (myMin != -1 && targetValue < myMin) goto exit_select_2;
-    if (myMax != -1 && targetValue > myMax) goto exit_select_2; 
+    if (myMin.set && targetValue.value < myMin.value) goto exit_select_2;
+    if (myMax.set && targetValue.value > myMax.value) goto exit_select_2; 
   }
   
   // early failure for Min-Max conflict
-  if (myMin != -1 && myMax != -1)
-    if (myMin > myMax)
+  if (myMin.set && myMax.set)
+    if (myMin.value > myMax.value)
       goto exit_select_2;  
 
 
+  // early failure for case like: value > 'b' AND value < 'a'
+  if (valMinSet && valMaxSet && myValMin > myValMax)
+    goto exit_select_2;
+
   // early failure for case like: value = 'hehe' AND value <> 'hehe'
   if (targetValue2 != "" && myV2.size())
     for (int i = 0; i < myV2.size(); ++i)
       if (myV2[i] == targetValue2)
         goto exit_select_2;
 
+  // the keys of IN that meet the other conditions on key. the index
+  // reads only them
+  if (inSet) {
+    myKeys.clear();
+    for (unsigned i = 0; i < inKeys.size(); ++i) {
+      int k = inKeys[i];
+      if ((targetValue.set && k != targetValue.value) || (myMin.set && k < myMin.value)
+          || (myMax.set && k > myMax.value) || find(myV.begin(), myV.end(), k) != myV.end())
+        continue;
+      myKeys.push_back(k);
+    }
+    inKeys.swap(myKeys);
+    if (inKeys.empty()) goto exit_select_2;
+  }
+
   // Now we have checked for all silly cases, lets get to business...
 
    // open the table file
-  if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+  if ((rc = rf.open(table + ".tbl", readMode)) < 0) {
     fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
     return rc;
   }
 
-  if (myTree.open(table + ".idx", 'r') || (!conditionForIndex && attr != 4)) {   // do the usual way 
-      // scan the table file from the beginning
+  indexRc = myTree.open(table + ".idx", readMode);
+  indexOpened = (indexRc == 0);
+  if (indexRc == RC_INVALID_FILE_FORMAT) {
+    fprintf(stderr, "Warning: index %s.idx has an old format and is not used. "
+            "Convert it with bruinbase -u %s.idx\n", table.c_str(), table.c_str());
+  }
+  // a range of values is read from the value index, if the table has it,
+  // unless there is a range of keys to read from the key index. a single
+  // value is read rather than a range of keys.
+  if ((valMinSet || valMaxSet)
+      && (!indexOpened || !conditionForIndex
+          || (valMinSet && valMaxSet && myValMin == myValMax && !targetValue.set))) {
+    valueIndexOpened = (valueIndex.open(valueIndexName(table), readMode) == 0);
+  }
+
+  if (valueIndexOpened) {   // read the range of values
+      if (indexOpened) myTree.close();
+
+      StringCursor cursor;
+      valueIndex.advise(PageFile::RANDOM);
+      rf.advise(PageFile::RANDOM);
+      valueIndex.locate(myValMin, cursor);
+
+      // the index has the values, but the keys are only in the table.
+      // they are read to print or sort them, or to check a key condition
+      bool keyNeeded = (attr != 2 && attr != 4) || order || conditionForIndex || !myV.empty();
+
+      vector<string> values(INDEX_BATCH);
+      RecordId rids[INDEX_BATCH];
+      int found;
+      while (!valueIndex.readBatch(cursor, &values[0], rids, INDEX_BATCH, found)) {
+        for (int j = 0; j < found; j++) {
+          // the range ends at the first value behind it
+          if (valMaxSet && values[j] > myValMax) goto exit_value_index;
+
+          rid = rids[j];
+          value = values[j];
+          if (keyNeeded && (rc = rf.read(rid, key, value)) < 0) {
+            fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+            valueIndex.close();
+            goto exit_select;
+          }
+          if (!matchConditions(cond, key, value)) continue;
+
+          // print the tuple, or keep it until all tuples are sorted by key
+          count++;
+          if (order && attr != 4) {
+            rows.push_back(make_pair(key, (attr == 2 || attr == 3) ? value : string()));
+          }
+          else {
+            printTuple(attr, key, value);
+            if (count == limit) goto exit_value_index;
+          }
+        }
+      }
+
+      exit_value_index:
+      valueIndex.close();
+  }
+  // (the index also gives the tuples in key order)
+  else if (!indexOpened || (!conditionForIndex && attr != 4 && !order)) {   // do the usual way 
+      if (indexOpened) myTree.close();
+
+      // scan the table file from the beginning.
+      // the pages ahead of the scan are read in the background.
+      rf.advise(PageFile::SEQUENTIAL);
       rid.pid = rid.sid = 0;
       while (rid < rf.endRid()) {
-        // read the tuple
-        if ((rc = rf.read(rid, key, value)) < 0) {
+        // read the tuple. (a deleted one is passed over)
+        if ((rc = rf.read(rid, key, value)) == RC_NO_SUCH_RECORD) goto next_tuple;
+        if (rc < 0) {
           fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
           goto exit_select;
         }
 
-        // check the conditions on the tuple
-        for (unsigned i = 0; i < cond.size(); i++) {
-          // compute the difference between the tuple value and the condition value
-          switch (cond[i].attr) {
-              case 1:
-	               diff = key - atoi(cond[i].value);
-	               break;
-              case 2:
-	               diff = strcmp(value.c_str(), cond[i].value);
-	               break;
-          }
-
-          // skip the tuple if any condition is not met
-          switch (cond[i].comp) {
-              case SelCond::EQ:
-	               if (diff != 0) goto next_tuple;
-	               break;
-              case SelCond::NE:
-	               if (diff == 0) goto next_tuple;
-	               break;
-              case SelCond::GT:
-	               if (diff <= 0) goto next_tuple;
-	               break;
-              case SelCond::LT:
-	               if (diff >= 0) goto next_tuple;
-	               break;
-              case SelCond::GE:
-	               if (diff < 0) goto next_tuple;
-	               break;
-              case SelCond::LE:
-	               if (diff > 0) goto next_tuple;
-	               break;
-          }
-        }
+        // skip the tuple if any condition is not met
+        if (!matchConditions(cond, key, value)) goto next_tuple;
 
         // the condition is met for the tuple. 
         // increase matching tuple counter
         count++;
 
-        // print the tuple 
-        switch (attr) {
-            case 1:  // SELECT key
-              fprintf(stdout, "%d\n", key);
-              break;
-            case 2:  // SELECT value
-              fprintf(stdout, "%s\n", value.c_str());
-              break;
-            case 3:  // SELECT *
-              fprintf(stdout, "%d '%s'\n", key, value.c_str());
-              break;
+        // print the tuple, or keep it until all tuples are sorted by key
+        if (order && attr != 4) {
+          rows.push_back(make_pair(key, (attr == 2 || attr == 3) ? value : string()));
+        }
+        else {
+          printTuple(attr, key, value);
+          if (count == limit) break;
         }
 
         // move to the next tuple
         next_tuple:
-        ++rid;
+        rf.advance(rid);
       }
   }
   else {    // do the B+ tree style 
@@ -218,91 +457,108 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
       IndexCursor cursor; 
       rid.pid = rid.sid = 0;
 
-      // now set the starting point 
-      if (targetValue != -1)
-        myTree.locate(targetValue, cursor);
-      else if (myMin != -1)
-        myTree.locate(myMin, cursor);
-      else myTree.locate(0, cursor);     // or start from the beginning
-
-      while (!myTree.readForward(cursor, key, rid)) {
+      // index probes and the table reads they lead to jump around
+      myTree.advise(PageFile::RANDOM);
+      rf.advise(PageFile::RANDOM);
+
+      // the range of keys to read
+      int fromKey = targetValue.set ? targetValue.value : (myMin.set ? myMin.value : INT_MIN);
+      int toKey = targetValue.set ? targetValue.value : (myMax.set ? myMax.value : INT_MAX);
+      bool backward = (order < 0 && attr != 4 && !inSet);
+
+      // now set the starting point: the first key of the range, or the
+      // last one to read the range backward. the keys of IN are all
+      // located at once, and then read one by one as ranges of a single
+      // key (the last one first for ORDER BY key DESC)
+      vector<IndexCursor> inCursors(inKeys.size());
+      vector<RC> inResults(inKeys.size());
+      unsigned probe = 0;
+      if (inSet)
+        myTree.locateBatch(&inKeys[0], inKeys.size(), &inCursors[0], &inResults[0]);
+      else if (backward)
+        myTree.locateBackward(toKey, cursor);
+      else myTree.locate(fromKey, cursor);
+
+      // for a range, start reading the leaves the range starts with
+      if (!targetValue.set && !backward && !inSet) {
+        myTree.prefetchLeaves(fromKey, toKey, LEAF_BATCH_PAGES);
+      }
 
-          // check each tuple 
-          if (targetValue != -1 && key != targetValue) break;
-          if (myMax != -1 && key > myMax) break;
+      // read the entries of the range a leaf at a time. a covering index
+      // gives the values along with them
+      int keys[INDEX_BATCH];
+      RecordId rids[INDEX_BATCH];
+      int coverSize = myTree.getCoverSize();
+      vector<char> covers(INDEX_BATCH * coverSize);
+      char* coverBuffer = coverSize ? &covers[0] : NULL;
+      int found;
+
+      next_probe:
+      if (inSet) {
+        while (probe < inKeys.size() && inResults[(order < 0) ? inKeys.size() - 1 - probe : probe])
+          probe++;
+        if (probe == inKeys.size()) goto exit_index;
+        unsigned k = (order < 0) ? inKeys.size() - 1 - probe : probe;
+        probe++;
+        cursor = inCursors[k];
+        fromKey = toKey = inKeys[k];
+      }
+      while (!(backward ? myTree.readBatchBackward(cursor, fromKey, keys, rids, INDEX_BATCH, found, coverBuffer)
+                        : myTree.readBatch(cursor, toKey, keys, rids, INDEX_BATCH, found, coverBuffer))) {
+
+        // if query is count(*) without condition for value 
+        // (or a key <> condition, which the index does not check)
+        if (attr == 4 && !valueCondition && myV.empty()) {
+          count += found;
+          continue;
+        }
 
-          // if query is count(*) without condition for value 
-          if (attr == 4 && !valueCondition) {
-              ++count;
-              continue;
-          }
+        for (int j = 0; j < found; j++) {
+          key = keys[j];
+          rid = rids[j];
 
-          // read the value only when we have to
+          // read the value only when we have to, and from the table only
+          // when the index does not have all of it
           if (valueCondition || attr == 2 || attr == 3)
-            if ((rc = rf.read(rid, key, value)) < 0) {
-              fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-              goto exit_select;
-            }
-
-          for (unsigned i = 0; i < cond.size(); i++) {
-              // compute the difference between the tuple value and the condition value
-              switch (cond[i].attr) {
-                  case 1:
-                    diff = key - atoi(cond[i].value);
-                    break;
-                  case 2:
-                    diff = strcmp(value.c_str(), cond[i].value);
-                    break;
+            if (!coverBuffer || !myTree.readCover(coverBuffer + j * coverSize, value))
+              if ((rc = rf.read(rid, key, value)) < 0) {
+                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+                goto exit_select;
               }
 
-              // skip the tuple if any condition is not met
-              switch (cond[i].comp) {
-                  case SelCond::EQ:
-                    if (diff != 0) goto my_exit;
-                    break;
-                  case SelCond::NE:
-                    if (diff == 0) goto my_exit;
-                    break;
-                  case SelCond::GT:
-                    if (diff <= 0) goto my_exit;
-                    break;
-                  case SelCond::LT:
-                    if (diff >= 0) goto my_exit;
-                    break;
-                  case SelCond::GE:
-                    if (diff < 0) goto my_exit;
-                    break;
-                  case SelCond::LE:
-                    if (diff > 0) goto my_exit;
-                    break;
-              }
-          }
+          if (!matchConditions(cond, key, value)) goto my_exit;
 
           ++count;
-          switch (attr) {
-            case 1:  // SELECT key
-              fprintf(stdout, "%d\n", key);
-              break;
-            case 2:  // SELECT value
-              fprintf(stdout, "%s\n", value.c_str());
-              break;
-            case 3:  // SELECT *
-              fprintf(stdout, "%d '%s'\n", key, value.c_str());
-              break;
-          }
+          printTuple(attr, key, value);
+          if (count == limit) goto exit_index;
 
 
           my_exit:
           ++dummy;
+        }
       }
+      if (inSet) goto next_probe;
+
+      exit_index:
       myTree.close();
       
   }
 
+  // the tuples kept for ORDER BY
+  if (!rows.empty()) {
+    stable_sort(rows.begin(), rows.end(), (order > 0) ? ascendingKey : descendingKey);
+    for (unsigned i = 0; i < rows.size() && (limit < 0 || (int)i < limit); i++) {
+      printTuple(attr, rows[i].first, rows[i].second);
+    }
+  }
+
   exit_select_2:
   // print matching tuple count if "select count(*)"
   if (attr == 4) 
     fprintf(stdout, "%d\n", count);
+  // MAX(key) and MIN(key) of no tuple
+  if ((attr == 5 || attr == 6) && !count)
+    fprintf(stdout, "NULL\n");
   
   rc = 0;
 
@@ -312,7 +568,8 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
   return rc;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+RC SqlEngine::load(const string& table, const string& loadfile, bool index, bool covering,
+                   bool valueIndex, bool packed)
 {
     RecordFile rf; 
     RecordId rid; 
@@ -328,28 +585,58 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
     rc = rf.open(table + ".tbl", 'w'); 
 
     string line; 
+    BTreeIndex myTree;
     if (index) {
-        // do sth here
-        BTreeIndex myTree;
-        myTree.open(table + ".idx", 'w');
-
-        while (getline(theData, line)) {
-            parseLoadLine(line, key, value);
-            if (rc = rf.append(key, value, rid))
-              return rc; 
-
-            if (rc = myTree.insert(key, rid))
-              return rc; 
+        if ((rc = myTree.open(table + ".idx", 'w', 0, covering ? BTreeIndex::DEFAULT_COVER_SIZE : 0, packed)) < 0) {
+          // e.g., an index in an old node format, which has to be rebuilt
+          fprintf(stderr, "Error: cannot open the index of table %s\n", table.c_str());
+          rf.close();
+          return rc;
+        }
+    }
 
+    // the (key, rid) pairs are sorted first, so that a new index is
+    // built bottom-up instead of by one insert per tuple. a covering
+    // index (a new one made WITH COVERING INDEX, or an existing one)
+    // takes the cover of the value with every pair. so are the (value,
+    // rid) pairs of the value index, which spill to the disk by the bytes
+    // of their values.
+    int coverSize = myTree.getCoverSize();
+    vector<char> cover(coverSize);
+    EntrySorter entries(table + ".idx", EntrySorter::DEFAULT_MEMORY_ENTRIES, coverSize);
+    StringSorter values(valueIndexName(table), BTStringNode::MAX_KEY_LENGTH);
+    while (getline(theData, line)) {
+        parseLoadLine(line, key, value);
+        if ((rc = rf.append(key, value, rid)) < 0)
+          break; 
+
+        if (index) {
+          if (coverSize) myTree.makeCover(value, &cover[0]);
+          if ((rc = entries.add(key, rid, coverSize ? &cover[0] : NULL)) < 0)
+            break; 
         }
+        if (valueIndex && (rc = values.add(value, rid)) < 0)
+          break; 
+    }
+
+    // an index opened for the load misses the tuples from here on, or is
+    // not built to the end. it is removed, so that no query reads it.
+    if (index && (rc < 0 || (rc = entries.sort()) < 0 || (rc = myTree.bulkLoad(entries, fillFactor)) < 0
+                  || (rc = myTree.close()) < 0)) {
+        fprintf(stderr, "Error: cannot build the index of table %s\n", table.c_str());
         myTree.close();
+        unlink((table + ".idx").c_str());
+        rf.close();
+        return rc;
     }
-    else {
-        while (getline(theData, line)) {
-            parseLoadLine(line, key, value); 
-            if (rc = rf.append(key, value, rid))
-                return rc;  
-        }
+    if (rc < 0) {
+        rf.close();
+        return rc;
+    }
+    if (valueIndex && (rc = loadValueIndex(table, values, fillFactor)) < 0) {
+        fprintf(stderr, "Error: cannot build the value index of table %s\n", table.c_str());
+        rf.close();
+        return rc;
     }
 
     theData.close(); 
@@ -357,6 +644,130 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
     return rc;
 }
 
+RC SqlEngine::createIndex(const string& table, int attr)
+{
+  RecordFile rf;
+  RecordId   rid;
+  RC         rc;
+  int        key;
+  string     value;
+
+  // the pairs of an existing index would be added again
+  string indexname = (attr == 1) ? table + ".idx" : valueIndexName(table);
+  if (ifstream(indexname.c_str()).is_open()) {
+    fprintf(stderr, "Error: table %s already has an index on %s\n", table.c_str(),
+            (attr == 1) ? "key" : "value");
+    return RC_INVALID_ATTRIBUTE;
+  }
+
+  if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return rc;
+  }
+
+  // collect the pairs of the index from the table, and build the index
+  // as LOAD ... WITH INDEX does
+  EntrySorter entries(indexname);
+  StringSorter values(indexname, BTStringNode::MAX_KEY_LENGTH);
+  rf.advise(PageFile::SEQUENTIAL);
+  rid.pid = rid.sid = 0;
+  while (rid < rf.endRid()) {
+    if ((rc = rf.read(rid, key, value)) == RC_NO_SUCH_RECORD) {
+      rf.advance(rid);
+      continue;
+    }
+    if (rc < 0) {
+      fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+      rf.close();
+      return rc;
+    }
+    if (attr == 1) rc = entries.add(key, rid);
+    else rc = values.add(value, rid);
+    if (rc < 0) {
+      rf.close();
+      return rc;
+    }
+    rf.advance(rid);
+  }
+  rf.close();
+
+  // (the table had no such index, so a new one that fails is removed)
+  if (attr == 1) {
+    BTreeIndex myTree;
+    if ((rc = myTree.open(indexname, 'w')) < 0 || (rc = entries.sort()) < 0
+        || (rc = myTree.bulkLoad(entries, fillFactor)) < 0 || (rc = myTree.close()) < 0) {
+      fprintf(stderr, "Error: cannot build the index of table %s\n", table.c_str());
+      myTree.close();
+      unlink(indexname.c_str());
+      return rc;
+    }
+    return 0;
+  }
+
+  if ((rc = loadValueIndex(table, values, fillFactor)) < 0) {
+    fprintf(stderr, "Error: cannot build the value index of table %s\n", table.c_str());
+  }
+  return rc;
+}
+
+RC SqlEngine::remove(const string& table, const vector<SelCond>& cond)
+{
+  RecordFile rf;
+  RecordId   rid;
+  RC         rc;
+  int        key;
+  string     value;
+  BTreeIndex myTree;
+  StringIndex valueIndex;
+
+  // (opening the table in 'w' mode would make it)
+  if (!ifstream((table + ".tbl").c_str()).is_open()
+      || (rc = rf.open(table + ".tbl", 'w')) < 0) {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    return RC_FILE_OPEN_FAILED;
+  }
+
+  // the tuples go from the indexes of the table as well. an index that
+  // cannot be opened (e.g., in an old node format) is not left behind
+  bool indexOpened = ifstream((table + ".idx").c_str()).is_open();
+  bool valueIndexOpened = ifstream(valueIndexName(table).c_str()).is_open();
+  if (indexOpened && (rc = myTree.open(table + ".idx", 'w')) < 0) {
+    fprintf(stderr, "Error: cannot open the index of table %s\n", table.c_str());
+    rf.close();
+    return rc;
+  }
+  if (valueIndexOpened && (rc = valueIndex.open(valueIndexName(table), 'w')) < 0) {
+    fprintf(stderr, "Error: cannot open the value index of table %s\n", table.c_str());
+    if (indexOpened) myTree.close();
+    rf.close();
+    return rc;
+  }
+
+  // scan the table, and delete the tuples that meet the conditions
+  rf.advise(PageFile::SEQUENTIAL);
+  rid.pid = rid.sid = 0;
+  while (rid < rf.endRid()) {
+    if ((rc = rf.read(rid, key, value)) == RC_NO_SUCH_RECORD) rc = 0;
+    else if (rc == 0 && matchConditions(cond, key, value)
+             && (rc = rf.remove(rid)) == 0) {
+      // (tuples LOADed without WITH INDEX are not in the index)
+      if (indexOpened && (rc = myTree.remove(key, rid)) == RC_NO_SUCH_RECORD) rc = 0;
+      if (rc == 0 && valueIndexOpened
+          && (rc = valueIndex.remove(value, rid)) == RC_NO_SUCH_RECORD) rc = 0;
+    }
+    if (rc < 0) {
+      fprintf(stderr, "Error: while deleting a tuple from table %s\n", table.c_str());
+      break;
+    }
+    rf.advance(rid);
+  }
+
+  if (indexOpened) myTree.close();
+  if (valueIndexOpened) valueIndex.close();
+  rf.close();
+  return rc;
+}
+
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
 {
     const char *s;
@@ -19,8 +19,8 @@
  */
 struct SelCond {
   int attr;     // attribute: 1 - key column,  2 - value column
-  enum Comparator { EQ, NE, LT, GT, LE, GE } comp;
-  char* value;  // the value to compare
+  enum Comparator { EQ, NE, LT, GT, LE, GE, IN } comp;
+  char* value;  // the value to compare. the keys separated by commas for IN
 };
 
 /**
@@ -41,23 +41,58 @@ class SqlEngine {
   /**
    * executes a SELECT statement.
    * all conditions in conds must be ANDed together.
+   * the keys of a key IN (...) condition are looked up in the index
+   * together (see BTreeIndex::locateBatch()).
    * the result of the SELECT is printed on screen.
    * @param attr[IN] attribute in the SELECT clause
-   * (1: key, 2: value, 3: *, 4: count(*))
+   * (1: key, 2: value, 3: *, 4: count(*), 5: max(key), 6: min(key))
    * @param table[IN] the table name in the FROM clause
    * @param conds[IN] list of conditions in the WHERE clause
+   * @param order[IN] the ORDER BY key clause
+   * (0: none, 1: ascending, -1: descending)
+   * @param limit[IN] the max # of tuples to print. -1 for no LIMIT
    * @return error code. 0 if no error
    */
-  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
+  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds,
+                   int order = 0, int limit = -1);
 
   /**
    * load a table from a load file.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
    * @param index[IN] true if "WITH INDEX" option was specified
+   * @param covering[IN] true if "WITH COVERING INDEX" was specified, for
+   *                     a new index that keeps the values in its leaves
+   * @param valueIndex[IN] true if "WITH INDEX(value)" was specified, for
+   *                       the index on the value column
+   * @param packed[IN] true if "WITH PACKED INDEX" was specified, for a new
+   *                   index with packed leaves
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC load(const std::string& table, const std::string& loadfile, bool index,
+                 bool covering = false, bool valueIndex = false, bool packed = false);
+
+  /**
+   * build an index of an existing table, for CREATE INDEX.
+   * SELECT reads a range of values (given by =, <, <=, > and >=
+   * conditions on value) from the index on value when there is no
+   * range of keys to read.
+   * @param table[IN] the table name
+   * @param attr[IN] the attribute to index (1: key, 2: value)
+   * @return error code. 0 if no error. RC_INVALID_ATTRIBUTE if the
+   *         table has the index already
+   */
+  static RC createIndex(const std::string& table, int attr);
+
+  /**
+   * executes a DELETE statement.
+   * the tuples of the table that meet all the conditions in conds are
+   * deleted, and removed from the indexes of the table.
+   * @param table[IN] the table name in the FROM clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @return error code. 0 if no error
+   */
+  static RC remove(const std::string& table, const std::vector<SelCond>& conds);
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -67,6 +102,29 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+  /**
+   * set the mode SELECT opens the table and index files in.
+   * @param mode[IN] 'r' to read through the buffer pool,
+   *                 'm' to read through memory mappings
+   * @return error code. 0 if no error
+   */
+  static RC setReadMode(char mode);
+
+  /**
+   * set how full LOAD ... WITH INDEX packs the nodes of a new index.
+   * @param percent[IN] the fill factor in percent (1-100)
+   * @return error code. 0 if no error
+   */
+  static RC setFillFactor(int percent);
+
+ private:
+  static const int LEAF_BATCH_PAGES = 32;  // # of leaves an index range
+                                           // scan reads ahead
+  static const int INDEX_BATCH = 512;      // # of index entries read at once
+
+  static char readMode;  // the mode SELECT opens files in
+  static int fillFactor; // % of a node filled by LOAD ... WITH INDEX
 };
 
 #endif /* SQLENGINE_H */
@@ -1,5 +1,6 @@
 %{
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <sys/times.h>
 #include <unistd.h>
@@ -8,24 +9,80 @@
 #include "Bruinbase.h"
 #include "SqlEngine.h" 
 #include "PageFile.h"
+#include "IOStats.h"
 
 int  sqllex(void);  
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
 extern "C" { int  sqlwrap() { return 1; } }
 
-static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
+static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds,
+                      int order, int limit)
 {
   struct tms tmsbuf;
   clock_t btime, etime;
   int     bpagecnt, epagecnt;
+  std::vector<FileStats> bstats;
 
+  if (IOStats::isReportEnabled()) IOStats::getSnapshot(bstats);
   btime = times(&tmsbuf);
   bpagecnt = PageFile::getPageReadCount();
-  SqlEngine::select(attr, table, conds);
+  SqlEngine::select(attr, table, conds, order, limit);
   etime = times(&tmsbuf);
   epagecnt = PageFile::getPageReadCount();
 
   fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  if (IOStats::isReportEnabled()) IOStats::report(stderr, bstats);
+}
+
+static void runLoad(const char* table, const char* loadfile, bool index, bool covering,
+                    bool valueIndex, bool packed = false)
+{
+  std::vector<FileStats> bstats;
+
+  if (IOStats::isReportEnabled()) IOStats::getSnapshot(bstats);
+  SqlEngine::load(std::string(table), std::string(loadfile), index, covering, valueIndex, packed);
+  if (IOStats::isReportEnabled()) IOStats::report(stderr, bstats);
+}
+
+static void runDelete(const char* table, const std::vector<SelCond>& conds)
+{
+  std::vector<FileStats> bstats;
+
+  if (IOStats::isReportEnabled()) IOStats::getSnapshot(bstats);
+  SqlEngine::remove(std::string(table), conds);
+  if (IOStats::isReportEnabled()) IOStats::report(stderr, bstats);
+}
+
+static void runCreateIndex(const char* table, int attr)
+{
+  std::vector<FileStats> bstats;
+
+  if (IOStats::isReportEnabled()) IOStats::getSnapshot(bstats);
+  SqlEngine::createIndex(std::string(table), attr);
+  if (IOStats::isReportEnabled()) IOStats::report(stderr, bstats);
+}
+
+// the attributes of INDEX(key, value): 1 for key and 2 for value, ORed.
+// a plain INDEX is on key. 0 if an attribute is wrong
+static int indexAttributes(const char* attrs)
+{
+  if (attrs == NULL) return 1;
+
+  int result = 0;
+  std::string list(attrs);
+  std::string::size_type from = 0;
+  do {
+    std::string::size_type to = list.find(',', from);
+    std::string attr = list.substr(from, (to == std::string::npos) ? to : to - from);
+    if (attr == "key") result |= 1;
+    else if (attr == "value") result |= 2;
+    else {
+      sqlerror("wrong attribute name. neither key or value");
+      return 0;
+    }
+    from = (to == std::string::npos) ? to : to + 1;
+  } while (from != std::string::npos);
+  return result;
 }
 
 %}
@@ -37,13 +94,14 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
   std::vector<SelCond>* conds;
 }
 
-%token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
+%token SELECT FROM WHERE LOAD WITH QUIT COUNT AND OR 
+%token ORDER BY ASC DESC LIMIT COVERING CREATE ON PACKED DELETE
 %token COMMA STAR LF
-%token <string> INTEGER STRING ID
+%token <string> INTEGER STRING ID MAX MIN INDEX IN
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
-%type <string> table value
+%type <integer> attributes attribute comparator order direction limit
+%type <string> table keyword value
 %type <cond> condition
 %type <conds> conditions
 %%
@@ -55,7 +113,9 @@ commands:
 
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
+	| create_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
+	| delete_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
 	| LF { fprintf(stdout, "Bruinbase> "); }
@@ -67,25 +127,53 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  runLoad($2, $4, false, false, false);
 	  free($2);
 	  free($4);
 	}
 	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	  int attrs = indexAttributes($6);
+	  if (attrs) runLoad($2, $4, attrs & 1, false, attrs & 2);
+	  free($2);
+	  free($4);
+	  free($6);
+	}
+	| LOAD table FROM STRING WITH COVERING INDEX LF { 
+	  int attrs = indexAttributes($7);
+	  if (attrs & 2) sqlerror("only an index on key can be covering");
+	  else if (attrs) runLoad($2, $4, true, true, false);
+	  free($2);
+	  free($4);
+	  free($7);
+	}
+	| LOAD table FROM STRING WITH PACKED INDEX LF { 
+	  int attrs = indexAttributes($7);
+	  if (attrs & 2) sqlerror("only an index on key can be packed");
+	  else if (attrs) runLoad($2, $4, true, false, false, true);
+	  free($2);
+	  free($4);
+	  free($7);
+	}
+	;
+
+create_command:
+	CREATE INDEX ON table LF {
+	  int attrs = indexAttributes($2);
+	  if (attrs & 1) runCreateIndex($4, 1);
+	  if (attrs & 2) runCreateIndex($4, 2);
 	  free($2);
 	  free($4);
 	}
 	;
 
 select_command:
-	SELECT attributes FROM table LF {
+	SELECT attributes FROM table order limit LF {
    	        std::vector<SelCond> conds;
-		runSelect($2, $4, conds);
+		runSelect($2, $4, conds, $5, $6);
 		free($4);
 	}
-	| SELECT attributes FROM table WHERE conditions LF {
-	        runSelect($2, $4, *$6);
+	| SELECT attributes FROM table WHERE conditions order limit LF {
+	        runSelect($2, $4, *$6, $7, $8);
 	  	free($4);
 	  	for (unsigned i = 0; i < $6->size(); i++) {
 		    free((*$6)[i].value);
@@ -94,6 +182,22 @@ select_command:
 	}
 	;
 
+delete_command:
+	DELETE FROM table LF {
+	        std::vector<SelCond> conds;
+		runDelete($3, conds);
+		free($3);
+	}
+	| DELETE FROM table WHERE conditions LF {
+	        runDelete($3, *$5);
+	  	free($3);
+	  	for (unsigned i = 0; i < $5->size(); i++) {
+		    free((*$5)[i].value);
+		}
+	  	delete $5;
+	}
+	;
+
 conditions:
 	condition {
 	  std::vector<SelCond>* v = new std::vector<SelCond>;
@@ -116,12 +220,59 @@ condition:
 	  c->value = $3;
 	  $$ = c;
         }
+	| attribute IN {
+	  if ($1 != 1 || $2 == NULL) {
+	    sqlerror($2 ? "IN only takes key" : "IN takes a list of keys in parentheses");
+	    free($2);
+	    YYERROR;
+	  }
+	  SelCond* c = new SelCond;
+	  c->attr = $1;
+	  c->comp = SelCond::IN;
+	  c->value = $2;
+	  $$ = c;
+	}
 	;
 
 attributes:
 	attribute { $$ = $1; }
 	| STAR  { $$ = 3; }
 	| COUNT { $$ = 4; }
+	| MAX   {
+		bool isKey = $1 && strcmp($1, "key") == 0;
+		free($1);
+		if (!isKey) { sqlerror("MAX only takes key"); YYERROR; }
+		$$ = 5;
+	}
+	| MIN   {
+		bool isKey = $1 && strcmp($1, "key") == 0;
+		free($1);
+		if (!isKey) { sqlerror("MIN only takes key"); YYERROR; }
+		$$ = 6;
+	}
+	;
+
+order:
+	/* empty */ { $$ = 0; }
+	| ORDER BY attribute direction {
+		if ($3 != 1) { sqlerror("only ORDER BY key is supported"); YYERROR; }
+		$$ = $4;
+	}
+	;
+
+direction:
+	/* empty */ { $$ = 1; }
+	| ASC       { $$ = 1; }
+	| DESC      { $$ = -1; }
+	;
+
+limit:
+	/* empty */ { $$ = -1; }
+	| LIMIT INTEGER {
+		$$ = atoi($2);
+		free($2);
+		if ($$ < 0) { sqlerror("LIMIT must not be negative"); YYERROR; }
+	}
 	;
 
 attribute:
@@ -139,6 +290,29 @@ value:
 
 table:
 	ID { $$ = $1; }
+	| keyword { $$ = $1; }
+	;
+
+/*
+ * the keywords that came after the original grammar are reserved only
+ * where they are used, so that a table may still be named after one.
+ * (a table name is always right behind LOAD, FROM or ON.)
+ */
+keyword:
+	ORDER      { $$ = strdup("order"); }
+	| BY       { $$ = strdup("by"); }
+	| ASC      { $$ = strdup("asc"); }
+	| DESC     { $$ = strdup("desc"); }
+	| LIMIT    { $$ = strdup("limit"); }
+	| COVERING { $$ = strdup("covering"); }
+	| CREATE   { $$ = strdup("create"); }
+	| ON       { $$ = strdup("on"); }
+	| PACKED   { $$ = strdup("packed"); }
+	| DELETE   { $$ = strdup("delete"); }
+	| MAX      { free($1); $$ = strdup("max"); }
+	| MIN      { free($1); $$ = strdup("min"); }
+	| INDEX    { free($1); $$ = strdup("index"); }
+	| IN       { free($1); $$ = strdup("in"); }
 	;
 
 comparator:
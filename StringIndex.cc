@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "BTreeNode.h"
+#include "EntrySorter.h"
+#include "StringIndex.h"
+
+using std::string;
+using std::vector;
+
+// the header page (page 0) of a string index:
+//   [0..7]   magic "BRUINST\0"
+//   [8..11]  the node format version (BTNODE_VERSION)
+//   [12..15] the PageId of the root node. 0 if the index is empty
+//   [16..19] the height of the tree
+static const char INDEX_MAGIC[8] = { 'B', 'R', 'U', 'I', 'N', 'S', 'T', 0 };
+
+StringIndex::StringIndex()
+{
+  rootPid = 0;
+  treeHeight = 0;
+  writable = false;
+}
+
+RC StringIndex::open(const string& indexname, char mode, int pageSize)
+{
+  RC rc;
+
+  if ((rc = pf.open(indexname, mode, pageSize)) < 0) return rc;
+  writable = (mode == 'w' || mode == 'W');
+  rootPid = 0;
+  treeHeight = 0;
+
+  // an empty file is an empty index
+  if (pf.endPid() == 0) return 0;
+
+  vector<char> header(pf.getPageSize());
+  if ((rc = pf.read(0, &header[0])) < 0) {
+    pf.close();
+    return rc;
+  }
+
+  // the file may be an index of another kind
+  int version;
+  memcpy(&version, &header[8], sizeof(int));
+  if (memcmp(&header[0], INDEX_MAGIC, sizeof(INDEX_MAGIC)) || version != BTNODE_VERSION) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+  memcpy(&rootPid, &header[12], sizeof(PageId));
+  memcpy(&treeHeight, &header[16], sizeof(int));
+  if (rootPid < 0 || rootPid >= pf.endPid() || treeHeight < 0 || treeHeight > MAX_HEIGHT
+      || (rootPid == 0) != (treeHeight == 0)) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  return 0;
+}
+
+RC StringIndex::close()
+{
+  RC rc;
+
+  // the root and the height only change in 'w' mode
+  if (writable) {
+    int version = BTNODE_VERSION;
+    vector<char> header(pf.getPageSize());
+    memcpy(&header[0], INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    memcpy(&header[8], &version, sizeof(int));
+    memcpy(&header[12], &rootPid, sizeof(PageId));
+    memcpy(&header[16], &treeHeight, sizeof(int));
+    if ((rc = pf.write(0, &header[0])) < 0) {
+      pf.close();
+      return rc;
+    }
+  }
+
+  return pf.close();
+}
+
+RC StringIndex::insert(const string& key, const RecordId& rid)
+{
+  RC rc;
+  int pageSize = pf.getPageSize();
+  string theKey(key, 0, std::min(key.size(), (size_t)BTStringNode::MAX_KEY_LENGTH));
+
+  if (!writable) return RC_INVALID_FILE_MODE;
+
+  // the first pair makes a leaf that is the root
+  if (rootPid == 0) {
+    BTStringNode leaf(pageSize, true);
+    PageId pid = std::max(pf.endPid(), 1);  // page 0 is the header
+    if ((rc = leaf.insert(0, theKey, rid)) < 0 || (rc = leaf.write(pid, pf)) < 0) return rc;
+    rootPid = pid;
+    treeHeight = 1;
+    return 0;
+  }
+
+  // go down to the rightmost leaf the key may be in, remembering the way
+  PageId path[MAX_HEIGHT];
+  int slots[MAX_HEIGHT];
+  BTStringNode node(pageSize);
+  path[0] = rootPid;
+  for (int level = 0; level < treeHeight - 1; level++) {
+    if ((rc = node.read(path[level], pf)) < 0) return rc;
+    path[level + 1] = node.locateChildPtr(theKey, slots[level], true);
+  }
+
+  BTStringNode leaf(pageSize);
+  PageId leafPid = path[treeHeight - 1];
+  if ((rc = leaf.read(leafPid, pf)) < 0) return rc;
+  int eid = leaf.locate(theKey, true);
+  rc = leaf.insert(eid, theKey, rid);
+  if (rc != RC_NODE_FULL) return (rc < 0) ? rc : leaf.write(leafPid, pf);
+
+  // split the leaf, and put the pair on its side of the separator
+  BTStringNode sibling(pageSize, true);
+  string siblingKey;
+  PageId siblingPid = pf.endPid();
+  if ((rc = leaf.split(sibling, siblingKey)) < 0) return rc;
+  int keep = leaf.getKeyCount();
+  if (eid < keep || (eid == keep && BTStringNode::compare(theKey.data(), theKey.size(),
+                                                          siblingKey.data(), siblingKey.size()) < 0)) {
+    rc = leaf.insert(eid, theKey, rid);
+  }
+  else rc = sibling.insert(eid - keep, theKey, rid);
+  if (rc < 0) return rc;
+
+  // link the sibling in behind the leaf
+  PageId nextPid = leaf.getNextNodePtr();
+  sibling.setNextNodePtr(nextPid);
+  sibling.setPrevNodePtr(leafPid);
+  leaf.setNextNodePtr(siblingPid);
+  if ((rc = sibling.write(siblingPid, pf)) < 0 || (rc = leaf.write(leafPid, pf)) < 0) return rc;
+  if (nextPid) {
+    BTStringNode next(pageSize);
+    if ((rc = next.read(nextPid, pf)) < 0) return rc;
+    next.setPrevNodePtr(siblingPid);
+    if ((rc = next.write(nextPid, pf)) < 0) return rc;
+  }
+
+  // add the separator to the parent, splitting the nonleaf nodes on the
+  // way up that are full
+  for (int level = treeHeight - 2; level >= 0; level--) {
+    if ((rc = node.read(path[level], pf)) < 0) return rc;
+    int slot = slots[level];
+    rc = node.insert(slot, siblingKey, siblingPid);
+    if (rc != RC_NODE_FULL) return (rc < 0) ? rc : node.write(path[level], pf);
+
+    BTStringNode nonleafSibling(pageSize, false);
+    string midKey;
+    if ((rc = node.split(nonleafSibling, midKey)) < 0) return rc;
+    keep = node.getKeyCount();
+    if (slot <= keep) rc = node.insert(slot, siblingKey, siblingPid);
+    else rc = nonleafSibling.insert(slot - keep - 1, siblingKey, siblingPid);
+    if (rc < 0) return rc;
+
+    siblingKey = midKey;
+    siblingPid = pf.endPid();
+    if ((rc = nonleafSibling.write(siblingPid, pf)) < 0 || (rc = node.write(path[level], pf)) < 0) {
+      return rc;
+    }
+  }
+
+  // the root was split
+  if (treeHeight == MAX_HEIGHT) return RC_NODE_FULL;
+  BTStringNode root(pageSize, false);
+  PageId newRootPid = pf.endPid();
+  if ((rc = root.initializeRoot(rootPid, siblingKey, siblingPid)) < 0
+      || (rc = root.write(newRootPid, pf)) < 0) {
+    return rc;
+  }
+  rootPid = newRootPid;
+  treeHeight++;
+
+  return 0;
+}
+
+RC StringIndex::remove(const string& key, const RecordId& rid)
+{
+  RC rc;
+  StringCursor cursor;
+  string theKey(key, 0, std::min(key.size(), (size_t)BTStringNode::MAX_KEY_LENGTH));
+
+  if (!writable) return RC_INVALID_FILE_MODE;
+  if ((rc = locate(theKey, cursor)) < 0) return rc;
+
+  // the pairs of the key may go on over several leaves
+  BTStringNode leaf(pf.getPageSize());
+  string entryKey;
+  while (cursor.pid > 0) {
+    if ((rc = leaf.read(cursor.pid, pf)) < 0) return rc;
+    for (; cursor.eid < leaf.getKeyCount(); cursor.eid++) {
+      leaf.readKey(cursor.eid, entryKey);
+      if (entryKey != theKey) return RC_NO_SUCH_RECORD;
+      if (leaf.readRid(cursor.eid) != rid) continue;
+      if ((rc = leaf.remove(cursor.eid)) < 0) return rc;
+      return leaf.write(cursor.pid, pf);
+    }
+    cursor.pid = leaf.getNextNodePtr();
+    cursor.eid = 0;
+  }
+
+  return RC_NO_SUCH_RECORD;
+}
+
+RC StringIndex::bulkLoad(StringSorter& entries, int fillFactor)
+{
+  RC rc;
+  int pageSize = pf.getPageSize();
+  string key, lastKey;
+  RecordId rid;
+
+  if (!writable) return RC_INVALID_FILE_MODE;
+  if (fillFactor < 1 || fillFactor > 100) return RC_INVALID_ATTRIBUTE;
+
+  if (rootPid != 0) {
+    while ((rc = entries.next(key, rid)) == 0) {
+      if ((rc = insert(key, rid)) < 0) return rc;
+    }
+    return (rc == RC_NO_SUCH_RECORD) ? 0 : rc;
+  }
+  if (entries.size() == 0) return 0;
+
+  // fill the leaves from left to right. a leaf is written when the next
+  // one is started, since it points to it. the separator of a leaf is
+  // made from the last key of the leaf in front of it.
+  vector<PageId> pids;
+  vector<string> keys;  // keys[i] separates pids[i] from pids[i - 1]
+  PageId pid = std::max(pf.endPid(), 1);  // page 0 is the header
+  BTStringNode node(pageSize, true);
+  int limit = node.getCapacity() * fillFactor / 100;
+  pids.push_back(pid);
+  keys.push_back(string());
+  while ((rc = entries.next(key, rid)) == 0) {
+    if (node.getKeyCount() > 0 && node.getUsedBytes() + node.getEntrySize(key.size()) > limit) {
+      node.setNextNodePtr(pid + 1);
+      if ((rc = node.write(pid, pf)) < 0) return rc;
+      node.initialize(true);
+      node.setPrevNodePtr(pid++);
+      pids.push_back(pid);
+      keys.push_back(string());
+      BTStringNode::makeSeparator(lastKey, key, keys.back());
+    }
+    if ((rc = node.insert(node.getKeyCount(), key, rid)) < 0) return rc;
+    lastKey.swap(key);
+  }
+  if (rc != RC_NO_SUCH_RECORD) return rc;
+  if ((rc = node.write(pid, pf)) < 0) return rc;
+
+  // build the nonleaf levels one by one, until a level has a single node.
+  // the separator in front of the first child of a node moves up to the
+  // next level.
+  treeHeight = 1;
+  while (pids.size() > 1) {
+    vector<PageId> upperPids;
+    vector<string> upperKeys;
+    node.initialize(false);
+    node.setLeftmostPtr(pids[0]);
+    upperPids.push_back(++pid);
+    upperKeys.push_back(keys[0]);
+    for (unsigned i = 1; i < pids.size(); i++) {
+      if (node.getKeyCount() > 0 && node.getUsedBytes() + node.getEntrySize(keys[i].size()) > limit) {
+        if ((rc = node.write(pid, pf)) < 0) return rc;
+        node.initialize(false);
+        node.setLeftmostPtr(pids[i]);
+        upperPids.push_back(++pid);
+        upperKeys.push_back(keys[i]);
+        continue;
+      }
+      if ((rc = node.insert(node.getKeyCount(), keys[i], pids[i])) < 0) return rc;
+    }
+    if ((rc = node.write(pid, pf)) < 0) return rc;
+
+    pids.swap(upperPids);
+    keys.swap(upperKeys);
+    treeHeight++;
+  }
+  rootPid = pids[0];
+
+  return 0;
+}
+
+RC StringIndex::locate(const string& searchKey, StringCursor& cursor)
+{
+  RC rc;
+  BTStringNode node(pf.getPageSize());
+  int slot;
+
+  cursor.pid = rootPid;
+  cursor.eid = 0;
+  if (rootPid == 0) return RC_NO_SUCH_RECORD;
+
+  for (int level = 0; level < treeHeight - 1; level++) {
+    if ((rc = node.read(cursor.pid, pf)) < 0) return rc;
+    cursor.pid = node.locateChildPtr(searchKey, slot);
+  }
+  if ((rc = node.read(cursor.pid, pf)) < 0) return rc;
+  cursor.eid = node.locate(searchKey);
+
+  // the separator in front of the next leaf may be a prefix of its
+  // first key, which is then the entry. (leaves emptied by remove() are
+  // passed over.)
+  while (cursor.eid == node.getKeyCount()) {
+    if (node.getNextNodePtr() == 0) return RC_NO_SUCH_RECORD;
+    cursor.pid = node.getNextNodePtr();
+    cursor.eid = 0;
+    if ((rc = node.read(cursor.pid, pf)) < 0) return rc;
+  }
+  string key;
+  node.readKey(cursor.eid, key);
+  return (key == searchKey) ? 0 : RC_NO_SUCH_RECORD;
+}
+
+RC StringIndex::readBatch(StringCursor& cursor, string* keys, RecordId* rids,
+                          int maxCount, int& count)
+{
+  RC rc;
+  BTStringNode leaf(pf.getPageSize());
+
+  count = 0;
+  while (cursor.pid > 0) {
+    if ((rc = leaf.read(cursor.pid, pf)) < 0) return rc;
+    if (cursor.eid < leaf.getKeyCount()) {
+      count = leaf.readEntries(cursor.eid, keys, rids, maxCount);
+      // the scan is going on to the next leaf
+      PageId nextPid = leaf.getNextNodePtr();
+      if (cursor.eid == leaf.getKeyCount() && nextPid) pf.prefetch(&nextPid, 1);
+      return 0;
+    }
+    cursor.pid = leaf.getNextNodePtr();
+    cursor.eid = 0;
+  }
+
+  return RC_END_OF_TREE;
+}
+
+RC StringIndex::advise(PageFile::AccessPattern pattern) const
+{
+  return pf.advise(pattern);
+}
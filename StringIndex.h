@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef STRINGINDEX_H
+#define STRINGINDEX_H
+
+#include <string>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+
+class StringSorter;
+
+/**
+ * The position of an entry in a leaf of a StringIndex.
+ */
+typedef struct {
+  PageId pid;  // the leaf. 0 past the last leaf
+  int    eid;  // the entry number inside the leaf
+} StringCursor;
+
+/**
+ * A B+tree index on the value column of a table, i.e., with string keys.
+ *
+ * The nodes are BTStringNodes, which keep keys of any length. A nonleaf
+ * node keeps only the shortest prefix of the first key of a child that
+ * separates it from the child in front of it (a prefix B+tree), so that
+ * more children fit in a node. A key may be in the index more than once,
+ * with an entry for every RecordId, and the entries of a key may be in
+ * more than one leaf. Keys longer than BTStringNode::MAX_KEY_LENGTH are
+ * cut to it, as the value of a tuple is in the table.
+ *
+ * An entry that is removed leaves its leaf smaller, and a leaf may even
+ * be left empty; leaves are neither merged nor given back.
+ */
+class StringIndex {
+ public:
+  static const int DEFAULT_FILL_FACTOR = 90;  /// % of a node filled by bulkLoad()
+
+  StringIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * Under 'm' mode, the index file is read through a memory mapping.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for memory-mapped read
+   * @param pageSize[IN] the node size of a new index. 0 for the default
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode, int pageSize = 0);
+
+  /**
+   * Close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Insert (key, RecordId) pair to the index, behind the pairs with the
+   * same key.
+   * @param key[IN] the key
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @return error code. 0 if no error
+   */
+  RC insert(const std::string& key, const RecordId& rid);
+
+  /**
+   * Remove (key, RecordId) pair from the index.
+   * @param key[IN] the key
+   * @param rid[IN] the RecordId of the pair
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the index
+   *         does not have the pair
+   */
+  RC remove(const std::string& key, const RecordId& rid);
+
+  /**
+   * Build the index bottom-up from (key, RecordId) pairs sorted by key.
+   * The nodes are filled to fillFactor percent of their capacity (in
+   * bytes) and written from the leaves up in a single sequential pass.
+   * If the index is not empty, the pairs are inserted one by one instead.
+   * @param entries[IN] the pairs to load, with their keys cut to
+   *                    BTStringNode::MAX_KEY_LENGTH. sort() must have
+   *                    been called
+   * @param fillFactor[IN] how full the nodes are made, in percent (1-100)
+   * @return error code. 0 if no error
+   */
+  RC bulkLoad(StringSorter& entries, int fillFactor = DEFAULT_FILL_FACTOR);
+
+  /**
+   * Find the first index entry with a key >= searchKey.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the index entry, or behind
+   *                    the last entry of the index if there is none
+   * @return 0 if the key of the entry is searchKey. Othewise, an error code
+   */
+  RC locate(const std::string& searchKey, StringCursor& cursor);
+
+  /**
+   * Read the (key, rid) pairs from the index cursor on, and move the
+   * cursor behind them. The pairs of a call all come from one leaf, and
+   * the next leaf is read in the background when the cursor reaches the
+   * end of a leaf.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry
+   * @param keys[OUT] the keys read
+   * @param rids[OUT] the RecordIds read
+   * @param maxCount[IN] the max # of pairs to read. at least 1
+   * @param count[OUT] # of pairs read
+   * @return error code. 0 if no error. RC_END_OF_TREE if no pair is left
+   */
+  RC readBatch(StringCursor& cursor, std::string* keys, RecordId* rids,
+               int maxCount, int& count);
+
+  /**
+   * Tell how the index is going to be accessed. See PageFile::advise().
+   * @param pattern[IN] the expected access pattern
+   * @return error code. 0 if no error
+   */
+  RC advise(PageFile::AccessPattern pattern) const;
+
+ private:
+  static const int MAX_HEIGHT = 32;  /// the max height of a tree
+
+  PageFile pf;         /// the PageFile used to store the b+tree
+  PageId   rootPid;    /// the PageId of the root node. 0 if the index is empty
+  int      treeHeight; /// the height of the tree. 0 if the index is empty
+  bool     writable;   /// true if the index was opened in 'w' mode
+};
+
+#endif // STRINGINDEX_H
@@ -557,7 +557,9 @@ int sql_flex_debug = 0;
 char *sqltext;
 #line 1 "SqlParser.l"
 #line 2 "SqlParser.l"
+#include <cstdlib>
 #include <cstring>
+#include <string>
 #include "SqlEngine.h"
 #include "SqlParser.tab.h"
 
@@ -570,7 +572,9 @@ char* strlower(char* s)
         }
 	return s;
 }
-#line 574 "lex.sql.c"
+
+static int identifier();
+#line 578 "lex.sql.c"
 
 #define INITIAL 0
 
@@ -757,10 +761,10 @@ YY_DECL
 	register char *yy_cp, *yy_bp;
 	register int yy_act;
     
-#line 17 "SqlParser.l"
+#line 21 "SqlParser.l"
 
 
-#line 764 "lex.sql.c"
+#line 768 "lex.sql.c"
 
 	if ( !(yy_init) )
 		{
@@ -845,137 +849,137 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 19 "SqlParser.l"
+#line 23 "SqlParser.l"
 return SELECT;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 20 "SqlParser.l"
+#line 24 "SqlParser.l"
 return FROM;
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 21 "SqlParser.l"
+#line 25 "SqlParser.l"
 return WHERE;
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 22 "SqlParser.l"
+#line 26 "SqlParser.l"
 return LOAD;
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 23 "SqlParser.l"
+#line 27 "SqlParser.l"
 return WITH;
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 24 "SqlParser.l"
-return INDEX;
+#line 28 "SqlParser.l"
+return identifier();
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 25 "SqlParser.l"
+#line 29 "SqlParser.l"
 return QUIT;
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 26 "SqlParser.l"
+#line 30 "SqlParser.l"
 return QUIT;
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 27 "SqlParser.l"
+#line 31 "SqlParser.l"
 return COUNT;
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 29 "SqlParser.l"
+#line 33 "SqlParser.l"
 return AND;
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 30 "SqlParser.l"
+#line 34 "SqlParser.l"
 return OR;
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 31 "SqlParser.l"
+#line 35 "SqlParser.l"
 return EQUAL;
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 32 "SqlParser.l"
+#line 36 "SqlParser.l"
 return NEQUAL;
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 33 "SqlParser.l"
+#line 37 "SqlParser.l"
 return GREATER;
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 34 "SqlParser.l"
+#line 38 "SqlParser.l"
 return LESS;
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 35 "SqlParser.l"
+#line 39 "SqlParser.l"
 return GREATEREQUAL;
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 36 "SqlParser.l"
+#line 40 "SqlParser.l"
 return LESSEQUAL;
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 38 "SqlParser.l"
+#line 42 "SqlParser.l"
 sqllval.string = strdup(sqltext); return INTEGER;
 	YY_BREAK
 case 19:
 /* rule 19 can match eol */
 YY_RULE_SETUP
-#line 39 "SqlParser.l"
+#line 43 "SqlParser.l"
 sqllval.string = strdup(sqltext+1); sqllval.string[sqlleng-2] = 0; return STRING;
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 40 "SqlParser.l"
-sqllval.string = strlower(strdup(sqltext)); return ID;
+#line 44 "SqlParser.l"
+return identifier();
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 41 "SqlParser.l"
+#line 45 "SqlParser.l"
 return COMMA;
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 42 "SqlParser.l"
+#line 46 "SqlParser.l"
 return STAR;
 	YY_BREAK
 case 23:
 /* rule 23 can match eol */
 YY_RULE_SETUP
-#line 43 "SqlParser.l"
+#line 47 "SqlParser.l"
 return LF;
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 44 "SqlParser.l"
+#line 48 "SqlParser.l"
 /* ignore semicolon */
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 45 "SqlParser.l"
+#line 49 "SqlParser.l"
 /* ignore white space */
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 47 "SqlParser.l"
+#line 51 "SqlParser.l"
 ECHO;
 	YY_BREAK
-#line 979 "lex.sql.c"
+#line 983 "lex.sql.c"
 case YY_STATE_EOF(INITIAL):
 	yyterminate();
 
@@ -1973,7 +1977,46 @@ void sqlfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 47 "SqlParser.l"
-
+#line 51 "SqlParser.l"
 
+/*
+ * the token of an identifier. the keywords that are not rules of their
+ * own are told apart here. MAX(key), MIN(key), INDEX(value) and
+ * IN (1, 2, ...) are read here as a whole, since parentheses are not
+ * tokens; the attributes (or keys) in the parentheses are passed on as
+ * the string of the token.
+ */
+static int identifier()
+{
+	static const struct { const char* name; int token; } keywords[] = {
+		{ "order", ORDER }, { "by", BY }, { "asc", ASC }, { "desc", DESC },
+		{ "limit", LIMIT }, { "max", MAX }, { "min", MIN },
+		{ "covering", COVERING }, { "index", INDEX }, { "create", CREATE },
+		{ "on", ON }, { "packed", PACKED }, { "delete", DELETE }, { "in", IN }
+	};
 
+	sqllval.string = strlower(strdup(sqltext));
+	for (unsigned i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+		if (strcmp(sqllval.string, keywords[i].name)) continue;
+		int token = keywords[i].token;
+		free(sqllval.string);
+		sqllval.string = NULL;
+		if (token != MAX && token != MIN && token != INDEX && token != IN) return token;
+
+		// (attribute, ...)
+		std::string attr;
+		int c;
+		while ((c = yyinput()) == ' ' || c == '\t');
+		if (c != '(') {
+			if (c != EOF && c != 0) unput(c);
+			return token;
+		}
+		while ((c = yyinput()) != ')' && c != EOF && c != 0 && c != '\n') {
+			if (c != ' ' && c != '\t') attr += tolower(c);
+		}
+		if (c == '\n') unput(c);
+		sqllval.string = strdup(attr.c_str());
+		return token;
+	}
+	return ID;
+}
@@ -6,23 +6,140 @@
  * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
  * @date 3/24/2008
  */
- 
+
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include <cstdio>
 #include <iostream>
 #include "BTreeNode.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "BTreeIndex.h"
+#include "BufferPool.h"
+#include "IOEngine.h"
+#include "PageFile.h"
+#include "IOStats.h"
 
 using namespace std;
 
-int main()
+static void usage(const char* prog)
+{
+  fprintf(stderr, "usage: %s [-b frames] [-s shards] [-e policy] [-m] [-i engine] [-P size] [-S] [-u index] [-F percent]\n", prog);
+  fprintf(stderr, "  -b frames   # of 1KB page frames in the buffer pool (default %d)\n", BufferPool::DEFAULT_FRAME_COUNT);
+  fprintf(stderr, "  -s shards   # of buffer pool shards (default %d)\n", BufferPool::DEFAULT_SHARD_COUNT);
+  fprintf(stderr, "  -e policy   buffer pool replacement policy: clock, lru or 2q (default %s)\n", BufferPool::getPolicyName(BufferPool::DEFAULT_POLICY));
+  fprintf(stderr, "              the hit rate of the pool is printed on exit\n");
+  fprintf(stderr, "  -m          SELECT reads tables and indexes through memory mappings\n");
+  fprintf(stderr, "  -i engine   asynchronous I/O engine: uring or threads\n");
+  fprintf(stderr, "              (default: uring if the kernel supports it)\n");
+  fprintf(stderr, "  -P size     page size of new tables and indexes, a power of two\n");
+  fprintf(stderr, "              from %d to %d (default %d)\n", PageFile::MIN_PAGE_SIZE, PageFile::MAX_PAGE_SIZE, PageFile::DEFAULT_PAGE_SIZE);
+  fprintf(stderr, "  -S          print the I/O statistics of every file a statement\n");
+  fprintf(stderr, "              accessed after the statement\n");
+  fprintf(stderr, "  -u index    rewrite an index file built with an older node format\n");
+  fprintf(stderr, "              in the current format and exit. may be repeated\n");
+  fprintf(stderr, "  -F percent  how full LOAD ... WITH INDEX fills the index nodes\n");
+  fprintf(stderr, "              (default %d)\n", BTreeIndex::DEFAULT_FILL_FACTOR);
+}
+
+int main(int argc, char* argv[])
 {
+  int frameCount = BufferPool::DEFAULT_FRAME_COUNT;
+  int shardCount = BufferPool::DEFAULT_SHARD_COUNT;
+  BufferPool::Policy policy = BufferPool::DEFAULT_POLICY;
+  vector<string> convertIndexes;
+  int opt;
+
+  // parse the startup options
+  while ((opt = getopt(argc, argv, "b:s:e:mi:P:Su:F:")) != -1) {
+    switch (opt) {
+    case 'b':
+      frameCount = atoi(optarg);
+      break;
+    case 's':
+      shardCount = atoi(optarg);
+      break;
+    case 'e':
+      if (strcmp(optarg, "clock") == 0) {
+        policy = BufferPool::CLOCK;
+      } else if (strcmp(optarg, "lru") == 0) {
+        policy = BufferPool::LRU;
+      } else if (strcmp(optarg, "2q") == 0) {
+        policy = BufferPool::TWO_QUEUE;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'm':
+      SqlEngine::setReadMode('m');
+      break;
+    case 'i':
+      if (strcmp(optarg, "uring") == 0) {
+        IOEngine::configure(IOEngine::URING);
+      } else if (strcmp(optarg, "threads") == 0) {
+        IOEngine::configure(IOEngine::THREADS);
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'P':
+      if (PageFile::setDefaultPageSize(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'S':
+      IOStats::setReportEnabled(true);
+      break;
+    case 'u':
+      convertIndexes.push_back(optarg);
+      break;
+    case 'F':
+      if (SqlEngine::setFillFactor(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (BufferPool::configure(frameCount, shardCount, policy) < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // convert the old indexes instead of running the SQL engine
+  if (!convertIndexes.empty()) {
+    int failed = 0;
+    for (unsigned i = 0; i < convertIndexes.size(); i++) {
+      RC rc = BTreeIndex::convert(convertIndexes[i]);
+      if (rc < 0) {
+        fprintf(stderr, "Error: cannot convert index %s (error %d)\n", convertIndexes[i].c_str(), rc);
+        failed++;
+      }
+    }
+    return failed ? 1 : 0;
+  }
 
   // run the SQL engine taking user commands from standard input (console).
   SqlEngine::run(stdin);
 
+  // report how well the buffer pools did
+  vector<BufferPool*> pools = BufferPool::getInstances();
+  for (unsigned i = 0; i < pools.size(); i++) {
+    long long hits = pools[i]->getHitCount();
+    long long total = hits + pools[i]->getMissCount();
+    fprintf(stderr, "  -- buffer pool of %d-byte pages (%s): %lld hits, %lld misses, %.1f%% hit rate\n",
+            pools[i]->getPageSize(), BufferPool::getPolicyName(pools[i]->getPolicy()),
+            hits, total - hits, total ? 100.0 * hits / total : 0.0);
+  }
+
   return 0;
 }
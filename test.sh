@@ -5,6 +5,15 @@ rm -f small.tbl small.idx
 rm -f medium.tbl medium.idx
 rm -f large.tbl large.idx
 rm -f xlarge.tbl xlarge.idx
+rm -f signed.tbl signed.idx
+rm -f cover.tbl cover.idx cover.vidx
+rm -f vmovie.tbl vmovie.idx vmovie.vidx
+rm -f pmovie.tbl pmovie.idx
+rm -f order.tbl order.idx max.tbl
+rm -f dlarge.tbl dlarge.idx delete.tbl
+rm -f btreetest.idx
 
 ./bruinbase < test.sql > result.txt
 
+echo >> result.txt
+./btreetest >> result.txt
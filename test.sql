@@ -20,3 +20,75 @@ SELECT COUNT(*) FROM xlarge
 SELECT * FROM xlarge WHERE key = 4240
 SELECT * FROM xlarge WHERE key > 400 AND key < 500 AND key > 100 AND key < 4000000
 
+LOAD signed FROM 'signed.del' WITH INDEX
+SELECT COUNT(*) FROM signed
+SELECT * FROM signed WHERE key = 0
+SELECT * FROM signed WHERE key = -1
+SELECT COUNT(*) FROM signed WHERE key < 0
+SELECT * FROM signed WHERE key >= -3 AND key <= 2
+SELECT * FROM signed WHERE key < -145
+SELECT * FROM signed WHERE key > 2147483646
+SELECT COUNT(*) FROM signed WHERE key > 2147483647
+SELECT * FROM signed WHERE key < -2147483647
+SELECT COUNT(*) FROM signed WHERE key <> 0 AND key > -10 AND key < 10
+SELECT key FROM signed WHERE key < 0 ORDER BY key DESC LIMIT 3
+SELECT * FROM large WHERE key > 4500 ORDER BY key DESC LIMIT 2
+SELECT MAX(key) FROM signed
+SELECT MIN(key) FROM signed
+SELECT MAX(key) FROM signed WHERE key < -145
+LOAD cover FROM 'movie.del' WITH COVERING INDEX
+SELECT COUNT(*) FROM cover
+SELECT * FROM cover WHERE key >= 2000 AND key < 2010
+SELECT value FROM cover WHERE key = 2634
+SELECT * FROM cover WHERE key > 4000 AND value > 'S' ORDER BY key DESC LIMIT 3
+LOAD vmovie FROM 'movie.del' WITH INDEX(value)
+SELECT * FROM vmovie WHERE value = 'Blue Hawaii'
+SELECT COUNT(*) FROM vmovie WHERE value >= 'The' AND value < 'Thf'
+SELECT key FROM vmovie WHERE value > 'Matter' AND value < 'Mb' ORDER BY key
+SELECT * FROM vmovie WHERE value = 'Payback' ORDER BY key
+SELECT value FROM vmovie WHERE value > 'Matter' AND value < 'Mb' AND key < 2700
+SELECT COUNT(*) FROM vmovie WHERE value >= 'The' AND value < 'Thf' AND key > 4000 AND key <> 4500
+CREATE INDEX(value) ON cover
+SELECT * FROM cover WHERE value >= 'Star' AND value < 'Stas' ORDER BY key DESC
+LOAD pmovie FROM 'movie.del' WITH PACKED INDEX
+SELECT COUNT(*) FROM pmovie WHERE key > 0
+SELECT * FROM pmovie WHERE key >= 2000 AND key < 2010
+SELECT * FROM pmovie WHERE key = 2634
+LOAD pmovie FROM 'movie.del' WITH PACKED INDEX
+SELECT COUNT(*) FROM pmovie WHERE key > 3000 AND key < 3100
+SELECT * FROM pmovie WHERE key > 4600 ORDER BY key DESC LIMIT 4
+LOAD order FROM 'xsmall.del' WITH INDEX
+SELECT key FROM order WHERE key > 1000 ORDER BY key DESC LIMIT 2
+SELECT MAX(key) FROM order
+LOAD max FROM 'xsmall.del'
+SELECT COUNT(*) FROM max
+LOAD dlarge FROM 'xlarge.del' WITH INDEX
+DELETE FROM dlarge WHERE key > 1000 AND key < 30000
+SELECT COUNT(*) FROM dlarge
+SELECT COUNT(*) FROM dlarge WHERE key > 0
+SELECT key FROM dlarge WHERE key > 900 ORDER BY key LIMIT 3
+SELECT key FROM dlarge WHERE key < 40000 ORDER BY key DESC LIMIT 3
+DELETE FROM dlarge WHERE key <> 2
+SELECT * FROM dlarge WHERE key > 0
+SELECT COUNT(*) FROM dlarge
+LOAD dlarge FROM 'xlarge.del' WITH INDEX
+SELECT COUNT(*) FROM dlarge WHERE key > 0
+SELECT * FROM dlarge WHERE key = 2
+SELECT key FROM dlarge WHERE key > 1000 ORDER BY key LIMIT 3
+DELETE FROM pmovie WHERE key > 3000 AND key < 3100
+SELECT COUNT(*) FROM pmovie WHERE key > 2990 AND key < 3110
+SELECT * FROM pmovie WHERE key > 3095 AND key < 3105
+DELETE FROM cover WHERE value >= 'Star' AND value < 'Stas'
+SELECT * FROM cover WHERE value >= 'Sta' AND value < 'Stb'
+SELECT COUNT(*) FROM cover
+LOAD delete FROM 'xsmall.del'
+DELETE FROM delete WHERE key > 1000
+SELECT * FROM delete
+SELECT * FROM pmovie WHERE key IN (4500, 3, 2634, 489, 3050, 999999)
+SELECT key FROM pmovie WHERE key IN (4500, 3, 2634, 489) ORDER BY key DESC
+SELECT COUNT(*) FROM pmovie WHERE key IN (4500, 3, 2634, 489, 3050)
+SELECT * FROM pmovie WHERE key IN (4500, 2634, 489) AND key > 500 AND key <> 4500
+SELECT * FROM pmovie WHERE key IN (489, 2634) AND key IN (2634, 4500)
+SELECT * FROM dlarge WHERE key IN (2, 9212341, 1002, 8) LIMIT 3
+SELECT * FROM max WHERE key IN (2634, 272, 3)
+SELECT * FROM pmovie WHERE value IN ('Payback')